@@ -0,0 +1,443 @@
+/** \file cortex_bench.c
+ * \brief cortex benchmark harness
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/*
+ * Generates synthetic cores with cortex_gencore, then runs cortex on
+ * each of them for every output format, reading the core from a file
+ * and from a pipe as the kernel does. Each run is timed from fork to
+ * exit; the read/write syscall counts come from /proc/<pid>/io, read
+ * while the child is a zombie, and the peak RSS from wait4().
+ *
+ * Results are written as one json object per line.
+ */
+
+#define BENCH_RUNS	5
+#define BENCH_RUNS_MAX	64
+
+struct bench_scenario {
+	const char *name;
+	const char *threads;
+	const char *loads;
+	const char *seg_size;
+	const char *stack_size;
+	const char *notes;
+};
+
+static const struct bench_scenario bench_scenarios[] = {
+	{"small", "1", "4", "64k", "128k", "kernel"},
+	{"threads", "64", "16", "64k", "4M", "kernel"},
+	{"segments", "4", "512", "16k", "256k", "grouped"},
+	{"large", "4", "16", "4M", "1M", "kernel"},
+};
+
+static const char *bench_formats[] = {
+	"def", "all", "jsn,all", "bin,all", "min,all", "mdmp",
+};
+
+enum bench_input {
+	BENCH_INPUT_FILE = 0,
+	BENCH_INPUT_PIPE,
+};
+
+struct bench_run {
+	double wall_ms;
+	double cpu_ms;
+	long syscr;
+	long syscw;
+	long maxrss_kb;
+	int status;
+};
+
+struct bench {
+	char *cortex;
+	char *gencore;
+	char *dir;
+	char *word;
+	int runs;
+	FILE *output;
+};
+
+static void bench_usage(char *argv0)
+{
+	printf("cortex benchmark\n\nusage: %s [OPTIONS]\nOPTIONS:\n"
+	       "\t-c, --cortex\n\t\tcortex binary (default ./cortex)\n"
+	       "\t-g, --gencore\n\t\tcore generator (default "
+	       "bench/cortex_gencore)\n"
+	       "\t-o, --output\n\t\tresult file, one json object per line. "
+	       "If this option is not present, stdout will be used.\n"
+	       "\t-r, --runs\n\t\truns per measure (default %d)\n"
+	       "\t-d, --dir\n\t\tdirectory for the generated cores "
+	       "(default /tmp)\n"
+	       "\t-w, --word-size\n\t\tword size of the generated cores\n"
+	       "\t-h, --help\n\t\tShow this help and exit.\n", argv0,
+	       BENCH_RUNS);
+}
+
+static double bench_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int bench_gencore(struct bench *bench,
+			 const struct bench_scenario *scn, const char *path)
+{
+	char *argv[20];
+	int argc = 0;
+	int status;
+	pid_t pid;
+
+	argv[argc++] = bench->gencore;
+	argv[argc++] = "-t";
+	argv[argc++] = (char *)scn->threads;
+	argv[argc++] = "-l";
+	argv[argc++] = (char *)scn->loads;
+	argv[argc++] = "-s";
+	argv[argc++] = (char *)scn->seg_size;
+	argv[argc++] = "-S";
+	argv[argc++] = (char *)scn->stack_size;
+	argv[argc++] = "-n";
+	argv[argc++] = (char *)scn->notes;
+	argv[argc++] = "-o";
+	argv[argc++] = (char *)path;
+	if (bench->word) {
+		argv[argc++] = "-w";
+		argv[argc++] = bench->word;
+	}
+	argv[argc] = NULL;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+
+	if (pid == 0) {
+		execv(argv[0], argv);
+		perror(argv[0]);
+		_exit(127);
+	}
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "%s: cannot generate core\n", scn->name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* read and write syscall counts of a child that exited but is not
+ * reaped yet */
+static void bench_read_io(pid_t pid, struct bench_run *run)
+{
+	char path[32];
+	char line[64];
+	FILE *io;
+
+	run->syscr = -1;
+	run->syscw = -1;
+
+	snprintf(path, sizeof(path), "/proc/%d/io", pid);
+	io = fopen(path, "r");
+	if (io == NULL)
+		return;
+
+	while (fgets(line, sizeof(line), io)) {
+		sscanf(line, "syscr: %ld", &run->syscr);
+		sscanf(line, "syscw: %ld", &run->syscw);
+	}
+
+	fclose(io);
+}
+
+static int bench_run_cortex(struct bench *bench, const char *core,
+			    const unsigned char *data, size_t size,
+			    const char *fmt, int input, struct bench_run *run)
+{
+	int pipefd[2] = { -1, -1 };
+	struct rusage ru;
+	siginfo_t info;
+	double start;
+	size_t done;
+	ssize_t ret;
+	int status;
+	pid_t pid;
+
+	if (input == BENCH_INPUT_PIPE && pipe(pipefd) < 0) {
+		perror("pipe");
+		return -1;
+	}
+
+	start = bench_now_ms();
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+
+	if (pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+
+		dup2(null, STDOUT_FILENO);
+		if (input == BENCH_INPUT_PIPE) {
+			dup2(pipefd[0], STDIN_FILENO);
+			close(pipefd[0]);
+			close(pipefd[1]);
+			execl(bench->cortex, bench->cortex, "-f", fmt, NULL);
+		} else {
+			execl(bench->cortex, bench->cortex, "-f", fmt,
+			      "-i", core, NULL);
+		}
+		perror(bench->cortex);
+		_exit(127);
+	}
+
+	/* feed the core like the kernel: cortex may stop reading early */
+	if (input == BENCH_INPUT_PIPE) {
+		close(pipefd[0]);
+		for (done = 0; done < size; done += ret) {
+			ret = write(pipefd[1], data + done, size - done);
+			if (ret < 0 && errno == EINTR)
+				ret = 0;
+			else if (ret <= 0)
+				break;
+		}
+		close(pipefd[1]);
+	}
+
+	if (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) < 0) {
+		perror("waitid");
+		return -1;
+	}
+	run->wall_ms = bench_now_ms() - start;
+
+	bench_read_io(pid, run);
+
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		perror("wait4");
+		return -1;
+	}
+
+	run->status = WIFEXITED(status) ? WEXITSTATUS(status) :
+	    128 + WTERMSIG(status);
+	run->maxrss_kb = ru.ru_maxrss;
+	run->cpu_ms = ru.ru_utime.tv_sec * 1000.0 +
+	    ru.ru_utime.tv_usec / 1000.0 + ru.ru_stime.tv_sec * 1000.0 +
+	    ru.ru_stime.tv_usec / 1000.0;
+
+	return 0;
+}
+
+static int bench_cmp_wall(const void *a, const void *b)
+{
+	const struct bench_run *ra = a;
+	const struct bench_run *rb = b;
+
+	return (ra->wall_ms > rb->wall_ms) - (ra->wall_ms < rb->wall_ms);
+}
+
+static void bench_report(struct bench *bench,
+			 const struct bench_scenario *scn, size_t size,
+			 const char *fmt, int input, struct bench_run *runs)
+{
+	struct bench_run *median;
+	long maxrss = 0;
+	int status = 0;
+	int i;
+
+	for (i = 0; i < bench->runs; i++) {
+		if (runs[i].maxrss_kb > maxrss)
+			maxrss = runs[i].maxrss_kb;
+		if (runs[i].status)
+			status = runs[i].status;
+	}
+
+	qsort(runs, bench->runs, sizeof(struct bench_run), bench_cmp_wall);
+	median = &runs[bench->runs / 2];
+
+	fprintf(bench->output,
+		"{\"scenario\":\"%s\",\"threads\":%s,\"loads\":%s,"
+		"\"segment_size\":\"%s\",\"notes\":\"%s\",\"core_bytes\":%zu,"
+		"\"format\":\"%s\",\"input\":\"%s\",\"runs\":%d,"
+		"\"wall_ms_min\":%.3f,\"wall_ms_median\":%.3f,"
+		"\"cpu_ms_median\":%.3f,\"mb_s\":%.1f,\"syscr\":%ld,"
+		"\"syscw\":%ld,\"maxrss_kb\":%ld,\"exit\":%d}\n",
+		scn->name, scn->threads, scn->loads, scn->seg_size,
+		scn->notes, size, fmt,
+		input == BENCH_INPUT_PIPE ? "pipe" : "file", bench->runs,
+		runs[0].wall_ms, median->wall_ms, median->cpu_ms,
+		median->wall_ms > 0 ?
+		size / (1024.0 * 1024.0) / (median->wall_ms / 1000.0) : 0,
+		median->syscr, median->syscw, maxrss, status);
+	fflush(bench->output);
+}
+
+static int bench_scenario(struct bench *bench,
+			  const struct bench_scenario *scn)
+{
+	struct bench_run runs[BENCH_RUNS_MAX];
+	unsigned char *data = NULL;
+	char path[256];
+	struct stat st;
+	size_t f;
+	int input, i;
+	int ret = -1;
+	int fd = -1;
+
+	snprintf(path, sizeof(path), "%s/cortex-bench-%s.%d.core", bench->dir,
+		 scn->name, getpid());
+
+	if (bench_gencore(bench, scn, path) < 0)
+		goto out;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		goto out;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		perror("mmap");
+		data = NULL;
+		goto out;
+	}
+
+	for (f = 0; f < sizeof(bench_formats) / sizeof(bench_formats[0]); f++) {
+		for (input = BENCH_INPUT_FILE; input <= BENCH_INPUT_PIPE;
+		     input++) {
+			for (i = 0; i < bench->runs; i++) {
+				if (bench_run_cortex(bench, path, data,
+						     st.st_size,
+						     bench_formats[f], input,
+						     &runs[i]) < 0)
+					goto out;
+			}
+			bench_report(bench, scn, st.st_size, bench_formats[f],
+				     input, runs);
+		}
+	}
+
+	ret = 0;
+
+out:
+	if (data)
+		munmap(data, st.st_size);
+	if (fd >= 0)
+		close(fd);
+	unlink(path);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench bench = {
+		.cortex = "./cortex",
+		.gencore = "bench/cortex_gencore",
+		.dir = "/tmp",
+		.runs = BENCH_RUNS,
+	};
+	char *output_file = NULL;
+	int arg_count = 1;
+	int ret = 0;
+	size_t i;
+
+	while (arg_count < argc) {
+		if ((strcmp(argv[arg_count], "-h") == 0)
+		    || (strcmp(argv[arg_count], "--help") == 0)) {
+			bench_usage(argv[0]);
+			exit(0);
+		} else if (arg_count + 1 >= argc) {
+			bench_usage(argv[0]);
+			exit(1);
+		} else if ((strcmp(argv[arg_count], "-c") == 0)
+			   || (strcmp(argv[arg_count], "--cortex") == 0)) {
+			bench.cortex = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-g") == 0)
+			   || (strcmp(argv[arg_count], "--gencore") == 0)) {
+			bench.gencore = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-o") == 0)
+			   || (strcmp(argv[arg_count], "--output") == 0)) {
+			output_file = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-r") == 0)
+			   || (strcmp(argv[arg_count], "--runs") == 0)) {
+			bench.runs = atoi(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-d") == 0)
+			   || (strcmp(argv[arg_count], "--dir") == 0)) {
+			bench.dir = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-w") == 0)
+			   || (strcmp(argv[arg_count], "--word-size") == 0)) {
+			bench.word = argv[++arg_count];
+		} else {
+			bench_usage(argv[0]);
+			exit(1);
+		}
+		arg_count++;
+	}
+
+	if (bench.runs < 1 || bench.runs > BENCH_RUNS_MAX) {
+		fprintf(stderr, "runs must be between 1 and %d\n",
+			BENCH_RUNS_MAX);
+		exit(1);
+	}
+
+	if (output_file) {
+		bench.output = fopen(output_file, "w");
+		if (bench.output == NULL) {
+			perror(output_file);
+			exit(1);
+		}
+	} else {
+		bench.output = stdout;
+	}
+
+	/* cortex stops reading once it has what it needs */
+	signal(SIGPIPE, SIG_IGN);
+
+	for (i = 0; i < sizeof(bench_scenarios) / sizeof(bench_scenarios[0]);
+	     i++) {
+		fprintf(stderr, "  BENCH    %s\n", bench_scenarios[i].name);
+		if (bench_scenario(&bench, &bench_scenarios[i]) < 0)
+			ret = 1;
+	}
+
+	if (bench.output != stdout)
+		fclose(bench.output);
+
+	return ret;
+}
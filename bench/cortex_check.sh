@@ -0,0 +1,78 @@
+#!/bin/sh
+
+# Regression checks of cortex on synthetic cores
+# usage: cortex_check.sh [cortex] [cortex_gencore] [dir]
+
+CORTEX=${1:-./cortex}
+GENCORE=${2:-bench/cortex_gencore}
+DIR=$(mktemp -d ${3:-/tmp}/cortex_check.XXXXXX) || exit 1
+FAILED=0
+
+trap 'rm -rf $DIR' EXIT
+
+fail()
+{
+	echo "FAIL: $*"
+	FAILED=1
+}
+
+# offset, vaddr and size of the last PT_LOAD of an ELF file: the stack
+# segment of a bin output
+stack_segment()
+{
+	readelf -lW $1 | awk '$1 == "LOAD" { o = $2; v = $3; s = $5 }
+		END { print o, v, s }'
+}
+
+# bin under a small memory budget: the stack is a window of the segment,
+# what is written must be the bytes written with the whole segment
+check_bin_window()
+{
+	$GENCORE -S 4M -s 1M -o $DIR/core || { fail "cannot generate core"; return; }
+	$CORTEX -F none -i $DIR/core -f bin,all -o $DIR/full.bin ||
+		{ fail "bin"; return; }
+	$CORTEX -F none -m 256k -i $DIR/core -f bin,all -o $DIR/window.bin ||
+		{ fail "bin under -m 256k"; return; }
+
+	set -- $(stack_segment $DIR/full.bin) $(stack_segment $DIR/window.bin)
+	full_off=$(($1)) full_vaddr=$(($2)) full_size=$(($3))
+	win_off=$(($4)) win_vaddr=$(($5)) win_size=$(($6))
+
+	if [ $win_size -eq 0 -o $win_size -ge $full_size -o \
+	     $win_vaddr -lt $full_vaddr ]; then
+		fail "bin under -m 256k: stack segment $win_vaddr+$win_size"
+		return
+	fi
+
+	dd if=$DIR/full.bin of=$DIR/full.stack bs=1 \
+	   skip=$((full_off + win_vaddr - full_vaddr)) count=$win_size 2>/dev/null
+	dd if=$DIR/window.bin of=$DIR/window.stack bs=1 \
+	   skip=$win_off count=$win_size 2>/dev/null
+	cmp -s $DIR/full.stack $DIR/window.stack ||
+		fail "bin under -m 256k: stack window differs from the segment"
+}
+
+# report of a minicore: the same as the report of its core, but for the
+# memory used by cortex. The code is file backed text, left out of both,
+# and the stack can only be scanned against its segment
+check_mini_report()
+{
+	$GENCORE -x -b -t 2 -o $DIR/core || { fail "cannot generate core"; return; }
+	$CORTEX -F none -i $DIR/core -f min,all -o $DIR/core.min ||
+		{ fail "min"; return; }
+	$CORTEX -F none -u all -i $DIR/core -f all |
+		sed 's/peak [0-9]* KB/peak/' > $DIR/core.txt ||
+		{ fail "report of the core"; return; }
+	$CORTEX -F none -u all -i $DIR/core.min -f all |
+		sed 's/peak [0-9]* KB/peak/' > $DIR/min.txt ||
+		{ fail "report of the minicore"; return; }
+
+	cmp -s $DIR/core.txt $DIR/min.txt ||
+		fail "min: report differs from the report of the core"
+}
+
+check_bin_window
+check_mini_report
+
+[ $FAILED -eq 0 ] && echo "cortex_check: all checks passed"
+exit $FAILED
@@ -0,0 +1,637 @@
+/** \file cortex_gencore.c
+ * \brief synthetic core dump generator
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+
+#include "cortex_mem.h"
+
+/*
+ * Writes an x86 ET_CORE file the way the kernel does: ELF header,
+ * program headers, one PT_NOTE segment, then the PT_LOAD segments at
+ * page aligned offsets. The first load is the code, the last one holds
+ * the stacks of the threads, with a frame pointer chain the unwinder
+ * can follow, and the others are filled with pseudo random data.
+ *
+ * The 32 and 64 bit layouts of the notes are written field by field so
+ * that both can be generated whatever the host: 4 bytes words give an
+ * EM_386 core, 8 bytes words an EM_X86_64 one. Everything is streamed:
+ * the output can be a pipe to cortex.
+ */
+
+#define GENCORE_PAGE		4096
+#define GENCORE_CHUNK		(64 * 1024)
+#define GENCORE_FRAMES		8
+
+#define GENCORE_CODE_BASE	0x00400000UL
+#define GENCORE_DATA_BASE	0x10000000UL
+#define GENCORE_STACK_TOP_32	0xbf000000UL
+#define GENCORE_STACK_TOP_64	0x7ffd00000000UL
+
+#define GENCORE_PID		4242
+#define GENCORE_SIGNAL		11
+
+enum gencore_notes {
+	GENCORE_NOTES_KERNEL = 0,	/*!< first thread, process, other threads */
+	GENCORE_NOTES_GROUPED,		/*!< all threads, then process */
+	GENCORE_NOTES_REVERSED,		/*!< process, then all threads */
+};
+
+struct gencore {
+	int word;		/*!< 4 or 8 */
+	int threads;
+	int loads;		/*!< number of PT_LOAD, code and stack included */
+	long seg_size;
+	long stack_size;
+	int notes;
+	int fpregs;		/*!< add a NT_FPREGSET per thread */
+	int text;		/*!< code segment left out, as file backed text */
+	int no_fp;		/*!< frame pointer register cleared */
+	uint64_t seed;
+
+	FILE *output;
+	unsigned char *note;	/*!< content of the PT_NOTE segment */
+	size_t note_size;
+	size_t note_len;
+};
+
+/* x86 user_regs_struct indexes of the registers we set */
+struct gencore_regs {
+	int nr;
+	int pc;
+	int sp;
+	int bp;
+	int cs;
+	int ss;
+	int flags;
+};
+
+static const struct gencore_regs gencore_regs_32 = {
+	.nr = 17,.pc = 12,.sp = 15,.bp = 5,.cs = 13,.ss = 16,.flags = 14,
+};
+
+static const struct gencore_regs gencore_regs_64 = {
+	.nr = 27,.pc = 16,.sp = 19,.bp = 4,.cs = 17,.ss = 20,.flags = 18,
+};
+
+static void gencore_usage(char *argv0)
+{
+	printf("Synthetic core dump generator\n\nusage: %s [OPTIONS]\nOPTIONS:\n"
+	       "\t-o, --output\n\t\tcore file. "
+	       "If this option is not present, stdout will be used.\n"
+	       "\t-t, --threads\n\t\tnumber of threads (default 1)\n"
+	       "\t-l, --loads\n\t\tnumber of PT_LOAD segments, code and stack "
+	       "included (default 8)\n"
+	       "\t-s, --segment-size\n\t\tsize of the code and data segments, "
+	       "with k, M or G suffix (default 64k)\n"
+	       "\t-S, --stack-size\n\t\tsize of the stack segment shared by "
+	       "the threads (default 128k)\n"
+	       "\t-w, --word-size\n\t\t4 for an i386 core, 8 for a x86_64 "
+	       "core (default native)\n"
+	       "\t-n, --notes\n\t\tnote layout: 'kernel' (default), 'grouped' "
+	       "(threads first)\n\t\tor 'reversed' (process notes first)\n"
+	       "\t-F, --fpregs\n\t\tadd a NT_FPREGSET note to each thread\n"
+	       "\t-b, --no-frame-pointer\n\t\tclear the frame pointer "
+	       "register: the stacks can only\n\t\tbe scanned\n"
+	       "\t-x, --text\n\t\tleave the code segment out of the file, "
+	       "as the kernel does\n\t\tfor file backed text\n"
+	       "\t-r, --seed\n\t\tseed of the segment content (default 1)\n"
+	       "\t-h, --help\n\t\tShow this help and exit.\n", argv0);
+}
+
+static uint64_t gencore_random(struct gencore *gen)
+{
+	/* xorshift64: fast and reproducible */
+	gen->seed ^= gen->seed << 13;
+	gen->seed ^= gen->seed >> 7;
+	gen->seed ^= gen->seed << 17;
+	return gen->seed;
+}
+
+static void gencore_put(unsigned char *buf, int size, uint64_t val)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+		buf[i] = (val >> (8 * i)) & 0xff;
+}
+
+static unsigned char *gencore_note(struct gencore *gen, int type,
+				   size_t descsz)
+{
+	size_t len = 12 + 8 + ((descsz + 3) & ~3UL);
+	unsigned char *desc;
+
+	if (gen->note_len + len > gen->note_size) {
+		size_t size = (gen->note_size + len) * 2;
+		unsigned char *note = realloc(gen->note, size);
+
+		if (note == NULL) {
+			perror("cannot allocate notes");
+			exit(1);
+		}
+		gen->note = note;
+		gen->note_size = size;
+	}
+
+	desc = gen->note + gen->note_len;
+	memset(desc, 0, len);
+	gencore_put(desc, 4, 5);
+	gencore_put(desc + 4, 4, descsz);
+	gencore_put(desc + 8, 4, type);
+	memcpy(desc + 12, "CORE", 5);
+	gen->note_len += len;
+
+	return desc + 20;
+}
+
+/* stack slice of a thread: [base, base + size) */
+static void gencore_thread_stack(struct gencore *gen, int thread,
+				 uint64_t *base, uint64_t *size)
+{
+	uint64_t top = gen->word == 4 ? GENCORE_STACK_TOP_32 :
+	    GENCORE_STACK_TOP_64;
+	uint64_t slice = (gen->stack_size / gen->threads) & ~15UL;
+
+	*size = slice;
+	*base = top - gen->stack_size + thread * slice;
+}
+
+/* where a thread is stopped: in the code segment, with a frame chain
+ * starting in the middle of its stack slice */
+static void gencore_thread_context(struct gencore *gen, int thread,
+				   uint64_t *pc, uint64_t *sp, uint64_t *bp)
+{
+	uint64_t base, size;
+
+	gencore_thread_stack(gen, thread, &base, &size);
+
+	*pc = GENCORE_CODE_BASE + ((thread * 64 + 16) % gen->seg_size);
+	*sp = (base + size / 2) & ~15UL;
+	*bp = *sp + 2 * gen->word;
+}
+
+static void gencore_prstatus(struct gencore *gen, int thread)
+{
+	const struct gencore_regs *regs = gen->word == 4 ?
+	    &gencore_regs_32 : &gencore_regs_64;
+	int w = gen->word;
+	size_t regs_off = w == 4 ? 72 : 112;
+	size_t size = regs_off + regs->nr * w + (w == 4 ? 4 : 8);
+	unsigned char *desc = gencore_note(gen, NT_PRSTATUS, size);
+	unsigned char *reg = desc + regs_off;
+	uint64_t pc, sp, bp;
+	int i;
+
+	gencore_thread_context(gen, thread, &pc, &sp, &bp);
+
+	gencore_put(desc, 4, thread ? 0 : GENCORE_SIGNAL);
+	gencore_put(desc + 12, 2, thread ? 0 : GENCORE_SIGNAL);
+	/* pid, ppid, pgrp, sid after the pending and held signal masks */
+	gencore_put(desc + 16 + 2 * w, 4, GENCORE_PID + thread);
+	gencore_put(desc + 20 + 2 * w, 4, 1);
+	gencore_put(desc + 24 + 2 * w, 4, GENCORE_PID);
+	gencore_put(desc + 28 + 2 * w, 4, GENCORE_PID);
+
+	for (i = 0; i < regs->nr; i++)
+		gencore_put(reg + i * w, w, gencore_random(gen) & 0xffff);
+	gencore_put(reg + regs->pc * w, w, pc);
+	gencore_put(reg + regs->sp * w, w, sp);
+	gencore_put(reg + regs->bp * w, w, gen->no_fp ? 0 : bp);
+	gencore_put(reg + regs->cs * w, w, w == 4 ? 0x73 : 0x33);
+	gencore_put(reg + regs->ss * w, w, 0x2b);
+	gencore_put(reg + regs->flags * w, w, 0x10206);
+}
+
+static void gencore_fpregset(struct gencore *gen)
+{
+	unsigned char *desc =
+	    gencore_note(gen, NT_FPREGSET, gen->word == 4 ? 108 : 512);
+
+	/* default control word, everything else is empty */
+	gencore_put(desc, 2, 0x37f);
+}
+
+static void gencore_thread(struct gencore *gen, int thread)
+{
+	gencore_prstatus(gen, thread);
+	if (gen->fpregs)
+		gencore_fpregset(gen);
+}
+
+static void gencore_process(struct gencore *gen)
+{
+	static const char fname[] = "gencore";
+	static const char psargs[] = "./gencore --crash";
+	static const char path[] = "/usr/bin/gencore";
+	int w = gen->word;
+	unsigned char *desc;
+	uint64_t auxv[][2] = {
+		{AT_PHDR, GENCORE_CODE_BASE + 64},
+		{AT_PHENT, w == 4 ? 32 : 56},
+		{AT_PHNUM, 9},
+		{AT_PAGESZ, GENCORE_PAGE},
+		{AT_ENTRY, GENCORE_CODE_BASE},
+		{AT_UID, 0},
+		{AT_GID, 0},
+		{AT_NULL, 0},
+	};
+	size_t i;
+
+	/* prpsinfo: state, flags, ids, then fname and psargs */
+	desc = gencore_note(gen, NT_PRPSINFO, w == 4 ? 124 : 136);
+	desc[1] = 'R';
+	if (w == 4) {
+		gencore_put(desc + 12, 4, GENCORE_PID);
+		gencore_put(desc + 16, 4, 1);
+		gencore_put(desc + 20, 4, GENCORE_PID);
+		gencore_put(desc + 24, 4, GENCORE_PID);
+		memcpy(desc + 28, fname, sizeof(fname));
+		memcpy(desc + 44, psargs, sizeof(psargs));
+	} else {
+		gencore_put(desc + 24, 4, GENCORE_PID);
+		gencore_put(desc + 28, 4, 1);
+		gencore_put(desc + 32, 4, GENCORE_PID);
+		gencore_put(desc + 36, 4, GENCORE_PID);
+		memcpy(desc + 40, fname, sizeof(fname));
+		memcpy(desc + 56, psargs, sizeof(psargs));
+	}
+
+	/* siginfo: a segfault on a NULL pointer */
+	desc = gencore_note(gen, NT_SIGINFO, 128);
+	gencore_put(desc, 4, GENCORE_SIGNAL);
+	gencore_put(desc + 8, 4, 1);
+
+	desc = gencore_note(gen, NT_AUXV, sizeof(auxv) / 8 * w);
+	for (i = 0; i < sizeof(auxv) / sizeof(auxv[0]); i++) {
+		gencore_put(desc + 2 * i * w, w, auxv[i][0]);
+		gencore_put(desc + (2 * i + 1) * w, w, auxv[i][1]);
+	}
+
+	/* NT_FILE: the code segment is mapped from the binary */
+	desc = gencore_note(gen, NT_FILE, 5 * w + sizeof(path));
+	gencore_put(desc, w, 1);
+	gencore_put(desc + w, w, GENCORE_PAGE);
+	gencore_put(desc + 2 * w, w, GENCORE_CODE_BASE);
+	gencore_put(desc + 3 * w, w, GENCORE_CODE_BASE + gen->seg_size);
+	gencore_put(desc + 4 * w, w, 0);
+	memcpy(desc + 5 * w, path, sizeof(path));
+}
+
+static void gencore_build_notes(struct gencore *gen)
+{
+	int i;
+
+	switch (gen->notes) {
+	case GENCORE_NOTES_GROUPED:
+		for (i = 0; i < gen->threads; i++)
+			gencore_thread(gen, i);
+		gencore_process(gen);
+		break;
+	case GENCORE_NOTES_REVERSED:
+		gencore_process(gen);
+		for (i = 0; i < gen->threads; i++)
+			gencore_thread(gen, i);
+		break;
+	case GENCORE_NOTES_KERNEL:
+	default:
+		gencore_thread(gen, 0);
+		gencore_process(gen);
+		for (i = 1; i < gen->threads; i++)
+			gencore_thread(gen, i);
+		break;
+	}
+}
+
+static uint64_t gencore_load_vaddr(struct gencore *gen, int load)
+{
+	if (load == 0)
+		return GENCORE_CODE_BASE;
+	if (load == gen->loads - 1)
+		return (gen->word == 4 ? GENCORE_STACK_TOP_32 :
+			GENCORE_STACK_TOP_64) - gen->stack_size;
+	return GENCORE_DATA_BASE + (load - 1) * (gen->seg_size + GENCORE_PAGE);
+}
+
+static long gencore_load_size(struct gencore *gen, int load)
+{
+	return load == gen->loads - 1 ? gen->stack_size : gen->seg_size;
+}
+
+static int gencore_write(struct gencore *gen, const void *buf, size_t len)
+{
+	if (fwrite(buf, 1, len, gen->output) != len) {
+		perror("cannot write core");
+		return -1;
+	}
+	return 0;
+}
+
+static int gencore_write_headers(struct gencore *gen, uint64_t *offset)
+{
+	unsigned char *hdr;
+	int w = gen->word;
+	size_t ehsize = w == 4 ? sizeof(Elf32_Ehdr) : sizeof(Elf64_Ehdr);
+	size_t phsize = w == 4 ? sizeof(Elf32_Phdr) : sizeof(Elf64_Phdr);
+	int phnum = gen->loads + 1;
+	uint64_t note_off = ehsize + phnum * phsize;
+	uint64_t off;
+	unsigned char *ph;
+	int ret = -1;
+	int i;
+
+	if (phnum >= PN_XNUM) {
+		fprintf(stderr, "too many segments\n");
+		return -1;
+	}
+
+	hdr = calloc(1, note_off);
+	if (hdr == NULL) {
+		perror("cannot allocate headers");
+		return -1;
+	}
+
+	memcpy(hdr, ELFMAG, SELFMAG);
+	hdr[EI_CLASS] = w == 4 ? ELFCLASS32 : ELFCLASS64;
+	hdr[EI_DATA] = ELFDATA2LSB;
+	hdr[EI_VERSION] = EV_CURRENT;
+	hdr[EI_OSABI] = ELFOSABI_NONE;
+	gencore_put(hdr + 16, 2, ET_CORE);
+	gencore_put(hdr + 18, 2, w == 4 ? EM_386 : EM_X86_64);
+	gencore_put(hdr + 20, 4, EV_CURRENT);
+	if (w == 4) {
+		gencore_put(hdr + 28, 4, ehsize);	/* e_phoff */
+		gencore_put(hdr + 40, 2, ehsize);
+		gencore_put(hdr + 42, 2, phsize);
+		gencore_put(hdr + 44, 2, phnum);
+	} else {
+		gencore_put(hdr + 32, 8, ehsize);	/* e_phoff */
+		gencore_put(hdr + 52, 2, ehsize);
+		gencore_put(hdr + 54, 2, phsize);
+		gencore_put(hdr + 56, 2, phnum);
+	}
+
+	/* PT_NOTE first, then the loads at page aligned offsets */
+	off = (note_off + gen->note_len + GENCORE_PAGE - 1) &
+	    ~(uint64_t) (GENCORE_PAGE - 1);
+	for (i = 0; i < phnum; i++) {
+		uint64_t p_off = i ? off : note_off;
+		uint64_t size = i ? (uint64_t) gencore_load_size(gen, i - 1) :
+		    gen->note_len;
+		uint64_t vaddr = i ? gencore_load_vaddr(gen, i - 1) : 0;
+		int flags = i == 1 ? PF_R | PF_X : PF_R | PF_W;
+		uint64_t filesz = i == 1 && gen->text ? 0 : size;
+
+		ph = hdr + ehsize + i * phsize;
+		gencore_put(ph, 4, i ? PT_LOAD : PT_NOTE);
+		if (w == 4) {
+			gencore_put(ph + 4, 4, p_off);
+			gencore_put(ph + 8, 4, vaddr);
+			gencore_put(ph + 16, 4, filesz);
+			gencore_put(ph + 20, 4, size);
+			gencore_put(ph + 24, 4, i ? flags : 0);
+			gencore_put(ph + 28, 4, i ? GENCORE_PAGE : 4);
+		} else {
+			gencore_put(ph + 4, 4, i ? flags : 0);
+			gencore_put(ph + 8, 8, p_off);
+			gencore_put(ph + 16, 8, vaddr);
+			gencore_put(ph + 32, 8, filesz);
+			gencore_put(ph + 40, 8, size);
+			gencore_put(ph + 48, 8, i ? GENCORE_PAGE : 4);
+		}
+
+		if (i)
+			off += filesz;
+	}
+
+	if (gencore_write(gen, hdr, note_off) < 0)
+		goto out_err;
+	if (gencore_write(gen, gen->note, gen->note_len) < 0)
+		goto out_err;
+
+	*offset = note_off + gen->note_len;
+	ret = 0;
+
+out_err:
+	free(hdr);
+	return ret;
+}
+
+/* the frame chain of every thread: saved frame pointer, return address */
+static void gencore_fill_stack(struct gencore *gen, unsigned char *buf,
+			       uint64_t start, size_t len)
+{
+	int w = gen->word;
+	uint64_t pc, sp, bp, slot;
+	int t, f;
+
+	for (t = 0; t < gen->threads; t++) {
+		gencore_thread_context(gen, t, &pc, &sp, &bp);
+
+		for (f = 0; f < GENCORE_FRAMES; f++) {
+			uint64_t next = f + 1 < GENCORE_FRAMES ?
+			    bp + 8 * w : 0;
+			uint64_t ret = GENCORE_CODE_BASE +
+			    ((pc - GENCORE_CODE_BASE + 32 * (f + 1)) %
+			     gen->seg_size);
+
+			slot = bp;
+			if (slot >= start && slot + 2 * w <= start + len) {
+				gencore_put(buf + slot - start, w, next);
+				gencore_put(buf + slot - start + w, w, ret);
+			}
+			bp = next;
+		}
+	}
+}
+
+static int gencore_write_load(struct gencore *gen, int load,
+			      unsigned char *buf)
+{
+	long size = gencore_load_size(gen, load);
+	uint64_t vaddr = gencore_load_vaddr(gen, load);
+	long done, len, i;
+
+	for (done = 0; done < size; done += len) {
+		len = size - done < GENCORE_CHUNK ? size - done : GENCORE_CHUNK;
+
+		if (load == 0) {
+			/* nops, with a ret every 32 bytes */
+			memset(buf, 0x90, len);
+			for (i = 31; i < len; i += 32)
+				buf[i] = 0xc3;
+		} else if (load == gen->loads - 1) {
+			memset(buf, 0, len);
+			gencore_fill_stack(gen, buf, vaddr + done, len);
+		} else {
+			for (i = 0; i + 8 <= len; i += 8)
+				gencore_put(buf + i, 8, gencore_random(gen));
+		}
+
+		if (gencore_write(gen, buf, len) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct gencore gen = {
+		.word = sizeof(long),
+		.threads = 1,
+		.loads = 8,
+		.seg_size = 64 * 1024,
+		.stack_size = 128 * 1024,
+		.notes = GENCORE_NOTES_KERNEL,
+		.seed = 1,
+	};
+	unsigned char *buf = NULL;
+	char *output_file = NULL;
+	uint64_t offset;
+	int arg_count = 1;
+	int ret = 1;
+	int i;
+
+	while (arg_count < argc) {
+		if ((strcmp(argv[arg_count], "-h") == 0)
+		    || (strcmp(argv[arg_count], "--help") == 0)) {
+			gencore_usage(argv[0]);
+			exit(0);
+		} else if ((strcmp(argv[arg_count], "-F") == 0)
+			   || (strcmp(argv[arg_count], "--fpregs") == 0)) {
+			gen.fpregs = 1;
+		} else if ((strcmp(argv[arg_count], "-b") == 0)
+			   || (strcmp(argv[arg_count], "--no-frame-pointer") == 0)) {
+			gen.no_fp = 1;
+		} else if ((strcmp(argv[arg_count], "-x") == 0)
+			   || (strcmp(argv[arg_count], "--text") == 0)) {
+			gen.text = 1;
+		} else if (arg_count + 1 >= argc) {
+			gencore_usage(argv[0]);
+			exit(1);
+		} else if ((strcmp(argv[arg_count], "-o") == 0)
+			   || (strcmp(argv[arg_count], "--output") == 0)) {
+			output_file = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-t") == 0)
+			   || (strcmp(argv[arg_count], "--threads") == 0)) {
+			gen.threads = atoi(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-l") == 0)
+			   || (strcmp(argv[arg_count], "--loads") == 0)) {
+			gen.loads = atoi(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-s") == 0)
+			   || (strcmp(argv[arg_count], "--segment-size") == 0)) {
+			gen.seg_size = cortex_mem_parse_size(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-S") == 0)
+			   || (strcmp(argv[arg_count], "--stack-size") == 0)) {
+			gen.stack_size = cortex_mem_parse_size(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-w") == 0)
+			   || (strcmp(argv[arg_count], "--word-size") == 0)) {
+			gen.word = atoi(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-n") == 0)
+			   || (strcmp(argv[arg_count], "--notes") == 0)) {
+			arg_count++;
+			if (strcmp(argv[arg_count], "kernel") == 0) {
+				gen.notes = GENCORE_NOTES_KERNEL;
+			} else if (strcmp(argv[arg_count], "grouped") == 0) {
+				gen.notes = GENCORE_NOTES_GROUPED;
+			} else if (strcmp(argv[arg_count], "reversed") == 0) {
+				gen.notes = GENCORE_NOTES_REVERSED;
+			} else {
+				fprintf(stderr, "unknown note layout %s\n",
+					argv[arg_count]);
+				exit(1);
+			}
+		} else if ((strcmp(argv[arg_count], "-r") == 0)
+			   || (strcmp(argv[arg_count], "--seed") == 0)) {
+			gen.seed = strtoull(argv[++arg_count], NULL, 0);
+		} else {
+			gencore_usage(argv[0]);
+			exit(1);
+		}
+		arg_count++;
+	}
+
+	if (gen.word != 4 && gen.word != 8) {
+		fprintf(stderr, "word size must be 4 or 8\n");
+		exit(1);
+	}
+	if (gen.threads < 1 || gen.loads < 2 || gen.seg_size < GENCORE_PAGE ||
+	    gen.stack_size / gen.threads < GENCORE_FRAMES * 16 * gen.word) {
+		fprintf(stderr, "invalid core geometry\n");
+		exit(1);
+	}
+	if (gen.seed == 0)
+		gen.seed = 1;
+
+	/* keep segments page aligned, as the kernel does */
+	gen.seg_size &= ~(long)(GENCORE_PAGE - 1);
+	gen.stack_size = (gen.stack_size + GENCORE_PAGE - 1) &
+	    ~(long)(GENCORE_PAGE - 1);
+
+	if (output_file) {
+		gen.output = fopen(output_file, "w");
+		if (gen.output == NULL) {
+			perror(output_file);
+			exit(1);
+		}
+	} else {
+		gen.output = stdout;
+	}
+
+	buf = malloc(GENCORE_CHUNK);
+	if (buf == NULL) {
+		perror("cannot allocate buffer");
+		goto out_err;
+	}
+
+	gencore_build_notes(&gen);
+
+	if (gencore_write_headers(&gen, &offset) < 0)
+		goto out_err;
+
+	/* pad up to the first page aligned load */
+	memset(buf, 0, GENCORE_PAGE);
+	if (offset % GENCORE_PAGE &&
+	    gencore_write(&gen, buf, GENCORE_PAGE - offset % GENCORE_PAGE) < 0)
+		goto out_err;
+
+	for (i = gen.text ? 1 : 0; i < gen.loads; i++) {
+		if (gencore_write_load(&gen, i, buf) < 0)
+			goto out_err;
+	}
+
+	ret = 0;
+
+out_err:
+	if (fclose(gen.output) != 0 && ret == 0) {
+		perror("cannot write core");
+		ret = 1;
+	}
+	free(buf);
+	free(gen.note);
+
+	return ret;
+}
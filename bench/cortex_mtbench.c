@@ -0,0 +1,332 @@
+/** \file cortex_mtbench.c
+ * \brief libcortex multithreaded throughput benchmark
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "cortex_mem.h"
+#include "libcortex.h"
+
+/*
+ * Analyses the same core over and over from several threads, each one
+ * with its own struct cortex_ctx, and reports the throughput for each
+ * thread count. Every report is compared with one rendered beforehand
+ * by a single thread: any difference means that the analyses leak into
+ * each other.
+ *
+ * Results are written as one json object per line.
+ */
+
+#define MTBENCH_THREADS		"1,2,4,8"
+#define MTBENCH_ANALYSES	200
+#define MTBENCH_THREADS_MAX	256
+
+struct mtbench {
+	char *core;
+	long fmt;
+	char *fmt_name;
+	long mem_budget;
+	int analyses;
+	char *reference;
+	size_t reference_size;
+	pthread_barrier_t start;
+};
+
+struct mtbench_thread {
+	struct mtbench *bench;
+	pthread_t thread;
+	int done;
+	int failed;
+	int mismatches;
+};
+
+static void mtbench_usage(char *argv0)
+{
+	printf("libcortex multithreaded benchmark\n\nusage: %s [OPTIONS]\n"
+	       "OPTIONS:\n"
+	       "\t-i, --input\n\t\tcore to analyse. If this option is not "
+	       "present, one is generated.\n"
+	       "\t-g, --gencore\n\t\tcore generator (default "
+	       "bench/cortex_gencore)\n"
+	       "\t-t, --threads\n\t\tcomma separated thread counts "
+	       "(default %s)\n"
+	       "\t-n, --analyses\n\t\tanalyses per thread (default %d)\n"
+	       "\t-f, --format\n\t\treport format, see cortex -h "
+	       "(default all)\n"
+	       "\t-m, --mem-budget\n\t\tarena of each context (default %dM)\n"
+	       "\t-h, --help\n\t\tShow this help and exit.\n", argv0,
+	       MTBENCH_THREADS, MTBENCH_ANALYSES, CORTEX_MEM_BUDGET >> 20);
+}
+
+static double mtbench_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int mtbench_gencore(const char *gencore, const char *path)
+{
+	int status;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+
+	if (pid == 0) {
+		execl(gencore, gencore, "-t", "4", "-l", "16", "-s", "64k",
+		      "-S", "256k", "-o", path, NULL);
+		perror(gencore);
+		_exit(127);
+	}
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "%s: cannot generate core\n", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* one analysis: parse the core and render it to memory */
+static int mtbench_analyse(struct mtbench *bench, struct cortex_ctx *ctx,
+			   char **report, size_t *size)
+{
+	FILE *stream;
+	int ret = -1;
+	int fd;
+
+	fd = open(bench->core, O_RDONLY);
+	if (fd < 0) {
+		perror(bench->core);
+		return -1;
+	}
+
+	stream = open_memstream(report, size);
+	if (stream == NULL) {
+		close(fd);
+		return -1;
+	}
+
+	if (cortex_ctx_parse(ctx, fd) == 0 &&
+	    cortex_ctx_render_stream(ctx, bench->fmt, stream, 40) == 0)
+		ret = 0;
+
+	fclose(stream);
+	cortex_ctx_reset(ctx);
+
+	return ret;
+}
+
+static void *mtbench_run(void *arg)
+{
+	struct mtbench_thread *thread = arg;
+	struct mtbench *bench = thread->bench;
+	struct cortex_ctx *ctx;
+	char *report;
+	size_t size;
+	int i;
+
+	ctx = cortex_ctx_new(bench->mem_budget);
+
+	pthread_barrier_wait(&bench->start);
+
+	for (i = 0; ctx && i < bench->analyses; i++) {
+		report = NULL;
+		if (mtbench_analyse(bench, ctx, &report, &size) < 0)
+			thread->failed++;
+		else if (size != bench->reference_size ||
+			 memcmp(report, bench->reference, size) != 0)
+			thread->mismatches++;
+		thread->done++;
+		free(report);
+	}
+
+	cortex_ctx_free(ctx);
+
+	return NULL;
+}
+
+static int mtbench_measure(struct mtbench *bench, int nr_threads,
+			   size_t core_size)
+{
+	struct mtbench_thread threads[MTBENCH_THREADS_MAX];
+	int done = 0, failed = 0, mismatches = 0;
+	double start, wall_ms;
+	int i;
+
+	memset(threads, 0, sizeof(threads));
+	pthread_barrier_init(&bench->start, NULL, nr_threads + 1);
+
+	for (i = 0; i < nr_threads; i++) {
+		threads[i].bench = bench;
+		if (pthread_create(&threads[i].thread, NULL, mtbench_run,
+				   &threads[i]) != 0) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+
+	/* the arenas are reserved: measure the analyses only */
+	pthread_barrier_wait(&bench->start);
+	start = mtbench_now_ms();
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		done += threads[i].done;
+		failed += threads[i].failed;
+		mismatches += threads[i].mismatches;
+	}
+
+	wall_ms = mtbench_now_ms() - start;
+	pthread_barrier_destroy(&bench->start);
+
+	printf("{\"bench\":\"libcortex\",\"format\":\"%s\",\"core_bytes\":%zu,"
+	       "\"threads\":%d,\"analyses\":%d,\"wall_ms\":%.3f,"
+	       "\"analyses_s\":%.1f,\"mb_s\":%.1f,\"failed\":%d,"
+	       "\"mismatches\":%d}\n", bench->fmt_name, core_size,
+	       nr_threads, done, wall_ms,
+	       wall_ms > 0 ? done / (wall_ms / 1000.0) : 0,
+	       wall_ms > 0 ? done * (core_size / (1024.0 * 1024.0)) /
+	       (wall_ms / 1000.0) : 0, failed, mismatches);
+	fflush(stdout);
+
+	return failed || mismatches || done != nr_threads * bench->analyses ?
+	    -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct mtbench bench = {
+		.fmt_name = "all",
+		.mem_budget = CORTEX_MEM_BUDGET,
+		.analyses = MTBENCH_ANALYSES,
+	};
+	char *gencore = "bench/cortex_gencore";
+	char *thread_list = MTBENCH_THREADS;
+	struct cortex_ctx *ctx;
+	char path[256];
+	char *fmt, *list, *count;
+	struct stat st;
+	int generated = 0;
+	int arg_count = 1;
+	int ret = 0;
+
+	while (arg_count < argc) {
+		if ((strcmp(argv[arg_count], "-h") == 0)
+		    || (strcmp(argv[arg_count], "--help") == 0)) {
+			mtbench_usage(argv[0]);
+			exit(0);
+		} else if (arg_count + 1 >= argc) {
+			mtbench_usage(argv[0]);
+			exit(1);
+		} else if ((strcmp(argv[arg_count], "-i") == 0)
+			   || (strcmp(argv[arg_count], "--input") == 0)) {
+			bench.core = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-g") == 0)
+			   || (strcmp(argv[arg_count], "--gencore") == 0)) {
+			gencore = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-t") == 0)
+			   || (strcmp(argv[arg_count], "--threads") == 0)) {
+			thread_list = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-n") == 0)
+			   || (strcmp(argv[arg_count], "--analyses") == 0)) {
+			bench.analyses = atoi(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-f") == 0)
+			   || (strcmp(argv[arg_count], "--format") == 0)) {
+			bench.fmt_name = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-m") == 0)
+			   || (strcmp(argv[arg_count], "--mem-budget") == 0)) {
+			bench.mem_budget =
+			    cortex_mem_parse_size(argv[++arg_count]);
+			if (bench.mem_budget < 0)
+				exit(1);
+		} else {
+			mtbench_usage(argv[0]);
+			exit(1);
+		}
+		arg_count++;
+	}
+
+	fmt = strdup(bench.fmt_name);
+	bench.fmt = cortex_output_parse_format(fmt);
+	free(fmt);
+	if (bench.fmt < 0 || bench.analyses < 1)
+		exit(1);
+
+	if (bench.core == NULL) {
+		snprintf(path, sizeof(path), "/tmp/cortex-mtbench.%d.core",
+			 getpid());
+		if (mtbench_gencore(gencore, path) < 0)
+			exit(1);
+		bench.core = path;
+		generated = 1;
+	}
+
+	if (stat(bench.core, &st) < 0) {
+		perror(bench.core);
+		exit(1);
+	}
+
+	/* the reference report, from a single thread */
+	ctx = cortex_ctx_new(bench.mem_budget);
+	if (ctx == NULL || mtbench_analyse(&bench, ctx, &bench.reference,
+					   &bench.reference_size) < 0) {
+		fprintf(stderr, "%s: cannot analyse core\n", bench.core);
+		ret = 1;
+		goto out;
+	}
+	cortex_ctx_free(ctx);
+	ctx = NULL;
+
+	list = strdup(thread_list);
+	for (count = strtok(list, ","); count; count = strtok(NULL, ",")) {
+		int nr_threads = atoi(count);
+
+		if (nr_threads < 1 || nr_threads > MTBENCH_THREADS_MAX) {
+			fprintf(stderr, "%s: invalid thread count\n", count);
+			ret = 1;
+			break;
+		}
+		if (mtbench_measure(&bench, nr_threads, st.st_size) < 0)
+			ret = 1;
+	}
+	free(list);
+
+out:
+	cortex_ctx_free(ctx);
+	free(bench.reference);
+	if (generated)
+		unlink(path);
+
+	return ret;
+}
@@ -4,12 +4,9 @@
 OUPUTNAME="$1"
 
 # Examples for cortex chain commands
-# Simply gzip the output
-COMMAND_GZ="gzip > $OUPUTNAME.gz"
-
-# Add some userland context info and gzip all
+# Add usb and pci devices with the context script and gzip all
 COMMAND_CTX_GZ="context.sh | gzip > $OUPUTNAME.gz"
 
-# Do the processing
-cortex -e "$COMMAND_GZ"
-
+# Do the processing: cortex gzips the report and reads the system
+# context itself, without forking
+cortex -f def,sys -z gzip -o "$OUPUTNAME.gz"
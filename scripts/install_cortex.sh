@@ -2,20 +2,32 @@
 
 CORTEX_OUPTUT_DIR=/var/log/cortex
 HANDLER="|/usr/local/bin/cortex_wrapper.sh $CORTEX_OUPTUT_DIR/report_%e_%p.log"
+CORTEX_FILTER_FORMAT="def,sys"
+CORTEX_FILTER_TARGETS=""
 
 [ -f /etc/default/cortex.conf ] && source /etc/default/cortex.conf
 
 case $1 in
 	"start")
 		mkdir -p $CORTEX_OUPTUT_DIR
+		# cross-run metrics, see cortex -M
+		mkdir -p /var/lib/cortex
 
 		if [ -f /bin/busybox ]; then
 			# enable coredump for busybox 
 			touch /.init_enable_core
 		fi
 
+		# keep the crashing process in /proc until cortex is done
+		echo 1 > /proc/sys/kernel/core_pipe_limit
+
 		# install the cortex coredump handler
 		echo "$HANDLER" > /proc/sys/kernel/core_pattern
+
+		# only dump what the reports read
+		for target in $CORTEX_FILTER_TARGETS; do
+			cortex -f "$CORTEX_FILTER_FORMAT" -T "$target"
+		done
 	;;
 
 	"stop")
@@ -26,6 +38,12 @@ case $1 in
 
 		# uninstall the cortex coredump handler
 		echo "core" > /proc/sys/kernel/core_pattern
+		echo 0 > /proc/sys/kernel/core_pipe_limit
+
+		# back to the default coredump_filter
+		for target in $CORTEX_FILTER_TARGETS; do
+			cortex -f mem -T "$target"
+		done
 	;;
 esac
 
@@ -0,0 +1,53 @@
+/** \file cortex_arch.c
+ * \brief cortex architecture backends
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdlib.h>
+
+#include "arch/cortex_arch.h"
+
+/* every backend is built in, whatever the host */
+static const struct cortex_arch_ops *const cortex_arch_table[] = {
+	&cortex_x86_64_arch_ops,
+	&cortex_i386_arch_ops,
+	&cortex_arm_arch_ops,
+	&cortex_ppc32_arch_ops,
+	&cortex_ppc64_arch_ops,
+	&cortex_mips32_arch_ops,
+	&cortex_mips64_arch_ops,
+};
+
+/** \brief backend of a core
+ * \param machine e_machine of the core
+ * \param elf_class EI_CLASS of the core
+ * \return the backend, NULL if the architecture is not supported
+ */
+const struct cortex_arch_ops *cortex_arch_find(int machine, int elf_class)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(cortex_arch_table) /
+	     sizeof(cortex_arch_table[0]); i++) {
+		if (cortex_arch_table[i]->machine == machine &&
+		    cortex_arch_table[i]->elf_class == elf_class)
+			return cortex_arch_table[i];
+	}
+
+	return NULL;
+}
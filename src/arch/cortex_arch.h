@@ -24,31 +24,88 @@
 
 #include <elf.h>
 #include <stdio.h>
-#include <asm/ptrace.h>
+#include <stdint.h>
 
 #include "cortex.h"
 
 #define REG_NAME_SZ	16
 
-extern struct cortex_arch_ops cortex_arch_ops;
+/** \brief room for the registers of any architecture */
+#define CORTEX_CPU_REGS_MAX	64
 
 struct cortex_cpu_regs {
 	char name[REG_NAME_SZ];
 	size_t size;
-	long value;
+	uint64_t value;		/*!< zero extended, whatever the host */
 };
 
+/** \brief room for the widest register, a zmm */
+#define CORTEX_VREG_SIZE	64
+
+/** \brief room for the FP or vector registers of any architecture */
+#define CORTEX_VREGS_MAX	48
+
+/** \struct cortex_vreg
+ ** \brief a FP or vector register, too wide for cortex_cpu_regs
+ */
+struct cortex_vreg {
+	char name[REG_NAME_SZ];
+	size_t size;		/*!< bytes used in value */
+	unsigned char value[CORTEX_VREG_SIZE];	/*!< least significant first */
+};
+
+/** \struct cortex_arch_ops
+ ** \brief one backend, for one machine and one ELF class
+ *
+ * All the backends are built in: the one matching the core header is
+ * picked by cortex_arch_find(). The registers are handed over as the
+ * elf_gregset_t of the core, widened to ElfN_Addr in host byte order.
+ *
+ * fill_fp_regs and fill_vec_regs decode the FP and vector state of a
+ * thread from its notes. They are optional and return the number of
+ * registers filled, 0 if the core does not hold that state.
+ *
+ * is_call_site tells whether the instruction before an address is a
+ * call, for the stack scanning unwinder: 1 if it is, 0 if it is not, -1
+ * if the core does not hold the code. It is optional.
+ *
+ * The operations only read their arguments: one table serves all the
+ * analyses running in the process.
+ */
 struct cortex_arch_ops {
-	int (*fill_regs) (struct cortex_proc_info * info,
-			  struct pt_regs * pr_regs);
-	int (*get_word_size) (void);
-	long (*get_sp) (struct cortex_cpu_regs * cpu_regs);
-	long (*get_pc) (struct cortex_cpu_regs * cpu_regs);
+	const char *name;	/*!< name shown in the reports */
+	int machine;		/*!< e_machine of its cores */
+	int elf_class;		/*!< ELFCLASS32 or ELFCLASS64 */
+	int word_size;		/*!< size of an address */
+	int nr_gregs;		/*!< entries in the elf_gregset_t */
+	int uid_size;		/*!< size of the uids of elf_prpsinfo */
+
+	int (*fill_regs) (struct cortex_cpu_regs * cpu_regs,
+			  const ElfN_Addr * gregs);
+	uint64_t (*get_sp) (struct cortex_cpu_regs * cpu_regs);
+	uint64_t (*get_pc) (struct cortex_cpu_regs * cpu_regs);
 	long (*unwind_next) (struct cortex_proc_info * info,
 			     struct cortex_stack_frame * frame, void *data);
 	void (*unwind_exit) (struct cortex_proc_info * info, void *data);
-	void *(*unwind_init) (struct cortex_proc_info * info,
+	void *(*unwind_init) (struct cortex_proc_info * info, int thread,
 			      struct cortex_stack_frame * frame);
+	int (*is_call_site) (struct cortex_proc_info * info, ElfN_Addr pc);
+	int (*fill_fp_regs) (struct cortex_proc_info * info, int thread,
+			     struct cortex_vreg * vregs);
+	int (*fill_vec_regs) (struct cortex_proc_info * info, int thread,
+			      struct cortex_vreg * vregs);
+	int (*get_mdmp_cpu) (void);
+	long (*fill_mdmp_context) (const ElfN_Addr * gregs, void *context);
 };
 
+extern const struct cortex_arch_ops cortex_x86_64_arch_ops;
+extern const struct cortex_arch_ops cortex_i386_arch_ops;
+extern const struct cortex_arch_ops cortex_arm_arch_ops;
+extern const struct cortex_arch_ops cortex_ppc32_arch_ops;
+extern const struct cortex_arch_ops cortex_ppc64_arch_ops;
+extern const struct cortex_arch_ops cortex_mips32_arch_ops;
+extern const struct cortex_arch_ops cortex_mips64_arch_ops;
+
+const struct cortex_arch_ops *cortex_arch_find(int machine, int elf_class);
+
 #endif /* _CORTEX_ARCH_H_ */
@@ -22,13 +22,15 @@
 #include <string.h>
 
 #include "cortex.h"
+#include "cortex_elf.h"
+#include "cortex_mdmp.h"
+#include "cortex_mem.h"
 #include "arch/cortex_arch.h"
 
-#ifdef LINUX64
-#define CORTEX_WORD_SIZE 8
-#else
 #define CORTEX_WORD_SIZE 4
-#endif
+
+/* elf_gregset_t: uregs[18] */
+#define CORTEX_ARM_NR_GREGS 18
 
 enum cortex_reg_id {
 	reg_id_r0 = 0,
@@ -51,7 +53,7 @@ enum cortex_reg_id {
 	reg_id_orig_r0,
 };
 
-static struct cortex_cpu_regs cortex_arm_cpu_regs[] = {
+static const struct cortex_cpu_regs cortex_arm_cpu_regs[] = {
 	{.name = "r0",.size = CORTEX_WORD_SIZE},
 	{.name = "r1",.size = CORTEX_WORD_SIZE},
 	{.name = "r2",.size = CORTEX_WORD_SIZE},
@@ -72,86 +74,96 @@ static struct cortex_cpu_regs cortex_arm_cpu_regs[] = {
 	{.name = "orig_r0",.size = CORTEX_WORD_SIZE},
 };
 
-static int cortex_arm_fill_regs(struct cortex_proc_info *info,
-				struct pt_regs *pr_regs)
+static int cortex_arm_fill_regs(struct cortex_cpu_regs *cpu_regs,
+                                const ElfN_Addr *gregs)
 {
-	info->cpu_regs = cortex_arm_cpu_regs;
-
-	info->cpu_regs[reg_id_r0].value = pr_regs->uregs[0];
-	info->cpu_regs[reg_id_r1].value = pr_regs->uregs[1];
-	info->cpu_regs[reg_id_r2].value = pr_regs->uregs[2];
-	info->cpu_regs[reg_id_r3].value = pr_regs->uregs[3];
-	info->cpu_regs[reg_id_r4].value = pr_regs->uregs[4];
-	info->cpu_regs[reg_id_r5].value = pr_regs->uregs[5];
-	info->cpu_regs[reg_id_r6].value = pr_regs->uregs[6];
-	info->cpu_regs[reg_id_r7].value = pr_regs->uregs[7];
-	info->cpu_regs[reg_id_r8].value = pr_regs->uregs[8];
-	info->cpu_regs[reg_id_r9].value = pr_regs->uregs[9];
-	info->cpu_regs[reg_id_r10].value = pr_regs->uregs[10];
-	info->cpu_regs[reg_id_fp].value = pr_regs->uregs[11];
-	info->cpu_regs[reg_id_ip].value = pr_regs->uregs[12];
-	info->cpu_regs[reg_id_sp].value = pr_regs->uregs[13];
-	info->cpu_regs[reg_id_lr].value = pr_regs->uregs[14];
-	info->cpu_regs[reg_id_pc].value = pr_regs->uregs[15];
-	info->cpu_regs[reg_id_cpsr].value = pr_regs->uregs[16];
-	info->cpu_regs[reg_id_orig_r0].value = pr_regs->uregs[17];
+	memcpy(cpu_regs, cortex_arm_cpu_regs, sizeof(cortex_arm_cpu_regs));
+
+	cpu_regs[reg_id_r0].value = gregs[0];
+	cpu_regs[reg_id_r1].value = gregs[1];
+	cpu_regs[reg_id_r2].value = gregs[2];
+	cpu_regs[reg_id_r3].value = gregs[3];
+	cpu_regs[reg_id_r4].value = gregs[4];
+	cpu_regs[reg_id_r5].value = gregs[5];
+	cpu_regs[reg_id_r6].value = gregs[6];
+	cpu_regs[reg_id_r7].value = gregs[7];
+	cpu_regs[reg_id_r8].value = gregs[8];
+	cpu_regs[reg_id_r9].value = gregs[9];
+	cpu_regs[reg_id_r10].value = gregs[10];
+	cpu_regs[reg_id_fp].value = gregs[11];
+	cpu_regs[reg_id_ip].value = gregs[12];
+	cpu_regs[reg_id_sp].value = gregs[13];
+	cpu_regs[reg_id_lr].value = gregs[14];
+	cpu_regs[reg_id_pc].value = gregs[15];
+	cpu_regs[reg_id_cpsr].value = gregs[16];
+	cpu_regs[reg_id_orig_r0].value = gregs[17];
 
 	return sizeof(cortex_arm_cpu_regs) / sizeof(struct cortex_cpu_regs);
 }
 
-static long cortex_arm_get_pc(struct cortex_cpu_regs *cpu_regs)
+static uint64_t cortex_arm_get_pc(struct cortex_cpu_regs *cpu_regs)
 {
 	return cpu_regs[reg_id_pc].value;
 }
 
-static long cortex_arm_get_sp(struct cortex_cpu_regs *cpu_regs)
+static uint64_t cortex_arm_get_sp(struct cortex_cpu_regs *cpu_regs)
 {
 	return cpu_regs[reg_id_sp].value;
 }
 
+/* the link register of the next frame and the one of the crash: a leaf
+ * function did not save it */
+struct cortex_arm_unwind {
+	ElfN_Addr lr;
+	ElfN_Addr first_lr;
+};
+
 static void *cortex_arm_unwind_init(struct cortex_proc_info *info,
+				    int thread,
 				    struct cortex_stack_frame *frame)
 {
-	ElfN_Addr *lr = malloc(sizeof(ElfN_Addr));
+	const ElfN_Addr *gregs = info->threads[thread].pr_reg;
+	struct cortex_arm_unwind *unwind;
+
+	unwind = cortex_mem_alloc(sizeof(struct cortex_arm_unwind));
+	if (unwind == NULL)
+		return NULL;
 
-	*lr = info->cpu_regs[reg_id_lr].value;
+	unwind->lr = gregs[reg_id_lr];
+	unwind->first_lr = gregs[reg_id_lr];
 
-	frame->pc = info->cpu_regs[reg_id_pc].value;
-	frame->sp = info->cpu_regs[reg_id_sp].value;
-	frame->bp = info->cpu_regs[reg_id_fp].value;
+	frame->pc = gregs[reg_id_pc];
+	frame->sp = gregs[reg_id_sp];
+	frame->bp = gregs[reg_id_fp];
 
-	return lr;
+	return unwind;
 }
 
 static long cortex_arm_unwind_next(struct cortex_proc_info *info,
 				   struct cortex_stack_frame *frame, void *data)
 {
+	struct cortex_arm_unwind *unwind = data;
 	struct cortex_stack_frame next;
-	ElfN_Addr *lr = (ElfN_Addr *) data;
+	ElfN_Addr bp_addr;
 
-	if (frame->bp == 0)
+	if (unwind == NULL || frame->bp == 0)
 		return 0;
 
 	if (frame->bp < frame->sp)
 		return 0;
 
-	next.pc = *lr;
+	next.pc = unwind->lr;
 	next.sp = frame->bp - info->word_size;
 
-	if (next.pc == (unsigned long)info->cpu_regs[reg_id_lr].value) {
-		next.bp =
-		    *(unsigned long *)(info->stack->d_buf + next.sp -
-				       info->sp_segm->p_vaddr);
-	} else {
-		next.bp =
-		    *(unsigned long *)(info->stack->d_buf + next.sp -
-				       info->word_size -
-				       info->sp_segm->p_vaddr);
-	}
-
-	*lr =
-	    *(unsigned long *)(info->stack->d_buf + frame->bp +
-			       info->word_size - info->sp_segm->p_vaddr);
+	if (next.pc == unwind->first_lr)
+		bp_addr = next.sp;
+	else
+		bp_addr = next.sp - info->word_size;
+
+	if (cortex_elf_read_word(info, bp_addr, &next.bp) < 0 ||
+	    cortex_elf_read_word(info, frame->bp + info->word_size,
+				 &unwind->lr) < 0)
+		return 0;
 
 	memcpy(frame, &next, sizeof(struct cortex_stack_frame));
 
@@ -162,22 +174,47 @@ static long cortex_arm_unwind_next(struct cortex_proc_info *info,
 
 static void cortex_arm_unwind_exit(struct cortex_proc_info *info, void *data)
 {
-	ElfN_Addr *lr = (ElfN_Addr *) data;
-	free(lr);
+	cortex_mem_free(data);
+}
+
+static int cortex_arm_get_mdmp_cpu(void)
+{
+	return MDMP_CPU_ARM;
 }
 
-static int cortex_arm_get_word_size(void)
+static long cortex_arm_fill_mdmp_context(const ElfN_Addr *gregs,
+					 void *context)
 {
-	return CORTEX_WORD_SIZE;
+	struct mdmp_context_arm *ctx = context;
+	int i = 0;
+
+	if (!ctx)
+		return sizeof(*ctx);
+
+	ctx->context_flags = MDMP_CONTEXT_ARM | MDMP_CONTEXT_INTEGER;
+	for (i = 0; i < 16; i++)
+		ctx->iregs[i] = gregs[i];
+	ctx->cpsr = gregs[16];
+
+	return sizeof(*ctx);
 }
 
-struct cortex_arch_ops cortex_arch_ops = {
+const struct cortex_arch_ops cortex_arm_arch_ops = {
+	.name = "arm",
+	.machine = EM_ARM,
+	.elf_class = ELFCLASS32,
+	.word_size = CORTEX_WORD_SIZE,
+	.nr_gregs = CORTEX_ARM_NR_GREGS,
+	.uid_size = 2,
+
 	.fill_regs = cortex_arm_fill_regs,
 	.get_pc = cortex_arm_get_pc,
 	.get_sp = cortex_arm_get_sp,
-	.get_word_size = cortex_arm_get_word_size,
 
 	.unwind_init = cortex_arm_unwind_init,
 	.unwind_next = cortex_arm_unwind_next,
 	.unwind_exit = cortex_arm_unwind_exit,
+
+	.get_mdmp_cpu = cortex_arm_get_mdmp_cpu,
+	.fill_mdmp_context = cortex_arm_fill_mdmp_context,
 };
@@ -22,7 +22,33 @@
 #include <string.h>
 
 #include "cortex.h"
+#include "cortex_elf.h"
+#include "cortex_mdmp.h"
+#include "cortex_mem.h"
 #include "arch/cortex_arch.h"
+#include "arch/cortex_x86.h"
+
+/* elf_gregset_t layout, struct user_regs_struct */
+enum cortex_greg_id {
+	greg_ebx = 0,
+	greg_ecx,
+	greg_edx,
+	greg_esi,
+	greg_edi,
+	greg_ebp,
+	greg_eax,
+	greg_xds,
+	greg_xes,
+	greg_xfs,
+	greg_xgs,
+	greg_orig_eax,
+	greg_eip,
+	greg_xcs,
+	greg_eflags,
+	greg_esp,
+	greg_xss,
+	greg_nr,
+};
 
 enum cortex_reg_id {
 	reg_id_eax = 0,
@@ -44,7 +70,7 @@ enum cortex_reg_id {
 	reg_id_orig_eax,
 };
 
-static struct cortex_cpu_regs cortex_i386_cpu_regs[] = {
+static const struct cortex_cpu_regs cortex_i386_cpu_regs[] = {
 	{.name = "eax",.size = 4,},
 	{.name = "ebx",.size = 4,},
 	{.name = "ecx",.size = 4,},
@@ -64,51 +90,58 @@ static struct cortex_cpu_regs cortex_i386_cpu_regs[] = {
 	{.name = "orig_eax",.size = 4,},
 };
 
-static int cortex_i386_fill_regs(struct cortex_proc_info *info,
-				 struct pt_regs *pr_regs)
+static int cortex_i386_fill_regs(struct cortex_cpu_regs *cpu_regs,
+                                 const ElfN_Addr *gregs)
 {
-	info->cpu_regs = cortex_i386_cpu_regs;
-
-	info->cpu_regs[reg_id_eax].value = pr_regs->eax;
-	info->cpu_regs[reg_id_ebx].value = pr_regs->ebx;
-	info->cpu_regs[reg_id_ecx].value = pr_regs->ecx;
-	info->cpu_regs[reg_id_edx].value = pr_regs->edx;
-	info->cpu_regs[reg_id_ebp].value = pr_regs->ebp;
-	info->cpu_regs[reg_id_esp].value = pr_regs->esp;
-	info->cpu_regs[reg_id_edi].value = pr_regs->edi;
-	info->cpu_regs[reg_id_esi].value = pr_regs->esi;
-	info->cpu_regs[reg_id_eip].value = pr_regs->eip;
-	info->cpu_regs[reg_id_xcs].value = pr_regs->xcs;
-	info->cpu_regs[reg_id_xds].value = pr_regs->xds;
-	info->cpu_regs[reg_id_xes].value = pr_regs->xes;
-	info->cpu_regs[reg_id_xfs].value = pr_regs->xfs;
-	info->cpu_regs[reg_id_xgs].value = pr_regs->xgs;
-	info->cpu_regs[reg_id_xss].value = pr_regs->xss;
-	info->cpu_regs[reg_id_eflags].value = pr_regs->eflags;
-	info->cpu_regs[reg_id_orig_eax].value = pr_regs->orig_eax;
+	memcpy(cpu_regs, cortex_i386_cpu_regs, sizeof(cortex_i386_cpu_regs));
+
+	cpu_regs[reg_id_eax].value = gregs[greg_eax];
+	cpu_regs[reg_id_ebx].value = gregs[greg_ebx];
+	cpu_regs[reg_id_ecx].value = gregs[greg_ecx];
+	cpu_regs[reg_id_edx].value = gregs[greg_edx];
+	cpu_regs[reg_id_ebp].value = gregs[greg_ebp];
+	cpu_regs[reg_id_esp].value = gregs[greg_esp];
+	cpu_regs[reg_id_edi].value = gregs[greg_edi];
+	cpu_regs[reg_id_esi].value = gregs[greg_esi];
+	cpu_regs[reg_id_eip].value = gregs[greg_eip];
+	cpu_regs[reg_id_xcs].value = gregs[greg_xcs];
+	cpu_regs[reg_id_xds].value = gregs[greg_xds];
+	cpu_regs[reg_id_xes].value = gregs[greg_xes];
+	cpu_regs[reg_id_xfs].value = gregs[greg_xfs];
+	cpu_regs[reg_id_xgs].value = gregs[greg_xgs];
+	cpu_regs[reg_id_xss].value = gregs[greg_xss];
+	cpu_regs[reg_id_eflags].value = gregs[greg_eflags];
+	cpu_regs[reg_id_orig_eax].value = gregs[greg_orig_eax];
 
 	return sizeof(cortex_i386_cpu_regs) / sizeof(struct cortex_cpu_regs);
 }
 
-static long cortex_i386_get_pc(struct cortex_cpu_regs *cpu_regs)
+static uint64_t cortex_i386_get_pc(struct cortex_cpu_regs *cpu_regs)
 {
 	return cpu_regs[reg_id_eip].value;
 }
 
-static long cortex_i386_get_sp(struct cortex_cpu_regs *cpu_regs)
+static uint64_t cortex_i386_get_sp(struct cortex_cpu_regs *cpu_regs)
 {
 	return cpu_regs[reg_id_esp].value;
 }
 
 static void *cortex_i386_unwind_init(struct cortex_proc_info *info,
+				     int thread,
 				     struct cortex_stack_frame *frame)
 {
+	const struct cortex_prstatus *prstatus = &info->threads[thread];
+	int *leader = cortex_mem_alloc(sizeof(int));
+
+	/* the outermost frame of the main thread has a null saved ebp */
+	if (leader)
+		*leader = prstatus->pr_pid == prstatus->pr_pgrp;
 
-	frame->pc = info->cpu_regs[reg_id_eip].value;
-	frame->sp = info->cpu_regs[reg_id_esp].value;
-	frame->bp = info->cpu_regs[reg_id_ebp].value;
+	frame->pc = prstatus->pr_reg[greg_eip];
+	frame->sp = prstatus->pr_reg[greg_esp];
+	frame->bp = prstatus->pr_reg[greg_ebp];
 
-	return NULL;
+	return leader;
 }
 
 static long cortex_i386_unwind_next(struct cortex_proc_info *info,
@@ -116,39 +149,99 @@ static long cortex_i386_unwind_next(struct cortex_proc_info *info,
 				    void *data)
 {
 	struct cortex_stack_frame next;
+	int *leader = (int *)data;
+	ElfN_Addr saved_bp;
 
-	next.pc =
-	    *(unsigned long *)(info->stack->d_buf + frame->bp -
-			       info->sp_segm->p_vaddr + info->word_size);
+	if (cortex_elf_read_word(info, frame->bp + info->word_size,
+				 &next.pc) < 0 ||
+	    cortex_elf_read_word(info, frame->bp, &next.bp) < 0)
+		return 0;
 	next.sp = frame->bp - info->word_size;
-	next.bp =
-	    *(unsigned long *)(info->stack->d_buf + frame->bp -
-			       info->sp_segm->p_vaddr);
 
 	memcpy(frame, &next, sizeof(struct cortex_stack_frame));
 
 	if (frame->bp == 0)
 		return 0;
-	if (info->threads[0]->pr_pid == info->threads[0]->pr_pgrp)
-		if (*(unsigned long *)
-		    (info->stack->d_buf + frame->bp - info->sp_segm->p_vaddr) ==
-		    0)
+	if (leader && *leader)
+		if (cortex_elf_read_word(info, frame->bp, &saved_bp) < 0 ||
+		    saved_bp == 0)
 			return 0;
 
 	return 1;
 }
 
-static int cortex_i386_get_word_size(void)
+static void cortex_i386_unwind_exit(struct cortex_proc_info *info, void *data)
+{
+	cortex_mem_free(data);
+}
+
+static int cortex_i386_fill_fp_regs(struct cortex_proc_info *info,
+				    int thread, struct cortex_vreg *vregs)
+{
+	return cortex_x86_fill_fp_regs(info, thread, vregs, 8);
+}
+
+static int cortex_i386_fill_vec_regs(struct cortex_proc_info *info,
+				     int thread, struct cortex_vreg *vregs)
 {
-	return 4;
+	return cortex_x86_fill_vec_regs(info, thread, vregs, 8);
 }
 
-struct cortex_arch_ops cortex_arch_ops = {
+static int cortex_i386_get_mdmp_cpu(void)
+{
+	return MDMP_CPU_X86;
+}
+
+static long cortex_i386_fill_mdmp_context(const ElfN_Addr *gregs,
+					  void *context)
+{
+	struct mdmp_context_x86 *ctx = context;
+
+	if (!ctx)
+		return sizeof(*ctx);
+
+	ctx->context_flags = MDMP_CONTEXT_X86 | MDMP_CONTEXT_CONTROL |
+	    MDMP_CONTEXT_INTEGER | MDMP_CONTEXT_SEGMENTS;
+	ctx->gs = gregs[greg_xgs];
+	ctx->fs = gregs[greg_xfs];
+	ctx->es = gregs[greg_xes];
+	ctx->ds = gregs[greg_xds];
+	ctx->edi = gregs[greg_edi];
+	ctx->esi = gregs[greg_esi];
+	ctx->ebx = gregs[greg_ebx];
+	ctx->edx = gregs[greg_edx];
+	ctx->ecx = gregs[greg_ecx];
+	ctx->eax = gregs[greg_eax];
+	ctx->ebp = gregs[greg_ebp];
+	ctx->eip = gregs[greg_eip];
+	ctx->cs = gregs[greg_xcs];
+	ctx->eflags = gregs[greg_eflags];
+	ctx->esp = gregs[greg_esp];
+	ctx->ss = gregs[greg_xss];
+
+	return sizeof(*ctx);
+}
+
+const struct cortex_arch_ops cortex_i386_arch_ops = {
+	.name = "i386",
+	.machine = EM_386,
+	.elf_class = ELFCLASS32,
+	.word_size = 4,
+	.nr_gregs = greg_nr,
+	.uid_size = 2,
+
 	.fill_regs = cortex_i386_fill_regs,
 	.get_pc = cortex_i386_get_pc,
 	.get_sp = cortex_i386_get_sp,
-	.get_word_size = cortex_i386_get_word_size,
 
 	.unwind_init = cortex_i386_unwind_init,
+	.is_call_site = cortex_x86_is_call_site,
 	.unwind_next = cortex_i386_unwind_next,
+	.unwind_exit = cortex_i386_unwind_exit,
+
+	.fill_fp_regs = cortex_i386_fill_fp_regs,
+	.fill_vec_regs = cortex_i386_fill_vec_regs,
+
+	.get_mdmp_cpu = cortex_i386_get_mdmp_cpu,
+	.fill_mdmp_context = cortex_i386_fill_mdmp_context,
 };
@@ -22,14 +22,10 @@
 #include <string.h>
 
 #include "cortex.h"
+#include "cortex_mdmp.h"
 #include "arch/cortex_arch.h"
 
-#ifdef LINUX64
-#define CORTEX_WORD_SIZE 8
-#else
-#define CORTEX_WORD_SIZE 4
-#endif
-
+/* pt_regs order, the first entries of the elf_gregset_t */
 enum cortex_reg_id {
 	reg_id_gpr0 = 0,
 	reg_id_gpr1,
@@ -70,147 +66,164 @@ enum cortex_reg_id {
 	reg_id_link,
 	reg_id_xer,
 	reg_id_ccr,
-#ifdef LINUX64
-	reg_id_softe,
-#else
 	reg_id_mq,
-#endif
 	reg_id_trap,
 	reg_id_dar,
 	reg_id_dsisr,
 	reg_id_result,
+	reg_id_nr,
 };
 
-static struct cortex_cpu_regs cortex_powerpc_cpu_regs[] = {
-	{.name = "gpr0",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr1",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr2",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr3",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr4",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr5",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr6",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr7",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr8",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr9",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr10",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr11",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr12",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr13",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr14",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr15",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr16",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr17",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr18",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr19",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr20",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr21",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr22",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr23",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr24",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr25",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr26",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr27",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr28",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr29",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr30",.size = CORTEX_WORD_SIZE,},
-	{.name = "gpr31",.size = CORTEX_WORD_SIZE,},
-	{.name = "nip",.size = CORTEX_WORD_SIZE,},
-	{.name = "msr",.size = CORTEX_WORD_SIZE,},
-	{.name = "orig_gpr3",.size = CORTEX_WORD_SIZE,},
-	{.name = "ctr",.size = CORTEX_WORD_SIZE,},
-	{.name = "link",.size = CORTEX_WORD_SIZE,},
-	{.name = "xer",.size = CORTEX_WORD_SIZE,},
-	{.name = "ccr",.size = CORTEX_WORD_SIZE,},
-#ifdef CORTEX_WORD_SIZEINUX64
-	{.name = "softe",.size = CORTEX_WORD_SIZE,},
-#else
-	{.name = "mq",.size = CORTEX_WORD_SIZE,},
-#endif
-	{.name = "trap",.size = CORTEX_WORD_SIZE,},
-	{.name = "dar",.size = CORTEX_WORD_SIZE,},
-	{.name = "dsisr",.size = CORTEX_WORD_SIZE,},
-	{.name = "result",.size = CORTEX_WORD_SIZE,},
+/* mq is softe on 64 bit */
+#define reg_id_softe reg_id_mq
+
+#define CORTEX_POWERPC_NR_GREGS 48
+
+static const struct cortex_cpu_regs cortex_powerpc_cpu_regs[] = {
+	{.name = "gpr0",},
+	{.name = "gpr1",},
+	{.name = "gpr2",},
+	{.name = "gpr3",},
+	{.name = "gpr4",},
+	{.name = "gpr5",},
+	{.name = "gpr6",},
+	{.name = "gpr7",},
+	{.name = "gpr8",},
+	{.name = "gpr9",},
+	{.name = "gpr10",},
+	{.name = "gpr11",},
+	{.name = "gpr12",},
+	{.name = "gpr13",},
+	{.name = "gpr14",},
+	{.name = "gpr15",},
+	{.name = "gpr16",},
+	{.name = "gpr17",},
+	{.name = "gpr18",},
+	{.name = "gpr19",},
+	{.name = "gpr20",},
+	{.name = "gpr21",},
+	{.name = "gpr22",},
+	{.name = "gpr23",},
+	{.name = "gpr24",},
+	{.name = "gpr25",},
+	{.name = "gpr26",},
+	{.name = "gpr27",},
+	{.name = "gpr28",},
+	{.name = "gpr29",},
+	{.name = "gpr30",},
+	{.name = "gpr31",},
+	{.name = "nip",},
+	{.name = "msr",},
+	{.name = "orig_gpr3",},
+	{.name = "ctr",},
+	{.name = "link",},
+	{.name = "xer",},
+	{.name = "ccr",},
+	{.name = "mq",},
+	{.name = "trap",},
+	{.name = "dar",},
+	{.name = "dsisr",},
+	{.name = "result",},
 };
 
-static int cortex_powerpc_fill_regs(struct cortex_proc_info *info,
-				    struct pt_regs *pr_regs)
+static int cortex_powerpc_fill_regs(struct cortex_cpu_regs *cpu_regs,
+				    const ElfN_Addr *gregs, int word_size)
+{
+	int i;
+
+	memcpy(cpu_regs, cortex_powerpc_cpu_regs, sizeof(cortex_powerpc_cpu_regs));
+
+	for (i = 0; i < reg_id_nr; i++) {
+		cpu_regs[i].size = word_size;
+		cpu_regs[i].value = gregs[i];
+	}
+
+	if (word_size == 8)
+		strcpy(cpu_regs[reg_id_softe].name, "softe");
+
+	return reg_id_nr;
+}
+
+static int cortex_ppc32_fill_regs(struct cortex_cpu_regs *cpu_regs,
+				  const ElfN_Addr *gregs)
+{
+	return cortex_powerpc_fill_regs(cpu_regs, gregs, 4);
+}
+
+static int cortex_ppc64_fill_regs(struct cortex_cpu_regs *cpu_regs,
+				  const ElfN_Addr *gregs)
 {
-	info->cpu_regs = cortex_powerpc_cpu_regs;
-
-	info->cpu_regs[reg_id_gpr0].value = pr_regs->gpr[0];
-	info->cpu_regs[reg_id_gpr1].value = pr_regs->gpr[1];
-	info->cpu_regs[reg_id_gpr2].value = pr_regs->gpr[2];
-	info->cpu_regs[reg_id_gpr3].value = pr_regs->gpr[3];
-	info->cpu_regs[reg_id_gpr4].value = pr_regs->gpr[4];
-	info->cpu_regs[reg_id_gpr5].value = pr_regs->gpr[5];
-	info->cpu_regs[reg_id_gpr6].value = pr_regs->gpr[6];
-	info->cpu_regs[reg_id_gpr7].value = pr_regs->gpr[7];
-	info->cpu_regs[reg_id_gpr8].value = pr_regs->gpr[8];
-	info->cpu_regs[reg_id_gpr9].value = pr_regs->gpr[9];
-	info->cpu_regs[reg_id_gpr10].value = pr_regs->gpr[10];
-	info->cpu_regs[reg_id_gpr11].value = pr_regs->gpr[11];
-	info->cpu_regs[reg_id_gpr12].value = pr_regs->gpr[12];
-	info->cpu_regs[reg_id_gpr13].value = pr_regs->gpr[13];
-	info->cpu_regs[reg_id_gpr14].value = pr_regs->gpr[14];
-	info->cpu_regs[reg_id_gpr15].value = pr_regs->gpr[15];
-	info->cpu_regs[reg_id_gpr16].value = pr_regs->gpr[16];
-	info->cpu_regs[reg_id_gpr17].value = pr_regs->gpr[17];
-	info->cpu_regs[reg_id_gpr18].value = pr_regs->gpr[18];
-	info->cpu_regs[reg_id_gpr19].value = pr_regs->gpr[19];
-	info->cpu_regs[reg_id_gpr20].value = pr_regs->gpr[20];
-	info->cpu_regs[reg_id_gpr21].value = pr_regs->gpr[21];
-	info->cpu_regs[reg_id_gpr22].value = pr_regs->gpr[22];
-	info->cpu_regs[reg_id_gpr23].value = pr_regs->gpr[23];
-	info->cpu_regs[reg_id_gpr24].value = pr_regs->gpr[24];
-	info->cpu_regs[reg_id_gpr25].value = pr_regs->gpr[25];
-	info->cpu_regs[reg_id_gpr26].value = pr_regs->gpr[26];
-	info->cpu_regs[reg_id_gpr27].value = pr_regs->gpr[27];
-	info->cpu_regs[reg_id_gpr28].value = pr_regs->gpr[28];
-	info->cpu_regs[reg_id_gpr29].value = pr_regs->gpr[29];
-	info->cpu_regs[reg_id_gpr30].value = pr_regs->gpr[30];
-	info->cpu_regs[reg_id_gpr31].value = pr_regs->gpr[31];
-	info->cpu_regs[reg_id_nip].value = pr_regs->nip;
-	info->cpu_regs[reg_id_msr].value = pr_regs->msr;
-	info->cpu_regs[reg_id_orig_gpr3].value = pr_regs->orig_gpr3;
-	info->cpu_regs[reg_id_ctr].value = pr_regs->ctr;
-	info->cpu_regs[reg_id_link].value = pr_regs->link;
-	info->cpu_regs[reg_id_xer].value = pr_regs->xer;
-	info->cpu_regs[reg_id_ccr].value = pr_regs->ccr;
-#ifdef LINUX64
-	info->cpu_regs[reg_id_softe].value = pr_regs->softe;
-#else
-	info->cpu_regs[reg_id_mq].value = pr_regs->mq;
-#endif
-	info->cpu_regs[reg_id_trap].value = pr_regs->trap;
-	info->cpu_regs[reg_id_dar].value = pr_regs->dar;
-	info->cpu_regs[reg_id_dsisr].value = pr_regs->dsisr;
-	info->cpu_regs[reg_id_result].value = pr_regs->result;
-
-	return sizeof(cortex_powerpc_cpu_regs) / sizeof(struct cortex_cpu_regs);
+	return cortex_powerpc_fill_regs(cpu_regs, gregs, 8);
 }
 
-static long cortex_powerpc_get_pc(struct cortex_cpu_regs *cpu_regs)
+static uint64_t cortex_powerpc_get_pc(struct cortex_cpu_regs *cpu_regs)
 {
 	return cpu_regs[reg_id_nip].value;
 }
 
-static long cortex_powerpc_get_sp(struct cortex_cpu_regs *cpu_regs)
+static uint64_t cortex_powerpc_get_sp(struct cortex_cpu_regs *cpu_regs)
 {
 	return cpu_regs[reg_id_gpr1].value;
 }
 
-static int cortex_powerpc_get_word_size(void)
+static int cortex_powerpc_get_mdmp_cpu(void)
 {
-	return CORTEX_WORD_SIZE;
+	return MDMP_CPU_PPC;
 }
 
-struct cortex_arch_ops cortex_arch_ops = {
-	.fill_regs = cortex_powerpc_fill_regs,
+/* breakpad only knows about 32 bit powerpc */
+static long cortex_powerpc_fill_mdmp_context(const ElfN_Addr *gregs,
+					     void *context)
+{
+	struct mdmp_context_ppc *ctx = context;
+	int i = 0;
+
+	if (!ctx)
+		return sizeof(*ctx);
+
+	ctx->context_flags = MDMP_CONTEXT_PPC | MDMP_CONTEXT_CONTROL;
+	ctx->srr0 = gregs[reg_id_nip];
+	ctx->srr1 = gregs[reg_id_msr];
+	for (i = 0; i < 32; i++)
+		ctx->gpr[i] = gregs[reg_id_gpr0 + i];
+	ctx->cr = gregs[reg_id_ccr];
+	ctx->xer = gregs[reg_id_xer];
+	ctx->lr = gregs[reg_id_link];
+	ctx->ctr = gregs[reg_id_ctr];
+	ctx->mq = gregs[reg_id_mq];
+
+	return sizeof(*ctx);
+}
+
+const struct cortex_arch_ops cortex_ppc32_arch_ops = {
+	.name = "powerpc",
+	.machine = EM_PPC,
+	.elf_class = ELFCLASS32,
+	.word_size = 4,
+	.nr_gregs = CORTEX_POWERPC_NR_GREGS,
+	.uid_size = 4,
+
+	.fill_regs = cortex_ppc32_fill_regs,
 	.get_pc = cortex_powerpc_get_pc,
 	.get_sp = cortex_powerpc_get_sp,
-	.get_word_size = cortex_powerpc_get_word_size,
 
 	.unwind_init = NULL,
 	.unwind_next = NULL,
 	.unwind_exit = NULL,
+
+	.get_mdmp_cpu = cortex_powerpc_get_mdmp_cpu,
+	.fill_mdmp_context = cortex_powerpc_fill_mdmp_context,
+};
+
+const struct cortex_arch_ops cortex_ppc64_arch_ops = {
+	.name = "powerpc64",
+	.machine = EM_PPC64,
+	.elf_class = ELFCLASS64,
+	.word_size = 8,
+	.nr_gregs = CORTEX_POWERPC_NR_GREGS,
+	.uid_size = 4,
+
+	.fill_regs = cortex_ppc64_fill_regs,
+	.get_pc = cortex_powerpc_get_pc,
+	.get_sp = cortex_powerpc_get_sp,
 };
@@ -0,0 +1,362 @@
+/** \file cortex_x86.c
+ * \brief x86 FP, SSE, AVX and AVX-512 state, shared by i386 and x86_64
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cortex.h"
+#include "cortex_elf.h"
+#include "arch/cortex_x86.h"
+
+#ifndef NT_X86_XSAVE_LAYOUT
+#define NT_X86_XSAVE_LAYOUT	0x205
+#endif
+
+/*
+ * The FP and vector registers are kept as they lie in the core, least
+ * significant byte first: x86 is little endian.
+ */
+
+/* fxsave image: the legacy area of the xsave state */
+#define X86_FXSAVE_SIZE		512
+#define X86_FXSAVE_MXCSR	24
+#define X86_FXSAVE_ST		32
+#define X86_FXSAVE_XMM		160
+#define X86_FXSAVE_XCR0		464	/* in the software reserved bytes */
+
+/* struct user_i387_ia32_struct, NT_PRFPREG of old i386 kernels */
+#define X86_FSAVE_SIZE		108
+#define X86_FSAVE_ST		28
+
+/* the xsave header follows the legacy area */
+#define X86_XSTATE_BV		512
+
+enum cortex_x86_xfeature {
+	xfeature_ymm = 2,
+	xfeature_opmask = 5,
+	xfeature_zmm_hi256 = 6,
+	xfeature_hi16_zmm = 7,
+	xfeature_nr,
+};
+
+/* where a component lies in the standard (non compacted) format */
+struct cortex_x86_xcomp {
+	uint32_t offset;
+	uint32_t size;
+};
+
+/* offsets of the components on every CPU so far, used when the core
+   has no NT_X86_XSAVE_LAYOUT to tell them */
+static const struct cortex_x86_xcomp cortex_x86_xcomp_default[] = {
+	[xfeature_ymm] = {576, 256},
+	[xfeature_opmask] = {1088, 64},
+	[xfeature_zmm_hi256] = {1152, 512},
+	[xfeature_hi16_zmm] = {1664, 1024},
+};
+
+/* the state of a thread, and which components are usable */
+struct cortex_x86_xstate {
+	const unsigned char *desc;
+	size_t size;
+	uint64_t features;	/*!< enabled in XCR0 */
+	uint64_t xstate_bv;	/*!< not in their init state */
+	struct cortex_x86_xcomp comp[xfeature_nr];
+};
+
+static void cortex_x86_set(struct cortex_vreg *vreg, const char *name,
+			   int index, const unsigned char *raw, size_t size)
+{
+	if (index < 0)
+		snprintf(vreg->name, REG_NAME_SZ, "%s", name);
+	else
+		snprintf(vreg->name, REG_NAME_SZ, "%s%d", name, index);
+	vreg->size = size;
+	memset(vreg->value, 0, sizeof(vreg->value));
+	if (raw)
+		memcpy(vreg->value, raw, size);
+}
+
+static struct cortex_elf_note *cortex_x86_note(struct cortex_proc_info *info,
+					       uint32_t type, int thread,
+					       size_t min_size)
+{
+	struct cortex_elf_note *note = cortex_elf_find_note(info, type, thread);
+
+	return note && note->size >= min_size ? note : NULL;
+}
+
+/* x86 cores are little endian, the host may not be */
+static uint64_t cortex_x86_get(struct cortex_proc_info *info,
+			       const unsigned char *raw, size_t size)
+{
+	return cortex_elf_get(raw, size, info->elf->swap);
+}
+
+/* the fxsave image of a thread: the legacy area of its xsave state,
+   NT_PRXFPREG on i386 or NT_PRFPREG on x86_64 */
+static const unsigned char *cortex_x86_fxsave(struct cortex_proc_info *info,
+					      int thread)
+{
+	struct cortex_elf_note *note = NULL;
+
+	note = cortex_x86_note(info, NT_X86_XSTATE, thread, X86_FXSAVE_SIZE);
+	if (!note)
+		note = cortex_x86_note(info, NT_PRXFPREG, thread,
+				       X86_FXSAVE_SIZE);
+	if (!note && info->word_size == 8)
+		note = cortex_x86_note(info, NT_PRFPREG, thread,
+				       X86_FXSAVE_SIZE);
+
+	return note ? note->desc : NULL;
+}
+
+/* user_i387_ia32_struct: control words on 32 bits, packed st */
+static int cortex_x86_fill_fsave(const unsigned char *fsave,
+				 struct cortex_vreg *vregs)
+{
+	static const char *const names[] = {
+		"fcw", "fsw", "ftw", "fip", "fcs", "fdp", "fds",
+	};
+	int nr = 0;
+	int i = 0;
+
+	for (i = 0; i < 7; i++)
+		cortex_x86_set(&vregs[nr++], names[i], -1, fsave + 4 * i,
+			       i < 3 ? 2 : 4);
+
+	for (i = 0; i < 8; i++)
+		cortex_x86_set(&vregs[nr++], "st", i,
+			       fsave + X86_FSAVE_ST + 10 * i, 10);
+
+	return nr;
+}
+
+/** \brief x87 and SSE registers of a thread
+ * \param nr_xmm 8 on i386, 16 on x86_64
+ */
+int cortex_x86_fill_fp_regs(struct cortex_proc_info *info, int thread,
+			    struct cortex_vreg *vregs, int nr_xmm)
+{
+	const unsigned char *fx = cortex_x86_fxsave(info, thread);
+	struct cortex_elf_note *note = NULL;
+	int nr = 0;
+	int i = 0;
+
+	if (!fx) {
+		note = cortex_x86_note(info, NT_PRFPREG, thread,
+				       X86_FSAVE_SIZE);
+		return note ? cortex_x86_fill_fsave(note->desc, vregs) : 0;
+	}
+
+	cortex_x86_set(&vregs[nr++], "fcw", -1, fx, 2);
+	cortex_x86_set(&vregs[nr++], "fsw", -1, fx + 2, 2);
+	cortex_x86_set(&vregs[nr++], "ftw", -1, fx + 4, 1);
+	cortex_x86_set(&vregs[nr++], "fop", -1, fx + 6, 2);
+	if (info->word_size == 8) {
+		cortex_x86_set(&vregs[nr++], "fip", -1, fx + 8, 8);
+		cortex_x86_set(&vregs[nr++], "fdp", -1, fx + 16, 8);
+	} else {
+		cortex_x86_set(&vregs[nr++], "fip", -1, fx + 8, 4);
+		cortex_x86_set(&vregs[nr++], "fcs", -1, fx + 12, 2);
+		cortex_x86_set(&vregs[nr++], "fdp", -1, fx + 16, 4);
+		cortex_x86_set(&vregs[nr++], "fds", -1, fx + 20, 2);
+	}
+	cortex_x86_set(&vregs[nr++], "mxcsr", -1, fx + X86_FXSAVE_MXCSR, 4);
+
+	for (i = 0; i < 8; i++)
+		cortex_x86_set(&vregs[nr++], "st", i,
+			       fx + X86_FXSAVE_ST + 16 * i, 10);
+
+	for (i = 0; i < nr_xmm; i++)
+		cortex_x86_set(&vregs[nr++], "xmm", i,
+			       fx + X86_FXSAVE_XMM + 16 * i, 16);
+
+	return nr;
+}
+
+/* read the NT_X86_XSTATE of a thread, and the layout of its components */
+static int cortex_x86_load_xstate(struct cortex_proc_info *info, int thread,
+				  struct cortex_x86_xstate *xstate)
+{
+	struct cortex_elf_note *note = NULL;
+	size_t i = 0;
+
+	note = cortex_x86_note(info, NT_X86_XSTATE, thread, X86_XSTATE_BV + 8);
+	if (!note)
+		return -1;
+
+	xstate->desc = note->desc;
+	xstate->size = note->size;
+	xstate->xstate_bv = cortex_x86_get(info, note->desc + X86_XSTATE_BV, 8);
+
+	/* the kernel leaves XCR0 in the software reserved bytes */
+	xstate->features = cortex_x86_get(info, note->desc + X86_FXSAVE_XCR0, 8);
+	if (!xstate->features)
+		xstate->features = xstate->xstate_bv;
+
+	memcpy(xstate->comp, cortex_x86_xcomp_default,
+	       sizeof(cortex_x86_xcomp_default));
+
+	/* recent kernels tell the offsets: (type, size, offset, flags) */
+	note = cortex_elf_find_note(info, NT_X86_XSAVE_LAYOUT, -1);
+	for (i = 0; note && i + 16 <= note->size; i += 16) {
+		uint32_t type = cortex_x86_get(info, note->desc + i, 4);
+
+		if (type >= xfeature_nr || !cortex_x86_xcomp_default[type].size)
+			continue;
+		xstate->comp[type].size = cortex_x86_get(info,
+							 note->desc + i + 4, 4);
+		xstate->comp[type].offset = cortex_x86_get(info,
+							   note->desc + i + 8,
+							   4);
+	}
+
+	return 0;
+}
+
+/* a component of the state, NULL if it is not there. Components in
+   their init state are all zeros */
+static const unsigned char *cortex_x86_xcomp(struct cortex_x86_xstate *xstate,
+					     int feature, size_t size)
+{
+	static const unsigned char zeros[CORTEX_VREG_SIZE * 16];
+	const struct cortex_x86_xcomp *comp = &xstate->comp[feature];
+
+	if (!(xstate->features & (1ULL << feature)) || comp->size < size ||
+	    comp->offset > xstate->size || size > xstate->size - comp->offset)
+		return NULL;
+
+	if (!(xstate->xstate_bv & (1ULL << feature)))
+		return zeros;
+
+	return xstate->desc + comp->offset;
+}
+
+/** \brief AVX and AVX-512 registers of a thread
+ * \param nr_vec 8 on i386, 32 on x86_64
+ *
+ * The widest registers available are reported: zmm when AVX-512 is
+ * enabled, ymm otherwise, then the opmask registers.
+ */
+int cortex_x86_fill_vec_regs(struct cortex_proc_info *info, int thread,
+			     struct cortex_vreg *vregs, int nr_vec)
+{
+	struct cortex_x86_xstate xstate;
+	const unsigned char *ymmh = NULL;
+	const unsigned char *zmmh = NULL;
+	const unsigned char *hi16 = NULL;
+	const unsigned char *opmask = NULL;
+	int nr_low = nr_vec < 16 ? nr_vec : 16;
+	int nr = 0;
+	int i = 0;
+
+	memset(&xstate, 0, sizeof(xstate));
+	if (cortex_x86_load_xstate(info, thread, &xstate) < 0)
+		return 0;
+
+	ymmh = cortex_x86_xcomp(&xstate, xfeature_ymm, 16 * nr_low);
+	zmmh = cortex_x86_xcomp(&xstate, xfeature_zmm_hi256, 32 * nr_low);
+	if (nr_vec > 16)
+		hi16 = cortex_x86_xcomp(&xstate, xfeature_hi16_zmm,
+					64 * (nr_vec - 16));
+	opmask = cortex_x86_xcomp(&xstate, xfeature_opmask, 64);
+
+	for (i = 0; ymmh && i < nr_low; i++) {
+		struct cortex_vreg *vreg = &vregs[nr++];
+
+		/* xmm, then the upper halves of ymm and zmm */
+		cortex_x86_set(vreg, zmmh ? "zmm" : "ymm", i,
+			       xstate.desc + X86_FXSAVE_XMM + 16 * i, 16);
+		memcpy(vreg->value + 16, ymmh + 16 * i, 16);
+		vreg->size = 32;
+		if (zmmh) {
+			memcpy(vreg->value + 32, zmmh + 32 * i, 32);
+			vreg->size = 64;
+		}
+	}
+
+	for (i = 16; zmmh && hi16 && i < nr_vec; i++)
+		cortex_x86_set(&vregs[nr++], "zmm", i, hi16 + 64 * (i - 16), 64);
+
+	for (i = 0; opmask && i < 8; i++)
+		cortex_x86_set(&vregs[nr++], "k", i, opmask + 8 * i, 8);
+
+	return nr;
+}
+
+/** \brief tell whether a return address follows a call
+ * \return 1 if it does, 0 if it does not, -1 if the code is not in the core
+ *
+ * The forms of call are e8 rel32 and ff /2, with a register, a
+ * displacement or a sib byte: they end 2 to 7 bytes before pc.
+ */
+int cortex_x86_is_call_site(struct cortex_proc_info *info, ElfN_Addr pc)
+{
+	/* bytes back to the opcode and the modrm mod of each ff /2 form */
+	static const struct {
+		int back;
+		int mod;
+		int sib;
+	} forms[] = {
+		{2, 3, 0},	/* call *%reg */
+		{2, 0, 0},	/* call *(%reg) */
+		{3, 1, 0},	/* call *disp8(%reg) */
+		{3, 0, 1},	/* call *(%reg,%reg) */
+		{4, 1, 1},	/* call *disp8(%reg,%reg) */
+		{6, 2, 0},	/* call *disp32(%reg) */
+		{6, 0, 0},	/* call *disp32(%rip), rm = 5 */
+		{7, 2, 1},	/* call *disp32(%reg,%reg) */
+	};
+	const unsigned char *code;
+	unsigned char modrm;
+	size_t len;
+	size_t i;
+
+	if (pc < 7)
+		return 0;
+
+	code = cortex_elf_map(info, pc - 7, &len);
+	if (code == NULL || len < 7)
+		return -1;
+	code += 7;
+
+	if (code[-5] == 0xe8)
+		return 1;
+
+	for (i = 0; i < sizeof(forms) / sizeof(forms[0]); i++) {
+		if (code[-forms[i].back] != 0xff)
+			continue;
+
+		modrm = code[-forms[i].back + 1];
+		if ((modrm & 0x38) != 0x10 || (modrm >> 6) != forms[i].mod)
+			continue;
+		if (((modrm & 7) == 4) != forms[i].sib && forms[i].mod != 3)
+			continue;
+		if (forms[i].back == 6 && forms[i].mod == 0 && (modrm & 7) != 5)
+			continue;
+		if (forms[i].back == 2 && forms[i].mod == 0 &&
+		    ((modrm & 7) == 5 || (modrm & 7) == 4))
+			continue;
+
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,33 @@
+
+#ifndef _CORTEX_X86_H_
+#define _CORTEX_X86_H_
+
+/** \file cortex_x86.h
+ * \brief x86 FP and vector state
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "arch/cortex_arch.h"
+
+int cortex_x86_fill_fp_regs(struct cortex_proc_info *info, int thread,
+			    struct cortex_vreg *vregs, int nr_xmm);
+int cortex_x86_fill_vec_regs(struct cortex_proc_info *info, int thread,
+			     struct cortex_vreg *vregs, int nr_vec);
+int cortex_x86_is_call_site(struct cortex_proc_info *info, ElfN_Addr pc);
+
+#endif /* _CORTEX_X86_H_ */
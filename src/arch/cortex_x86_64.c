@@ -22,7 +22,41 @@
 #include <string.h>
 
 #include "cortex_elf.h"
+#include "cortex_mdmp.h"
 #include "arch/cortex_arch.h"
+#include "arch/cortex_x86.h"
+
+/* elf_gregset_t layout, struct user_regs_struct */
+enum cortex_greg_id {
+	greg_r15 = 0,
+	greg_r14,
+	greg_r13,
+	greg_r12,
+	greg_rbp,
+	greg_rbx,
+	greg_r11,
+	greg_r10,
+	greg_r9,
+	greg_r8,
+	greg_rax,
+	greg_rcx,
+	greg_rdx,
+	greg_rsi,
+	greg_rdi,
+	greg_orig_rax,
+	greg_rip,
+	greg_cs,
+	greg_eflags,
+	greg_rsp,
+	greg_ss,
+	greg_fs_base,
+	greg_gs_base,
+	greg_ds,
+	greg_es,
+	greg_fs,
+	greg_gs,
+	greg_nr,
+};
 
 enum cortex_reg_id {
 	reg_id_rax = 0,
@@ -48,7 +82,7 @@ enum cortex_reg_id {
 	reg_id_eflags,
 };
 
-static struct cortex_cpu_regs cortex_x86_64_cpu_regs[] = {
+static const struct cortex_cpu_regs cortex_x86_64_cpu_regs[] = {
 	{.name = "rax",.size = 8},
 	{.name = "rbx",.size = 8},
 	{.name = "rcx",.size = 8},
@@ -72,53 +106,55 @@ static struct cortex_cpu_regs cortex_x86_64_cpu_regs[] = {
 	{.name = "eflags",.size = 8},
 };
 
-static int cortex_x86_64_fill_regs(struct cortex_proc_info *info,
-				   struct pt_regs *pr_regs)
+static int cortex_x86_64_fill_regs(struct cortex_cpu_regs *cpu_regs,
+                                   const ElfN_Addr *gregs)
 {
-	info->cpu_regs = cortex_x86_64_cpu_regs;
-
-	info->cpu_regs[reg_id_rax].value = pr_regs->rax,
-	    info->cpu_regs[reg_id_rbx].value = pr_regs->rbx;
-	info->cpu_regs[reg_id_rcx].value = pr_regs->rcx;
-	info->cpu_regs[reg_id_rdx].value = pr_regs->rdx;
-	info->cpu_regs[reg_id_rbp].value = pr_regs->rbp;
-	info->cpu_regs[reg_id_rsp].value = pr_regs->rsp;
-	info->cpu_regs[reg_id_rsi].value = pr_regs->rsi;
-	info->cpu_regs[reg_id_rdi].value = pr_regs->rdi;
-	info->cpu_regs[reg_id_rip].value = pr_regs->rip;
-	info->cpu_regs[reg_id_r8].value = pr_regs->r8;
-	info->cpu_regs[reg_id_r9].value = pr_regs->r9;
-	info->cpu_regs[reg_id_r10].value = pr_regs->r10;
-	info->cpu_regs[reg_id_r11].value = pr_regs->r11;
-	info->cpu_regs[reg_id_r12].value = pr_regs->r12;
-	info->cpu_regs[reg_id_r13].value = pr_regs->r13;
-	info->cpu_regs[reg_id_r14].value = pr_regs->r14;
-	info->cpu_regs[reg_id_r15].value = pr_regs->r15;
-	info->cpu_regs[reg_id_cs].value = pr_regs->cs;
-	info->cpu_regs[reg_id_ss].value = pr_regs->ss;
-	info->cpu_regs[reg_id_orig_rax].value = pr_regs->orig_rax;
-	info->cpu_regs[reg_id_eflags].value = pr_regs->eflags;
+	memcpy(cpu_regs, cortex_x86_64_cpu_regs, sizeof(cortex_x86_64_cpu_regs));
+
+	cpu_regs[reg_id_rax].value = gregs[greg_rax];
+	cpu_regs[reg_id_rbx].value = gregs[greg_rbx];
+	cpu_regs[reg_id_rcx].value = gregs[greg_rcx];
+	cpu_regs[reg_id_rdx].value = gregs[greg_rdx];
+	cpu_regs[reg_id_rbp].value = gregs[greg_rbp];
+	cpu_regs[reg_id_rsp].value = gregs[greg_rsp];
+	cpu_regs[reg_id_rsi].value = gregs[greg_rsi];
+	cpu_regs[reg_id_rdi].value = gregs[greg_rdi];
+	cpu_regs[reg_id_rip].value = gregs[greg_rip];
+	cpu_regs[reg_id_r8].value = gregs[greg_r8];
+	cpu_regs[reg_id_r9].value = gregs[greg_r9];
+	cpu_regs[reg_id_r10].value = gregs[greg_r10];
+	cpu_regs[reg_id_r11].value = gregs[greg_r11];
+	cpu_regs[reg_id_r12].value = gregs[greg_r12];
+	cpu_regs[reg_id_r13].value = gregs[greg_r13];
+	cpu_regs[reg_id_r14].value = gregs[greg_r14];
+	cpu_regs[reg_id_r15].value = gregs[greg_r15];
+	cpu_regs[reg_id_cs].value = gregs[greg_cs];
+	cpu_regs[reg_id_ss].value = gregs[greg_ss];
+	cpu_regs[reg_id_orig_rax].value = gregs[greg_orig_rax];
+	cpu_regs[reg_id_eflags].value = gregs[greg_eflags];
 
 	return sizeof(cortex_x86_64_cpu_regs) / sizeof(struct cortex_cpu_regs);
 }
 
-static long cortex_x86_64_get_pc(struct cortex_cpu_regs *cpu_regs)
+static uint64_t cortex_x86_64_get_pc(struct cortex_cpu_regs *cpu_regs)
 {
 	return cpu_regs[reg_id_rip].value;
 }
 
-static long cortex_x86_64_get_sp(struct cortex_cpu_regs *cpu_regs)
+static uint64_t cortex_x86_64_get_sp(struct cortex_cpu_regs *cpu_regs)
 {
 	return cpu_regs[reg_id_rsp].value;
 }
 
 static void *cortex_x86_64_unwind_init(struct cortex_proc_info *info,
+				       int thread,
 				       struct cortex_stack_frame *frame)
 {
+	const ElfN_Addr *gregs = info->threads[thread].pr_reg;
 
-	frame->pc = info->cpu_regs[reg_id_rip].value;
-	frame->sp = info->cpu_regs[reg_id_rsp].value;
-	frame->bp = info->cpu_regs[reg_id_rbp].value;
+	frame->pc = gregs[greg_rip];
+	frame->sp = gregs[greg_rsp];
+	frame->bp = gregs[greg_rbp];
 
 	return NULL;
 }
@@ -132,13 +168,11 @@ static long cortex_x86_64_unwind_next(struct cortex_proc_info *info,
 	if (frame->bp == 0)
 		return 0;
 
-	next.pc =
-	    *(unsigned long *)(info->stack->d_buf + frame->bp -
-			       info->sp_segm->p_vaddr + info->word_size);
+	if (cortex_elf_read_word(info, frame->bp + info->word_size,
+				 &next.pc) < 0 ||
+	    cortex_elf_read_word(info, frame->bp, &next.bp) < 0)
+		return 0;
 	next.sp = frame->bp - info->word_size;
-	next.bp =
-	    *(unsigned long *)(info->stack->d_buf + frame->bp -
-			       info->sp_segm->p_vaddr);
 
 	memcpy(frame, &next, sizeof(struct cortex_stack_frame));
 
@@ -147,17 +181,76 @@ static long cortex_x86_64_unwind_next(struct cortex_proc_info *info,
 	return 1;
 }
 
-static int cortex_x86_64_get_word_size(void)
+static int cortex_x86_64_fill_fp_regs(struct cortex_proc_info *info,
+				      int thread, struct cortex_vreg *vregs)
+{
+	return cortex_x86_fill_fp_regs(info, thread, vregs, 16);
+}
+
+static int cortex_x86_64_fill_vec_regs(struct cortex_proc_info *info,
+				       int thread, struct cortex_vreg *vregs)
+{
+	return cortex_x86_fill_vec_regs(info, thread, vregs, 32);
+}
+
+static int cortex_x86_64_get_mdmp_cpu(void)
 {
-	return 8;
+	return MDMP_CPU_AMD64;
 }
 
-struct cortex_arch_ops cortex_arch_ops = {
+static long cortex_x86_64_fill_mdmp_context(const ElfN_Addr *gregs,
+					    void *context)
+{
+	struct mdmp_context_amd64 *ctx = context;
+
+	if (!ctx)
+		return sizeof(*ctx);
+
+	ctx->context_flags = MDMP_CONTEXT_AMD64 | MDMP_CONTEXT_CONTROL |
+	    MDMP_CONTEXT_INTEGER | MDMP_CONTEXT_SEGMENTS;
+	ctx->cs = gregs[greg_cs];
+	ctx->ss = gregs[greg_ss];
+	ctx->eflags = gregs[greg_eflags];
+	ctx->rax = gregs[greg_rax];
+	ctx->rcx = gregs[greg_rcx];
+	ctx->rdx = gregs[greg_rdx];
+	ctx->rbx = gregs[greg_rbx];
+	ctx->rsp = gregs[greg_rsp];
+	ctx->rbp = gregs[greg_rbp];
+	ctx->rsi = gregs[greg_rsi];
+	ctx->rdi = gregs[greg_rdi];
+	ctx->r8 = gregs[greg_r8];
+	ctx->r9 = gregs[greg_r9];
+	ctx->r10 = gregs[greg_r10];
+	ctx->r11 = gregs[greg_r11];
+	ctx->r12 = gregs[greg_r12];
+	ctx->r13 = gregs[greg_r13];
+	ctx->r14 = gregs[greg_r14];
+	ctx->r15 = gregs[greg_r15];
+	ctx->rip = gregs[greg_rip];
+
+	return sizeof(*ctx);
+}
+
+const struct cortex_arch_ops cortex_x86_64_arch_ops = {
+	.name = "x86_64",
+	.machine = EM_X86_64,
+	.elf_class = ELFCLASS64,
+	.word_size = 8,
+	.nr_gregs = greg_nr,
+	.uid_size = 4,
+
 	.fill_regs = cortex_x86_64_fill_regs,
 	.get_pc = cortex_x86_64_get_pc,
 	.get_sp = cortex_x86_64_get_sp,
-	.get_word_size = cortex_x86_64_get_word_size,
 
 	.unwind_init = cortex_x86_64_unwind_init,
+	.is_call_site = cortex_x86_is_call_site,
 	.unwind_next = cortex_x86_64_unwind_next,
+
+	.fill_fp_regs = cortex_x86_64_fill_fp_regs,
+	.fill_vec_regs = cortex_x86_64_fill_vec_regs,
+
+	.get_mdmp_cpu = cortex_x86_64_get_mdmp_cpu,
+	.fill_mdmp_context = cortex_x86_64_fill_mdmp_context,
 };
@@ -50,15 +50,14 @@
  * \subsection elf_specific ELF SPECIFIC FUNCTIONS
  * This section describe all architecture dependant functions.<br>
  * These functions are implemented for each arch in a file called cortex_<arch>.c<br>
- * when configuring cortex, the --host option is used to choose the targeted architecture.<br>
- * The struct cortex_arch_ops cortex_arch_ops variable contains pointer to all
- * those functions.
+ * all of them are built in, the one matching the machine and class of the core is
+ * picked by cortex_arch_find() when the core is read.<br>
+ * Each struct cortex_arch_ops contains pointer to all those functions.
  * list:
- * - \ref int fill_regs(struct cortex_proc_info *info, struct pt_regs *pr_regs)
- * - \ref long get_pc(struct cortex_cpu_regs *cpu_regs)
- * - \ref long get_sp(struct cortex_cpu_regs *cpu_regs)
- * - \ref int get_word_size(void)
- * - \ref void *unwind_init(struct cortex_proc_info *info, struct cortex_stack_frame *frame)
+ * - \ref int fill_regs(struct cortex_cpu_regs *cpu_regs, const ElfN_Addr *gregs)
+ * - \ref uint64_t get_pc(struct cortex_cpu_regs *cpu_regs)
+ * - \ref uint64_t get_sp(struct cortex_cpu_regs *cpu_regs)
+ * - \ref void *unwind_init(struct cortex_proc_info *info, int thread, struct cortex_stack_frame *frame)
  * - \ref long unwind_next(struct cortex_proc_info *info, struct cortex_stack_frame *frame, void *data)
  * - \ref void unwind_exit(struct cortex_proc_info *info, void *data)
  */
@@ -72,10 +71,88 @@
 #define CORTEX_OUTPUT_FMT_CAL		0x0010
 #define CORTEX_OUTPUT_FMT_AUX		0x0020
 #define CORTEX_OUTPUT_FMT_STA		0x0040
-#define CORTEX_OUTPUT_FMT_ALL		0x007E
+#define CORTEX_OUTPUT_FMT_SYS		0x0080
+#define CORTEX_OUTPUT_FMT_FPR		0x1000
+#define CORTEX_OUTPUT_FMT_VEC		0x2000
+#define CORTEX_OUTPUT_FMT_MEM		0x4000
+#define CORTEX_OUTPUT_FMT_THR		0x8000
+#define CORTEX_OUTPUT_FMT_DIG		0x10000
+#define CORTEX_OUTPUT_FMT_ALL		0x307E
 #define CORTEX_OUTPUT_FMT_DEF		0x001E
 #define CORTEX_OUTPUT_FMT_BIN		0x0001
+#define CORTEX_OUTPUT_FMT_JSN		0x0100
+#define CORTEX_OUTPUT_FMT_MIN		0x0200
+#define CORTEX_OUTPUT_FMT_MDP		0x0400
+#define CORTEX_OUTPUT_FMT_PRC		0x0800
 #define CORTEX_OUTPUT_FMT_TXT		0x0000
+#define CORTEX_OUTPUT_FMT_NOTE		(CORTEX_OUTPUT_FMT_GEN | CORTEX_OUTPUT_FMT_REG | \
+					 CORTEX_OUTPUT_FMT_AUX | CORTEX_OUTPUT_FMT_FPR | \
+					 CORTEX_OUTPUT_FMT_VEC)
+#define CORTEX_OUTPUT_FMT_KIND		(CORTEX_OUTPUT_FMT_BIN | CORTEX_OUTPUT_FMT_JSN | \
+					 CORTEX_OUTPUT_FMT_MIN | CORTEX_OUTPUT_FMT_MDP)
+
+/* memory windows kept around each thread context */
+#define CORTEX_WINDOW_STACK		(64 * 1024)
+#define CORTEX_WINDOW_REDZONE		128
+#define CORTEX_WINDOW_CODE		256
+#define CORTEX_WINDOW_DATA		64
+#define CORTEX_WINDOW_MODULE		1024
+
+/** \brief room for the elf_gregset_t of any architecture */
+#define CORTEX_GREGS_MAX		48
+
+struct cortex_timeval {
+	long tv_sec;
+	long tv_usec;
+};
+
+/** \struct cortex_prstatus
+ ** \brief NT_PRSTATUS, decoded from the layout of the core
+ */
+struct cortex_prstatus {
+	int pr_cursig;		/*!< current signal */
+	int pr_pid;
+	int pr_ppid;
+	int pr_pgrp;
+	int pr_sid;
+	struct cortex_timeval pr_utime;	/*!< user time */
+	struct cortex_timeval pr_stime;	/*!< system time */
+	struct cortex_timeval pr_cutime;	/*!< cumulative user time */
+	struct cortex_timeval pr_cstime;	/*!< cumulative system time */
+	ElfN_Addr pr_reg[CORTEX_GREGS_MAX];	/*!< elf_gregset_t */
+};
+
+/** \struct cortex_prpsinfo
+ ** \brief NT_PRPSINFO, decoded from the layout of the core
+ */
+struct cortex_prpsinfo {
+	char pr_state;		/*!< numeric process state */
+	char pr_sname;		/*!< char for pr_state */
+	char pr_zomb;		/*!< zombie */
+	char pr_nice;		/*!< nice val */
+	unsigned long pr_flag;	/*!< flags */
+	unsigned int pr_uid;
+	unsigned int pr_gid;
+	int pr_pid;
+	int pr_ppid;
+	int pr_pgrp;
+	int pr_sid;
+	char pr_fname[16];	/*!< filename of executable */
+	char pr_psargs[80];	/*!< initial part of arg list */
+};
+
+/** \struct cortex_siginfo
+ ** \brief NT_SIGINFO, the signal that killed the process
+ */
+struct cortex_siginfo {
+	int signo;		/*!< si_signo, as numbered on the core machine */
+	int errnum;		/*!< si_errno */
+	int code;		/*!< si_code, origin of the signal */
+	int fault;		/*!< SIGILL, SIGTRAP, SIGFPE, SIGSEGV or SIGBUS
+				   as numbered on the host, 0 otherwise */
+	ElfN_Addr addr;		/*!< si_addr, if fault and the kernel raised
+				   it (code > 0) */
+};
 
 /** \struct cortex_proc_info
  ** \brief generic process info
@@ -93,6 +170,8 @@ struct cortex_proc_info {
 
 	ElfN_Phdr *note_segm;	/*!< note segment */
 	struct cortex_elf_data *note;	/*!< note segment data */
+	int nr_notes;		/*!< number of notes in the index */
+	struct cortex_elf_note *notes;	/*!< every note, in the core order */
 
 	ElfN_Addr pc;		/*!< instruction pointer */
 	ElfN_Phdr *pc_segm;	/*!< code segment */
@@ -102,12 +181,38 @@ struct cortex_proc_info {
 	ElfN_Phdr *sp_segm;	/*!< stack segment */
 	struct cortex_elf_data *stack;	/*!< stack segment data */
 
-	ElfN_auxv_t *auxv;	/*!< mapping of auxv table structure */
-	struct elf_prpsinfo *info;	/*!< mapping of generic elf info structure */
-	struct elf_prstatus **threads;	/*!< mapping of all thread elf infos */
+	const struct cortex_arch_ops *arch;	/*!< backend of the core */
+
+	ElfN_auxv_t *auxv;	/*!< auxv table, AT_NULL terminated */
+	unsigned char *auxv_raw;	/*!< auxv note as found in the core */
+	size_t auxv_size;	/*!< size of auxv_raw */
+	struct cortex_prpsinfo *info;	/*!< generic elf info structure */
+	struct cortex_prstatus *threads;	/*!< all thread elf infos */
+	struct cortex_siginfo *siginfo;	/*!< NULL if the core has none */
 
 	long cpu_regs_nr;	/*!< cpu registers numbers */
 	struct cortex_cpu_regs *cpu_regs;	/*!< cpu registers (arch dependent) */
+
+	struct cortex_unwind *unwind;	/*!< call trace of each thread, NULL if
+					   the backend cannot unwind */
+	int nr_groups;		/*!< number of distinct call traces */
+	struct cortex_unwind_group *groups;	/*!< threads grouped by call
+						   trace, largest group first */
+
+	int nr_files;		/*!< number of file mappings */
+	struct cortex_elf_file *files;	/*!< file mappings from NT_FILE */
+
+	int nr_regions;		/*!< number of memory windows */
+	struct cortex_elf_region *regions;	/*!< memory windows, sorted by address */
+	struct cortex_fetch *fetch;	/*!< files the code is read from, if
+					   the core does not hold it */
+
+	struct cortex_sys *sys;	/*!< system context, if collected */
+	struct cortex_stream *stream;	/*!< stream analyzers, if run */
+
+	ElfN_Phdr pc_window;	/*!< code window used when the code segment
+				   does not fit in the memory budget */
+	ElfN_Phdr sp_window;	/*!< same for the stack segment */
 };
 
 struct cortex_stack_frame {
@@ -116,6 +221,47 @@ struct cortex_stack_frame {
 	ElfN_Addr bp;
 };
 
+/** \enum cortex_unwind_stop
+ ** \brief why the unwinding of a thread stopped
+ */
+enum cortex_unwind_stop {
+	CORTEX_UNWIND_END = 0,	/*!< outermost frame reached */
+	CORTEX_UNWIND_MAX,	/*!< STACK_FRAME_MAX frames unwound */
+	CORTEX_UNWIND_LOOP,	/*!< frame pointer going backward */
+	CORTEX_UNWIND_DEADLINE,	/*!< analysis deadline expired */
+	CORTEX_UNWIND_SCANNED,	/*!< end of the stack window scanned */
+};
+
+/** \enum cortex_unwind_scan
+ ** \brief stack scanning, when the frame pointers lead nowhere
+ */
+enum cortex_unwind_scan {
+	CORTEX_UNWIND_SCAN_NONE = 0,	/*!< frame pointers only */
+	CORTEX_UNWIND_SCAN_ALL,	/*!< every word pointing to code */
+	CORTEX_UNWIND_SCAN_CALLS,	/*!< only those following a call
+					   instruction are kept */
+};
+
+/** \struct cortex_unwind
+ ** \brief the call trace of a thread, unwound once for all the outputs
+ */
+struct cortex_unwind {
+	int nr_frames;		/*!< entries in frames, at least 1 */
+	int nr_walked;		/*!< frames found by the backend, the
+				   following ones were scanned */
+	int stop;		/*!< enum cortex_unwind_stop */
+	struct cortex_stack_frame *frames;	/*!< innermost frame first */
+};
+
+/** \struct cortex_unwind_group
+ ** \brief the threads sharing a call trace
+ */
+struct cortex_unwind_group {
+	int thread;		/*!< first of them in info->threads */
+	int nr_threads;		/*!< entries in tids */
+	int *tids;		/*!< their tids, sorted */
+};
+
 int cortex_elf_perform_check(struct cortex_elf *core);
 
 void cortex_elf_release_core(struct cortex_elf *core);
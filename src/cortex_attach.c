@@ -0,0 +1,1080 @@
+/** \file cortex_attach.c
+ * \brief cortex live process snapshot
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/procfs.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include "cortex.h"
+#include "cortex_elf.h"
+#include "cortex_mem.h"
+#include "cortex_stats.h"
+#include "cortex_attach.h"
+#include "arch/cortex_arch.h"
+
+/*
+ * A snapshot of a running process, for the services that hang rather
+ * than crash. All its threads are stopped with PTRACE_SEIZE and
+ * PTRACE_INTERRUPT, their registers are read with PTRACE_GETREGSET and
+ * the memory windows cortex keeps from a core (stacks, code around the
+ * instruction pointers, memory around the registers of the first
+ * thread, headers of the mapped files) with process_vm_readv. The
+ * threads are then let go, before anything else is done.
+ *
+ * What was read is laid out as an ELF core in a memory file: the notes
+ * the kernel would write, and a PT_LOAD for each mapping, holding data
+ * only where a window lies. The core is then parsed and reported as any
+ * other, so that a snapshot and a crash give the same report.
+ *
+ * Only the processes of the cortex architecture and class can be
+ * attached: the registers come in the layout of the host.
+ *
+ * Like the analysis that follows, the snapshot works in the memory
+ * arena of the caller: a process stopped by cortex does not wait for
+ * malloc.
+ */
+
+#ifndef NT_PRFPREG
+#define NT_PRFPREG		2
+#endif
+
+/* room for the regsets, the XSAVE area of AVX-512 included */
+#define CORTEX_ATTACH_REGSET	16384
+
+#define CORTEX_ATTACH_ALIGN(x, a)	(((x) + (a) - 1) & ~((size_t)(a) - 1))
+
+/** \struct cortex_attach_window
+ ** \brief memory to read from the process
+ */
+struct cortex_attach_window {
+	unsigned long start;
+	unsigned long end;
+	int vma;		/*!< mapping it lies in */
+	size_t offset;		/*!< where it goes in the core */
+	int failed;		/*!< could not be read */
+};
+
+/** \struct cortex_attach_thread
+ ** \brief a thread, stopped
+ */
+struct cortex_attach_thread {
+	int tid;
+	int stopped;		/*!< in a ptrace stop, to be detached */
+	int signal;		/*!< signal to give back on detach */
+	size_t prstatus;	/*!< offset of its NT_PRSTATUS in the notes */
+};
+
+/** \struct cortex_attach_threads
+ ** \brief the threads of a process, stopped together
+ */
+struct cortex_attach_threads {
+	int pid;		/*!< the process */
+	int nr_threads;		/*!< threads stopped */
+	int alloc;		/*!< room in threads */
+	struct cortex_attach_thread *threads;
+};
+
+/** \struct cortex_attach
+ ** \brief one snapshot
+ */
+struct cortex_attach {
+	int pid;
+	const struct cortex_arch_ops *arch;
+	size_t page_size;
+
+	struct cortex_attach_threads stopped;
+
+	struct cortex_attach_maps maps;
+
+	int nr_windows;
+	struct cortex_attach_window *windows;
+
+	unsigned char *notes;	/*!< the PT_NOTE segment */
+	size_t notes_size;
+	size_t notes_alloc;
+
+	struct elf_prpsinfo psinfo;
+};
+
+/* make room for alloc bytes of notes */
+static int cortex_attach_grow_notes(struct cortex_attach *attach,
+				    size_t alloc)
+{
+	unsigned char *notes;
+
+	if (alloc <= attach->notes_alloc)
+		return 0;
+
+	notes = cortex_mem_realloc(attach->notes, alloc);
+	if (notes == NULL) {
+		fprintf(stderr, "%s: out of memory\n", __FILE__);
+		return -1;
+	}
+	attach->notes = notes;
+	attach->notes_alloc = alloc;
+
+	return 0;
+}
+
+/* append a note, return the offset of its desc in the notes */
+static int cortex_attach_note(struct cortex_attach *attach, const char *name,
+			      int type, const void *desc, size_t size)
+{
+	size_t namesz = strlen(name) + 1;
+	size_t len = sizeof(Elf32_Nhdr) + CORTEX_ATTACH_ALIGN(namesz, 4) +
+	    CORTEX_ATTACH_ALIGN(size, 4);
+	Elf32_Nhdr nhdr;
+	unsigned char *note;
+
+	if (attach->notes_size + len > attach->notes_alloc &&
+	    cortex_attach_grow_notes(attach, attach->notes_alloc * 2 + len) < 0)
+		return -1;
+
+	note = attach->notes + attach->notes_size;
+	memset(note, 0, len);
+
+	nhdr.n_namesz = namesz;
+	nhdr.n_descsz = size;
+	nhdr.n_type = type;
+	memcpy(note, &nhdr, sizeof(nhdr));
+	memcpy(note + sizeof(nhdr), name, namesz);
+	memcpy(note + sizeof(nhdr) + CORTEX_ATTACH_ALIGN(namesz, 4), desc, size);
+
+	attach->notes_size += len;
+
+	return note - attach->notes + sizeof(nhdr) +
+	    CORTEX_ATTACH_ALIGN(namesz, 4);
+}
+
+/* the whole of a /proc file, NUL terminated */
+static char *cortex_attach_read_file(const char *path, size_t *size)
+{
+	size_t alloc = 4096;
+	size_t len = 0;
+	char *buf = cortex_mem_alloc(alloc);
+	ssize_t count;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || buf == NULL) {
+		if (fd >= 0)
+			close(fd);
+		cortex_mem_free(buf);
+		return NULL;
+	}
+
+	while ((count = read(fd, buf + len, alloc - len - 1)) > 0) {
+		len += count;
+		if (len + 1 == alloc) {
+			char *grown = cortex_mem_realloc(buf, alloc * 2);
+
+			if (grown == NULL)
+				break;
+			buf = grown;
+			alloc *= 2;
+		}
+	}
+	close(fd);
+
+	buf[len] = '\0';
+	if (size)
+		*size = len;
+
+	return buf;
+}
+
+/* a copy of str */
+static char *cortex_attach_strdup(const char *str)
+{
+	size_t size = strlen(str) + 1;
+	char *copy = cortex_mem_alloc(size);
+
+	if (copy)
+		memcpy(copy, str, size);
+
+	return copy;
+}
+
+/* the fields of a stat file after the command name */
+static char *cortex_attach_stat(int pid, int tid, char *buf, size_t size)
+{
+	char path[64];
+	char *stat, *fields;
+
+	snprintf(path, sizeof(path), "/proc/%d/task/%d/stat", pid, tid);
+	stat = cortex_attach_read_file(path, NULL);
+	if (stat == NULL)
+		return NULL;
+
+	fields = strrchr(stat, ')');
+	snprintf(buf, size, "%s", fields ? fields + 2 : "");
+	cortex_mem_free(stat);
+
+	return buf;
+}
+
+/** \brief the backend of a running process
+ * \return its operations, NULL if it is not of the cortex architecture,
+ * class and byte order: the registers of ptrace come in the layout of
+ * the host
+ */
+const struct cortex_arch_ops *cortex_attach_arch(int pid)
+{
+	const struct cortex_arch_ops *arch;
+	unsigned char ident[sizeof(Elf64_Ehdr)];
+	char path[64];
+	uint16_t machine;
+	int fd;
+
+	snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || read(fd, ident, sizeof(ident)) < (ssize_t)
+	    sizeof(Elf32_Ehdr)) {
+		perror(path);
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+	close(fd);
+
+	memcpy(&machine, ident + offsetof(Elf64_Ehdr, e_machine),
+	       sizeof(machine));
+	arch = cortex_arch_find(machine, ident[EI_CLASS]);
+
+	if (memcmp(ident, ELFMAG, SELFMAG) != 0 || arch == NULL ||
+	    ident[EI_DATA] != CORTEX_ELF_HOST_DATA ||
+	    arch->word_size != sizeof(long)) {
+		fprintf(stderr, "%d: only processes of the cortex architecture "
+			"can be attached\n", pid);
+		return NULL;
+	}
+
+	return arch;
+}
+
+/** \brief read the mappings of a process
+ * \param maps filled with them, in address order
+ * \return 0 on success, -1 on error
+ */
+int cortex_attach_read_maps(int pid, struct cortex_attach_maps *maps)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	struct cortex_attach_vma *vma;
+	char *buf;
+	char path[64];
+	char *line, *next;
+	char perms[5];
+	unsigned long inode;
+	int len;
+
+	snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+	buf = cortex_attach_read_file(path, NULL);
+	if (buf == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	for (line = buf; *line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+
+		if ((maps->nr_vmas & (maps->nr_vmas - 1)) == 0) {
+			vma = cortex_mem_realloc(maps->vmas,
+						 (maps->nr_vmas * 2 + 1) *
+						 sizeof(*vma));
+			if (vma == NULL)
+				goto out_err;
+			maps->vmas = vma;
+		}
+
+		vma = &maps->vmas[maps->nr_vmas];
+		memset(vma, 0, sizeof(*vma));
+		len = 0;
+		if (sscanf(line, "%lx-%lx %4s %lx %*s %lu %n", &vma->start,
+			   &vma->end, perms, &vma->pgoff, &inode, &len) != 5)
+			continue;
+
+		vma->pgoff /= page_size;
+		vma->flags = (perms[0] == 'r' ? PF_R : 0) |
+		    (perms[1] == 'w' ? PF_W : 0) | (perms[2] == 'x' ? PF_X : 0);
+		vma->file = inode != 0 && line[len] == '/';
+		if (line[len]) {
+			vma->name = cortex_attach_strdup(line + len);
+			if (vma->name == NULL)
+				goto out_err;
+		}
+		maps->nr_vmas++;
+	}
+
+	cortex_mem_free(buf);
+	return 0;
+
+out_err:
+	cortex_mem_free(buf);
+	fprintf(stderr, "%s: out of memory\n", __FILE__);
+	return -1;
+}
+
+void cortex_attach_free_maps(struct cortex_attach_maps *maps)
+{
+	int i;
+
+	for (i = 0; i < maps->nr_vmas; i++)
+		cortex_mem_free(maps->vmas[i].name);
+	cortex_mem_free(maps->vmas);
+	maps->vmas = NULL;
+	maps->nr_vmas = 0;
+}
+
+/** \brief the mapping holding addr, -1 if there is none */
+int cortex_attach_find_vma(const struct cortex_attach_maps *maps,
+			   unsigned long addr)
+{
+	int lo = 0;
+	int hi = maps->nr_vmas - 1;
+
+	while (lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (addr < maps->vmas[mid].start)
+			hi = mid - 1;
+		else if (addr >= maps->vmas[mid].end)
+			lo = mid + 1;
+		else
+			return mid;
+	}
+
+	return -1;
+}
+
+/* the window around anchor, within its mapping */
+static int cortex_attach_add_window(struct cortex_attach *attach,
+				    unsigned long anchor, unsigned long before,
+				    unsigned long after)
+{
+	struct cortex_attach_window *win;
+	struct cortex_attach_vma *vma;
+	int i = cortex_attach_find_vma(&attach->maps, anchor);
+
+	if (i < 0 || !(attach->maps.vmas[i].flags & PF_R))
+		return 0;
+	vma = &attach->maps.vmas[i];
+
+	if ((attach->nr_windows & (attach->nr_windows - 1)) == 0) {
+		win = cortex_mem_realloc(attach->windows,
+					 (attach->nr_windows * 2 + 1) *
+					 sizeof(*win));
+		if (win == NULL) {
+			fprintf(stderr, "%s: out of memory\n", __FILE__);
+			return -1;
+		}
+		attach->windows = win;
+	}
+
+	win = &attach->windows[attach->nr_windows++];
+	memset(win, 0, sizeof(*win));
+	win->vma = i;
+	win->start = anchor - vma->start > before ? anchor - before :
+	    vma->start;
+	win->end = vma->end - anchor > after ? anchor + after : vma->end;
+
+	return 0;
+}
+
+static int cortex_attach_window_cmp(const void *a, const void *b)
+{
+	const struct cortex_attach_window *wa = a;
+	const struct cortex_attach_window *wb = b;
+
+	if (wa->start < wb->start)
+		return -1;
+	return wa->start > wb->start;
+}
+
+static void cortex_attach_merge_windows(struct cortex_attach *attach)
+{
+	struct cortex_attach_window *windows = attach->windows;
+	int nr = 0;
+	int i;
+
+	if (attach->nr_windows == 0)
+		return;
+
+	qsort(windows, attach->nr_windows, sizeof(*windows),
+	      cortex_attach_window_cmp);
+
+	for (i = 1; i < attach->nr_windows; i++) {
+		if (windows[i].vma == windows[nr].vma &&
+		    windows[i].start <= windows[nr].end) {
+			if (windows[i].end > windows[nr].end)
+				windows[nr].end = windows[i].end;
+		} else {
+			windows[++nr] = windows[i];
+		}
+	}
+
+	attach->nr_windows = nr + 1;
+}
+
+/* let a stopped thread run again */
+static void cortex_attach_resume_thread(struct cortex_attach_threads *set, int i)
+{
+	if (!set->threads[i].stopped)
+		return;
+
+	ptrace(PTRACE_DETACH, set->threads[i].tid, 0, set->threads[i].signal);
+	set->threads[i].stopped = 0;
+}
+
+/* and all of them */
+static void cortex_attach_resume(struct cortex_attach_threads *set)
+{
+	int i;
+
+	for (i = 0; i < set->nr_threads; i++)
+		cortex_attach_resume_thread(set, i);
+}
+
+static int cortex_attach_tid_cmp(const void *a, const void *b)
+{
+	const struct cortex_attach_thread *ta = a;
+	const struct cortex_attach_thread *tb = b;
+
+	return ta->tid - tb->tid;
+}
+
+/* stop every thread, those started meanwhile included. The threads of
+   a /proc listing are all interrupted before they are waited for: they
+   stop together rather than one after the other */
+static int cortex_attach_stop(struct cortex_attach_threads *set)
+{
+	struct cortex_attach_thread *thread;
+	struct cortex_attach_thread key;
+	struct dirent *entry;
+	char path[64];
+	int first = -1;
+	int status;
+	DIR *tasks;
+	int tid, i;
+
+	snprintf(path, sizeof(path), "/proc/%d/task", set->pid);
+	set->nr_threads = 0;
+
+	while (first < set->nr_threads) {
+		first = set->nr_threads;
+
+		tasks = opendir(path);
+		if (tasks == NULL) {
+			perror(path);
+			return -1;
+		}
+
+		while ((entry = readdir(tasks))) {
+			key.tid = atoi(entry->d_name);
+			if (key.tid <= 0)
+				continue;
+
+			/* the previous listings are sorted */
+			if (first && bsearch(&key, set->threads, first,
+					     sizeof(key), cortex_attach_tid_cmp))
+				continue;
+
+			if (set->nr_threads == set->alloc) {
+				thread = cortex_mem_realloc(set->threads,
+					(set->alloc * 2 + 16) *
+					sizeof(*thread));
+				if (thread == NULL) {
+					fprintf(stderr, "%s: out of memory\n",
+						__FILE__);
+					closedir(tasks);
+					return -1;
+				}
+				set->threads = thread;
+				set->alloc = set->alloc * 2 + 16;
+			}
+
+			if (ptrace(PTRACE_SEIZE, key.tid, 0, 0) < 0) {
+				/* gone already */
+				if (errno == ESRCH)
+					continue;
+				fprintf(stderr, "%d: cannot attach: %s\n",
+					key.tid, strerror(errno));
+				closedir(tasks);
+				cortex_attach_resume(set);
+				return -1;
+			}
+			ptrace(PTRACE_INTERRUPT, key.tid, 0, 0);
+
+			thread = &set->threads[set->nr_threads++];
+			memset(thread, 0, sizeof(*thread));
+			thread->tid = key.tid;
+		}
+
+		closedir(tasks);
+
+		for (i = first; i < set->nr_threads; i++) {
+			thread = &set->threads[i];
+
+			/* exited meanwhile: not stopped, not detached */
+			if (waitpid(thread->tid, &status, __WALL) < 0 ||
+			    !WIFSTOPPED(status))
+				continue;
+			thread->stopped = 1;
+
+			/* a signal came first: give it back on detach */
+			if (status >> 16 != PTRACE_EVENT_STOP)
+				thread->signal = WSTOPSIG(status);
+		}
+
+		qsort(set->threads, set->nr_threads, sizeof(*thread),
+		      cortex_attach_tid_cmp);
+	}
+
+	/* drop the threads that exited */
+	for (i = 0, tid = 0; i < set->nr_threads; i++)
+		if (set->threads[i].stopped)
+			set->threads[tid++] = set->threads[i];
+	set->nr_threads = tid;
+
+	return set->nr_threads ? 0 : -1;
+}
+
+static void cortex_attach_ticks(struct timeval *tv, unsigned long ticks)
+{
+	long hz = sysconf(_SC_CLK_TCK);
+
+	tv->tv_sec = ticks / hz;
+	tv->tv_usec = (ticks % hz) * 1000000 / hz;
+}
+
+/* NT_PRSTATUS and the other regsets of a thread, and its windows */
+static int cortex_attach_thread(struct cortex_attach *attach, int t)
+{
+	struct cortex_cpu_regs cpu_regs[CORTEX_CPU_REGS_MAX];
+	ElfN_Addr gregs[CORTEX_GREGS_MAX];
+	struct elf_prstatus prstatus;
+	unsigned char regset[CORTEX_ATTACH_REGSET];
+	struct iovec iov;
+	int tid = attach->stopped.threads[t].tid;
+	long nr_regs;
+	int ret, i;
+
+	memset(&prstatus, 0, sizeof(prstatus));
+
+	iov.iov_base = &prstatus.pr_reg;
+	iov.iov_len = sizeof(prstatus.pr_reg);
+	if (ptrace(PTRACE_GETREGSET, tid, NT_PRSTATUS, &iov) < 0) {
+		fprintf(stderr, "%d: cannot read registers: %s\n", tid,
+			strerror(errno));
+		return -1;
+	}
+
+	/* the thread is stopped by us, not by a signal: none is reported
+	   unless one was pending */
+	prstatus.pr_cursig = attach->stopped.threads[t].signal;
+	prstatus.pr_info.si_signo = prstatus.pr_cursig;
+	prstatus.pr_pid = tid;
+	prstatus.pr_ppid = attach->psinfo.pr_ppid;
+	prstatus.pr_pgrp = attach->psinfo.pr_pgrp;
+	prstatus.pr_sid = attach->psinfo.pr_sid;
+
+	ret = cortex_attach_note(attach, "CORE", NT_PRSTATUS, &prstatus,
+				 sizeof(prstatus));
+	if (ret < 0)
+		return -1;
+	attach->stopped.threads[t].prstatus = ret;
+
+	/* the process wide notes follow the first thread, as in a core */
+	if (t == 0) {
+		char path[64];
+		char *auxv;
+		size_t size;
+
+		if (cortex_attach_note(attach, "CORE", NT_PRPSINFO,
+				       &attach->psinfo,
+				       sizeof(attach->psinfo)) < 0)
+			return -1;
+
+		snprintf(path, sizeof(path), "/proc/%d/auxv", attach->pid);
+		auxv = cortex_attach_read_file(path, &size);
+		if (auxv && cortex_attach_note(attach, "CORE", NT_AUXV, auxv,
+					       size) < 0) {
+			cortex_mem_free(auxv);
+			return -1;
+		}
+		cortex_mem_free(auxv);
+	}
+
+	iov.iov_base = regset;
+	iov.iov_len = sizeof(regset);
+	if (ptrace(PTRACE_GETREGSET, tid, NT_PRFPREG, &iov) == 0 &&
+	    cortex_attach_note(attach, "CORE", NT_PRFPREG, regset,
+			       iov.iov_len) < 0)
+		return -1;
+
+#ifdef NT_X86_XSTATE
+	iov.iov_base = regset;
+	iov.iov_len = sizeof(regset);
+	if (ptrace(PTRACE_GETREGSET, tid, NT_X86_XSTATE, &iov) == 0 &&
+	    cortex_attach_note(attach, "LINUX", NT_X86_XSTATE, regset,
+			       iov.iov_len) < 0)
+		return -1;
+#endif
+
+	/* the same windows as cortex_elf_plan_windows() */
+	for (i = 0; i < attach->arch->nr_gregs; i++)
+		gregs[i] = ((unsigned long *)&prstatus.pr_reg)[i];
+	nr_regs = attach->arch->fill_regs(cpu_regs, gregs);
+
+	if (cortex_attach_add_window(attach, attach->arch->get_sp(cpu_regs),
+				     CORTEX_WINDOW_REDZONE,
+				     CORTEX_WINDOW_STACK) < 0 ||
+	    cortex_attach_add_window(attach, attach->arch->get_pc(cpu_regs),
+				     CORTEX_WINDOW_CODE,
+				     CORTEX_WINDOW_CODE) < 0)
+		return -1;
+
+	for (i = 0; t == 0 && i < nr_regs; i++)
+		if (cortex_attach_add_window(attach, cpu_regs[i].value,
+					     CORTEX_WINDOW_DATA,
+					     CORTEX_WINDOW_DATA) < 0)
+			return -1;
+
+	return 0;
+}
+
+/* the cpu times of the threads, read once they run again: /proc is
+   slow to read for thousands of threads */
+static void cortex_attach_times(struct cortex_attach *attach)
+{
+	struct elf_prstatus prstatus;
+	unsigned long utime, stime;
+	long cutime, cstime;
+	char stat[512];
+	int i;
+
+	for (i = 0; i < attach->stopped.nr_threads; i++) {
+		utime = stime = 0;
+		cutime = cstime = 0;
+		if (cortex_attach_stat(attach->pid, attach->stopped.threads[i].tid,
+				       stat, sizeof(stat)) == NULL)
+			continue;
+		sscanf(stat, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+		       "%lu %lu %ld %ld", &utime, &stime, &cutime, &cstime);
+
+		memcpy(&prstatus, attach->notes + attach->stopped.threads[i].prstatus,
+		       sizeof(prstatus));
+		cortex_attach_ticks(&prstatus.pr_utime, utime);
+		cortex_attach_ticks(&prstatus.pr_stime, stime);
+		cortex_attach_ticks(&prstatus.pr_cutime, cutime);
+		cortex_attach_ticks(&prstatus.pr_cstime, cstime);
+		memcpy(attach->notes + attach->stopped.threads[i].prstatus, &prstatus,
+		       sizeof(prstatus));
+	}
+}
+
+/* NT_FILE: count, page size, count * (start, end, page offset), names */
+static int cortex_attach_files(struct cortex_attach *attach)
+{
+	size_t size = 2 * sizeof(long);
+	unsigned long *desc;
+	char *name;
+	long count = 0;
+	int i, ret;
+
+	for (i = 0; i < attach->maps.nr_vmas; i++) {
+		if (!attach->maps.vmas[i].file)
+			continue;
+		size += 3 * sizeof(long) + strlen(attach->maps.vmas[i].name) + 1;
+		count++;
+	}
+
+	desc = cortex_mem_alloc(size);
+	if (desc == NULL) {
+		fprintf(stderr, "%s: out of memory\n", __FILE__);
+		return -1;
+	}
+
+	desc[0] = count;
+	desc[1] = attach->page_size;
+	name = (char *)(desc + 2 + 3 * count);
+	count = 0;
+
+	for (i = 0; i < attach->maps.nr_vmas; i++) {
+		struct cortex_attach_vma *vma = &attach->maps.vmas[i];
+
+		if (!vma->file)
+			continue;
+		desc[2 + 3 * count] = vma->start;
+		desc[2 + 3 * count + 1] = vma->end;
+		desc[2 + 3 * count + 2] = vma->pgoff;
+		strcpy(name, vma->name);
+		name += strlen(name) + 1;
+		count++;
+	}
+
+	ret = cortex_attach_note(attach, "CORE", NT_FILE, desc, size);
+	cortex_mem_free(desc);
+
+	return ret < 0 ? -1 : 0;
+}
+
+static int cortex_attach_psinfo(struct cortex_attach *attach)
+{
+	struct elf_prpsinfo *psinfo = &attach->psinfo;
+	char path[64];
+	char buf[512];
+	char *cmdline;
+	size_t size, i;
+	struct stat st;
+	int nice = 0;
+
+	if (cortex_attach_stat(attach->pid, attach->pid, buf,
+			       sizeof(buf)) == NULL) {
+		fprintf(stderr, "%d: no such process\n", attach->pid);
+		return -1;
+	}
+
+	sscanf(buf, "%c %d %d %d %*d %*d %lu %*u %*u %*u %*u %*u %*u "
+	       "%*d %*d %*d %d", &psinfo->pr_sname, &psinfo->pr_ppid,
+	       &psinfo->pr_pgrp, &psinfo->pr_sid, &psinfo->pr_flag, &nice);
+
+	psinfo->pr_state = strchr("RSDTZW", psinfo->pr_sname) ?
+	    strchr("RSDTZW", psinfo->pr_sname) - "RSDTZW" : 0;
+	psinfo->pr_zomb = psinfo->pr_sname == 'Z';
+	psinfo->pr_nice = nice;
+	psinfo->pr_pid = attach->pid;
+
+	snprintf(path, sizeof(path), "/proc/%d", attach->pid);
+	if (stat(path, &st) == 0) {
+		psinfo->pr_uid = st.st_uid;
+		psinfo->pr_gid = st.st_gid;
+	}
+
+	snprintf(path, sizeof(path), "/proc/%d/comm", attach->pid);
+	cmdline = cortex_attach_read_file(path, NULL);
+	if (cmdline) {
+		cmdline[strcspn(cmdline, "\n")] = '\0';
+		snprintf(psinfo->pr_fname, sizeof(psinfo->pr_fname), "%s",
+			 cmdline);
+		cortex_mem_free(cmdline);
+	}
+
+	/* the arguments are separated by spaces in a core */
+	snprintf(path, sizeof(path), "/proc/%d/cmdline", attach->pid);
+	cmdline = cortex_attach_read_file(path, &size);
+	if (cmdline) {
+		size = size < sizeof(psinfo->pr_psargs) ? size :
+		    sizeof(psinfo->pr_psargs) - 1;
+		for (i = 0; i < size; i++)
+			psinfo->pr_psargs[i] = cmdline[i] ? cmdline[i] : ' ';
+		cortex_mem_free(cmdline);
+	}
+
+	return 0;
+}
+
+/* read the windows straight into the core, IOV_MAX at a time. A batch
+   that comes short is read again window by window: those that fail are
+   left out of the core */
+static void cortex_attach_read(struct cortex_attach *attach,
+			       unsigned char *core)
+{
+	struct iovec local[IOV_MAX], remote[IOV_MAX];
+	int first, nr, i;
+	ssize_t expected;
+
+	for (first = 0; first < attach->nr_windows; first += nr) {
+		nr = attach->nr_windows - first;
+		if (nr > IOV_MAX)
+			nr = IOV_MAX;
+
+		expected = 0;
+		for (i = 0; i < nr; i++) {
+			struct cortex_attach_window *win =
+			    &attach->windows[first + i];
+
+			local[i].iov_base = core + win->offset;
+			local[i].iov_len = win->end - win->start;
+			remote[i].iov_base = (void *)win->start;
+			remote[i].iov_len = win->end - win->start;
+			expected += win->end - win->start;
+		}
+
+		if (process_vm_readv(attach->pid, local, nr, remote, nr, 0) ==
+		    expected)
+			continue;
+
+		for (i = 0; i < nr; i++)
+			if (process_vm_readv(attach->pid, &local[i], 1,
+					     &remote[i], 1, 0) !=
+			    (ssize_t)local[i].iov_len)
+				attach->windows[first + i].failed = 1;
+	}
+}
+
+/* a PT_LOAD for each mapping, split around the windows */
+static int cortex_attach_phdrs(struct cortex_attach *attach, ElfN_Phdr *phdr)
+{
+	int nr = 0;
+	int w = 0;
+	int i;
+
+	for (i = 0; i < attach->maps.nr_vmas; i++) {
+		struct cortex_attach_vma *vma = &attach->maps.vmas[i];
+		unsigned long addr = vma->start;
+
+		while (addr < vma->end) {
+			struct cortex_attach_window *win =
+			    w < attach->nr_windows && attach->windows[w].vma == i ?
+			    &attach->windows[w] : NULL;
+			unsigned long end = win ? (addr < win->start ?
+						  win->start : win->end) :
+			    vma->end;
+
+			if (phdr) {
+				memset(&phdr[nr], 0, sizeof(*phdr));
+				phdr[nr].p_type = PT_LOAD;
+				phdr[nr].p_flags = vma->flags;
+				phdr[nr].p_vaddr = addr;
+				phdr[nr].p_memsz = end - addr;
+				phdr[nr].p_align = attach->page_size;
+				if (win && addr == win->start) {
+					phdr[nr].p_offset = win->offset;
+					if (!win->failed)
+						phdr[nr].p_filesz = end - addr;
+				}
+			}
+			nr++;
+
+			if (win && addr == win->start)
+				w++;
+			addr = end;
+		}
+	}
+
+	return nr;
+}
+
+/* write the ELF header, the program headers and the notes */
+static void cortex_attach_headers(struct cortex_attach *attach,
+				  unsigned char *core, ElfN_Phdr *phdr,
+				  int nr_phdrs, size_t notes_offset)
+{
+	const struct cortex_elf_class *elf_class = sizeof(long) == 8 ?
+	    &cortex_elf64_class : &cortex_elf32_class;
+	ElfN_Ehdr ehdr;
+	ElfN_Phdr note;
+	int i;
+
+	memset(&ehdr, 0, sizeof(ehdr));
+	memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+	ehdr.e_ident[EI_CLASS] = elf_class->elf_class;
+	ehdr.e_ident[EI_DATA] = CORTEX_ELF_HOST_DATA;
+	ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr.e_ident[EI_OSABI] = ELFOSABI_NONE;
+	ehdr.e_type = ET_CORE;
+	ehdr.e_machine = attach->arch->machine;
+	ehdr.e_version = EV_CURRENT;
+	ehdr.e_phoff = elf_class->ehdr_size;
+	ehdr.e_ehsize = elf_class->ehdr_size;
+	ehdr.e_phentsize = elf_class->phdr_size;
+	ehdr.e_phnum = nr_phdrs + 1;
+	elf_class->write_ehdr(core, &ehdr, 0);
+
+	memset(&note, 0, sizeof(note));
+	note.p_type = PT_NOTE;
+	note.p_offset = notes_offset;
+	note.p_filesz = attach->notes_size;
+	elf_class->write_phdr(core + ehdr.e_phoff, &note, 0);
+
+	for (i = 0; i < nr_phdrs; i++)
+		elf_class->write_phdr(core + ehdr.e_phoff +
+				      (i + 1) * elf_class->phdr_size,
+				      &phdr[i], 0);
+
+	memcpy(core + notes_offset, attach->notes, attach->notes_size);
+}
+
+static void cortex_attach_free(struct cortex_attach *attach)
+{
+	cortex_attach_free_maps(&attach->maps);
+	cortex_mem_free(attach->windows);
+	cortex_mem_free(attach->stopped.threads);
+	cortex_mem_free(attach->notes);
+}
+
+/** \brief take a snapshot of a running process
+ * \param pid the process
+ * \return a file holding an ELF core of the process, to be read as any
+ * core, or -1 on error
+ *
+ * The threads of the process are stopped while their registers and
+ * memory windows are read, then let go: this is timed by the "attach"
+ * statistic.
+ */
+int cortex_attach(int pid)
+{
+	struct cortex_attach attach;
+	unsigned char *core = MAP_FAILED;
+	ElfN_Phdr *phdr = NULL;
+	size_t notes_offset, offset, size = 0;
+	uint64_t begin;
+	int nr_phdrs;
+	int fd = -1;
+	int i;
+
+	memset(&attach, 0, sizeof(attach));
+	attach.pid = pid;
+	attach.stopped.pid = pid;
+	attach.page_size = sysconf(_SC_PAGESIZE);
+
+	attach.arch = cortex_attach_arch(pid);
+	if (attach.arch == NULL || cortex_attach_psinfo(&attach) < 0)
+		goto out;
+
+	fd = memfd_create("cortex-attach", MFD_CLOEXEC);
+	if (fd < 0) {
+		perror("memfd_create");
+		goto out;
+	}
+
+	/* from here on, the process is stopped */
+	begin = cortex_stats_begin();
+	if (cortex_attach_stop(&attach.stopped) < 0)
+		goto out_resume;
+
+	/* the mappings cannot change under the stopped threads */
+	if (cortex_attach_read_maps(pid, &attach.maps) < 0)
+		goto out_resume;
+
+	/* the headers of the mapped files, to identify them */
+	for (i = 0; i < attach.maps.nr_vmas; i++) {
+		if (attach.maps.vmas[i].file && attach.maps.vmas[i].pgoff == 0 &&
+		    cortex_attach_add_window(&attach, attach.maps.vmas[i].start, 0,
+					     CORTEX_WINDOW_MODULE) < 0) {
+			fprintf(stderr, "%s: out of memory\n", __FILE__);
+			goto out_resume;
+		}
+	}
+
+	/* the main thread first, as the crashing thread of a core */
+	for (i = 0; i < attach.stopped.nr_threads; i++) {
+		if (attach.stopped.threads[i].tid == pid) {
+			struct cortex_attach_thread main_thread =
+			    attach.stopped.threads[i];
+
+			attach.stopped.threads[i] = attach.stopped.threads[0];
+			attach.stopped.threads[0] = main_thread;
+			break;
+		}
+	}
+
+	/* the notes of the other threads take the room of those of the
+	   first: reserved at once, the windows then grow in place */
+	for (i = 0; i < attach.stopped.nr_threads; i++) {
+		if (cortex_attach_thread(&attach, i) < 0)
+			goto out_resume;
+		if (i == 0 &&
+		    cortex_attach_grow_notes(&attach, attach.notes_size *
+					     attach.stopped.nr_threads) < 0)
+			goto out_resume;
+	}
+
+	if (cortex_attach_files(&attach) < 0)
+		goto out_resume;
+
+	cortex_attach_merge_windows(&attach);
+
+	nr_phdrs = cortex_attach_phdrs(&attach, NULL);
+	if (nr_phdrs + 1 >= PN_XNUM) {
+		fprintf(stderr, "%d: too many mappings\n", pid);
+		goto out_resume;
+	}
+
+	/* headers, notes, then the windows */
+	notes_offset = CORTEX_ATTACH_ALIGN(sizeof(Elf64_Ehdr) + (nr_phdrs + 1)
+					   * sizeof(Elf64_Phdr),
+					   sizeof(long));
+	offset = CORTEX_ATTACH_ALIGN(notes_offset + attach.notes_size,
+				     attach.page_size);
+	for (i = 0; i < attach.nr_windows; i++) {
+		attach.windows[i].offset = offset;
+		offset += attach.windows[i].end - attach.windows[i].start;
+	}
+	size = offset;
+
+	phdr = cortex_mem_calloc(nr_phdrs, sizeof(*phdr));
+	if (phdr == NULL) {
+		fprintf(stderr, "%s: out of memory\n", __FILE__);
+		goto out_resume;
+	}
+	if (ftruncate(fd, size) < 0)
+		goto out_resume;
+
+	core = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (core == MAP_FAILED)
+		goto out_resume;
+
+	cortex_attach_read(&attach, core);
+
+	cortex_attach_resume(&attach.stopped);
+	cortex_stats_end(CORTEX_STATS_ATTACH, begin);
+
+	cortex_attach_times(&attach);
+	cortex_attach_phdrs(&attach, phdr);
+	cortex_attach_headers(&attach, core, phdr, nr_phdrs, notes_offset);
+
+	munmap(core, size);
+	cortex_mem_free(phdr);
+	cortex_attach_free(&attach);
+
+	return fd;
+
+out_resume:
+	cortex_attach_resume(&attach.stopped);
+	cortex_stats_end(CORTEX_STATS_ATTACH, begin);
+	if (core != MAP_FAILED)
+		munmap(core, size);
+	cortex_mem_free(phdr);
+	close(fd);
+	fd = -1;
+	goto out;
+
+out:
+	cortex_attach_free(&attach);
+	return -1;
+}
@@ -0,0 +1,57 @@
+#ifndef _CORTEX_ATTACH_H_
+#define _CORTEX_ATTACH_H_
+
+/** \file cortex_attach.h
+ * \brief cortex live process snapshot
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stddef.h>
+
+struct cortex_arch_ops;
+
+/** \struct cortex_attach_vma
+ ** \brief a mapping of the process, from its maps file
+ */
+struct cortex_attach_vma {
+	unsigned long start;
+	unsigned long end;
+	unsigned long pgoff;	/*!< offset in the file, in pages */
+	int flags;		/*!< PF_R, PF_W and PF_X */
+	int file;		/*!< backed by a file */
+	char *name;		/*!< path or [stack], [vdso]..., NULL if none */
+};
+
+/** \struct cortex_attach_maps
+ ** \brief the mappings of a process
+ */
+struct cortex_attach_maps {
+	int nr_vmas;
+	struct cortex_attach_vma *vmas;	/*!< in address order */
+};
+
+const struct cortex_arch_ops *cortex_attach_arch(int pid);
+
+int cortex_attach_read_maps(int pid, struct cortex_attach_maps *maps);
+void cortex_attach_free_maps(struct cortex_attach_maps *maps);
+int cortex_attach_find_vma(const struct cortex_attach_maps *maps,
+			   unsigned long addr);
+
+int cortex_attach(int pid);
+
+#endif /* _CORTEX_ATTACH_H_ */
@@ -0,0 +1,134 @@
+/** \file cortex_deadline.c
+ * \brief cortex analysis time budget
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "cortex_deadline.h"
+
+/*
+ * One ITIMER_REAL bounds the whole analysis. Its handler only raises a
+ * flag: the blocking reads of the core are interrupted (the handler is
+ * installed without SA_RESTART) and the long loops poll the flag, so
+ * that the report can still be finalised with what is complete.
+ *
+ * The alarm is process wide, and so is its state below: there is one
+ * deadline per process, shared by all the analysis contexts. Starting
+ * it again re-arms it for all of them.
+ */
+
+static volatile sig_atomic_t cortex_deadline_flag;
+static struct timespec cortex_deadline_end;
+static int cortex_deadline_ms;
+static int cortex_deadline_started;
+
+static void cortex_deadline_handler(int signum)
+{
+	cortex_deadline_flag = 1;
+}
+
+static void cortex_deadline_arm(long ms)
+{
+	struct itimerval timer;
+
+	memset(&timer, 0, sizeof(timer));
+	timer.it_value.tv_sec = ms / 1000;
+	timer.it_value.tv_usec = (ms % 1000) * 1000;
+
+	/* a zero timer would disarm it: expire right away instead */
+	if (ms <= 0)
+		timer.it_value.tv_usec = 1;
+
+	setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+/** \brief start the time budget
+ * \param total time given to the whole analysis in ms, 0 for no limit
+ *
+ * Until cortex_deadline_input_ready() is called, the budget is also
+ * limited to CORTEX_DEADLINE_INPUT: no core on the input is an error.
+ * Only one deadline may be armed at a time: this one replaces any
+ * previous one, whatever context it was started for.
+ */
+void cortex_deadline_start(int total)
+{
+	struct sigaction action;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = cortex_deadline_handler;
+	action.sa_flags = 0;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGALRM, &action, NULL);
+
+	cortex_deadline_ms = total;
+	cortex_deadline_started = 1;
+	clock_gettime(CLOCK_MONOTONIC, &cortex_deadline_end);
+	cortex_deadline_end.tv_sec += total / 1000;
+	cortex_deadline_end.tv_nsec += (total % 1000) * 1000000L;
+	if (cortex_deadline_end.tv_nsec >= 1000000000L) {
+		cortex_deadline_end.tv_sec++;
+		cortex_deadline_end.tv_nsec -= 1000000000L;
+	}
+
+	if (total > 0 && total < CORTEX_DEADLINE_INPUT)
+		cortex_deadline_arm(total);
+	else
+		cortex_deadline_arm(CORTEX_DEADLINE_INPUT);
+}
+
+/** \brief the core started coming: only the total budget remains */
+void cortex_deadline_input_ready(void)
+{
+	struct timespec now;
+	long remaining;
+
+	/* the alarm belongs to whoever started the deadline: a program
+	   using the library without one keeps its timers */
+	if (!cortex_deadline_started || cortex_deadline_flag)
+		return;
+
+	if (cortex_deadline_ms <= 0) {
+		struct itimerval timer;
+
+		memset(&timer, 0, sizeof(timer));
+		setitimer(ITIMER_REAL, &timer, NULL);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	remaining = (cortex_deadline_end.tv_sec - now.tv_sec) * 1000 +
+	    (cortex_deadline_end.tv_nsec - now.tv_nsec) / 1000000;
+
+	cortex_deadline_arm(remaining);
+}
+
+/** \brief return non zero once the time budget is spent */
+int cortex_deadline_expired(void)
+{
+	return cortex_deadline_flag;
+}
+
+/** \brief the total time budget in ms, 0 if there is none */
+int cortex_deadline_total(void)
+{
+	return cortex_deadline_ms;
+}
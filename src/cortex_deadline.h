@@ -0,0 +1,34 @@
+#ifndef _CORTEX_DEADLINE_H_
+#define _CORTEX_DEADLINE_H_
+
+/** \file cortex_deadline.h
+ * \brief cortex analysis time budget
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/** \brief time given to the core to start coming, in ms */
+#define CORTEX_DEADLINE_INPUT	2000
+/** \brief default time budget of the whole analysis, in ms */
+#define CORTEX_DEADLINE_TOTAL	10000
+
+void cortex_deadline_start(int total);
+void cortex_deadline_input_ready(void);
+int cortex_deadline_expired(void);
+int cortex_deadline_total(void);
+
+#endif /* _CORTEX_DEADLINE_H_ */
@@ -21,32 +21,45 @@
 #ifdef HAVE_DIS_ASM
 #include <dis-asm.h>
 
+#include <stdio.h>
 #include <stdarg.h>
 
 #include "cortex.h"
+#include "cortex_stats.h"
+#include "cortex_probe.h"
 
-static int cortex_dis_print_mute = 0;
-static int cortex_dis_print_offset = 0;
+typedef int (*cortex_dis_insn_func) (bfd_vma, struct disassemble_info *);
 
-static int (*print_insn_func) (bfd_vma, struct disassemble_info *) = NULL;
+/* state of one disassembly: given to libopcodes as its stream, so that
+ * several threads can disassemble at the same time */
+struct cortex_dis_state {
+	char buffer[256];	/*!< text of the current instruction */
+	int offset;		/*!< end of the text in buffer */
+	int mute;		/*!< outside of the context, drop the text */
+};
 
-static void cortex_dis_fprintf_reset(void)
+static void cortex_dis_fprintf_reset(struct cortex_dis_state *state)
 {
-	cortex_dis_print_offset = 0;
+	state->offset = 0;
+	state->buffer[0] = '\0';
 }
 
 static int cortex_dis_fprintf(void *stream, const char *format, ...)
 {
+	struct cortex_dis_state *state = stream;
 	int ret = 0;
 
-	if (!cortex_dis_print_mute) {
+	if (!state->mute) {
 		va_list args;
-		char *buffer = (char *)(stream + cortex_dis_print_offset);
+		size_t room = sizeof(state->buffer) - state->offset;
 
 		va_start(args, format);
 
-		ret = vsprintf(buffer, format, args);
-		cortex_dis_print_offset += ret;
+		ret = vsnprintf(state->buffer + state->offset, room, format,
+				args);
+		if (ret > 0)
+			state->offset += (size_t)ret < room ? (size_t)ret :
+			    room - 1;
 
 		va_end(args);
 	}
@@ -54,96 +67,111 @@ static int cortex_dis_fprintf(void *stream, const char *format, ...)
 	return ret;
 }
 
-static void cortex_dis_set_arch(void)
+/* the disassembler of the core: libopcodes must be built for all the
+ * targets (binutils-multiarch) to read the cores of other machines */
+static cortex_dis_insn_func cortex_dis_get_arch(struct cortex_elf *core,
+						disassemble_info * disinfo)
 {
-	switch (BFD_ARCH) {
-	case bfd_arch_i386:
-		switch (BFD_MACH) {
-		case bfd_mach_x86_64:
-		case bfd_mach_i386_i386:
-		default:
-			print_insn_func = &print_insn_i386;
-			break;
-		}
+	cortex_dis_insn_func print_insn_func = NULL;
+	int big = core->e_ident[EI_DATA] == ELFDATA2MSB;
+
+	disinfo->endian = big ? BFD_ENDIAN_BIG : BFD_ENDIAN_LITTLE;
+
+	switch (core->ehdr->e_machine) {
+	case EM_386:
+		disinfo->arch = bfd_arch_i386;
+		disinfo->mach = bfd_mach_i386_i386;
+		print_insn_func = &print_insn_i386;
 		break;
-	case bfd_arch_powerpc:
-		switch (BFD_MACH) {
-		case bfd_mach_ppc_e500:
-		default:
-			print_insn_func = &print_insn_big_powerpc;
-			break;
-		}
+	case EM_X86_64:
+		disinfo->arch = bfd_arch_i386;
+		disinfo->mach = bfd_mach_x86_64;
+		print_insn_func = &print_insn_i386;
 		break;
-	case bfd_arch_mips:
+	case EM_PPC:
+	case EM_PPC64:
+		disinfo->arch = bfd_arch_powerpc;
+		disinfo->mach = core->ehdr->e_machine == EM_PPC64 ?
+		    bfd_mach_ppc64 : bfd_mach_ppc;
+		print_insn_func = big ? &print_insn_big_powerpc :
+		    &print_insn_little_powerpc;
 		break;
-	case bfd_arch_arm:
-		switch (BFD_MACH) {
-		case bfd_mach_arm_unknown:
-		default:
-			print_insn_func = &print_insn_little_arm;
-			break;
-		}
+	case EM_MIPS:
+		disinfo->arch = bfd_arch_mips;
+		disinfo->mach = core->e_ident[EI_CLASS] == ELFCLASS64 ?
+		    bfd_mach_mipsisa64 : bfd_mach_mipsisa32;
+		print_insn_func = big ? &print_insn_big_mips :
+		    &print_insn_little_mips;
+		break;
+	case EM_ARM:
+		disinfo->arch = bfd_arch_arm;
+		disinfo->mach = bfd_mach_arm_unknown;
+		print_insn_func = big ? &print_insn_big_arm :
+		    &print_insn_little_arm;
 		break;
-	case bfd_arch_unknown:
 	default:
+		disinfo->arch = bfd_arch_unknown;
 		break;
-
 	}
+
+	return print_insn_func;
 }
 
-void cortex_dis_process_buffer(FILE * output, unsigned char *buffer,
-			       unsigned long len, unsigned long instr_context,
-			       ElfN_Addr base, ElfN_Addr pc)
+void cortex_dis_process_buffer(FILE * output, struct cortex_elf *core,
+			       unsigned char *buffer, unsigned long len,
+			       unsigned long instr_context, ElfN_Addr base,
+			       ElfN_Addr pc)
 {
 	unsigned long instr_context_start = (pc - base) - instr_context;
 	unsigned long instr_context_end = 0;
 	unsigned long instr_ptr = 0;
-	char instruction_buffer[256] = "\0";
+	struct cortex_dis_state state;
+	cortex_dis_insn_func print_insn_func;
 	disassemble_info disinfo;
+	uint64_t begin = cortex_stats_begin();
 
-	/* internal: set arch for disassembly ouput */
-	cortex_dis_set_arch();
+	CORTEX_PROBE2(disasm_start, pc, len);
 
 	/* we got to init the disassemble_info struct with machine
-	 * special arch and mach: ouput will be done to buffer */
-	init_disassemble_info(&disinfo, instruction_buffer,
+	 * special arch and mach: ouput will be done to state */
+	cortex_dis_fprintf_reset(&state);
+	init_disassemble_info(&disinfo, &state,
 			      (fprintf_ftype) cortex_dis_fprintf);
 
 	/* mach info after init even if advised not to
 	 * because init overrides mach value */
-	disinfo.arch = BFD_ARCH;
-	disinfo.mach = BFD_MACH;
+	print_insn_func = cortex_dis_get_arch(core, &disinfo);
 
 	disinfo.buffer = buffer;
 	disinfo.buffer_length = len;
 
-	cortex_dis_print_mute = 1;
+	state.mute = 1;
 
 	/* iterate thru all instruction and display them */
 	while (instr_ptr < len) {
 		int size = 0;
 
 		/* only display instructions around the current instruction pointer */
-		if (!cortex_dis_print_mute) {
+		if (!state.mute) {
 			if (instr_ptr > instr_context_end) {
-				cortex_dis_print_mute = 1;
+				state.mute = 1;
 			}
 		} else if (!instr_context_end) {
 			if (instr_ptr >= instr_context_start) {
 				instr_context_end =
 				    (pc - base) + instr_context + 1;
-				cortex_dis_print_mute = 0;
+				state.mute = 0;
 			}
 		}
 
 		if (print_insn_func) {
-			cortex_dis_fprintf_reset();
+			cortex_dis_fprintf_reset(&state);
 			size = print_insn_func(instr_ptr, &disinfo);
 		} else {
 			size = 4;
 		}
 
-		if (!cortex_dis_print_mute) {
+		if (!state.mute) {
 			int j = 0;
 
 			/* display format is: <addr>: <hexcode> <asm> */
@@ -157,23 +185,27 @@ void cortex_dis_process_buffer(FILE * output, unsigned char *buffer,
 
 			if (base + instr_ptr == pc) {
 				fprintf(output, "| => %s\n",
-					instruction_buffer);
+					state.buffer);
 			} else {
 				fprintf(output, "|    %s\n",
-					instruction_buffer);
+					state.buffer);
 			}
 		}
 
 		instr_ptr += size;
 	}
+
+	CORTEX_PROBE2(disasm_end, pc, instr_ptr);
+	cortex_stats_end(CORTEX_STATS_DISASM, begin);
 }
 #else /* HAVE_DIS_ASM */
 #include <stdio.h>
 #include "cortex.h"
 
-void cortex_dis_process_buffer(FILE * output, unsigned char *buffer,
-			       unsigned long len, unsigned long instr_context,
-			       ElfN_Addr base, ElfN_Addr pc)
+void cortex_dis_process_buffer(FILE * output, struct cortex_elf *core,
+			       unsigned char *buffer, unsigned long len,
+			       unsigned long instr_context, ElfN_Addr base,
+			       ElfN_Addr pc)
 {
 	fprintf(output, "Unsupported\n");
 }
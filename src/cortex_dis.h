@@ -20,6 +20,7 @@
 
 #include "cortex.h"
 
-void cortex_dis_process_buffer(FILE * output, unsigned char *buffer,
-			       unsigned long len, unsigned long instr_context,
-			       ElfN_Addr base, ElfN_Addr pc);
+void cortex_dis_process_buffer(FILE * output, struct cortex_elf *core,
+			       unsigned char *buffer, unsigned long len,
+			       unsigned long instr_context, ElfN_Addr base,
+			       ElfN_Addr pc);
@@ -20,45 +20,99 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <stddef.h>
+#include <signal.h>
 
 #include "cortex.h"
 #include "cortex_elf.h"
+#include "cortex_mem.h"
+#include "cortex_deadline.h"
+#include "cortex_stats.h"
+#include "cortex_probe.h"
+#include "cortex_mini.h"
+#include "cortex_stream.h"
+#include "cortex_fetch.h"
 #include "arch/cortex_arch.h"
 
 #define max(a, b)		(((a)>(b))?(a):(b))
 #define min(a, b)		(((a)<(b))?(a):(b))
 
-#define ELF_DATA_ALIGN(a, d)	((long)(a) + d - ((long)(a) % (d)))
+#define ELF_DATA_ALIGN(a, d)	(((long)(a) + (d) - 1) / (d) * (d))
+
+#define CORTEX_ELF_BLOCK	16384
+
+/* first size of the note index, doubled as needed */
+#define CORTEX_ELF_NOTES	16
+
+/* a range of the core file to copy into a buffer */
+struct cortex_elf_fetch {
+	ElfN_Off offset;
+	size_t size;
+	size_t filled;
+	unsigned char *d_buf;
+};
+
+/* a memory window, and the segment it comes from */
+struct cortex_elf_window {
+	ElfN_Phdr *segm;
+	struct cortex_elf_region region;
+};
 
 static long __cortex_fseek(struct cortex_elf *core, off_t offset)
 {
-	char __dummy[512];
+	unsigned char block[CORTEX_ELF_BLOCK];
+	uint64_t begin = cortex_stats_begin();
 
 	offset -= core->offset;
 
 	while (offset) {
-		size_t block = min(512, offset);
-		size_t count = read(core->fd, __dummy, block);
+		size_t len = min(sizeof(block), (size_t)offset);
+		ssize_t count = read(core->fd, block, len);
+		cortex_stats_read(count, 1);
 		if (count > 0) {
+			if (core->stream)
+				cortex_stream_feed(core->stream, block, count);
 			offset -= count;
 			core->offset += count;
+		} else if (count < 0 && errno == EINTR &&
+			   !cortex_deadline_expired()) {
+			continue;
 		} else {
 			goto err_out;
 		}
 	}
 err_out:
+	cortex_stats_end(CORTEX_STATS_SKIP, begin);
 	return core->offset;
 }
 
+/* read count bytes. Stops early at the end of the input, on error or
+   when the time budget is spent */
 static long __cortex_elf_read(struct cortex_elf *core, void *buf, size_t count)
 {
 	unsigned long nbytes = 0;
 
 	while (nbytes < count) {
-		int ret = read(core->fd, buf, count - nbytes);
-		if (ret < 0)
+		uint64_t begin = cortex_stats_begin();
+		ssize_t ret = read(core->fd, (char *)buf + nbytes,
+				   count - nbytes);
+		cortex_stats_end(CORTEX_STATS_READ, begin);
+		cortex_stats_read(ret, 0);
+		if (ret < 0 && errno == EINTR && !cortex_deadline_expired())
+			continue;
+		if (ret <= 0)
 			break;
+
+		/* the core is coming: cortex was not started without input */
+		if (core->offset == 0 && nbytes == 0)
+			cortex_deadline_input_ready();
+
+		if (core->stream)
+			cortex_stream_feed(core->stream, (unsigned char *)buf +
+					   nbytes, ret);
 		nbytes += ret;
 	}
 
@@ -68,9 +122,16 @@ static long __cortex_elf_read(struct cortex_elf *core, void *buf, size_t count)
 	return nbytes;
 }
 
+/* why a read came short */
+static const char *__cortex_elf_short_read(void)
+{
+	return cortex_deadline_expired() ?
+	    "deadline expired, core partially read" : "truncated file";
+}
+
 static struct cortex_elf *cortex_elf_begin(int fd)
 {
-	struct cortex_elf *elf = calloc(1, sizeof(struct cortex_elf));
+	struct cortex_elf *elf = cortex_mem_calloc(1, sizeof(struct cortex_elf));
 	if (!elf)
 		goto out_err;
 
@@ -86,8 +147,10 @@ static void cortex_elf_end(struct cortex_elf *core)
 	if (!core)
 		goto out_err;
 
-	free(core->ehdr);
-	free(core->phdr);
+	cortex_mem_free(core->ehdr);
+	cortex_mem_free(core->phdr);
+	cortex_stream_free(core->stream);
+	core->stream = NULL;
 
 	if (core->fd >= 0)
 		close(core->fd);
@@ -99,76 +162,77 @@ out_err:
 static unsigned char *cortex_elf_getident(struct cortex_elf *core,
 					  size_t * count)
 {
-	unsigned char *ident = NULL;
-
-	if (!core->ehdr) {
-		long count = 0;
-
-		if (core->offset != 0) {
-			fprintf(stderr, "%s: non fast forward\n", __FILE__);
-			goto out_err;
-		}
-
-		core->ehdr = calloc(1, sizeof(ElfN_Ehdr));
+	/* only e_ident: the size of the rest depends on the class */
+	if (core->offset == 0) {
+		long nbytes = __cortex_elf_read(core, core->e_ident, EI_NIDENT);
 
-		count = __cortex_elf_read(core, core->ehdr, sizeof(ElfN_Ehdr));
-		if (count <= 0) {
+		if (nbytes <= 0) {
 			fprintf(stderr, "%s: cannot read file\n", __FILE__);
-			goto out_err;
-		} else if (count < (long)sizeof(ElfN_Ehdr)) {
-			fprintf(stderr, "%s: truncated file\n", __FILE__);
-			goto out_err;
+			return NULL;
+		} else if (nbytes < EI_NIDENT) {
+			fprintf(stderr, "%s: %s\n", __FILE__,
+				__cortex_elf_short_read());
+			return NULL;
 		}
-
 	}
 
 	if (count)
-		*count = sizeof(core->ehdr->e_ident);
-	ident = core->ehdr->e_ident;
+		*count = EI_NIDENT;
 
-	return ident;
-out_err:
-	free(core->ehdr);
-	core->ehdr = NULL;
-	return NULL;
+	return core->e_ident;
 }
 
 static ElfN_Ehdr *cortex_elf_getehdr(struct cortex_elf *core)
 {
+	unsigned char raw[sizeof(Elf64_Ehdr)];
+	size_t size = core->elf_class->ehdr_size;
 	ElfN_Ehdr *ehdr = NULL;
+
 	if (!core->ehdr) {
 		long count = 0;
 
-		if (core->offset != 0) {
+		if (core->offset != EI_NIDENT) {
 			fprintf(stderr, "%s: non fast forward\n", __FILE__);
 			goto out_err;
 		}
 
-		core->ehdr = calloc(1, sizeof(ElfN_Ehdr));
+		core->ehdr = cortex_mem_calloc(1, sizeof(ElfN_Ehdr));
+		if (!core->ehdr) {
+			fprintf(stderr, "%s: out of memory\n", __FILE__);
+			goto out_err;
+		}
 
-		count = __cortex_elf_read(core, core->ehdr, sizeof(ElfN_Ehdr));
+		memcpy(raw, core->e_ident, EI_NIDENT);
+		count = __cortex_elf_read(core, raw + EI_NIDENT,
+					  size - EI_NIDENT);
 		if (count <= 0) {
 			fprintf(stderr, "%s: cannot read file\n", __FILE__);
 			goto out_err;
-		} else if (count < (long)sizeof(ElfN_Ehdr)) {
-			fprintf(stderr, "%s: truncated file\n", __FILE__);
+		} else if (count < (long)(size - EI_NIDENT)) {
+			fprintf(stderr, "%s: %s\n", __FILE__,
+				__cortex_elf_short_read());
 			goto out_err;
 		}
 
+		core->elf_class->read_ehdr(core->ehdr, raw, core->swap);
 	}
 
 	ehdr = core->ehdr;
 
 	return ehdr;
 out_err:
-	free(core->ehdr);
+	cortex_mem_free(core->ehdr);
 	core->ehdr = NULL;
 	return NULL;
 }
 
 static ElfN_Phdr *cortex_elf_getphdr(struct cortex_elf *core)
 {
+	size_t size = core->elf_class->phdr_size;
+	unsigned char *raw = NULL;
 	ElfN_Phdr *phdr = NULL;
+	int i = 0;
+
 	if (!core->phdr) {
 		long count = 0;
 
@@ -179,31 +243,68 @@ static ElfN_Phdr *cortex_elf_getphdr(struct cortex_elf *core)
 
 		__cortex_fseek(core, core->ehdr->e_phoff);
 
-		core->phdr = calloc(core->ehdr->e_phnum, sizeof(ElfN_Phdr));
+		core->phdr = cortex_mem_calloc(core->ehdr->e_phnum, sizeof(ElfN_Phdr));
+		raw = cortex_mem_alloc(core->ehdr->e_phnum * size);
+		if (!core->phdr || !raw) {
+			fprintf(stderr, "%s: out of memory\n", __FILE__);
+			goto out_err;
+		}
 
-		count =
-		    __cortex_elf_read(core, core->phdr,
-				      core->ehdr->e_phnum * sizeof(ElfN_Phdr));
+		count = __cortex_elf_read(core, raw, core->ehdr->e_phnum * size);
 		if (count <= 0) {
 			fprintf(stderr, "%s: cannot read file\n", __FILE__);
 			goto out_err;
-		} else if (count <
-			   (long)(core->ehdr->e_phnum * sizeof(ElfN_Phdr))) {
-			fprintf(stderr, "%s: truncated file\n", __FILE__);
+		} else if (count < (long)(core->ehdr->e_phnum * size)) {
+			fprintf(stderr, "%s: %s\n", __FILE__,
+				__cortex_elf_short_read());
 			goto out_err;
 		}
 
+		for (i = 0; i < core->ehdr->e_phnum; i++)
+			core->elf_class->read_phdr(&core->phdr[i],
+						   raw + i * size, core->swap);
+		cortex_mem_free(raw);
 	}
 
 	phdr = core->phdr;
 
 	return phdr;
 out_err:
-	free(core->phdr);
+	cortex_mem_free(raw);
+	cortex_mem_free(core->phdr);
 	core->phdr = NULL;
 	return NULL;
 }
 
+static struct cortex_elf_data *cortex_elf_alloc_data(ElfN_Phdr * phdr)
+{
+	struct cortex_elf_data *elf_data = NULL;
+
+	if (!phdr || !phdr->p_filesz)
+		return NULL;
+
+	elf_data = cortex_mem_calloc(1, sizeof(struct cortex_elf_data));
+	if (!elf_data)
+		return NULL;
+
+	elf_data->d_buf = cortex_mem_calloc(1, phdr->p_filesz);
+	if (!elf_data->d_buf) {
+		cortex_mem_free(elf_data);
+		return NULL;
+	}
+	elf_data->d_size = phdr->p_filesz;
+	elf_data->d_align = phdr->p_align;
+
+	return elf_data;
+}
+
+static void cortex_elf_free_data(struct cortex_elf_data *data)
+{
+	if (data && !data->d_window)
+		cortex_mem_free(data->d_buf);
+	cortex_mem_free(data);
+}
+
 static struct cortex_elf_data *cortex_elf_getdata(struct cortex_elf *core,
 						  ElfN_Phdr * phdr)
 {
@@ -218,113 +319,506 @@ static struct cortex_elf_data *cortex_elf_getdata(struct cortex_elf *core,
 
 	__cortex_fseek(core, phdr->p_offset);
 
-	elf_data = calloc(1, sizeof(struct cortex_elf_data));
-	elf_data->d_buf = calloc(1, phdr->p_filesz);
-	elf_data->d_size = phdr->p_filesz;
-	elf_data->d_align = phdr->p_align;
+	elf_data = cortex_elf_alloc_data(phdr);
+	if (!elf_data) {
+		fprintf(stderr, "%s: out of memory\n", __FILE__);
+		goto out_err;
+	}
 
 	count = __cortex_elf_read(core, elf_data->d_buf, phdr->p_filesz);
 	if (count <= 0) {
 		fprintf(stderr, "%s: cannot read file\n", __FILE__);
 		goto out_err;
 	} else if (count < (long)phdr->p_filesz) {
-		fprintf(stderr, "%s: truncated file\n", __FILE__);
+		fprintf(stderr, "%s: %s\n", __FILE__,
+			__cortex_elf_short_read());
 		goto out_err;
 	}
 
 	return elf_data;
 out_err:
-	free(elf_data->d_buf);
-	free(elf_data);
-	elf_data = NULL;
+	cortex_elf_free_data(elf_data);
 	return NULL;
 }
 
-static int cortex_elf_count_thread(struct cortex_elf_data *pt_note)
+/* read the note at *pos and move *pos to the next one.
+   Returns 0 at the end of the segment */
+static int cortex_elf_next_note(struct cortex_elf *core,
+				struct cortex_elf_data *pt_note, size_t *pos,
+				struct cortex_elf_note *note)
 {
-	int thread_cnt = 0;
-	long nhdr_end = (long)pt_note->d_buf + pt_note->d_size;
+	size_t align = max(4, pt_note->d_align);
+	unsigned char *nhdr = pt_note->d_buf + *pos;
+	size_t namesz = 0;
+	size_t desc = 0;
 
-	ElfN_Nhdr *nhdr = (ElfN_Nhdr *) pt_note->d_buf;
+	if (*pos + sizeof(ElfN_Nhdr) > pt_note->d_size)
+		return 0;
 
-	while ((long)nhdr < nhdr_end) {
-		long align = max(4, pt_note->d_align);
-		long note_total_size =
-		    sizeof(ElfN_Nhdr) + nhdr->n_namesz + nhdr->n_descsz;
-		long offset = (long)nhdr + note_total_size;
+	namesz = cortex_elf_get(nhdr + offsetof(ElfN_Nhdr, n_namesz), 4,
+				core->swap);
+	note->size = cortex_elf_get(nhdr + offsetof(ElfN_Nhdr, n_descsz), 4,
+				    core->swap);
+	note->type = cortex_elf_get(nhdr + offsetof(ElfN_Nhdr, n_type), 4,
+				    core->swap);
 
-		switch (nhdr->n_type) {
-		case NT_PRSTATUS:
-			thread_cnt++;
-			break;
-		default:
-			break;
+	desc = ELF_DATA_ALIGN(*pos + sizeof(ElfN_Nhdr) + namesz, align);
+	if (desc > pt_note->d_size || note->size > pt_note->d_size - desc)
+		return 0;
+
+	note->desc = pt_note->d_buf + desc;
+	*pos = ELF_DATA_ALIGN(desc + note->size, align);
+
+	return 1;
+}
+
+/* record every note of the segment in the index, in a single walk.
+   Returns the number of NT_PRSTATUS found */
+static int cortex_elf_index_notes(struct cortex_elf *core,
+				  struct cortex_elf_data *pt_note,
+				  struct cortex_proc_info *proc)
+{
+	struct cortex_elf_note note;
+	struct cortex_elf_note *notes = NULL;
+	int thread_cnt = 0;
+	int size = 0;
+	size_t pos = 0;
+
+	while (cortex_elf_next_note(core, pt_note, &pos, &note)) {
+		if (proc->nr_notes == size) {
+			size = size ? 2 * size : CORTEX_ELF_NOTES;
+			notes = cortex_mem_realloc(proc->notes,
+						   size * sizeof(*notes));
+			if (!notes)
+				return -1;
+			proc->notes = notes;
 		}
 
-		nhdr = (ElfN_Nhdr *) ELF_DATA_ALIGN(offset, align);
+		/* threads are assigned once the prstatus are decoded */
+		note.thread = -1;
+		proc->notes[proc->nr_notes++] = note;
+
+		if (note.type == NT_PRSTATUS)
+			thread_cnt++;
 	}
+
 	return thread_cnt;
 }
 
-static struct cortex_proc_info *cortex_elf_parse_note(struct cortex_elf_data
+/** \brief look a note up in the index
+ * \param thread index of the thread, -1 for any
+ * \return the first matching note, NULL if there is none
+ */
+struct cortex_elf_note *cortex_elf_find_note(struct cortex_proc_info *info,
+					     uint32_t type, int thread)
+{
+	int i = 0;
+
+	for (i = 0; i < info->nr_notes; i++) {
+		if (info->notes[i].type == type &&
+		    (thread < 0 || info->notes[i].thread == thread))
+			return &info->notes[i];
+	}
+
+	return NULL;
+}
+
+/* read the word at index i of a note */
+static ElfN_Addr cortex_elf_note_word(struct cortex_elf *core,
+				      const unsigned char *desc, size_t i)
+{
+	int word_size = core->arch->word_size;
+
+	return cortex_elf_get(desc + i * word_size, word_size, core->swap);
+}
+
+/* elf_prstatus is: elf_siginfo, pr_cursig, pr_sigpend and pr_sighold,
+   pid, ppid, pgrp and sid, four timevals then the elf_gregset_t. Only
+   the size of a long changes from one architecture to another. */
+static int cortex_elf_parse_prstatus(struct cortex_elf *core,
+				     struct cortex_elf_note *note,
+				     struct cortex_prstatus *prstatus)
+{
+	const struct cortex_arch_ops *arch = core->arch;
+	size_t word = arch->word_size;
+	size_t ids = 16 + 2 * word;
+	size_t times = 32 + 2 * word;
+	size_t regs = times + 8 * word;
+	struct cortex_timeval *tv[] = {
+		&prstatus->pr_utime, &prstatus->pr_stime,
+		&prstatus->pr_cutime, &prstatus->pr_cstime,
+	};
+	int i = 0;
+
+	if (note->size < regs + arch->nr_gregs * word)
+		return -1;
+
+	prstatus->pr_cursig = cortex_elf_get(note->desc + 12, 2, core->swap);
+	prstatus->pr_pid = cortex_elf_get(note->desc + ids, 4, core->swap);
+	prstatus->pr_ppid = cortex_elf_get(note->desc + ids + 4, 4, core->swap);
+	prstatus->pr_pgrp = cortex_elf_get(note->desc + ids + 8, 4, core->swap);
+	prstatus->pr_sid = cortex_elf_get(note->desc + ids + 12, 4, core->swap);
+
+	for (i = 0; i < 4; i++) {
+		tv[i]->tv_sec = cortex_elf_note_word(core, note->desc + times,
+						     2 * i);
+		tv[i]->tv_usec = cortex_elf_note_word(core, note->desc + times,
+						      2 * i + 1);
+	}
+
+	for (i = 0; i < arch->nr_gregs; i++)
+		prstatus->pr_reg[i] =
+		    cortex_elf_note_word(core, note->desc + regs, i);
+
+	return 0;
+}
+
+/* elf_prpsinfo is: state, sname, zomb and nice, pr_flag, uid and gid,
+   pid, ppid, pgrp and sid, then the name and the arguments. uids are
+   16 bit on some architectures. */
+static struct cortex_prpsinfo *cortex_elf_parse_prpsinfo(struct cortex_elf
+							 *core,
+							 struct cortex_elf_note
+							 *note)
+{
+	const struct cortex_arch_ops *arch = core->arch;
+	struct cortex_prpsinfo *info = NULL;
+	size_t word = arch->word_size;
+	size_t uids = 2 * word;
+	size_t ids = ELF_DATA_ALIGN(uids + 2 * arch->uid_size, 4);
+	size_t fname = ids + 16;
+	size_t psargs = fname + sizeof(info->pr_fname);
+
+	if (note->size < psargs + sizeof(info->pr_psargs))
+		return NULL;
+
+	info = cortex_mem_calloc(1, sizeof(*info));
+	if (!info)
+		return NULL;
+
+	info->pr_state = note->desc[0];
+	info->pr_sname = note->desc[1];
+	info->pr_zomb = note->desc[2];
+	info->pr_nice = note->desc[3];
+	info->pr_flag = cortex_elf_note_word(core, note->desc, 1);
+	info->pr_uid = cortex_elf_get(note->desc + uids, arch->uid_size,
+				      core->swap);
+	info->pr_gid = cortex_elf_get(note->desc + uids + arch->uid_size,
+				      arch->uid_size, core->swap);
+	info->pr_pid = cortex_elf_get(note->desc + ids, 4, core->swap);
+	info->pr_ppid = cortex_elf_get(note->desc + ids + 4, 4, core->swap);
+	info->pr_pgrp = cortex_elf_get(note->desc + ids + 8, 4, core->swap);
+	info->pr_sid = cortex_elf_get(note->desc + ids + 12, 4, core->swap);
+	memcpy(info->pr_fname, note->desc + fname, sizeof(info->pr_fname));
+	memcpy(info->pr_psargs, note->desc + psargs, sizeof(info->pr_psargs));
+
+	return info;
+}
+
+/* the faults, numbered as on the host: they carry an address */
+static int cortex_elf_fault_signal(const struct cortex_arch_ops *arch,
+				   int signo)
+{
+	switch (signo) {
+	case 4:
+		return SIGILL;
+	case 5:
+		return SIGTRAP;
+	case 8:
+		return SIGFPE;
+	case 11:
+		return SIGSEGV;
+	case 7:
+		return arch->machine == EM_MIPS ? 0 : SIGBUS;
+	case 10:
+		return arch->machine == EM_MIPS ? SIGBUS : 0;
+	default:
+		return 0;
+	}
+}
+
+/* siginfo is: si_signo, si_errno and si_code (si_code first on mips),
+   then a union aligned on a long. The faults start it with si_addr. */
+static struct cortex_siginfo *cortex_elf_parse_siginfo(struct cortex_elf
+						       *core,
+						       struct cortex_elf_note
+						       *note)
+{
+	const struct cortex_arch_ops *arch = core->arch;
+	struct cortex_siginfo *siginfo = NULL;
+	size_t fields = ELF_DATA_ALIGN(12, arch->word_size);
+	size_t errno_off = arch->machine == EM_MIPS ? 8 : 4;
+	size_t code_off = arch->machine == EM_MIPS ? 4 : 8;
+
+	if (note->size < fields + arch->word_size)
+		return NULL;
+
+	siginfo = cortex_mem_calloc(1, sizeof(*siginfo));
+	if (!siginfo)
+		return NULL;
+
+	siginfo->signo = cortex_elf_get(note->desc, 4, core->swap);
+	siginfo->errnum = cortex_elf_get(note->desc + errno_off, 4,
+					   core->swap);
+	siginfo->code = (int32_t)cortex_elf_get(note->desc + code_off, 4,
+						   core->swap);
+	siginfo->fault = cortex_elf_fault_signal(arch, siginfo->signo);
+
+	/* a fault sent by kill() has a pid and a uid instead */
+	if (siginfo->fault && siginfo->code > 0)
+		siginfo->addr = cortex_elf_note_word(core,
+							note->desc + fields, 0);
+
+	return siginfo;
+}
+
+/* auxv is a list of (type, value) words ending with AT_NULL. The note
+   is kept as is for the minidump. */
+static void cortex_elf_parse_auxv(struct cortex_proc_info *proc,
+				  struct cortex_elf *core,
+				  struct cortex_elf_note *note)
+{
+	size_t nr = note->size / (2 * core->arch->word_size);
+	size_t i = 0;
+
+	/* calloc'd one more: the table is AT_NULL terminated anyway */
+	proc->auxv = cortex_mem_calloc(nr + 1, sizeof(ElfN_auxv_t));
+	if (!proc->auxv)
+		return;
+
+	for (i = 0; i < nr; i++) {
+		proc->auxv[i].a_type =
+		    cortex_elf_note_word(core, note->desc, 2 * i);
+		proc->auxv[i].a_un.a_val =
+		    cortex_elf_note_word(core, note->desc, 2 * i + 1);
+		if (proc->auxv[i].a_type == AT_NULL)
+			break;
+	}
+
+	proc->auxv_raw = note->desc;
+	proc->auxv_size = min(i + 1, nr) * 2 * core->arch->word_size;
+}
+
+/* NT_FILE is: count, page size, count * (start, end, page offset),
+   then count filenames. Names are kept in the note buffer. */
+static void cortex_elf_parse_files(struct cortex_proc_info *proc,
+				   struct cortex_elf *core,
+				   unsigned char *desc, size_t size)
+{
+	size_t word = core->arch->word_size;
+	ElfN_Addr count = 0;
+	ElfN_Addr page_size = 0;
+	char *name = NULL;
+	char *end = (char *)desc + size;
+	ElfN_Addr i = 0;
+
+	if (size < 2 * word)
+		return;
+
+	count = cortex_elf_note_word(core, desc, 0);
+	page_size = cortex_elf_note_word(core, desc, 1);
+	if (count > (size / word - 2) / 3)
+		return;
+
+	proc->files = cortex_mem_calloc(count, sizeof(struct cortex_elf_file));
+	if (!proc->files)
+		return;
+
+	name = (char *)desc + (2 + 3 * count) * word;
+	for (i = 0; i < count && name < end; i++) {
+		struct cortex_elf_file *file = &proc->files[i];
+		size_t len = strnlen(name, end - name);
+
+		file->start = cortex_elf_note_word(core, desc, 2 + 3 * i);
+		file->end = cortex_elf_note_word(core, desc, 2 + 3 * i + 1);
+		file->offset =
+		    cortex_elf_note_word(core, desc, 2 + 3 * i + 2) * page_size;
+		file->name = name;
+
+		name += len + 1;
+		proc->nr_files++;
+	}
+}
+
+static struct cortex_proc_info *cortex_elf_parse_note(struct cortex_elf *core,
+						      struct cortex_elf_data
 						      *pt_note)
 {
+	struct cortex_elf_note *note = NULL;
 	int thread_cnt = 0;
-	long nhdr_end = (long)pt_note->d_buf + (long)pt_note->d_size;
-
-	ElfN_Nhdr *nhdr = (ElfN_Nhdr *) pt_note->d_buf;
+	int thread = -1;
+	int i = 0;
 
-	struct cortex_proc_info *proc = calloc(1, sizeof(*proc));
+	struct cortex_proc_info *proc = cortex_mem_calloc(1, sizeof(*proc));
 	if (proc == NULL) {
 		return proc;
 	}
 
-	proc->nr_threads = cortex_elf_count_thread(pt_note);
-	proc->threads = calloc(proc->nr_threads, sizeof(struct elf_prstatus *));
+	proc->nr_threads = cortex_elf_index_notes(core, pt_note, proc);
+	if (proc->nr_threads > 0)
+		proc->threads = cortex_mem_calloc(proc->nr_threads,
+						  sizeof(struct cortex_prstatus));
 
-	if (proc->nr_threads == 0) {
-		return NULL;
-	}
+	if (proc->nr_threads <= 0 || proc->threads == NULL)
+		goto out_err;
 
-	/* parse all notes depending on their type */
-	while ((long)nhdr < nhdr_end) {
-		long align = max(4, pt_note->d_align);
-		long note_nhdr_size = sizeof(ElfN_Nhdr) + nhdr->n_namesz;
-		long note_total_size = note_nhdr_size + nhdr->n_descsz;
-		long desc = (long)nhdr + note_nhdr_size;
-		long offset = (long)nhdr + note_total_size;
+	/* decode the notes from the index, depending on their type */
+	for (i = 0; i < proc->nr_notes; i++) {
+		note = &proc->notes[i];
 
-		switch (nhdr->n_type) {
+		switch (note->type) {
 		case NT_PRSTATUS:
-			proc->threads[thread_cnt++] =
-			    (struct elf_prstatus *)ELF_DATA_ALIGN(desc, align);
+			thread = -1;
+			if (cortex_elf_parse_prstatus(core, note,
+						      &proc->threads[thread_cnt])
+			    == 0)
+				thread = thread_cnt++;
 			break;
 		case NT_PRPSINFO:
-			proc->info =
-			    (struct elf_prpsinfo *)ELF_DATA_ALIGN(desc, align);
+			if (!proc->info)
+				proc->info = cortex_elf_parse_prpsinfo(core,
+								       note);
+			break;
+		case NT_SIGINFO:
+			if (!proc->siginfo)
+				proc->siginfo = cortex_elf_parse_siginfo(core,
+									 note);
 			break;
 		case NT_AUXV:
-			proc->auxv =
-			    (ElfN_auxv_t *) ELF_DATA_ALIGN(desc, align);
+			if (!proc->auxv)
+				cortex_elf_parse_auxv(proc, core, note);
+			break;
+		case NT_FILE:
+			if (!proc->files)
+				cortex_elf_parse_files(proc, core, note->desc,
+						       note->size);
 			break;
 		default:
+			/* FP and vector states are decoded when reported */
 			break;
 		}
 
-		nhdr = (ElfN_Nhdr *) ELF_DATA_ALIGN(offset, align);
+		note->thread = thread;
 	}
+	proc->nr_threads = thread_cnt;
 
 	/* fill some global structure helpers */
-	if (proc->info == NULL) {
-		free(proc->threads);
-		free(proc);
-		proc = NULL;
-		return NULL;
-	}
+	if (proc->info == NULL || proc->nr_threads == 0)
+		goto out_err;
+
 	proc->pid = proc->info->pr_pid;
-	proc->signum = proc->threads[0]->pr_cursig;
+	proc->signum = proc->threads[0].pr_cursig;
 
 	return proc;
+
+out_err:
+	cortex_mem_free(proc->siginfo);
+	cortex_mem_free(proc->info);
+	cortex_mem_free(proc->auxv);
+	cortex_mem_free(proc->files);
+	cortex_mem_free(proc->threads);
+	cortex_mem_free(proc->notes);
+	cortex_mem_free(proc);
+	return NULL;
+}
+
+/** \brief read a word of the core
+ * \param raw where it lies, in a segment or a memory window
+ */
+ElfN_Addr cortex_elf_get_word(struct cortex_proc_info *info, const void *raw)
+{
+	return cortex_elf_get(raw, info->word_size, info->elf->swap);
+}
+
+/** \brief find process memory in the core
+ * \param vaddr its address in the process
+ * \param len set to the number of bytes held from vaddr on
+ * \return where it lies, NULL if the core does not hold it
+ *
+ * The stack segment is looked up first, then the memory windows, then
+ * the files the process had mapped.
+ */
+const unsigned char *cortex_elf_map(struct cortex_proc_info *info,
+				    ElfN_Addr vaddr, size_t *len)
+{
+	struct cortex_elf_region *region;
+
+	if (info->stack && info->stack->d_buf && info->sp_segm &&
+	    vaddr >= info->sp_segm->p_vaddr &&
+	    vaddr - info->sp_segm->p_vaddr < info->stack->d_size) {
+		*len = info->stack->d_size - (vaddr - info->sp_segm->p_vaddr);
+		return info->stack->d_buf + vaddr - info->sp_segm->p_vaddr;
+	}
+
+	region = cortex_elf_find_region(info, vaddr);
+	if (region && region->d_buf) {
+		*len = region->size - (vaddr - region->vaddr);
+		return region->d_buf + vaddr - region->vaddr;
+	}
+
+	return cortex_fetch_map(info, vaddr, len);
+}
+
+/** \brief read a word of the process memory
+ * \param vaddr its address in the process
+ * \param value where to store it
+ * \return 0 on success, -1 if the core does not hold it
+ */
+int cortex_elf_read_word(struct cortex_proc_info *info, ElfN_Addr vaddr,
+			 ElfN_Addr *value)
+{
+	const unsigned char *raw;
+	size_t len;
+
+	raw = cortex_elf_map(info, vaddr, &len);
+	if (raw == NULL || len < (size_t)info->word_size)
+		return -1;
+
+	*value = cortex_elf_get_word(info, raw);
+	return 0;
+}
+
+/** \brief pick the layout and the backend of a core
+ * \param ident e_ident of the core
+ * \param machine e_machine of the core, EM_NONE to leave the backend
+ * \return 0 on success, -1 if the core is not supported
+ */
+int cortex_elf_select(struct cortex_elf *core, const unsigned char *ident,
+		      int machine)
+{
+	switch (ident[EI_CLASS]) {
+	case ELFCLASS32:
+		core->elf_class = &cortex_elf32_class;
+		break;
+	case ELFCLASS64:
+		core->elf_class = &cortex_elf64_class;
+		break;
+	default:
+		printf("elf: file doesn't have a compatible class.\n");
+		return -1;
+	}
+
+	switch (ident[EI_DATA]) {
+	case ELFDATA2LSB:
+	case ELFDATA2MSB:
+		core->swap = ident[EI_DATA] != CORTEX_ELF_HOST_DATA;
+		break;
+	default:
+		printf("elf: file doesn't have a compatible byte order.\n");
+		return -1;
+	}
+
+	if (machine == EM_NONE)
+		return 0;
+
+	core->arch = cortex_arch_find(machine, ident[EI_CLASS]);
+	if (!core->arch) {
+		printf("elf: unsupported machine %d (%d bit)\n", machine,
+		       core->elf_class->word_size * 8);
+		return -1;
+	}
+
+	return 0;
 }
 
 static int cortex_check_ident(struct cortex_elf *core)
@@ -335,6 +829,12 @@ static int cortex_check_ident(struct cortex_elf *core)
 		return -1;
 	}
 
+	/* cortex own stripped format */
+	if (memcmp(e_ident, CORTEX_MINI_MAGIC, CORTEX_MINI_MAGIC_LEN) == 0) {
+		core->format = CORTEX_ELF_FORMAT_MINI;
+		return 0;
+	}
+
 	/* check magic */
 	if (e_ident[EI_MAG0] != ELFMAG0) {
 		printf("elf: wrong magic[0].\n");
@@ -353,12 +853,11 @@ static int cortex_check_ident(struct cortex_elf *core)
 		return -1;
 	}
 
-	/* check elf file class */
-	if (e_ident[EI_CLASS] != ELFCLASSN) {
-		printf("elf: file doesn't have a compatible class.\n");
+	/* check elf file class and byte order */
+	if (cortex_elf_select(core, e_ident, EM_NONE) < 0)
 		return -1;
-	}
-	/* check elf file class */
+
+	/* check elf file version */
 	if (e_ident[EI_VERSION] != EV_CURRENT) {
 		printf("elf: file doesn't have a compatible version.\n");
 		return -1;
@@ -419,7 +918,7 @@ static ElfN_Phdr *cortex_find_segment_vaddr(ElfN_Phdr * phdr, ElfN_Ehdr * ehdr,
 		ElfN_Addr vaddr_start = phdr[i].p_vaddr;
 		ElfN_Addr vaddr_end = phdr[i].p_vaddr + phdr[i].p_memsz;
 
-		if ((vaddr_start < vaddr) && (vaddr < vaddr_end)) {
+		if ((vaddr_start <= vaddr) && (vaddr < vaddr_end)) {
 			segm = phdr + i;
 			break;
 		}
@@ -428,49 +927,492 @@ static ElfN_Phdr *cortex_find_segment_vaddr(ElfN_Phdr * phdr, ElfN_Ehdr * ehdr,
 	return segm;
 }
 
+static int cortex_elf_fetch_cmp(const void *a, const void *b)
+{
+	const struct cortex_elf_fetch *fa = a;
+	const struct cortex_elf_fetch *fb = b;
+
+	if (fa->offset < fb->offset)
+		return -1;
+	return fa->offset > fb->offset;
+}
+
+/* Read all requested ranges in a single forward pass: the core
+   may come from a pipe, so we cannot go back. Overlapping ranges
+   are filled from the same blocks. */
+static void cortex_elf_fetch(struct cortex_elf *core,
+			     struct cortex_elf_fetch *fetch, int nr)
+{
+	unsigned char block[CORTEX_ELF_BLOCK];
+	unsigned long pos = core->offset;
+	int first = 0;
+	int i = 0;
+
+	qsort(fetch, nr, sizeof(*fetch), cortex_elf_fetch_cmp);
+
+	while (first < nr) {
+		ElfN_Off limit = 0;
+		long count = 0;
+
+		/* skip what is already behind us */
+		if (fetch[first].offset + fetch[first].size <= pos) {
+			first++;
+			continue;
+		}
+
+		if (fetch[first].offset > pos) {
+			pos = __cortex_fseek(core, fetch[first].offset);
+			if (pos != fetch[first].offset) {
+				fprintf(stderr, "%s: %s\n", __FILE__,
+					__cortex_elf_short_read());
+				break;
+			}
+		}
+
+		/* do not read past the farthest range we need */
+		for (i = first; i < nr && fetch[i].offset <= pos; i++)
+			limit = max(limit, fetch[i].offset + fetch[i].size);
+
+		count =
+		    __cortex_elf_read(core, block,
+				      min(CORTEX_ELF_BLOCK, limit - pos));
+		if (count <= 0) {
+			fprintf(stderr, "%s: %s\n", __FILE__,
+				__cortex_elf_short_read());
+			break;
+		}
+
+		for (i = first; i < nr && fetch[i].offset < pos + count; i++) {
+			ElfN_Off lo = max(pos, fetch[i].offset);
+			ElfN_Off hi =
+			    min(pos + count, fetch[i].offset + fetch[i].size);
+
+			if (lo >= hi)
+				continue;
+
+			if (!fetch[i].filled)
+				CORTEX_PROBE2(fetch_start, fetch[i].offset,
+					      fetch[i].size);
+
+			memcpy(fetch[i].d_buf + lo - fetch[i].offset,
+			       block + lo - pos, hi - lo);
+			fetch[i].filled += hi - lo;
+
+			if (fetch[i].filled == fetch[i].size)
+				CORTEX_PROBE3(fetch_end, fetch[i].offset,
+					      fetch[i].size, fetch[i].filled);
+		}
+
+		pos += count;
+	}
+
+	/* ranges the core did not contain end short */
+	for (i = 0; i < nr; i++)
+		if (fetch[i].filled != fetch[i].size)
+			CORTEX_PROBE3(fetch_end, fetch[i].offset,
+				      fetch[i].size, fetch[i].filled);
+}
+
+static int cortex_elf_add_window(struct cortex_elf *core,
+				 struct cortex_elf_window **windows,
+				 int *nr_windows, ElfN_Addr anchor,
+				 ElfN_Addr before, ElfN_Addr after, int type,
+				 int thread)
+{
+	struct cortex_elf_window *win = NULL;
+	ElfN_Phdr *segm = cortex_elf_find_segment(core, anchor);
+	ElfN_Addr start = 0;
+	ElfN_Addr end = 0;
+
+	/* only the part of the segment present in the core is usable */
+	if (!segm || anchor >= segm->p_vaddr + segm->p_filesz)
+		return 0;
+
+	start = segm->p_vaddr;
+	if (anchor - segm->p_vaddr > before)
+		start = anchor - before;
+
+	end = segm->p_vaddr + segm->p_filesz;
+	if (end - anchor > after)
+		end = anchor + after;
+
+	/* grow the array by powers of two */
+	if ((*nr_windows & (*nr_windows - 1)) == 0) {
+		win = cortex_mem_realloc(*windows, max(1, *nr_windows * 2) *
+			      sizeof(struct cortex_elf_window));
+		if (!win)
+			return -1;
+		*windows = win;
+	}
+
+	win = *windows + (*nr_windows)++;
+	memset(win, 0, sizeof(*win));
+	win->segm = segm;
+	win->region.vaddr = start;
+	win->region.size = end - start;
+	win->region.type = type;
+	win->region.thread = thread;
+	win->region.flags = segm->p_flags;
+
+	return 0;
+}
+
+static int cortex_elf_window_cmp(const void *a, const void *b)
+{
+	const struct cortex_elf_window *wa = a;
+	const struct cortex_elf_window *wb = b;
+
+	if (wa->region.vaddr < wb->region.vaddr)
+		return -1;
+	return wa->region.vaddr > wb->region.vaddr;
+}
+
+/* merge overlapping windows of the same segment. Stack windows
+   win over code windows, that win over data windows. */
+static int cortex_elf_merge_windows(struct cortex_elf_window *windows, int nr)
+{
+	int i = 0;
+	int nr_merged = 0;
+
+	if (nr == 0)
+		return 0;
+
+	qsort(windows, nr, sizeof(*windows), cortex_elf_window_cmp);
+
+	for (i = 1; i < nr; i++) {
+		struct cortex_elf_region *prev = &windows[nr_merged].region;
+		struct cortex_elf_region *cur = &windows[i].region;
+
+		if (windows[i].segm == windows[nr_merged].segm &&
+		    cur->vaddr <= prev->vaddr + prev->size) {
+			ElfN_Addr end = max(prev->vaddr + prev->size,
+					    cur->vaddr + cur->size);
+
+			prev->size = end - prev->vaddr;
+			if (cur->type < prev->type) {
+				prev->type = cur->type;
+				prev->thread = cur->thread;
+			}
+		} else {
+			windows[++nr_merged] = windows[i];
+		}
+	}
+
+	return nr_merged + 1;
+}
+
+/* Collect the stack and code windows of all threads, and the
+   memory pointed to by the registers of the active thread */
+static int cortex_elf_plan_windows(struct cortex_proc_info *info,
+				   struct cortex_elf_window **windows)
+{
+	int nr = 0;
+	int i = 0;
+	int t = 0;
+
+	for (t = 0; t < info->nr_threads; t++) {
+		struct cortex_cpu_regs cpu_regs[CORTEX_CPU_REGS_MAX];
+		long nr_regs = info->arch->fill_regs(cpu_regs,
+						     info->threads[t].pr_reg);
+		ElfN_Addr pc = info->arch->get_pc(cpu_regs);
+		ElfN_Addr sp = info->arch->get_sp(cpu_regs);
+
+		cortex_elf_add_window(info->elf, windows, &nr, sp,
+				      CORTEX_WINDOW_REDZONE,
+				      CORTEX_WINDOW_STACK,
+				      CORTEX_REGION_STACK, t);
+		cortex_elf_add_window(info->elf, windows, &nr, pc,
+				      CORTEX_WINDOW_CODE, CORTEX_WINDOW_CODE,
+				      CORTEX_REGION_CODE, t);
+
+		if (t != 0)
+			continue;
+
+		for (i = 0; i < nr_regs; i++) {
+			cortex_elf_add_window(info->elf, windows, &nr,
+					      cpu_regs[i].value,
+					      CORTEX_WINDOW_DATA,
+					      CORTEX_WINDOW_DATA,
+					      CORTEX_REGION_DATA, t);
+		}
+	}
+
+	/* headers of the mapped files, to identify them */
+	for (i = 0; i < info->nr_files; i++) {
+		if (info->files[i].offset != 0)
+			continue;
+		cortex_elf_add_window(info->elf, windows, &nr,
+				      info->files[i].start, 0,
+				      CORTEX_WINDOW_MODULE,
+				      CORTEX_REGION_MODULE, 0);
+	}
+
+	return cortex_elf_merge_windows(*windows, nr);
+}
+
+/* Make a segment of the memory window around addr, and use it in place
+   of *segm. d_buf is shared with the window. */
+static struct cortex_elf_data *cortex_elf_window_data(struct cortex_proc_info
+						      *info, ElfN_Phdr ** segm,
+						      ElfN_Phdr * window,
+						      ElfN_Addr addr)
+{
+	struct cortex_elf_region *region = cortex_elf_find_region(info, addr);
+	struct cortex_elf_data *data = NULL;
+
+	if (!region || !*segm)
+		return NULL;
+
+	data = cortex_mem_calloc(1, sizeof(struct cortex_elf_data));
+	if (!data)
+		return NULL;
+
+	data->d_buf = region->d_buf;
+	data->d_size = region->size;
+	data->d_align = (*segm)->p_align;
+	data->d_window = 1;
+
+	*window = **segm;
+	window->p_offset += region->vaddr - window->p_vaddr;
+	window->p_vaddr = region->vaddr;
+	window->p_filesz = region->size;
+	window->p_memsz = region->size;
+	*segm = window;
+
+	return data;
+}
+
+/* Load the memory windows, then the code and stack segments if the
+   memory budget allows it */
+static void cortex_elf_load_memory(struct cortex_proc_info *info)
+{
+	struct cortex_elf_window *windows = NULL;
+	struct cortex_elf_fetch *fetch = NULL;
+	int nr_windows = 0;
+	int nr_fetch = 0;
+	int i = 0;
+
+	nr_windows = cortex_elf_plan_windows(info, &windows);
+
+	info->regions = cortex_mem_calloc(max(1, nr_windows),
+			       sizeof(struct cortex_elf_region));
+	fetch = cortex_mem_calloc(nr_windows + 2, sizeof(struct cortex_elf_fetch));
+	if (!info->regions || !fetch)
+		goto out;
+
+	/* windows first: they are small and every output relies on them */
+	for (i = 0; i < nr_windows; i++) {
+		struct cortex_elf_region *region = &windows[i].region;
+
+		region->d_buf = cortex_mem_calloc(1, region->size);
+		if (!region->d_buf)
+			continue;
+
+		fetch[nr_fetch].offset = windows[i].segm->p_offset +
+		    region->vaddr - windows[i].segm->p_vaddr;
+		fetch[nr_fetch].size = region->size;
+		fetch[nr_fetch++].d_buf = region->d_buf;
+
+		info->regions[info->nr_regions++] = *region;
+	}
+
+	info->code = cortex_elf_alloc_data(info->pc_segm);
+	info->stack = cortex_elf_alloc_data(info->sp_segm);
+	if (info->code) {
+		fetch[nr_fetch].offset = info->pc_segm->p_offset;
+		fetch[nr_fetch].size = info->code->d_size;
+		fetch[nr_fetch++].d_buf = info->code->d_buf;
+	}
+	if (info->stack) {
+		fetch[nr_fetch].offset = info->sp_segm->p_offset;
+		fetch[nr_fetch].size = info->stack->d_size;
+		fetch[nr_fetch++].d_buf = info->stack->d_buf;
+	}
+
+	cortex_elf_fetch(info->elf, fetch, nr_fetch);
+
+	/* drop what the core did not contain */
+	for (i = 0; i < nr_fetch; i++) {
+		int j = 0;
+
+		if (fetch[i].filled == fetch[i].size)
+			continue;
+
+		if (info->code && fetch[i].d_buf == info->code->d_buf) {
+			cortex_elf_free_data(info->code);
+			info->code = NULL;
+		} else if (info->stack && fetch[i].d_buf == info->stack->d_buf) {
+			cortex_elf_free_data(info->stack);
+			info->stack = NULL;
+		}
+
+		for (j = 0; j < info->nr_regions; j++) {
+			if (info->regions[j].d_buf != fetch[i].d_buf)
+				continue;
+			cortex_mem_free(info->regions[j].d_buf);
+			memmove(info->regions + j, info->regions + j + 1,
+				(info->nr_regions - j - 1) *
+				sizeof(struct cortex_elf_region));
+			info->nr_regions--;
+			break;
+		}
+	}
+
+	/* the kernel may have left the text out, it is on disk */
+	if (!info->code)
+		cortex_fetch_code(info);
+
+	/* a segment that did not fit is replaced by its window */
+	if (!info->code)
+		info->code = cortex_elf_window_data(info, &info->pc_segm,
+						    &info->pc_window, info->pc);
+	if (!info->stack)
+		info->stack = cortex_elf_window_data(info, &info->sp_segm,
+						     &info->sp_window, info->sp);
+
+out:
+	cortex_mem_free(fetch);
+	cortex_mem_free(windows);
+}
+
+/** \brief find the memory window that contains an address
+ * \return the region or NULL
+ */
+struct cortex_elf_region *cortex_elf_find_region(struct cortex_proc_info *info,
+						 ElfN_Addr vaddr)
+{
+	int lo = 0;
+	int hi = info->nr_regions - 1;
+
+	while (lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+		struct cortex_elf_region *region = &info->regions[mid];
+
+		if (vaddr < region->vaddr) {
+			hi = mid - 1;
+		} else if (vaddr >= region->vaddr + region->size) {
+			lo = mid + 1;
+		} else {
+			return region;
+		}
+	}
+
+	return NULL;
+}
+
+/** \brief find the file mapped at an address, from NT_FILE
+ * \return the mapping or NULL
+ */
+struct cortex_elf_file *cortex_elf_find_file(struct cortex_proc_info *info,
+					     ElfN_Addr vaddr)
+{
+	int lo = 0;
+	int hi = info->nr_files - 1;
+
+	/* the kernel writes the mappings in address order */
+	while (lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+		struct cortex_elf_file *file = &info->files[mid];
+
+		if (vaddr < file->start) {
+			hi = mid - 1;
+		} else if (vaddr >= file->end) {
+			lo = mid + 1;
+		} else {
+			return file;
+		}
+	}
+
+	return NULL;
+}
+
+ElfN_Phdr *cortex_elf_find_segment(struct cortex_elf *core, ElfN_Addr vaddr)
+{
+	return cortex_find_segment_vaddr(core->phdr, core->ehdr, vaddr);
+}
+
+struct cortex_proc_info *cortex_elf_parse_process(struct cortex_elf *core,
+						  ElfN_Phdr * note,
+						  struct cortex_elf_data *data)
+{
+	struct cortex_proc_info *info = NULL;
+
+	info = cortex_elf_parse_note(core, data);
+	if (info == NULL)
+		return NULL;
+
+	info->note_segm = note;
+	info->note = data;
+	info->elf = core;
+	info->arch = core->arch;
+	info->word_size = core->arch->word_size;
+
+	/* the registers of the active thread, owned by this analysis */
+	info->cpu_regs = cortex_mem_calloc(CORTEX_CPU_REGS_MAX,
+					   sizeof(struct cortex_cpu_regs));
+	if (info->cpu_regs == NULL) {
+		/* the note belongs to the caller until we succeed */
+		info->note = NULL;
+		cortex_elf_cleanup_process_info(info);
+		return NULL;
+	}
+
+	info->cpu_regs_nr = info->arch->fill_regs(info->cpu_regs,
+						  info->threads[0].pr_reg);
+
+	/* Then look for the segment that contains
+	   the instruction pointer */
+	info->pc = info->arch->get_pc(info->cpu_regs);
+	info->pc_segm = cortex_elf_find_segment(core, info->pc);
+
+	/* and the one that contains the stack */
+	info->sp = info->arch->get_sp(info->cpu_regs);
+	info->sp_segm = cortex_elf_find_segment(core, info->sp);
+
+	return info;
+}
+
 struct cortex_proc_info *cortex_elf_parse(struct cortex_elf *core,
 					  ElfN_Ehdr * ehdr)
 {
-	struct pt_regs *pr_regs;
 	struct cortex_elf_data *data = NULL;
 	struct cortex_proc_info *info = NULL;
 
 	ElfN_Phdr *note = 0;
-	ElfN_Phdr *phdr = cortex_elf_getphdr(core);
+	ElfN_Phdr *phdr = NULL;
+	uint64_t begin;
+
+	begin = cortex_stats_begin();
+	phdr = cortex_elf_getphdr(core);
+	cortex_stats_end(CORTEX_STATS_HEADERS, begin);
+	if (phdr)
+		CORTEX_PROBE2(phdr_loaded, ehdr->e_phnum, core->offset);
 
 	/* retrieve generic information about the process
 	   registers... */
+	begin = cortex_stats_begin();
 	note = cortex_find_segment_type(phdr, ehdr, PT_NOTE);
 	if (note == NULL)
 		goto err_out;
+	CORTEX_PROBE2(note_start, note->p_offset, note->p_filesz);
 	data = cortex_load_segment(core, ehdr, note);
 	if (data == NULL)
 		goto err_out;
-	info = cortex_elf_parse_note(data);
+	info = cortex_elf_parse_process(core, note, data);
 	if (info == NULL)
 		goto err_out;
+	CORTEX_PROBE2(note_end, info->nr_threads, info->signum);
+	cortex_stats_end(CORTEX_STATS_NOTES, begin);
 
-	info->note_segm = note;
-	info->note = data;
-	info->elf = core;
-
-	pr_regs = (struct pt_regs *)info->threads[0]->pr_reg;
-	info->word_size = cortex_arch_ops.get_word_size();
-	info->cpu_regs_nr = cortex_arch_ops.fill_regs(info, pr_regs);
-
-	/* Then look for the segment that contains
-	   the instruction pointer */
-	info->pc = cortex_arch_ops.get_pc(info->cpu_regs);
-	info->pc_segm = cortex_find_segment_vaddr(phdr, ehdr, info->pc);
-	info->code = cortex_load_segment(core, ehdr, info->pc_segm);
-
-	/* Finally, load the stack segment */
-	info->sp = cortex_arch_ops.get_sp(info->cpu_regs);
-	info->sp_segm = cortex_find_segment_vaddr(phdr, ehdr, info->sp);
-	info->stack = cortex_load_segment(core, ehdr, info->sp_segm);
+	/* Finally, load the code, the stack and the memory
+	   windows in a single pass over the core */
+	begin = cortex_stats_begin();
+	cortex_elf_load_memory(info);
+	cortex_stats_end(CORTEX_STATS_MEMORY, begin);
 
 	return info;
 err_out:
+	cortex_elf_free_data(data);
 	fprintf(stderr, "Cannot read segment PT_NOTE\n");
 	return NULL;
 }
@@ -484,6 +1426,8 @@ struct cortex_elf *cortex_elf_load_core(int fd)
 	if (cortex_check_ident(core) < 0) {
 		cortex_elf_end(core);
 		core = NULL;
+	} else {
+		CORTEX_PROBE2(core_open, fd, core->format);
 	}
 
 	return core;
@@ -504,34 +1448,64 @@ ElfN_Ehdr *cortex_elf_load_ehdr(struct cortex_elf * core)
 	}
 
 	/* check elf machine type */
-	if (ehdr->e_machine != MACHINE) {
-		printf("elf: wrong machine. Got %d but expect %d\n",
-		       ehdr->e_machine, MACHINE);
+	if (cortex_elf_select(core, ehdr->e_ident, ehdr->e_machine) < 0)
+		return NULL;
+
+	if (ehdr->e_phnum && ehdr->e_phentsize != core->elf_class->phdr_size) {
+		printf("elf: wrong program header size %d.\n",
+		       ehdr->e_phentsize);
 		return NULL;
 	}
+
+	CORTEX_PROBE2(ehdr_loaded, ehdr->e_phnum, ehdr->e_phoff);
 out_err:
 	return ehdr;
 }
 
 void cortex_elf_cleanup_process_info(struct cortex_proc_info *info)
 {
+	int i = 0;
+
 	if (info) {
-		if (info->stack)
-			free(info->stack->d_buf);
-		if (info->note)
-			free(info->note->d_buf);
-		if (info->code)
-			free(info->code->d_buf);
-		free(info->stack);
-		free(info->note);
-		free(info->code);
-		free(info->threads);
-		free(info);
+		for (i = 0; info->unwind && i < info->nr_threads; i++)
+			cortex_mem_free(info->unwind[i].frames);
+		cortex_mem_free(info->unwind);
+		cortex_mem_free(info->groups);
+		for (i = 0; i < info->nr_regions; i++)
+			cortex_mem_free(info->regions[i].d_buf);
+		cortex_elf_free_data(info->stack);
+		cortex_elf_free_data(info->code);
+		cortex_mem_free(info->regions);
+		cortex_fetch_free(info->fetch);
+		cortex_mem_free(info->cpu_regs);
+		cortex_mem_free(info->files);
+		cortex_elf_free_data(info->note);
+		cortex_mem_free(info->auxv);
+		cortex_mem_free(info->info);
+		cortex_mem_free(info->siginfo);
+		cortex_mem_free(info->threads);
+		cortex_mem_free(info->notes);
+		cortex_mem_free(info);
 	}
 }
 
+/** \brief read the rest of the core, for the stream analyzers
+ * \return 0 once the end of the core is reached, -1 if the deadline
+ * expired first
+ */
+int cortex_elf_drain(struct cortex_elf *core)
+{
+	off_t offset;
+
+	do {
+		offset = core->offset + CORTEX_ELF_BLOCK;
+	} while (__cortex_fseek(core, offset) == offset);
+
+	return cortex_deadline_expired() ? -1 : 0;
+}
+
 void cortex_elf_release_core(struct cortex_elf *core)
 {
 	cortex_elf_end(core);
-	free(core);
+	cortex_mem_free(core);
 }
@@ -23,64 +23,161 @@
  */
 
 #include <elf.h>
-#include <sys/procfs.h>
-#include <asm/ptrace.h>
-
-/** \brief defines depending on cpu nr bits */
-#if defined(LINUX32)
-	/* select arch: 32 bit */
-#define ElfN_Ehdr       Elf32_Ehdr
-#define ElfN_Phdr       Elf32_Phdr
-#define ElfN_Nhdr       Elf32_Nhdr
-#define ElfN_Shdr       Elf32_Shdr
-#define ElfN_Addr	Elf32_Addr
-#define ElfN_Off 	Elf32_Off
-#define ELFCLASSN	ELFCLASS32
-
-#define elfN_getehdr	elf32_getehdr
-#define elfN_getphdr	elf32_getphdr
-#define elfN_getshdr	elf32_getshdr
-
-#define ElfN_auxv_t	Elf32_auxv_t
-#elif defined(LINUX64)
-	/* select arch: 64 bit */
+#include <stdint.h>
+#include <stddef.h>
+#include <endian.h>
+
+/** \brief cortex types
+ *
+ * Cores of both classes and byte orders are read into 64 bit headers
+ * in host byte order (see cortex_elf_class.h), so that one binary
+ * handles the cores of every supported architecture.
+ */
 #define ElfN_Ehdr       Elf64_Ehdr
 #define ElfN_Phdr       Elf64_Phdr
 #define ElfN_Nhdr       Elf64_Nhdr
 #define ElfN_Shdr       Elf64_Shdr
 #define ElfN_Addr	Elf64_Addr
 #define ElfN_Off 	Elf64_Off
-#define ELFCLASSN	ELFCLASS64
-
-#define elfN_getehdr	elf64_getehdr
-#define elfN_getphdr	elf64_getphdr
-#define elfN_getshdr	elf64_getshdr
 
 #define ElfN_auxv_t	Elf64_auxv_t
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define CORTEX_ELF_HOST_DATA	ELFDATA2LSB
 #else
-	/* default: */
-#error "please specify 32b or 64b target using MODE=64 or MODE=32"
+#define CORTEX_ELF_HOST_DATA	ELFDATA2MSB
 #endif
 
+struct cortex_proc_info;
+struct cortex_arch_ops;
+
+enum cortex_elf_format {
+	CORTEX_ELF_FORMAT_CORE = 0,	/*!< regular ELF core file */
+	CORTEX_ELF_FORMAT_MINI,	/*!< cortex sparse minicore */
+};
+
+enum cortex_elf_region_type {
+	CORTEX_REGION_NOTE = 0,
+	CORTEX_REGION_STACK,
+	CORTEX_REGION_CODE,
+	CORTEX_REGION_DATA,
+	CORTEX_REGION_MODULE,
+};
+
+/** \struct cortex_elf_class
+ ** \brief layout of the 32 or 64 bit ELF structures
+ *
+ * The conversions between the file layout and the cortex types, in
+ * either byte order.
+ */
+struct cortex_elf_class {
+	int elf_class;		/*!< ELFCLASS32 or ELFCLASS64 */
+	int word_size;		/*!< size of an address in the core */
+	size_t ehdr_size;	/*!< size of the ELF header in the file */
+	size_t phdr_size;	/*!< size of a program header in the file */
+
+	void (*read_ehdr) (ElfN_Ehdr * ehdr, const void *raw, int swap);
+	void (*read_phdr) (ElfN_Phdr * phdr, const void *raw, int swap);
+	void (*write_ehdr) (void *raw, const ElfN_Ehdr * ehdr, int swap);
+	void (*write_phdr) (void *raw, const ElfN_Phdr * phdr, int swap);
+};
+
+extern const struct cortex_elf_class cortex_elf32_class;
+extern const struct cortex_elf_class cortex_elf64_class;
+
 struct cortex_elf {
 	int fd;
+	int format;
 	unsigned long offset;
 
+	unsigned char e_ident[EI_NIDENT];	/*!< first bytes of the file */
+	const struct cortex_elf_class *elf_class;	/*!< 32 or 64 bit */
+	int swap;		/*!< the core byte order is not the host one */
+	const struct cortex_arch_ops *arch;	/*!< backend of e_machine */
+
 	ElfN_Ehdr *ehdr;
 	ElfN_Phdr *phdr;
+
+	struct cortex_stream *stream;	/*!< analyzers fed with every byte
+					   of the core, if any */
 };
 
 struct cortex_elf_data {
 	size_t d_size;
 	ElfN_Addr d_align;
 	unsigned char *d_buf;
+	int d_window;		/*!< d_buf belongs to a memory window */
+};
+
+/** \struct cortex_elf_region
+ ** \brief a small window of process memory
+ *
+ * Regions are the parts of the PT_LOAD segments that are worth
+ * keeping: thread stacks, code around each pc and memory around
+ * the pointers held in registers.
+ */
+struct cortex_elf_region {
+	ElfN_Addr vaddr;	/*!< address of the first byte */
+	size_t size;		/*!< size of the window */
+	int type;		/*!< stack, code or data */
+	int thread;		/*!< index of the thread it belongs to */
+	uint32_t flags;		/*!< p_flags of the original segment */
+	unsigned char *d_buf;	/*!< window content */
+};
+
+/** \struct cortex_elf_note
+ ** \brief an entry of the note index
+ *
+ * The PT_NOTE segment is walked once and every note is recorded, in
+ * the order of the core. The kernel writes the notes of a thread right
+ * after its NT_PRSTATUS: that is how they are told apart.
+ */
+struct cortex_elf_note {
+	uint32_t type;		/*!< n_type */
+	int thread;		/*!< index of the thread of the last NT_PRSTATUS
+				   before it, -1 if there is none */
+	unsigned char *desc;	/*!< descriptor, in the note buffer */
+	size_t size;		/*!< n_descsz */
+};
+
+/** \struct cortex_elf_file
+ ** \brief a file mapping from the NT_FILE note
+ */
+struct cortex_elf_file {
+	ElfN_Addr start;	/*!< first mapped address */
+	ElfN_Addr end;		/*!< end of the mapping */
+	ElfN_Addr offset;	/*!< offset of the mapping in the file */
+	const char *name;	/*!< path of the file, in the note buffer */
 };
 
+uint64_t cortex_elf_get(const void *raw, size_t size, int swap);
+void cortex_elf_put(void *raw, size_t size, uint64_t value, int swap);
+ElfN_Addr cortex_elf_get_word(struct cortex_proc_info *info, const void *raw);
+const unsigned char *cortex_elf_map(struct cortex_proc_info *info,
+				    ElfN_Addr vaddr, size_t * len);
+int cortex_elf_read_word(struct cortex_proc_info *info, ElfN_Addr vaddr,
+			 ElfN_Addr * value);
+
+int cortex_elf_select(struct cortex_elf *core, const unsigned char *ident,
+		      int machine);
+
 struct cortex_elf *cortex_elf_load_core(int elf_core_fd);
 ElfN_Ehdr *cortex_elf_load_ehdr(struct cortex_elf *core);
 
 struct cortex_proc_info *cortex_elf_parse(struct cortex_elf *core,
 					  ElfN_Ehdr * ehdr);
+struct cortex_proc_info *cortex_elf_parse_process(struct cortex_elf *core,
+						  ElfN_Phdr * note,
+						  struct cortex_elf_data *data);
+struct cortex_elf_note *cortex_elf_find_note(struct cortex_proc_info *info,
+					     uint32_t type, int thread);
+ElfN_Phdr *cortex_elf_find_segment(struct cortex_elf *core, ElfN_Addr vaddr);
+struct cortex_elf_region *cortex_elf_find_region(struct cortex_proc_info *info,
+						 ElfN_Addr vaddr);
+struct cortex_elf_file *cortex_elf_find_file(struct cortex_proc_info *info,
+					     ElfN_Addr vaddr);
+
+int cortex_elf_drain(struct cortex_elf *core);
 
 void cortex_elf_cleanup_process_info(struct cortex_proc_info *info);
 void cortex_elf_release_core(struct cortex_elf *core);
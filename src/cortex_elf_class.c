@@ -0,0 +1,85 @@
+/** \file cortex_elf_class.c
+ * \brief cortex 32 and 64 bit ELF layouts
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <string.h>
+#include <byteswap.h>
+
+#include "cortex_elf.h"
+
+/** \brief read an integer of the core
+ * \param raw where it lies in the core, unaligned
+ * \param size 1, 2, 4 or 8 bytes
+ * \param swap the core byte order is not the host one
+ */
+uint64_t cortex_elf_get(const void *raw, size_t size, int swap)
+{
+	uint16_t v16;
+	uint32_t v32;
+	uint64_t v64;
+
+	switch (size) {
+	case 1:
+		return *(const uint8_t *)raw;
+	case 2:
+		memcpy(&v16, raw, sizeof(v16));
+		return swap ? bswap_16(v16) : v16;
+	case 4:
+		memcpy(&v32, raw, sizeof(v32));
+		return swap ? bswap_32(v32) : v32;
+	case 8:
+		memcpy(&v64, raw, sizeof(v64));
+		return swap ? bswap_64(v64) : v64;
+	}
+
+	return 0;
+}
+
+/** \brief write an integer in the core byte order, truncated to size */
+void cortex_elf_put(void *raw, size_t size, uint64_t value, int swap)
+{
+	uint16_t v16;
+	uint32_t v32;
+
+	switch (size) {
+	case 1:
+		*(uint8_t *) raw = value;
+		break;
+	case 2:
+		v16 = swap ? bswap_16(value) : value;
+		memcpy(raw, &v16, sizeof(v16));
+		break;
+	case 4:
+		v32 = swap ? bswap_32(value) : value;
+		memcpy(raw, &v32, sizeof(v32));
+		break;
+	case 8:
+		value = swap ? bswap_64(value) : value;
+		memcpy(raw, &value, sizeof(value));
+		break;
+	}
+}
+
+#define CORTEX_ELF_BITS 32
+#include "cortex_elf_class.h"
+#undef CORTEX_ELF_BITS
+
+#define CORTEX_ELF_BITS 64
+#include "cortex_elf_class.h"
+#undef CORTEX_ELF_BITS
@@ -0,0 +1,137 @@
+/** \file cortex_elf_class.h
+ * \brief cortex ELF layouts, generic over the class
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Included by cortex_elf_class.c once per class, with CORTEX_ELF_BITS set
+ * to 32 then 64: the conversions between the headers of the file and the
+ * cortex types are written once for both. Every field is copied from its
+ * offset in the file, so the raw buffers need no alignment.
+ *
+ * No include guard on purpose.
+ */
+
+#ifndef CORTEX_ELF_BITS
+#error "CORTEX_ELF_BITS must be 32 or 64"
+#endif
+
+#define __CORTEX_ELF_PASTE(a, b, c)	a ## b ## c
+#define __CORTEX_ELF_EXPAND(a, b, c)	__CORTEX_ELF_PASTE(a, b, c)
+
+/* Elf32_Ehdr or Elf64_Ehdr, cortex_elf32_xxx or cortex_elf64_xxx */
+#define ElfW(type)	__CORTEX_ELF_EXPAND(Elf, CORTEX_ELF_BITS, _ ## type)
+#define cortex_elfW(name) \
+	__CORTEX_ELF_EXPAND(cortex_elf, CORTEX_ELF_BITS, _ ## name)
+
+#define CORTEX_ELF_GET(dst, src, field) \
+	((dst)->field = cortex_elf_get(&(src)->field, sizeof((src)->field), \
+				       swap))
+#define CORTEX_ELF_PUT(dst, src, field) \
+	cortex_elf_put(&(dst)->field, sizeof((dst)->field), (src)->field, swap)
+
+static void cortex_elfW(read_ehdr) (ElfN_Ehdr * ehdr, const void *raw,
+				    int swap)
+{
+	const ElfW(Ehdr) *src = raw;
+
+	memcpy(ehdr->e_ident, src->e_ident, EI_NIDENT);
+	CORTEX_ELF_GET(ehdr, src, e_type);
+	CORTEX_ELF_GET(ehdr, src, e_machine);
+	CORTEX_ELF_GET(ehdr, src, e_version);
+	CORTEX_ELF_GET(ehdr, src, e_entry);
+	CORTEX_ELF_GET(ehdr, src, e_phoff);
+	CORTEX_ELF_GET(ehdr, src, e_shoff);
+	CORTEX_ELF_GET(ehdr, src, e_flags);
+	CORTEX_ELF_GET(ehdr, src, e_ehsize);
+	CORTEX_ELF_GET(ehdr, src, e_phentsize);
+	CORTEX_ELF_GET(ehdr, src, e_phnum);
+	CORTEX_ELF_GET(ehdr, src, e_shentsize);
+	CORTEX_ELF_GET(ehdr, src, e_shnum);
+	CORTEX_ELF_GET(ehdr, src, e_shstrndx);
+}
+
+static void cortex_elfW(read_phdr) (ElfN_Phdr * phdr, const void *raw,
+				    int swap)
+{
+	const ElfW(Phdr) *src = raw;
+
+	CORTEX_ELF_GET(phdr, src, p_type);
+	CORTEX_ELF_GET(phdr, src, p_flags);
+	CORTEX_ELF_GET(phdr, src, p_offset);
+	CORTEX_ELF_GET(phdr, src, p_vaddr);
+	CORTEX_ELF_GET(phdr, src, p_paddr);
+	CORTEX_ELF_GET(phdr, src, p_filesz);
+	CORTEX_ELF_GET(phdr, src, p_memsz);
+	CORTEX_ELF_GET(phdr, src, p_align);
+}
+
+static void cortex_elfW(write_ehdr) (void *raw, const ElfN_Ehdr * ehdr,
+				     int swap)
+{
+	ElfW(Ehdr) *dst = raw;
+
+	memcpy(dst->e_ident, ehdr->e_ident, EI_NIDENT);
+	CORTEX_ELF_PUT(dst, ehdr, e_type);
+	CORTEX_ELF_PUT(dst, ehdr, e_machine);
+	CORTEX_ELF_PUT(dst, ehdr, e_version);
+	CORTEX_ELF_PUT(dst, ehdr, e_entry);
+	CORTEX_ELF_PUT(dst, ehdr, e_phoff);
+	CORTEX_ELF_PUT(dst, ehdr, e_shoff);
+	CORTEX_ELF_PUT(dst, ehdr, e_flags);
+	CORTEX_ELF_PUT(dst, ehdr, e_ehsize);
+	CORTEX_ELF_PUT(dst, ehdr, e_phentsize);
+	CORTEX_ELF_PUT(dst, ehdr, e_phnum);
+	CORTEX_ELF_PUT(dst, ehdr, e_shentsize);
+	CORTEX_ELF_PUT(dst, ehdr, e_shnum);
+	CORTEX_ELF_PUT(dst, ehdr, e_shstrndx);
+}
+
+static void cortex_elfW(write_phdr) (void *raw, const ElfN_Phdr * phdr,
+				     int swap)
+{
+	ElfW(Phdr) *dst = raw;
+
+	CORTEX_ELF_PUT(dst, phdr, p_type);
+	CORTEX_ELF_PUT(dst, phdr, p_flags);
+	CORTEX_ELF_PUT(dst, phdr, p_offset);
+	CORTEX_ELF_PUT(dst, phdr, p_vaddr);
+	CORTEX_ELF_PUT(dst, phdr, p_paddr);
+	CORTEX_ELF_PUT(dst, phdr, p_filesz);
+	CORTEX_ELF_PUT(dst, phdr, p_memsz);
+	CORTEX_ELF_PUT(dst, phdr, p_align);
+}
+
+const struct cortex_elf_class cortex_elfW(class) = {
+	.elf_class = __CORTEX_ELF_EXPAND(ELFCLASS, CORTEX_ELF_BITS,),
+	.word_size = CORTEX_ELF_BITS / 8,
+	.ehdr_size = sizeof(ElfW(Ehdr)),
+	.phdr_size = sizeof(ElfW(Phdr)),
+
+	.read_ehdr = cortex_elfW(read_ehdr),
+	.read_phdr = cortex_elfW(read_phdr),
+	.write_ehdr = cortex_elfW(write_ehdr),
+	.write_phdr = cortex_elfW(write_phdr),
+};
+
+#undef CORTEX_ELF_PUT
+#undef CORTEX_ELF_GET
+#undef cortex_elfW
+#undef ElfW
+#undef __CORTEX_ELF_EXPAND
+#undef __CORTEX_ELF_PASTE
@@ -0,0 +1,408 @@
+/** \file cortex_fetch.c
+ * \brief cortex code read from the mapped files
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "cortex.h"
+#include "cortex_elf.h"
+#include "cortex_mem.h"
+#include "cortex_stats.h"
+#include "cortex_fetch.h"
+#include "arch/cortex_arch.h"
+
+#define max(a, b)		(((a)>(b))?(a):(b))
+#define min(a, b)		(((a)<(b))?(a):(b))
+
+/*
+ * The default coredump_filter writes the first page of the mapped ELF
+ * files but not their text: the code around pc is then read from the
+ * files named in NT_FILE, at the offset of the mapping.
+ *
+ * Only the executable and read only parts are read, the others may have
+ * changed in memory. A file is used only if its first bytes on disk are
+ * those the core holds for it: the core may come from another machine,
+ * or the binary may have been updated since the crash.
+ *
+ * A file is opened once for all the threads and frames, and what the
+ * unwinders read is kept by chunks.
+ */
+
+/** \struct cortex_fetch_file
+ ** \brief a file named in NT_FILE, opened once
+ */
+struct cortex_fetch_file {
+	const char *name;	/*!< path, in the note buffer */
+	int fd;			/*!< -1 if the file cannot be used */
+};
+
+/** \struct cortex_fetch_chunk
+ ** \brief code read from a file for cortex_fetch_map()
+ */
+struct cortex_fetch_chunk {
+	ElfN_Addr vaddr;	/*!< address of the first byte */
+	ElfN_Addr limit;	/*!< addresses up to it are looked up here */
+	size_t size;		/*!< bytes read, past limit for the
+				   instructions across it */
+	unsigned char *d_buf;
+};
+
+/** \struct cortex_fetch
+ ** \brief what was opened and read for a core
+ */
+struct cortex_fetch {
+	int nr_files;
+	struct cortex_fetch_file *files;
+	int nr_chunks;
+	struct cortex_fetch_chunk *chunks;	/*!< sorted by address */
+};
+
+/* grow an array by powers of two */
+static void *cortex_fetch_grow(void *array, int nr, size_t size)
+{
+	void *grown = NULL;
+
+	if (nr & (nr - 1))
+		return array;
+
+	grown = cortex_mem_realloc(array, max(1, nr * 2) * size);
+	if (!grown)
+		fprintf(stderr, "%s: out of memory\n", __FILE__);
+
+	return grown;
+}
+
+/* compare the start of the file with its header in the core */
+static int cortex_fetch_check(struct cortex_proc_info *info, const char *name,
+			      int fd)
+{
+	unsigned char buf[CORTEX_WINDOW_MODULE];
+	struct cortex_elf_region *region = NULL;
+	size_t size = 0;
+	int i = 0;
+
+	for (i = 0; i < info->nr_files; i++) {
+		struct cortex_elf_file *file = &info->files[i];
+
+		if (file->offset != 0 || strcmp(file->name, name))
+			continue;
+
+		region = cortex_elf_find_region(info, file->start);
+		if (!region || !region->d_buf)
+			continue;
+
+		size = min(region->vaddr + region->size - file->start,
+			   (ElfN_Addr)sizeof(buf));
+		if (pread(fd, buf, size, 0) != (ssize_t)size)
+			return -1;
+
+		return memcmp(buf, region->d_buf + file->start - region->vaddr,
+			      size) ? -1 : 0;
+	}
+
+	/* nothing to compare with */
+	return -1;
+}
+
+static int cortex_fetch_open(struct cortex_proc_info *info,
+			     struct cortex_fetch *fetch, const char *name)
+{
+	struct cortex_fetch_file *file = NULL;
+	int i = 0;
+
+	for (i = 0; i < fetch->nr_files; i++)
+		if (fetch->files[i].name == name ||
+		    !strcmp(fetch->files[i].name, name))
+			return fetch->files[i].fd;
+
+	file = cortex_fetch_grow(fetch->files, fetch->nr_files,
+				 sizeof(struct cortex_fetch_file));
+	if (!file)
+		return -1;
+	fetch->files = file;
+
+	file = &fetch->files[fetch->nr_files++];
+	file->name = name;
+	file->fd = open(name, O_RDONLY | O_CLOEXEC);
+	if (file->fd >= 0 && cortex_fetch_check(info, name, file->fd) < 0) {
+		close(file->fd);
+		file->fd = -1;
+	}
+
+	return file->fd;
+}
+
+/* the file to read vaddr from, and the addresses it can be read for */
+static int cortex_fetch_find(struct cortex_proc_info *info, ElfN_Addr vaddr,
+			     struct cortex_elf_file **file, ElfN_Addr *start,
+			     ElfN_Addr *end)
+{
+	ElfN_Phdr *segm = NULL;
+
+	if (info->nr_files == 0)
+		return -1;
+
+	if (!info->fetch) {
+		info->fetch = cortex_mem_calloc(1, sizeof(struct cortex_fetch));
+		if (!info->fetch) {
+			fprintf(stderr, "%s: out of memory\n", __FILE__);
+			return -1;
+		}
+	}
+
+	segm = cortex_elf_find_segment(info->elf, vaddr);
+	if (!segm || !(segm->p_flags & PF_X) || (segm->p_flags & PF_W))
+		return -1;
+
+	*file = cortex_elf_find_file(info, vaddr);
+	if (!*file)
+		return -1;
+
+	*start = max(segm->p_vaddr, (*file)->start);
+	*end = min(segm->p_vaddr + segm->p_memsz, (*file)->end);
+
+	return cortex_fetch_open(info, info->fetch, (*file)->name);
+}
+
+/* read [start, start + *size) of a mapping, *size is set to what the
+   file holds */
+static unsigned char *cortex_fetch_read(struct cortex_elf_file *file, int fd,
+					ElfN_Addr start, size_t *size)
+{
+	unsigned char *buf = cortex_mem_alloc(*size);
+	uint64_t begin = 0;
+	ssize_t count = 0;
+
+	if (!buf) {
+		fprintf(stderr, "%s: out of memory\n", __FILE__);
+		return NULL;
+	}
+
+	begin = cortex_stats_begin();
+	count = pread(fd, buf, *size, file->offset + start - file->start);
+	cortex_stats_end(CORTEX_STATS_FETCH, begin);
+
+	/* the last page of a mapping may lie past the end of the file */
+	if (count <= 0) {
+		cortex_mem_free(buf);
+		return NULL;
+	}
+
+	*size = count;
+	return buf;
+}
+
+/* add a code window read from disk to the memory windows */
+static int cortex_fetch_add_region(struct cortex_proc_info *info,
+				   ElfN_Addr vaddr, size_t size, int thread,
+				   unsigned char *d_buf)
+{
+	struct cortex_elf_region *regions = NULL;
+	ElfN_Phdr *segm = cortex_elf_find_segment(info->elf, vaddr);
+	int i = 0;
+
+	regions = cortex_mem_realloc(info->regions, (info->nr_regions + 1) *
+				     sizeof(struct cortex_elf_region));
+	if (!regions) {
+		fprintf(stderr, "%s: out of memory\n", __FILE__);
+		return -1;
+	}
+	info->regions = regions;
+
+	/* keep them sorted */
+	for (i = info->nr_regions; i > 0 && regions[i - 1].vaddr > vaddr; i--)
+		regions[i] = regions[i - 1];
+
+	regions[i].vaddr = vaddr;
+	regions[i].size = size;
+	regions[i].type = CORTEX_REGION_CODE;
+	regions[i].thread = thread;
+	regions[i].flags = segm->p_flags;
+	regions[i].d_buf = d_buf;
+	info->nr_regions++;
+
+	return 0;
+}
+
+/** \brief read the code around the pc of each thread from the mapped files
+ * \return the number of windows added to info->regions
+ *
+ * Only the pcs the core holds no code for are read, the windows end
+ * where those of the core begin.
+ */
+int cortex_fetch_code(struct cortex_proc_info *info)
+{
+	int nr = 0;
+	int t = 0;
+	int i = 0;
+
+	for (t = 0; t < info->nr_threads; t++) {
+		struct cortex_cpu_regs cpu_regs[CORTEX_CPU_REGS_MAX];
+		struct cortex_elf_file *file = NULL;
+		unsigned char *d_buf = NULL;
+		ElfN_Addr start = 0;
+		ElfN_Addr end = 0;
+		ElfN_Addr pc = 0;
+		size_t size = 0;
+		int fd = -1;
+
+		info->arch->fill_regs(cpu_regs, info->threads[t].pr_reg);
+		pc = info->arch->get_pc(cpu_regs);
+		if (cortex_elf_find_region(info, pc))
+			continue;
+
+		fd = cortex_fetch_find(info, pc, &file, &start, &end);
+		if (fd < 0)
+			continue;
+
+		if (pc - start > CORTEX_WINDOW_CODE)
+			start = pc - CORTEX_WINDOW_CODE;
+		if (end - pc > CORTEX_WINDOW_CODE)
+			end = pc + CORTEX_WINDOW_CODE;
+
+		for (i = 0; i < info->nr_regions; i++) {
+			struct cortex_elf_region *region = &info->regions[i];
+
+			if (region->vaddr + region->size <= pc)
+				start = max(start, region->vaddr + region->size);
+			else if (region->vaddr > pc)
+				end = min(end, region->vaddr);
+		}
+
+		size = end - start;
+		d_buf = cortex_fetch_read(file, fd, start, &size);
+		if (!d_buf || size <= pc - start) {
+			cortex_mem_free(d_buf);
+			continue;
+		}
+
+		if (cortex_fetch_add_region(info, start, size, t, d_buf) < 0) {
+			cortex_mem_free(d_buf);
+			break;
+		}
+		nr++;
+	}
+
+	return nr;
+}
+
+/** \brief find code the core does not hold in the mapped files
+ * \param vaddr its address in the process
+ * \param len set to the number of bytes read from vaddr on
+ * \return the code, NULL if it cannot be read
+ *
+ * The code is read by chunks of CORTEX_FETCH_CHUNK bytes, kept until
+ * the core is released.
+ */
+const unsigned char *cortex_fetch_map(struct cortex_proc_info *info,
+				      ElfN_Addr vaddr, size_t *len)
+{
+	struct cortex_fetch_chunk *chunk = NULL;
+	struct cortex_elf_file *file = NULL;
+	struct cortex_fetch *fetch = NULL;
+	unsigned char *d_buf = NULL;
+	ElfN_Addr start = 0;
+	ElfN_Addr end = 0;
+	ElfN_Addr page = 0;
+	size_t size = 0;
+	int lo = 0;
+	int hi = 0;
+	int fd = -1;
+
+	fetch = info->fetch;
+	hi = fetch ? fetch->nr_chunks - 1 : -1;
+	while (lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		chunk = &fetch->chunks[mid];
+		if (vaddr < chunk->vaddr) {
+			hi = mid - 1;
+		} else if (vaddr >= chunk->limit) {
+			lo = mid + 1;
+		} else {
+			if (vaddr - chunk->vaddr >= chunk->size)
+				return NULL;
+			*len = chunk->size - (vaddr - chunk->vaddr);
+			return chunk->d_buf + vaddr - chunk->vaddr;
+		}
+	}
+
+	fd = cortex_fetch_find(info, vaddr, &file, &start, &end);
+	if (fd < 0)
+		return NULL;
+	fetch = info->fetch;
+
+	page = vaddr & ~((ElfN_Addr)CORTEX_FETCH_CHUNK - 1);
+	start = max(start, page);
+	if (end - page > CORTEX_FETCH_CHUNK + CORTEX_WINDOW_CODE)
+		end = page + CORTEX_FETCH_CHUNK + CORTEX_WINDOW_CODE;
+
+	size = end - start;
+	d_buf = cortex_fetch_read(file, fd, start, &size);
+	if (!d_buf)
+		return NULL;
+
+	chunk = cortex_fetch_grow(fetch->chunks, fetch->nr_chunks,
+				  sizeof(struct cortex_fetch_chunk));
+	if (!chunk) {
+		cortex_mem_free(d_buf);
+		return NULL;
+	}
+	fetch->chunks = chunk;
+
+	/* lo is where the chunk goes */
+	memmove(fetch->chunks + lo + 1, fetch->chunks + lo,
+		(fetch->nr_chunks - lo) * sizeof(struct cortex_fetch_chunk));
+	fetch->nr_chunks++;
+
+	chunk = &fetch->chunks[lo];
+	chunk->vaddr = start;
+	chunk->limit = min(page + CORTEX_FETCH_CHUNK, end);
+	chunk->size = size;
+	chunk->d_buf = d_buf;
+
+	if (vaddr - start >= size)
+		return NULL;
+
+	*len = size - (vaddr - start);
+	return d_buf + vaddr - start;
+}
+
+/** \brief close the files and free what was read from them */
+void cortex_fetch_free(struct cortex_fetch *fetch)
+{
+	int i = 0;
+
+	if (!fetch)
+		return;
+
+	for (i = 0; i < fetch->nr_files; i++)
+		if (fetch->files[i].fd >= 0)
+			close(fetch->files[i].fd);
+	for (i = 0; i < fetch->nr_chunks; i++)
+		cortex_mem_free(fetch->chunks[i].d_buf);
+
+	cortex_mem_free(fetch->files);
+	cortex_mem_free(fetch->chunks);
+	cortex_mem_free(fetch);
+}
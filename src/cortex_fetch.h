@@ -0,0 +1,36 @@
+#ifndef _CORTEX_FETCH_H_
+#define _CORTEX_FETCH_H_
+
+/** \file cortex_fetch.h
+ * \brief cortex code read from the mapped files
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "cortex.h"
+
+/** \brief bytes read from a file at once for cortex_fetch_map() */
+#define CORTEX_FETCH_CHUNK	4096
+
+struct cortex_fetch;
+
+int cortex_fetch_code(struct cortex_proc_info *info);
+const unsigned char *cortex_fetch_map(struct cortex_proc_info *info,
+				      ElfN_Addr vaddr, size_t *len);
+void cortex_fetch_free(struct cortex_fetch *fetch);
+
+#endif /* _CORTEX_FETCH_H_ */
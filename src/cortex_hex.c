@@ -0,0 +1,193 @@
+/** \file cortex_hex.c
+ * \brief cortex hex dumps
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cortex.h"
+#include "cortex_elf.h"
+#include "cortex_deadline.h"
+#include "cortex_hex.h"
+
+/*
+ * Dumps in the xxd way: the address, CORTEX_HEX_LINE bytes as words of
+ * the core, the same bytes as ascii, then the mapped file each word
+ * points into if any. Lines identical to the previous one are collapsed
+ * into a single '*' line.
+ *
+ * Lines are built in a buffer and written at once: a large stack would
+ * otherwise take one fprintf per word.
+ */
+
+/* the two digits of each byte value */
+static const char cortex_hex_pairs[512] =
+	"000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+	"202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+	"404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+	"606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+	"808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+	"a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+	"c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+	"e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+/** \brief write a word as hex digits, most significant first
+ * \param size bytes of the word, 2 * size digits are written
+ * \return the end of the digits, not nul terminated
+ */
+char *cortex_hex_word(char *dst, uint64_t value, int size)
+{
+	int i;
+
+	for (i = size - 1; i >= 0; i--) {
+		memcpy(dst, &cortex_hex_pairs[((value >> (i * 8)) & 0xff) * 2],
+		       2);
+		dst += 2;
+	}
+
+	return dst;
+}
+
+/* "name+0xoffset" of the file mapped at addr, nothing if none is */
+static char *cortex_hex_annotate(struct cortex_proc_info *info, char *dst,
+				 char *end, ElfN_Addr addr)
+{
+	const struct cortex_elf_file *file = cortex_elf_find_file(info, addr);
+	const char *name;
+	int len;
+
+	if (file == NULL)
+		return dst;
+
+	name = strrchr(file->name, '/');
+	name = name ? name + 1 : file->name;
+
+	len = snprintf(dst, end - dst, " %s+0x%lx", name,
+		       (unsigned long)(addr - file->start + file->offset));
+	if (len < 0 || len >= end - dst)
+		return dst;
+
+	return dst + len;
+}
+
+static char *cortex_hex_line(struct cortex_proc_info *info, char *dst,
+			     char *end, ElfN_Addr vaddr,
+			     const unsigned char *raw, size_t len)
+{
+	int word = info->word_size;
+	size_t i;
+
+	*dst++ = ' ';
+	*dst++ = ' ';
+	*dst++ = '0';
+	*dst++ = 'x';
+	dst = cortex_hex_word(dst, vaddr, word);
+	*dst++ = ':';
+
+	for (i = 0; i < CORTEX_HEX_LINE; i += word) {
+		*dst++ = ' ';
+		if (i + word <= len) {
+			dst = cortex_hex_word(dst,
+					      cortex_elf_get_word(info, raw + i),
+					      word);
+		} else {
+			memset(dst, ' ', word * 2);
+			dst += word * 2;
+		}
+	}
+
+	*dst++ = ' ';
+	*dst++ = ' ';
+	*dst++ = '|';
+	for (i = 0; i < len; i++)
+		*dst++ = (raw[i] >= 0x20 && raw[i] < 0x7f) ? raw[i] : '.';
+	*dst++ = '|';
+
+	for (i = 0; i + word <= len; i += word)
+		dst = cortex_hex_annotate(info, dst, end,
+					  cortex_elf_get_word(info, raw + i));
+
+	*dst++ = '\n';
+
+	return dst;
+}
+
+/** \brief dump process memory
+ * \param vaddr first byte, rounded down to a word
+ * \param size bytes to dump, rounded up to whole words
+ *
+ * The dump stops at the first byte the core does not hold.
+ */
+void cortex_hex_dump(struct cortex_proc_info *info, FILE * output,
+		     ElfN_Addr vaddr, size_t size)
+{
+	/* address, words, ascii and a few annotations */
+	char line[512];
+	const unsigned char *raw;
+	const unsigned char *prev = NULL;
+	int word = info->word_size;
+	size_t avail;
+	size_t pos;
+	int skipped = 0;
+
+	size += vaddr % word;
+	vaddr -= vaddr % word;
+	size = (size + word - 1) / word * word;
+
+	raw = cortex_elf_map(info, vaddr, &avail);
+	if (raw == NULL)
+		avail = 0;
+
+	for (pos = 0; pos < size && pos < avail; pos += CORTEX_HEX_LINE) {
+		size_t len = CORTEX_HEX_LINE;
+		char *end;
+
+		if (len > size - pos)
+			len = size - pos;
+		if (len > avail - pos)
+			len = avail - pos - (avail - pos) % word;
+		if (len == 0)
+			break;
+
+		if (cortex_deadline_expired()) {
+			fprintf(output, "  [deadline expired]\n");
+			return;
+		}
+
+		/* the last line is always shown, so the dump end is known */
+		if (prev && len == CORTEX_HEX_LINE && pos + len < size &&
+		    pos + len < avail && memcmp(prev, raw + pos, len) == 0) {
+			if (!skipped)
+				fwrite("  *\n", 1, 4, output);
+			skipped = 1;
+			continue;
+		}
+
+		end = cortex_hex_line(info, line, line + sizeof(line) - 1,
+				      vaddr + pos, raw + pos, len);
+		fwrite(line, 1, end - line, output);
+
+		prev = raw + pos;
+		skipped = 0;
+	}
+
+	if (pos < size)
+		fprintf(output, "  0x%0*lx: <unavailable>\n", word * 2,
+			(unsigned long)(vaddr + pos));
+}
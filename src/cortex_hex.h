@@ -0,0 +1,36 @@
+#ifndef _CORTEX_HEX_H_
+#define _CORTEX_HEX_H_
+
+/** \file cortex_hex.h
+ * \brief cortex hex dumps
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cortex.h"
+
+/** \brief bytes shown on a line of a dump */
+#define CORTEX_HEX_LINE		16
+
+char *cortex_hex_word(char *dst, uint64_t value, int size);
+void cortex_hex_dump(struct cortex_proc_info *info, FILE * output,
+		     ElfN_Addr vaddr, size_t size);
+
+#endif /* _CORTEX_HEX_H_ */
@@ -0,0 +1,878 @@
+/** \file cortex_inproc.c
+ * \brief cortex in-process crash handler
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/procfs.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#if defined(__x86_64__)
+#include <asm/prctl.h>
+#endif
+
+#include "cortex_mini.h"
+#include "cortex_inproc.h"
+
+/*
+ * The handler runs on an alternate stack, so that a stack overflow can
+ * be reported, and only calls async-signal-safe functions: everything
+ * it needs is allocated and faulted in by cortex_inproc_install(), the
+ * process information that does not change (name, arguments, auxiliary
+ * vector) is read there as well.
+ *
+ * On a crash, the registers of the ucontext become the NT_PRSTATUS of
+ * the only thread of the record, the siginfo its NT_SIGINFO and the FP
+ * state its NT_PRFPREG (and NT_X86_XSTATE). /proc/self/maps is read
+ * for NT_FILE and to bound the stack and code windows to readable
+ * mappings. The record is written to the fd in the minicore layout in
+ * a single writev(). A stripped ELF core, as bin writes, would need its
+ * windows laid out at page aligned offsets and would read back as whole
+ * segments: the minicore is the layout cortex has for windows. The process is then made non dumpable, the
+ * previous handlers are restored and the signal is raised again: it
+ * dies as it would have, without waiting for a core to be written.
+ */
+
+#ifndef NT_PRFPREG
+#define NT_PRFPREG		2
+#endif
+
+#define CORTEX_INPROC_ALTSTACK	(64 * 1024)
+
+/* room for the XSAVE area of AVX-512 */
+#define CORTEX_INPROC_REGSET	16384
+#define CORTEX_INPROC_AUXV	4096
+
+/* file mappings kept in NT_FILE, and room for their names */
+#define CORTEX_INPROC_FILES	512
+#define CORTEX_INPROC_NAMES	(32 * 1024)
+#define CORTEX_INPROC_LINE	4096
+
+#define CORTEX_INPROC_NOTES	(CORTEX_INPROC_REGSET + CORTEX_INPROC_AUXV + \
+				 4096 + (2 + 3 * CORTEX_INPROC_FILES) * \
+				 sizeof(long) + CORTEX_INPROC_NAMES)
+
+#define CORTEX_INPROC_ALIGN(x, a)	(((x) + (a) - 1) & ~((size_t)(a) - 1))
+
+/* the layout of the XSAVE area follows the FXSAVE one when sw_reserved
+   holds this magic, see struct _fpx_sw_bytes */
+#define CORTEX_INPROC_XSTATE_MAGIC	0x46505853
+#define CORTEX_INPROC_SW_BYTES		464
+
+#if defined(__x86_64__)
+#define CORTEX_INPROC_MACHINE	EM_X86_64
+#elif defined(__i386__)
+#define CORTEX_INPROC_MACHINE	EM_386
+#elif defined(__arm__)
+#define CORTEX_INPROC_MACHINE	EM_ARM
+#endif
+
+static const int cortex_inproc_signals[] = {
+	SIGSEGV, SIGBUS, SIGABRT, SIGILL, SIGFPE,
+};
+
+#define CORTEX_INPROC_NR_SIGNALS \
+	(int)(sizeof(cortex_inproc_signals) / sizeof(cortex_inproc_signals[0]))
+
+/** \struct cortex_inproc_window
+ ** \brief memory kept around a register
+ */
+struct cortex_inproc_window {
+	unsigned long anchor;
+	unsigned long start;	/*!< bounded to the mapping of anchor */
+	unsigned long end;	/*!< start if the mapping is not readable */
+	int flags;		/*!< PF_R, PF_W and PF_X */
+};
+
+/** \struct cortex_inproc_buffer
+ ** \brief everything the handler writes, allocated beforehand
+ */
+struct cortex_inproc_buffer {
+	unsigned char notes[CORTEX_INPROC_NOTES];
+	char names[CORTEX_INPROC_NAMES];	/*!< NT_FILE names, then
+						   moved after the ranges */
+	char line[CORTEX_INPROC_LINE];	/*!< /proc/self/maps, read by lines */
+	unsigned char stack[CORTEX_WINDOW_REDZONE + CORTEX_WINDOW_STACK];
+	unsigned char code[2 * CORTEX_WINDOW_CODE];
+};
+
+/** \struct cortex_inproc
+ ** \brief the handler state
+ */
+static struct cortex_inproc {
+	int fd;
+	int installed;
+	int crashed;		/*!< set by the first crashing thread */
+	long page_size;
+
+	struct cortex_inproc_buffer *buf;
+	size_t notes_size;
+
+	struct elf_prpsinfo psinfo;
+	unsigned char auxv[CORTEX_INPROC_AUXV];
+	size_t auxv_size;
+
+	struct sigaction old[CORTEX_INPROC_NR_SIGNALS];
+
+	char path[PATH_MAX];	/*!< output of the preloaded library */
+	pid_t owner;		/*!< process that opened it */
+} cortex_inproc = {
+	.fd = -1,
+};
+
+/* append a note, return where its desc goes. The desc is not cleared:
+   NT_FILE is built in place. */
+static unsigned char *cortex_inproc_note(const char *name, int type,
+					 size_t size)
+{
+	size_t namesz = strlen(name) + 1;
+	size_t descoff = sizeof(Elf32_Nhdr) + CORTEX_INPROC_ALIGN(namesz, 4);
+	size_t len = descoff + CORTEX_INPROC_ALIGN(size, 4);
+	unsigned char *note = cortex_inproc.buf->notes + cortex_inproc.notes_size;
+	Elf32_Nhdr nhdr;
+
+	if (cortex_inproc.notes_size + len > CORTEX_INPROC_NOTES)
+		return NULL;
+
+	nhdr.n_namesz = namesz;
+	nhdr.n_descsz = size;
+	nhdr.n_type = type;
+	memcpy(note, &nhdr, sizeof(nhdr));
+	memset(note + sizeof(nhdr), 0, descoff - sizeof(nhdr));
+	memcpy(note + sizeof(nhdr), name, namesz);
+	memset(note + descoff + size, 0, len - descoff - size);
+
+	cortex_inproc.notes_size += len;
+
+	return note + descoff;
+}
+
+static void cortex_inproc_add_note(const char *name, int type,
+				   const void *desc, size_t size)
+{
+	unsigned char *note = cortex_inproc_note(name, type, size);
+
+	if (note)
+		memcpy(note, desc, size);
+}
+
+#if defined(__x86_64__)
+static void cortex_inproc_gregs(struct elf_prstatus *prstatus,
+				const ucontext_t *uc)
+{
+	struct user_regs_struct *regs = (void *)&prstatus->pr_reg;
+	const greg_t *gregs = uc->uc_mcontext.gregs;
+	unsigned long segs = gregs[REG_CSGSFS];
+
+	regs->r15 = gregs[REG_R15];
+	regs->r14 = gregs[REG_R14];
+	regs->r13 = gregs[REG_R13];
+	regs->r12 = gregs[REG_R12];
+	regs->rbp = gregs[REG_RBP];
+	regs->rbx = gregs[REG_RBX];
+	regs->r11 = gregs[REG_R11];
+	regs->r10 = gregs[REG_R10];
+	regs->r9 = gregs[REG_R9];
+	regs->r8 = gregs[REG_R8];
+	regs->rax = gregs[REG_RAX];
+	regs->rcx = gregs[REG_RCX];
+	regs->rdx = gregs[REG_RDX];
+	regs->rsi = gregs[REG_RSI];
+	regs->rdi = gregs[REG_RDI];
+	regs->orig_rax = -1;
+	regs->rip = gregs[REG_RIP];
+	regs->eflags = gregs[REG_EFL];
+	regs->rsp = gregs[REG_RSP];
+
+	/* cs, gs, fs and ss, 16 bits each */
+	regs->cs = segs & 0xffff;
+	regs->gs = (segs >> 16) & 0xffff;
+	regs->fs = (segs >> 32) & 0xffff;
+	regs->ss = (segs >> 48) & 0xffff;
+
+	syscall(SYS_arch_prctl, ARCH_GET_FS, &regs->fs_base);
+	syscall(SYS_arch_prctl, ARCH_GET_GS, &regs->gs_base);
+}
+
+static void cortex_inproc_fpregs(const ucontext_t *uc)
+{
+	const unsigned char *fpregs = (const void *)uc->uc_mcontext.fpregs;
+	unsigned char *xstate;
+	uint32_t magic, size;
+
+	if (fpregs == NULL)
+		return;
+
+	cortex_inproc_add_note("CORE", NT_PRFPREG, fpregs,
+			       sizeof(struct user_fpregs_struct));
+
+	/* magic1, extended_size, xfeatures, xstate_size */
+	memcpy(&magic, fpregs + CORTEX_INPROC_SW_BYTES, sizeof(magic));
+	memcpy(&size, fpregs + CORTEX_INPROC_SW_BYTES + 16, sizeof(size));
+	if (magic != CORTEX_INPROC_XSTATE_MAGIC ||
+	    size <= sizeof(struct user_fpregs_struct) ||
+	    size > CORTEX_INPROC_REGSET)
+		return;
+
+	/* a core holds XCR0 where the frame holds magic1 */
+	xstate = cortex_inproc_note("LINUX", NT_X86_XSTATE, size);
+	if (xstate == NULL)
+		return;
+	memcpy(xstate, fpregs, size);
+	memcpy(xstate + CORTEX_INPROC_SW_BYTES,
+	       fpregs + CORTEX_INPROC_SW_BYTES + 8, sizeof(uint64_t));
+}
+
+static unsigned long cortex_inproc_pc(const ucontext_t *uc)
+{
+	return uc->uc_mcontext.gregs[REG_RIP];
+}
+
+static unsigned long cortex_inproc_sp(const ucontext_t *uc)
+{
+	return uc->uc_mcontext.gregs[REG_RSP];
+}
+#elif defined(__i386__)
+static void cortex_inproc_gregs(struct elf_prstatus *prstatus,
+				const ucontext_t *uc)
+{
+	struct user_regs_struct *regs = (void *)&prstatus->pr_reg;
+	const greg_t *gregs = uc->uc_mcontext.gregs;
+
+	regs->ebx = gregs[REG_EBX];
+	regs->ecx = gregs[REG_ECX];
+	regs->edx = gregs[REG_EDX];
+	regs->esi = gregs[REG_ESI];
+	regs->edi = gregs[REG_EDI];
+	regs->ebp = gregs[REG_EBP];
+	regs->eax = gregs[REG_EAX];
+	regs->xds = gregs[REG_DS];
+	regs->xes = gregs[REG_ES];
+	regs->xfs = gregs[REG_FS];
+	regs->xgs = gregs[REG_GS];
+	regs->orig_eax = -1;
+	regs->eip = gregs[REG_EIP];
+	regs->xcs = gregs[REG_CS];
+	regs->eflags = gregs[REG_EFL];
+	regs->esp = gregs[REG_UESP];
+	regs->xss = gregs[REG_SS];
+}
+
+static void cortex_inproc_fpregs(const ucontext_t *uc)
+{
+	if (uc->uc_mcontext.fpregs)
+		cortex_inproc_add_note("CORE", NT_PRFPREG,
+				       uc->uc_mcontext.fpregs,
+				       sizeof(struct user_fpregs_struct));
+}
+
+static unsigned long cortex_inproc_pc(const ucontext_t *uc)
+{
+	return uc->uc_mcontext.gregs[REG_EIP];
+}
+
+static unsigned long cortex_inproc_sp(const ucontext_t *uc)
+{
+	return uc->uc_mcontext.gregs[REG_UESP];
+}
+#elif defined(__arm__)
+static void cortex_inproc_gregs(struct elf_prstatus *prstatus,
+				const ucontext_t *uc)
+{
+	/* r0 to r15 and cpsr, as in struct pt_regs */
+	memcpy(prstatus->pr_reg, &uc->uc_mcontext.arm_r0,
+	       17 * sizeof(unsigned long));
+	prstatus->pr_reg[17] = -1;
+}
+
+static void cortex_inproc_fpregs(const ucontext_t *uc)
+{
+	/* the VFP state is not in the ucontext layout of the kernel */
+}
+
+static unsigned long cortex_inproc_pc(const ucontext_t *uc)
+{
+	return uc->uc_mcontext.arm_pc;
+}
+
+static unsigned long cortex_inproc_sp(const ucontext_t *uc)
+{
+	return uc->uc_mcontext.arm_sp;
+}
+#endif
+
+static const char *cortex_inproc_hex(const char *s, unsigned long *value)
+{
+	*value = 0;
+	for (;; s++) {
+		if (*s >= '0' && *s <= '9')
+			*value = (*value << 4) | (*s - '0');
+		else if (*s >= 'a' && *s <= 'f')
+			*value = (*value << 4) | (*s - 'a' + 10);
+		else
+			return s;
+	}
+}
+
+/* the window around anchor, within the mapping that holds it or, for
+   a stack pointer past the end of its stack, the first one it meets */
+static void cortex_inproc_bound(struct cortex_inproc_window *win,
+				unsigned long start, unsigned long end,
+				const char *perms, unsigned long before,
+				unsigned long after)
+{
+	unsigned long low = win->anchor > before ? win->anchor - before : 0;
+	unsigned long high = win->anchor + after;
+
+	if (perms[0] != 'r' || end <= low || start >= high)
+		return;
+	if (win->end > win->start &&
+	    (win->anchor < start || win->anchor >= end))
+		return;
+
+	win->start = start > low ? start : low;
+	win->end = end < high ? end : high;
+	win->flags = PF_R | (perms[1] == 'w' ? PF_W : 0) |
+	    (perms[2] == 'x' ? PF_X : 0);
+}
+
+/* "start-end perms offset dev inode   name": add a file mapping to
+   NT_FILE and bound the windows that lie in it */
+static void cortex_inproc_map(const char *line, unsigned char *desc,
+			      unsigned long *count, size_t *names,
+			      struct cortex_inproc_window *stack,
+			      struct cortex_inproc_window *code)
+{
+	unsigned long start, end, offset, words[3];
+	const char *perms, *name;
+	size_t len;
+	int field;
+
+	line = cortex_inproc_hex(line, &start);
+	if (*line++ != '-')
+		return;
+	line = cortex_inproc_hex(line, &end);
+	if (*line++ != ' ' || strnlen(line, 5) < 5)
+		return;
+	perms = line;
+	line = cortex_inproc_hex(line + 5, &offset);
+
+	cortex_inproc_bound(stack, start, end, perms, CORTEX_WINDOW_REDZONE,
+			    CORTEX_WINDOW_STACK);
+	cortex_inproc_bound(code, start, end, perms, CORTEX_WINDOW_CODE,
+			    CORTEX_WINDOW_CODE);
+
+	/* skip dev and inode */
+	for (name = line, field = 0; *name && field < 3; name++)
+		if (*name == ' ' && name[1] != ' ')
+			field++;
+	if (*name != '/' || *count >= CORTEX_INPROC_FILES)
+		return;
+
+	len = strlen(name) + 1;
+	if (*names + len > CORTEX_INPROC_NAMES)
+		return;
+	memcpy(cortex_inproc.buf->names + *names, name, len);
+	*names += len;
+
+	words[0] = start;
+	words[1] = end;
+	words[2] = offset / cortex_inproc.page_size;
+	memcpy(desc + (2 + 3 * *count) * sizeof(long), words, sizeof(words));
+	(*count)++;
+}
+
+/* NT_FILE: count, page size, count * (start, end, page offset), names */
+static void cortex_inproc_files(struct cortex_inproc_window *stack,
+				struct cortex_inproc_window *code)
+{
+	struct cortex_inproc_buffer *buf = cortex_inproc.buf;
+	unsigned long count = 0;
+	size_t names = 0;
+	size_t len = 0;
+	size_t size;
+	unsigned char *desc;
+	char *line, *eol;
+	ssize_t ret;
+	int fd;
+
+	/* the desc is built past the notes, then appended */
+	desc = buf->notes + cortex_inproc.notes_size + sizeof(Elf32_Nhdr) +
+	    CORTEX_INPROC_ALIGN(sizeof("CORE"), 4);
+	if ((desc - buf->notes) + (2 + 3 * CORTEX_INPROC_FILES) * sizeof(long) +
+	    CORTEX_INPROC_NAMES > CORTEX_INPROC_NOTES)
+		return;
+
+	fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	while ((ret = read(fd, buf->line + len,
+			   CORTEX_INPROC_LINE - 1 - len)) > 0) {
+		len += ret;
+		buf->line[len] = '\0';
+
+		line = buf->line;
+		while ((eol = strchr(line, '\n')) != NULL) {
+			*eol = '\0';
+			cortex_inproc_map(line, desc, &count, &names, stack,
+					  code);
+			line = eol + 1;
+		}
+
+		/* a line longer than the buffer is dropped */
+		len = line == buf->line && len == CORTEX_INPROC_LINE - 1 ?
+		    0 : buf->line + len - line;
+		memmove(buf->line, line, len);
+	}
+	close(fd);
+
+	if (count == 0)
+		return;
+
+	memcpy(desc, &count, sizeof(long));
+	memcpy(desc + sizeof(long), &cortex_inproc.page_size, sizeof(long));
+	size = (2 + 3 * count) * sizeof(long);
+	memcpy(desc + size, buf->names, names);
+
+	cortex_inproc_note("CORE", NT_FILE, size + names);
+}
+
+static void cortex_inproc_region(struct cortex_mini_region *region,
+				 struct cortex_mini_chunk *chunk,
+				 const struct cortex_inproc_window *win,
+				 int type, uint64_t *cursor)
+{
+	memset(region, 0, sizeof(*region));
+	region->vaddr = win->start;
+	region->size = win->end - win->start;
+	region->offset = *cursor;
+	region->nr_chunks = 1;
+	region->type = type;
+	region->flags = win->flags;
+
+	chunk->offset = 0;
+	chunk->size = region->size;
+
+	*cursor += sizeof(*chunk) + chunk->size;
+}
+
+static int cortex_inproc_writev(int fd, struct iovec *iov, int nr)
+{
+	while (nr > 0) {
+		ssize_t count = writev(fd, iov, nr);
+
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		while (nr > 0 && (size_t)count >= iov->iov_len) {
+			count -= iov->iov_len;
+			iov++;
+			nr--;
+		}
+		if (nr > 0) {
+			iov->iov_base = (char *)iov->iov_base + count;
+			iov->iov_len -= count;
+		}
+	}
+
+	return 0;
+}
+
+/* the minicore of the crashing thread */
+static void cortex_inproc_record(int sig, siginfo_t *si, ucontext_t *uc)
+{
+	struct cortex_inproc_buffer *buf = cortex_inproc.buf;
+	struct cortex_inproc_window stack, code;
+	struct cortex_inproc_window *windows[2];
+	struct cortex_mini_header hdr;
+	struct cortex_mini_footer footer;
+	struct cortex_mini_region index[3];
+	struct cortex_mini_chunk chunks[3];
+	struct elf_prstatus prstatus;
+	struct iovec iov[10];
+	uint64_t cursor;
+	int nr_windows = 0;
+	int nr = 0;
+	int i;
+
+	memset(&prstatus, 0, sizeof(prstatus));
+	cortex_inproc_gregs(&prstatus, uc);
+	prstatus.pr_cursig = sig;
+	prstatus.pr_info.si_signo = sig;
+	prstatus.pr_info.si_code = si->si_code;
+	prstatus.pr_info.si_errno = si->si_errno;
+	prstatus.pr_pid = syscall(SYS_gettid);
+	prstatus.pr_ppid = getppid();
+	prstatus.pr_pgrp = getpgrp();
+	prstatus.pr_sid = getsid(0);
+
+	/* a forked child has its own ids */
+	cortex_inproc.psinfo.pr_pid = getpid();
+	cortex_inproc.psinfo.pr_ppid = prstatus.pr_ppid;
+	cortex_inproc.psinfo.pr_pgrp = prstatus.pr_pgrp;
+	cortex_inproc.psinfo.pr_sid = prstatus.pr_sid;
+
+	/* in the order of a core */
+	cortex_inproc.notes_size = 0;
+	cortex_inproc_add_note("CORE", NT_PRSTATUS, &prstatus,
+			       sizeof(prstatus));
+	cortex_inproc_add_note("CORE", NT_PRPSINFO, &cortex_inproc.psinfo,
+			       sizeof(cortex_inproc.psinfo));
+	cortex_inproc_add_note("CORE", NT_SIGINFO, si, sizeof(*si));
+	if (cortex_inproc.auxv_size)
+		cortex_inproc_add_note("CORE", NT_AUXV, cortex_inproc.auxv,
+				       cortex_inproc.auxv_size);
+
+	memset(&stack, 0, sizeof(stack));
+	memset(&code, 0, sizeof(code));
+	stack.anchor = cortex_inproc_sp(uc);
+	code.anchor = cortex_inproc_pc(uc);
+	cortex_inproc_files(&stack, &code);
+
+	cortex_inproc_fpregs(uc);
+
+	/* the windows lie in readable mappings, and the process is frozen
+	   but for the other threads */
+	if (stack.end > stack.start) {
+		memcpy(buf->stack, (void *)stack.start, stack.end - stack.start);
+		windows[nr_windows++] = &stack;
+	}
+	if (code.end > code.start &&
+	    (code.end <= stack.start || code.start >= stack.end)) {
+		memcpy(buf->code, (void *)code.start, code.end - code.start);
+		windows[nr_windows++] = &code;
+	}
+
+	/* the index is sorted by address */
+	if (nr_windows == 2 && code.start < stack.start) {
+		windows[0] = &code;
+		windows[1] = &stack;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CORTEX_MINI_MAGIC, CORTEX_MINI_MAGIC_LEN);
+	hdr.version = CORTEX_MINI_VERSION;
+	hdr.word_size = sizeof(long);
+	memcpy(hdr.ehdr.e_ident, ELFMAG, SELFMAG);
+	hdr.ehdr.e_ident[EI_CLASS] = sizeof(long) == 8 ? ELFCLASS64 :
+	    ELFCLASS32;
+	hdr.ehdr.e_ident[EI_DATA] = CORTEX_ELF_HOST_DATA;
+	hdr.ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+	hdr.ehdr.e_type = ET_CORE;
+	hdr.ehdr.e_machine = CORTEX_INPROC_MACHINE;
+	hdr.ehdr.e_version = EV_CURRENT;
+
+	iov[nr].iov_base = &hdr;
+	iov[nr++].iov_len = sizeof(hdr);
+	cursor = sizeof(hdr);
+
+	memset(&index[0], 0, sizeof(index[0]));
+	index[0].type = CORTEX_REGION_NOTE;
+	index[0].size = cortex_inproc.notes_size;
+	index[0].offset = cursor;
+	index[0].nr_chunks = 1;
+	chunks[0].offset = 0;
+	chunks[0].size = cortex_inproc.notes_size;
+	cursor += sizeof(chunks[0]) + chunks[0].size;
+	iov[nr].iov_base = &chunks[0];
+	iov[nr++].iov_len = sizeof(chunks[0]);
+	iov[nr].iov_base = buf->notes;
+	iov[nr++].iov_len = cortex_inproc.notes_size;
+
+	for (i = 0; i < nr_windows; i++) {
+		int type = windows[i] == &stack ? CORTEX_REGION_STACK :
+		    CORTEX_REGION_CODE;
+
+		cortex_inproc_region(&index[i + 1], &chunks[i + 1], windows[i],
+				     type, &cursor);
+		iov[nr].iov_base = &chunks[i + 1];
+		iov[nr++].iov_len = sizeof(chunks[i + 1]);
+		iov[nr].iov_base = windows[i] == &stack ? buf->stack : buf->code;
+		iov[nr++].iov_len = chunks[i + 1].size;
+	}
+
+	memset(&footer, 0, sizeof(footer));
+	footer.index_offset = cursor;
+	footer.nr_regions = nr_windows + 1;
+	footer.version = CORTEX_MINI_VERSION;
+	memcpy(footer.magic, CORTEX_MINI_MAGIC, CORTEX_MINI_MAGIC_LEN);
+
+	iov[nr].iov_base = index;
+	iov[nr++].iov_len = footer.nr_regions * sizeof(index[0]);
+	iov[nr].iov_base = &footer;
+	iov[nr++].iov_len = sizeof(footer);
+
+	/* emptied by cortex_inproc_install(), truncating here costs
+	   milliseconds */
+	lseek(cortex_inproc.fd, 0, SEEK_SET);
+	cortex_inproc_writev(cortex_inproc.fd, iov, nr);
+}
+
+static void cortex_inproc_restore(void)
+{
+	int i;
+
+	for (i = 0; i < CORTEX_INPROC_NR_SIGNALS; i++)
+		sigaction(cortex_inproc_signals[i], &cortex_inproc.old[i], NULL);
+}
+
+static void cortex_inproc_handler(int sig, siginfo_t *si, void *context)
+{
+	int err = errno;
+
+	/* another thread is writing its record, the process is going
+	   down */
+	if (__sync_lock_test_and_set(&cortex_inproc.crashed, 1))
+		for (;;)
+			pause();
+
+	cortex_inproc_record(sig, si, context);
+
+	/* no core on top of the record, whatever core_pattern says */
+	prctl(PR_SET_DUMPABLE, 0);
+
+	/* die as without the handler: a fault happens again on return,
+	   the other signals are pending until then */
+	cortex_inproc_restore();
+	cortex_inproc.installed = 0;
+	if (si->si_code <= 0)
+		raise(sig);
+
+	errno = err;
+}
+
+/* a /proc/self file, at most size bytes */
+static size_t cortex_inproc_read_file(const char *path, void *buf,
+				      size_t size)
+{
+	size_t len = 0;
+	ssize_t count;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+
+	while (len < size && (count = read(fd, (char *)buf + len,
+					   size - len)) > 0)
+		len += count;
+	close(fd);
+
+	return len;
+}
+
+static void cortex_inproc_read_psinfo(struct elf_prpsinfo *psinfo)
+{
+	size_t len;
+	size_t i;
+
+	memset(psinfo, 0, sizeof(*psinfo));
+	psinfo->pr_sname = 'R';
+	psinfo->pr_uid = getuid();
+	psinfo->pr_gid = getgid();
+
+	len = cortex_inproc_read_file("/proc/self/comm", psinfo->pr_fname,
+				      sizeof(psinfo->pr_fname) - 1);
+	if (len && psinfo->pr_fname[len - 1] == '\n')
+		psinfo->pr_fname[len - 1] = '\0';
+
+	/* the arguments are NUL separated */
+	len = cortex_inproc_read_file("/proc/self/cmdline", psinfo->pr_psargs,
+				      sizeof(psinfo->pr_psargs) - 1);
+	for (i = 0; len && i < len - 1; i++)
+		if (psinfo->pr_psargs[i] == '\0')
+			psinfo->pr_psargs[i] = ' ';
+}
+
+/** \brief give the calling thread an alternate signal stack
+ * \return 0 on success, -1 if it cannot be allocated
+ *
+ * Without one, a stack overflow in the thread is not reported. The
+ * thread that calls cortex_inproc_install() gets one, the others should
+ * call this when they start. The stack is not freed with the thread.
+ */
+int cortex_inproc_thread_init(void)
+{
+	stack_t ss;
+
+	if (sigaltstack(NULL, &ss) == 0 && !(ss.ss_flags & SS_DISABLE))
+		return 0;
+
+	ss.ss_sp = mmap(NULL, CORTEX_INPROC_ALTSTACK, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ss.ss_sp == MAP_FAILED)
+		return -1;
+	ss.ss_size = CORTEX_INPROC_ALTSTACK;
+	ss.ss_flags = 0;
+
+	if (sigaltstack(&ss, NULL) < 0) {
+		munmap(ss.ss_sp, CORTEX_INPROC_ALTSTACK);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** \brief report the crashes of the process
+ * \param fd where the record is written, kept open by the caller. A
+ * file is emptied.
+ * \return 0 on success, -1 with errno set otherwise
+ *
+ * The handler is installed for SIGSEGV, SIGBUS, SIGABRT, SIGILL and
+ * SIGFPE, over the existing ones, which are restored before the signal
+ * is raised again. Calling it again only changes the fd.
+ */
+int cortex_inproc_install(int fd)
+{
+#ifdef CORTEX_INPROC_MACHINE
+	struct sigaction action;
+	int i;
+
+	if (fd < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* faulted in now, not on a crash */
+	if (cortex_inproc.buf == NULL) {
+		void *buf = mmap(NULL, sizeof(*cortex_inproc.buf),
+				 PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (buf == MAP_FAILED)
+			return -1;
+		memset(buf, 0, sizeof(*cortex_inproc.buf));
+		cortex_inproc.buf = buf;
+	}
+
+	/* a file holds one record, a pipe gets it as is */
+	if (lseek(fd, 0, SEEK_SET) == 0 && ftruncate(fd, 0) < 0)
+		return -1;
+
+	cortex_inproc.fd = fd;
+	if (cortex_inproc.installed)
+		return 0;
+
+	if (cortex_inproc_thread_init() < 0)
+		return -1;
+
+	cortex_inproc.page_size = sysconf(_SC_PAGESIZE);
+	cortex_inproc_read_psinfo(&cortex_inproc.psinfo);
+	cortex_inproc.auxv_size = cortex_inproc_read_file("/proc/self/auxv",
+							  cortex_inproc.auxv,
+							  CORTEX_INPROC_AUXV);
+
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = cortex_inproc_handler;
+	action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+	sigemptyset(&action.sa_mask);
+	for (i = 0; i < CORTEX_INPROC_NR_SIGNALS; i++)
+		sigaddset(&action.sa_mask, cortex_inproc_signals[i]);
+
+	for (i = 0; i < CORTEX_INPROC_NR_SIGNALS; i++)
+		sigaction(cortex_inproc_signals[i], &action,
+			  &cortex_inproc.old[i]);
+	cortex_inproc.installed = 1;
+
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/** \brief restore the handlers found by cortex_inproc_install()
+ *
+ * The fd is left open.
+ */
+void cortex_inproc_uninstall(void)
+{
+	if (!cortex_inproc.installed)
+		return;
+
+	cortex_inproc_restore();
+	cortex_inproc.installed = 0;
+}
+
+/* a preloaded library removes its output if there was no crash */
+static void cortex_inproc_exit(void)
+{
+	if (!cortex_inproc.crashed && cortex_inproc.owner == getpid())
+		unlink(cortex_inproc.path);
+}
+
+__attribute__ ((constructor))
+static void cortex_inproc_preload(void)
+{
+	const char *pattern = getenv(CORTEX_INPROC_ENV);
+	size_t len = 0;
+	int fd;
+
+	if (pattern == NULL || *pattern == '\0')
+		return;
+
+	/* %p is the pid */
+	for (; *pattern && len < sizeof(cortex_inproc.path) - 1; pattern++) {
+		if (pattern[0] == '%' && pattern[1] == 'p') {
+			len += snprintf(cortex_inproc.path + len,
+					sizeof(cortex_inproc.path) - len, "%d",
+					getpid());
+			pattern++;
+		} else {
+			cortex_inproc.path[len++] = *pattern;
+		}
+	}
+	if (len >= sizeof(cortex_inproc.path))
+		return;
+	cortex_inproc.path[len] = '\0';
+
+	fd = open(cortex_inproc.path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+		  0600);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", cortex_inproc.path,
+			strerror(errno));
+		return;
+	}
+
+	if (cortex_inproc_install(fd) < 0) {
+		fprintf(stderr, "%s: cannot install the crash handler: %s\n",
+			__FILE__, strerror(errno));
+		close(fd);
+		unlink(cortex_inproc.path);
+		return;
+	}
+
+	cortex_inproc.owner = getpid();
+	atexit(cortex_inproc_exit);
+}
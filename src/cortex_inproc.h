@@ -0,0 +1,43 @@
+#ifndef _CORTEX_INPROC_H_
+#define _CORTEX_INPROC_H_
+
+/** \file cortex_inproc.h
+ * \brief cortex in-process crash handler
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * libcortex-inproc writes a minicore of the crashing thread from its own
+ * signal handler, with no kernel core dump: registers, the stack and
+ * the code around pc, the mapped files. cortex reads it as any other
+ * minicore. The library does not depend on libcortex.
+ *
+ * Linked, it does nothing until cortex_inproc_install() is called.
+ * Preloaded, it installs itself when CORTEX_INPROC_OUTPUT is set: the
+ * file is opened at startup, "%p" in its name is replaced by the pid,
+ * and it is removed at exit if the process did not crash.
+ */
+
+/** \brief environment variable naming the output of a preloaded library */
+#define CORTEX_INPROC_ENV	"CORTEX_INPROC_OUTPUT"
+
+int cortex_inproc_install(int fd);
+int cortex_inproc_thread_init(void);
+void cortex_inproc_uninstall(void);
+
+#endif /* _CORTEX_INPROC_H_ */
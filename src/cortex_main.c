@@ -22,15 +22,22 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <signal.h>
 #include <sys/stat.h>
-#include <sys/time.h>
 #include <fcntl.h>
 
 #include "config.h"
 #include "cortex.h"
-#include "cortex_elf.h"
 #include "cortex_out.h"
+#include "cortex_zip.h"
+#include "cortex_sys.h"
+#include "cortex_mem.h"
+#include "cortex_tune.h"
+#include "cortex_profile.h"
+#include "cortex_deadline.h"
+#include "cortex_stats.h"
+#include "cortex_metrics.h"
+#include "cortex_unwind.h"
+#include "libcortex.h"
 
 static void cortex_version(void)
 {
@@ -42,8 +49,17 @@ static void cortex_version(void)
 static void cortex_usage(char *argv0)
 {
 	printf("Coredump log extractor\n\nusage: %s [OPTIONS]\nOPTIONS:\n"
-	       "\t-i, --input\n\t\tcoredump input file. "
+	       "\t-i, --input\n\t\tcoredump or minicore input file. "
 	       "If this option is not present, stdin will be used.\n"
+	       "\t-a, --attach\n\t\t<pid>. Report on a running process "
+	       "instead of a core: its\n\t\tthreads are stopped while their "
+	       "registers and stacks are read.\n"
+	       "\t-r, --profile\n\t\t<pid>. Sample the call traces of a "
+	       "running process and write\n\t\tthem as folded stacks, "
+	       "for flame graphs.\n"
+	       "\t-H, --hz\n\t\tSamples per second of --profile (default %d)\n"
+	       "\t-D, --duration\n\t\tDuration of --profile in s "
+	       "(default %d)\n"
 	       "\t-o, --output\n\t\tcoredump input file. "
 	       "If this option is not present, stdout will be used.\n"
 	       "\t-e, --exec\n\t\tcommand. After the oops is generated, "
@@ -55,35 +71,73 @@ static void cortex_usage(char *argv0)
 	       "\t\t 'cal' for process call trace\n"
 	       "\t\t 'aux' for process auxv\n"
 	       "\t\t 'sta' for process stack\n"
+	       "\t\t 'fpr' for x87 and SSE registers\n"
+	       "\t\t 'vec' for AVX and AVX-512 registers\n"
+	       "\t\t 'sys' for system context (memory, load, network, disks)\n"
+	       "\t\t 'prc' for /proc/<pid> state of the process (see --pid)\n"
+	       "\t\t 'thr' for the call traces of all threads, grouped\n"
+	       "\t\t 'mem' for per segment memory statistics\n"
+	       "\t\t 'dig' for the xxh64 digest of the whole core\n"
 	       "\t\tOutput format\n"
 	       "\t\t 'txt' to export a text file summary (default)\n"
 	       "\t\t 'bin' to export a stripped core file\n"
+	       "\t\t 'jsn' to export a json summary\n"
+	       "\t\t 'min' to export a sparse minicore (cortex can read it back)\n"
+	       "\t\t 'mdmp' to export a breakpad minidump (all sections)\n"
 	       "\t\tOr predefined format\n"
 	       "\t\t 'def' for txt,gen,cod,cal\n"
-	       "\t\t 'all' for txt,gen,cod,cal,aux,sta\n"
+	       "\t\t 'all' for txt,gen,cod,cal,aux,sta,fpr,vec\n"
+	       "\t-s, --sink\n\t\t<format>:<output>. Write an additional report "
+	       "from the same core.\n\t\t<output> is a file, '-' for stdout, "
+	       "'|<command>' or '&<fd>'.\n\t\tMay be given up to %d times.\n"
+	       "\t-z, --compress\n\t\t<method>[:<level>]. Compress every output "
+	       "with 'gzip' or 'zstd'.\n"
+	       "\t-p, --probes\n\t\tComma separated list of system context probes "
+	       "run for 'sys' and 'prc':\n\t\t meminfo, loadavg, netdev, mounts, "
+	       "statfs, maps, status, smaps,\n\t\t tasks, fds, cgroup, "
+	       "'all' (default) or 'none'\n"
+	       "\t-P, --pid\n\t\tPID of the crashing process (%%p in core_pattern), "
+	       "read for 'prc'\n"
+	       "\t-t, --probe-timeout\n\t\tTime budget of the system context "
+	       "probes in ms (default %d)\n"
+	       "\t-m, --mem-budget\n\t\tMemory reserved for the whole analysis, "
+	       "with k, M or G suffix (default %dM).\n\t\tSegments that do not "
+	       "fit are reduced to their memory windows.\n"
+	       "\t-d, --deadline\n\t\tTime budget of the whole analysis in ms, "
+	       "0 for none (default %d).\n\t\tSections not written in time "
+	       "are dropped from the report.\n"
+	       "\t-S, --stats\n\t\t<file>. Write the time spent in each phase "
+	       "and the input, syscall\n\t\tand memory counters as a json "
+	       "line to <file>, '-' for stderr.\n"
+	       "\t-F, --metrics-file\n\t\t<file>. Metrics updated by every "
+	       "run (default %s),\n\t\t'none' to disable.\n"
+	       "\t-M, --metrics\n\t\tPrint the metrics file in the "
+	       "Prometheus text format and exit.\n"
+	       "\t-T, --tune-filter\n\t\t<pid|cgroup|exe>. Set the "
+	       "coredump_filter of running processes\n\t\tto the memory "
+	       "needed by the reports of -f and -s, and exit.\n"
+	       "\t-n, --dry-run\n\t\tWith --tune-filter, only report the "
+	       "filters and the expected\n\t\tcore size reduction.\n"
+	       "\t-u, --unwind-scan\n\t\tStack scanning when the frame "
+	       "pointers lead nowhere:\n\t\t 'calls' for return addresses "
+	       "following a call (default),\n\t\t 'all' for any pointer to "
+	       "code or 'none'\n"
 	       "\t-c, --context\n\t\tDisassemble context size in bytes (default 40)\n"
 	       "\t-v, --version\n\t\tShow program version and exit.\n"
-	       "\t-h, --help\n\t\tShow this help and exit.\n", argv0);
+	       "\t-h, --help\n\t\tShow this help and exit.\n", argv0,
+	       CORTEX_PROFILE_HZ, CORTEX_PROFILE_DURATION,
+	       CORTEX_OUTPUT_SINK_MAX - 1, CORTEX_SYS_BUDGET,
+	       CORTEX_MEM_BUDGET >> 20, CORTEX_DEADLINE_TOTAL,
+	       CORTEX_METRICS_FILE);
 	return;
 }
 
-static void cortex_no_input(int signum)
-{
-	printf("cannot read core file: no input\n");
-	exit(1);
-}
-
 int main(int argc, char **argv)
 {
 	int ret = -1;
 	int disassemble_ctx = 40;
 
-	struct itimerval timer_wd;
-	struct sigaction func_wd;
-
-	struct cortex_elf *core = NULL;
-	ElfN_Ehdr *ehdr = NULL;
-	struct cortex_proc_info *info = NULL;
+	struct cortex_ctx *ctx = NULL;
 
 	int arg_count = 1;
 	int elf_core_fd = 0;
@@ -92,13 +146,58 @@ int main(int argc, char **argv)
 	char *input_file = NULL;
 	char *fmt = NULL;
 
-	FILE *output = stdout;
+	int i = 0;
+	int zip = CORTEX_ZIP_NONE;
+	int zip_level = -1;
+	int nr_sinks = 0;
+	struct cortex_output_sink sinks[CORTEX_OUTPUT_SINK_MAX];
+
+	long sys_probes = CORTEX_SYS_PROBES_ALL;
+	int sys_budget = CORTEX_SYS_BUDGET;
+	int deadline = CORTEX_DEADLINE_TOTAL;
+	char *stats_file = NULL;
+	char *metrics_file = CORTEX_METRICS_FILE;
+	int print_metrics = 0;
+	char *tune_target = NULL;
+	int dry_run = 0;
+	long tune_fmt;
+	struct cortex_metrics_run run;
+	long sys_fmt = 0;
+	int pid = 0;
+	int attach_pid = 0;
+	int profile_pid = 0;
+	int profile_hz = CORTEX_PROFILE_HZ;
+	int profile_duration = CORTEX_PROFILE_DURATION;
+	FILE *profile_output;
+	int scan = CORTEX_UNWIND_SCAN_CALLS;
+
+	long mem_budget = CORTEX_MEM_BUDGET;
 
 	/* Parse all parameters */
 	while (arg_count < argc) {
 		if ((strcmp(argv[arg_count], "-i") == 0) ||
 		    (strcmp(argv[arg_count], "--input") == 0)) {
 			input_file = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-a") == 0) ||
+			   (strcmp(argv[arg_count], "--attach") == 0)) {
+			attach_pid = atoi(argv[++arg_count]);
+			if (attach_pid <= 0) {
+				cortex_usage(argv[0]);
+				exit(1);
+			}
+		} else if ((strcmp(argv[arg_count], "-r") == 0) ||
+			   (strcmp(argv[arg_count], "--profile") == 0)) {
+			profile_pid = atoi(argv[++arg_count]);
+			if (profile_pid <= 0) {
+				cortex_usage(argv[0]);
+				exit(1);
+			}
+		} else if ((strcmp(argv[arg_count], "-H") == 0) ||
+			   (strcmp(argv[arg_count], "--hz") == 0)) {
+			profile_hz = atoi(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-D") == 0) ||
+			   (strcmp(argv[arg_count], "--duration") == 0)) {
+			profile_duration = atoi(argv[++arg_count]);
 		} else if ((strcmp(argv[arg_count], "-o") == 0) ||
 			   (strcmp(argv[arg_count], "--output") == 0)) {
 			output_file = argv[++arg_count];
@@ -108,6 +207,65 @@ int main(int argc, char **argv)
 		} else if ((strcmp(argv[arg_count], "-f") == 0) ||
 			   (strcmp(argv[arg_count], "--format") == 0)) {
 			fmt = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-s") == 0) ||
+			   (strcmp(argv[arg_count], "--sink") == 0)) {
+			/* keep the first slot for the -o/-e/-f sink */
+			if (nr_sinks + 1 >= CORTEX_OUTPUT_SINK_MAX) {
+				fprintf(stderr, "too many sinks\n");
+				exit(1);
+			}
+			if (cortex_output_parse_sink(&sinks[++nr_sinks],
+						     argv[++arg_count]) < 0) {
+				exit(1);
+			}
+		} else if ((strcmp(argv[arg_count], "-z") == 0) ||
+			   (strcmp(argv[arg_count], "--compress") == 0)) {
+			zip = cortex_zip_parse(argv[++arg_count], &zip_level);
+			if (zip < 0) {
+				exit(1);
+			}
+		} else if ((strcmp(argv[arg_count], "-p") == 0) ||
+			   (strcmp(argv[arg_count], "--probes") == 0)) {
+			sys_probes = cortex_sys_parse_probes(argv[++arg_count]);
+			if (sys_probes < 0) {
+				exit(1);
+			}
+		} else if ((strcmp(argv[arg_count], "-P") == 0) ||
+			   (strcmp(argv[arg_count], "--pid") == 0)) {
+			pid = atoi(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-t") == 0) ||
+			   (strcmp(argv[arg_count], "--probe-timeout") == 0)) {
+			sys_budget = atoi(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-d") == 0) ||
+			   (strcmp(argv[arg_count], "--deadline") == 0)) {
+			deadline = atoi(argv[++arg_count]);
+		} else if ((strcmp(argv[arg_count], "-S") == 0) ||
+			   (strcmp(argv[arg_count], "--stats") == 0)) {
+			stats_file = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-M") == 0) ||
+			   (strcmp(argv[arg_count], "--metrics") == 0)) {
+			print_metrics = 1;
+		} else if ((strcmp(argv[arg_count], "-T") == 0) ||
+			   (strcmp(argv[arg_count], "--tune-filter") == 0)) {
+			tune_target = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-n") == 0) ||
+			   (strcmp(argv[arg_count], "--dry-run") == 0)) {
+			dry_run = 1;
+		} else if ((strcmp(argv[arg_count], "-F") == 0) ||
+			   (strcmp(argv[arg_count], "--metrics-file") == 0)) {
+			metrics_file = argv[++arg_count];
+		} else if ((strcmp(argv[arg_count], "-m") == 0) ||
+			   (strcmp(argv[arg_count], "--mem-budget") == 0)) {
+			mem_budget = cortex_mem_parse_size(argv[++arg_count]);
+			if (mem_budget < 0) {
+				exit(1);
+			}
+		} else if ((strcmp(argv[arg_count], "-u") == 0) ||
+			   (strcmp(argv[arg_count], "--unwind-scan") == 0)) {
+			scan = cortex_unwind_parse_scan(argv[++arg_count]);
+			if (scan < 0) {
+				exit(1);
+			}
 		} else if ((strcmp(argv[arg_count], "-c") == 0)
 			   || (strcmp(argv[arg_count], "--context") == 0)) {
 			disassemble_ctx = atoi(argv[++arg_count]);
@@ -122,9 +280,60 @@ int main(int argc, char **argv)
 		arg_count++;
 	}
 
+	/* render the metrics of the previous runs, no core involved */
+	if (print_metrics) {
+		exit(cortex_metrics_print(metrics_file, stdout) < 0 ? 1 : 0);
+	}
+
+	/* shrink the cores of running processes to what the reports
+	   need, no core involved */
+	if (tune_target) {
+		tune_fmt = cortex_output_parse_format(fmt);
+		if (tune_fmt < 0) {
+			exit(1);
+		}
+		for (i = 1; i <= nr_sinks; i++)
+			tune_fmt |= sinks[i].fmt;
+		exit(cortex_tune_apply(tune_target, cortex_tune_filter(tune_fmt),
+				       dry_run, stdout) < 0 ? 1 : 0);
+	}
+
+	cortex_metrics_start();
+	if (stats_file)
+		cortex_stats_start();
+
+	/* reserve all the memory of the analysis now: when a process
+	   crashed the system may be short of it */
+	ctx = cortex_ctx_new(mem_budget);
+	if (ctx == NULL) {
+		exit(1);
+	}
+
+	/* sample a running process, no core involved */
+	if (profile_pid) {
+		profile_output = output_file ? fopen(output_file, "w") : stdout;
+		if (profile_output == NULL) {
+			perror("cannot open output");
+			goto out_err;
+		}
+		ret = cortex_ctx_profile(ctx, profile_pid, profile_hz,
+					 profile_duration, profile_output);
+		if (profile_output != stdout && fclose(profile_output) != 0)
+			ret = -1;
+		goto out_err;
+	}
+
 	/* If a filename is given, then open it. Else, we gonna use
-	   the stdin as input stream. */
-	if (input_file) {
+	   the stdin as input stream. A running process is read into a
+	   core of its own. */
+	if (attach_pid) {
+		elf_core_fd = cortex_ctx_attach(ctx, attach_pid);
+		if (elf_core_fd < 0) {
+			exit(1);
+		}
+		if (pid == 0)
+			pid = attach_pid;
+	} else if (input_file) {
 		elf_core_fd = open(input_file, O_RDONLY);
 		if (elf_core_fd < 0) {
 			perror("cannot open core file");
@@ -132,83 +341,97 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/* try to parse output format */
-	if (cortex_output_set_format(fmt) < 0) {
-		goto out_err;
+	/* the -o/-e/-f options describe the main sink. It is
+	   implicit (stdout, default format) if no other sink is set */
+	if (nr_sinks == 0 || output_cmd || output_file || fmt) {
+		sinks[0].fmt = cortex_output_parse_format(fmt);
+		sinks[0].stream = NULL;
+		if (output_cmd) {
+			sinks[0].type = CORTEX_OUTPUT_SINK_CMD;
+			sinks[0].dest = output_cmd;
+		} else if (output_file) {
+			sinks[0].type = CORTEX_OUTPUT_SINK_FILE;
+			sinks[0].dest = output_file;
+		} else {
+			sinks[0].type = CORTEX_OUTPUT_SINK_STDOUT;
+			sinks[0].dest = "stdout";
+		}
+	} else {
+		sinks[0].fmt = -1;
 	}
 
-	/* Install a sig handler for VT ALARM 
-	   in case no input is provided to cortex */
-	func_wd.sa_handler = cortex_no_input;
-	func_wd.sa_flags = 0;
-	sigaction(SIGALRM, &func_wd, NULL);
-
-	/* start a timer in case the core is not sent 
-	   to stdin (or input option) 2 seconds should be
-	   more than enought */
-	timer_wd.it_value.tv_sec = 2;
-	timer_wd.it_value.tv_usec = 0;
-	timer_wd.it_interval.tv_sec = 0;
-	timer_wd.it_interval.tv_usec = 0;
-	setitimer(ITIMER_REAL, &timer_wd, NULL);
-
-	/* Here we start the load/parse of the elf core file. */
-	core = cortex_elf_load_core(elf_core_fd);
-
-	/* Here we can be sure that something was provided as input */
-	timer_wd.it_value.tv_sec = 0;
-	timer_wd.it_value.tv_usec = 0;
-	timer_wd.it_interval.tv_sec = 0;
-	timer_wd.it_interval.tv_usec = 0;
-	setitimer(ITIMER_REAL, &timer_wd, NULL);
-
-	if (core == NULL) {
-		goto out_err;
+	/* the same compression applies to every output */
+	for (i = 0; i <= nr_sinks; i++) {
+		sinks[i].zip = zip;
+		sinks[i].level = zip_level;
 	}
 
-	ehdr = cortex_elf_load_ehdr(core);
-	if (ehdr == NULL) {
+	/* try to parse output format */
+	if (fmt && sinks[0].fmt < 0) {
 		goto out_err;
 	}
 
-	/* elf core is valid: read it */
-	info = cortex_elf_parse(core, ehdr);
-	if (info == NULL) {
-		goto out_err;
+	/* the context probes run while the core is read. The /proc/<pid>
+	   ones must: the process goes away once its core is consumed */
+	for (i = 0; i <= nr_sinks; i++) {
+		if (sinks[i].fmt >= 0)
+			sys_fmt |= sinks[i].fmt;
 	}
+	if (!(sys_fmt & CORTEX_OUTPUT_FMT_SYS))
+		sys_probes &= ~CORTEX_SYS_PROBES_SYSTEM;
+	if (!(sys_fmt & CORTEX_OUTPUT_FMT_PRC))
+		sys_probes &= ~CORTEX_SYS_PROBES_PROC;
+	if (deadline > 0 && sys_budget > deadline)
+		sys_budget = deadline;
+	if (sys_fmt & (CORTEX_OUTPUT_FMT_SYS | CORTEX_OUTPUT_FMT_PRC))
+		cortex_ctx_probe(ctx, sys_probes, sys_budget, pid);
 
-	/* We have a correct elf loaded. Now let's parse
-	   the output of cortex: cmd or file */
-	if (output_cmd) {
-		output = popen(output_cmd, "w");
-	} else if (output_file) {
-		output = fopen(output_file, "w");
-	}
+	/* bound the whole analysis. Until the first bytes of the core
+	   come, the budget is limited to CORTEX_DEADLINE_INPUT: cortex
+	   was most likely started without any input */
+	cortex_deadline_start(deadline);
 
-	if (!output) {
-		perror("cannot open output");
-		exit(1);
+	/* Here we start the load/parse of the elf core file. */
+	cortex_ctx_set_scan(ctx, scan);
+	if (sys_fmt & CORTEX_OUTPUT_FMT_MEM)
+		cortex_ctx_stream(ctx, CORTEX_STREAM_PAGES);
+	if (sys_fmt & CORTEX_OUTPUT_FMT_DIG)
+		cortex_ctx_stream(ctx, CORTEX_STREAM_DIGEST);
+	if (cortex_ctx_parse(ctx, elf_core_fd) < 0) {
+		/* exits with 1, as cortex always did when no core came */
+		if (cortex_ctx_bytes(ctx) == 0 && cortex_deadline_expired()) {
+			printf("cannot read core file: no input\n");
+			ret = 1;
+		}
+		goto out_err;
 	}
 
 	/* parsing is done. now write all we know about current
-	 * process to the output stream */
-	cortex_output_write_process(info, output, disassemble_ctx);
+	 * process to each output: stdout, cmd, file or fd */
+	ret = cortex_ctx_render(ctx, sinks, nr_sinks + 1, disassemble_ctx);
 
-	/* we got all we want, so cleanup all ressources
-	 * and byebye. */
-	if (output != stdout) {
-		if (output_cmd) {
-			pclose(output);
-		} else {
-			fclose(output);
-		}
+out_err:
+	/* written even when the analysis failed: that is when
+	   they are the most useful */
+	if (stats_file)
+		cortex_ctx_write_stats(ctx, stats_file);
+
+	/* fleet wide metrics: best effort, the file may not be
+	   writable when cortex is not run by the kernel. A snapshot
+	   is not a crash, nor is a profile */
+	if (strcmp(metrics_file, "none") != 0 && attach_pid == 0 &&
+	    profile_pid == 0) {
+		memset(&run, 0, sizeof(run));
+		run.signum = cortex_ctx_signum(ctx);
+		run.failed = ret != 0;
+		run.truncated = cortex_ctx_info(ctx) &&
+		    cortex_deadline_expired();
+		run.bytes = cortex_ctx_bytes(ctx);
+		cortex_metrics_record(metrics_file, &run);
 	}
 
-	ret = 0;
-out_err:
-	cortex_elf_cleanup_process_info(info);
-	cortex_elf_release_core(core);
-	close(elf_core_fd);
+	/* the context closes the core */
+	cortex_ctx_free(ctx);
 
 	return ret;
 }
@@ -0,0 +1,549 @@
+/** \file cortex_mdmp.c
+ * \brief cortex minidump output
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cortex.h"
+#include "cortex_elf.h"
+#include "cortex_mem.h"
+#include "cortex_mdmp.h"
+#include "arch/cortex_arch.h"
+
+#define MDMP_NR_STREAMS		7
+#define MDMP_ALIGN(a)		(((a) + 7) & ~7UL)
+#define MDMP_BUILD_ID_MAX	64
+
+/* a module: consecutive NT_FILE mappings of the same file */
+struct cortex_mdmp_module {
+	ElfN_Addr base;
+	ElfN_Addr end;
+	const char *name;
+	size_t build_id_len;
+	unsigned char build_id[MDMP_BUILD_ID_MAX];
+	uint32_t name_rva;
+	uint32_t cv_rva;
+};
+
+/* everything is laid out before the first byte is written, so
+   that the minidump can be streamed to a pipe */
+struct cortex_mdmp_layout {
+	uint32_t sysinfo_rva;
+	uint32_t csd_rva;
+	uint32_t thread_rva;
+	uint32_t memory_rva;
+	uint32_t module_rva;
+	uint32_t exception_rva;
+	uint32_t auxv_rva;
+	uint32_t auxv_size;
+	uint32_t cmdline_rva;
+	uint32_t cmdline_size;
+	uint32_t context_rva;
+	uint32_t context_size;
+	uint32_t *region_rva;
+	uint32_t end;
+};
+
+static void cortex_mdmp_pad(FILE * output, uint32_t * cursor, uint32_t rva)
+{
+	static const char zero[8];
+
+	while (*cursor < rva) {
+		uint32_t len = rva - *cursor;
+
+		if (len > sizeof(zero))
+			len = sizeof(zero);
+		fwrite(zero, 1, len, output);
+		*cursor += len;
+	}
+}
+
+static void cortex_mdmp_write_string(FILE * output, uint32_t * cursor,
+				     const char *str)
+{
+	uint32_t len = strlen(str);
+	uint32_t i = 0;
+
+	/* minidump strings are utf-16: this is only right for ascii */
+	len *= 2;
+	fwrite(&len, sizeof(len), 1, output);
+	for (i = 0; i <= len / 2; i++) {
+		uint16_t c = (unsigned char)str[i];
+
+		fwrite(&c, sizeof(c), 1, output);
+	}
+	*cursor += sizeof(len) + len + 2;
+}
+
+static uint32_t cortex_mdmp_string_size(const char *str)
+{
+	return sizeof(uint32_t) + 2 * (strlen(str) + 1);
+}
+
+/* look for the GNU build id in the ELF header page of a module. The
+   modules have the class and the byte order of the core */
+static void cortex_mdmp_build_id(struct cortex_proc_info *info,
+				 struct cortex_mdmp_module *module)
+{
+	struct cortex_elf_region *region =
+	    cortex_elf_find_region(info, module->base);
+	const struct cortex_elf_class *elf_class = info->elf->elf_class;
+	int swap = info->elf->swap;
+	unsigned char *image = NULL;
+	ElfN_Ehdr ehdr;
+	size_t avail = 0;
+	int i = 0;
+
+	if (!region)
+		return;
+
+	avail = region->vaddr + region->size - module->base;
+	image = region->d_buf + module->base - region->vaddr;
+	if (avail < elf_class->ehdr_size || memcmp(image, ELFMAG, SELFMAG) ||
+	    image[EI_CLASS] != elf_class->elf_class)
+		return;
+
+	elf_class->read_ehdr(&ehdr, image, swap);
+	if (ehdr.e_phoff + ehdr.e_phnum * elf_class->phdr_size > avail)
+		return;
+
+	for (i = 0; i < ehdr.e_phnum; i++) {
+		unsigned char *note = NULL;
+		unsigned char *end = NULL;
+		ElfN_Phdr phdr;
+
+		elf_class->read_phdr(&phdr, image + ehdr.e_phoff +
+				     i * elf_class->phdr_size, swap);
+		if (phdr.p_type != PT_NOTE ||
+		    phdr.p_offset + phdr.p_filesz > avail)
+			continue;
+
+		note = image + phdr.p_offset;
+		end = note + phdr.p_filesz;
+		while (note + sizeof(ElfN_Nhdr) <= end) {
+			uint32_t namesz = cortex_elf_get(note, 4, swap);
+			uint32_t descsz = cortex_elf_get(note + 4, 4, swap);
+			uint32_t type = cortex_elf_get(note + 8, 4, swap);
+			unsigned char *desc =
+			    note + sizeof(ElfN_Nhdr) + ((namesz + 3) & ~3);
+
+			if (desc + descsz > end)
+				break;
+
+			if (type == NT_GNU_BUILD_ID && namesz == 4 &&
+			    memcmp(note + sizeof(ElfN_Nhdr), "GNU", 4) == 0 &&
+			    descsz <= MDMP_BUILD_ID_MAX) {
+				module->build_id_len = descsz;
+				memcpy(module->build_id, desc, descsz);
+				return;
+			}
+
+			note = desc + ((descsz + 3) & ~3);
+		}
+	}
+}
+
+static int cortex_mdmp_modules(struct cortex_proc_info *info,
+			       struct cortex_mdmp_module **modules)
+{
+	int i = 0;
+	int nr = 0;
+
+	*modules = cortex_mem_calloc(info->nr_files + 1, sizeof(**modules));
+	if (!*modules)
+		return 0;
+
+	for (i = 0; i < info->nr_files; i++) {
+		struct cortex_elf_file *file = &info->files[i];
+		struct cortex_mdmp_module *module = NULL;
+
+		if (nr && strcmp((*modules)[nr - 1].name, file->name) == 0 &&
+		    file->start >= (*modules)[nr - 1].end) {
+			(*modules)[nr - 1].end = file->end;
+			continue;
+		}
+
+		/* a module starts at its first page */
+		if (file->offset != 0)
+			continue;
+
+		module = &(*modules)[nr++];
+		module->base = file->start;
+		module->end = file->end;
+		module->name = file->name;
+		cortex_mdmp_build_id(info, module);
+	}
+
+	return nr;
+}
+
+static struct cortex_elf_region *cortex_mdmp_stack(struct cortex_proc_info
+						   *info, int thread,
+						   ElfN_Addr sp)
+{
+	struct cortex_elf_region *region = cortex_elf_find_region(info, sp);
+
+	if (region && region->type == CORTEX_REGION_STACK &&
+	    region->thread == thread)
+		return region;
+	return NULL;
+}
+
+/* AT_PLATFORM points to a string on the stack of the process, if the
+   core holds it */
+static const char *cortex_mdmp_platform(struct cortex_proc_info *info,
+					ElfN_Addr vaddr)
+{
+	const unsigned char *raw = NULL;
+	size_t len = 0;
+
+	raw = cortex_elf_map(info, vaddr, &len);
+	if (!raw || !memchr(raw, '\0', len))
+		return NULL;
+
+	return (const char *)raw;
+}
+
+/* Only what the core tells is reported: it may be analyzed away from the
+   machine that crashed. The kernel version and the number of cpus are
+   not in the core, they are left to zero. */
+static void cortex_mdmp_system_info(struct cortex_proc_info *info,
+				    struct mdmp_system_info *sysinfo,
+				    char *csd, size_t csd_size)
+{
+	ElfN_auxv_t *auxv = info->auxv;
+	const char *platform = NULL;
+
+	memset(sysinfo, 0, sizeof(*sysinfo));
+	sysinfo->processor_architecture = MDMP_CPU_UNKNOWN;
+	if (info->arch->get_mdmp_cpu)
+		sysinfo->processor_architecture = info->arch->get_mdmp_cpu();
+	sysinfo->platform_id = MDMP_OS_LINUX;
+
+	/* the hwcap are the cpuid features on x86 */
+	while (auxv && auxv->a_type != AT_NULL) {
+		if (auxv->a_type == AT_HWCAP) {
+			if (sysinfo->processor_architecture == MDMP_CPU_X86 ||
+			    sysinfo->processor_architecture == MDMP_CPU_AMD64)
+				sysinfo->processor_features[2] =
+				    auxv->a_un.a_val;
+			else
+				sysinfo->processor_features[0] =
+				    auxv->a_un.a_val;
+		} else if (auxv->a_type == AT_PLATFORM) {
+			platform = cortex_mdmp_platform(info, auxv->a_un.a_val);
+		}
+		auxv++;
+	}
+
+	snprintf(csd, csd_size, "Linux%s%s", platform ? " " : "",
+		 platform ? platform : "");
+}
+
+static void cortex_mdmp_layout(struct cortex_proc_info *info,
+			       struct cortex_mdmp_layout *layout,
+			       struct cortex_mdmp_module *modules,
+			       int nr_modules, const char *csd)
+{
+	uint32_t rva = 0;
+	int i = 0;
+
+	rva = sizeof(struct mdmp_header);
+	rva += MDMP_NR_STREAMS * sizeof(struct mdmp_directory);
+
+	layout->sysinfo_rva = rva;
+	rva += sizeof(struct mdmp_system_info);
+	layout->csd_rva = rva;
+	rva += cortex_mdmp_string_size(csd);
+
+	layout->thread_rva = rva;
+	rva += sizeof(uint32_t) + info->nr_threads * sizeof(struct mdmp_thread);
+	layout->memory_rva = rva;
+	rva += sizeof(uint32_t) + info->nr_regions * sizeof(struct mdmp_memory);
+	layout->module_rva = rva;
+	rva += sizeof(uint32_t) + nr_modules * sizeof(struct mdmp_module);
+	layout->exception_rva = rva;
+	rva += sizeof(struct mdmp_exception);
+
+	layout->auxv_rva = rva;
+	layout->auxv_size = info->auxv_size;
+	rva += layout->auxv_size;
+	layout->cmdline_rva = rva;
+	layout->cmdline_size = strnlen(info->info->pr_psargs,
+				       sizeof(info->info->pr_psargs)) + 1;
+	rva += layout->cmdline_size;
+
+	layout->context_rva = rva = MDMP_ALIGN(rva);
+	rva += info->nr_threads * layout->context_size;
+
+	for (i = 0; i < nr_modules; i++) {
+		modules[i].name_rva = rva;
+		rva += cortex_mdmp_string_size(modules[i].name);
+		modules[i].cv_rva = rva;
+		if (modules[i].build_id_len)
+			rva += sizeof(uint32_t) + modules[i].build_id_len;
+	}
+
+	for (i = 0; i < info->nr_regions; i++) {
+		rva = MDMP_ALIGN(rva);
+		layout->region_rva[i] = rva;
+		rva += info->regions[i].size;
+	}
+
+	layout->end = rva;
+}
+
+static void cortex_mdmp_write_streams(struct cortex_proc_info *info,
+				      FILE * output,
+				      struct cortex_mdmp_layout *layout,
+				      int nr_modules)
+{
+	struct mdmp_directory dir[MDMP_NR_STREAMS];
+	int i = 0;
+
+	dir[i].type = MDMP_STREAM_SYSTEM_INFO;
+	dir[i].location.rva = layout->sysinfo_rva;
+	dir[i++].location.size = sizeof(struct mdmp_system_info);
+
+	dir[i].type = MDMP_STREAM_THREAD_LIST;
+	dir[i].location.rva = layout->thread_rva;
+	dir[i++].location.size = layout->memory_rva - layout->thread_rva;
+
+	dir[i].type = MDMP_STREAM_MEMORY_LIST;
+	dir[i].location.rva = layout->memory_rva;
+	dir[i++].location.size = layout->module_rva - layout->memory_rva;
+
+	dir[i].type = MDMP_STREAM_MODULE_LIST;
+	dir[i].location.rva = layout->module_rva;
+	dir[i++].location.size = sizeof(uint32_t) +
+	    nr_modules * sizeof(struct mdmp_module);
+
+	dir[i].type = MDMP_STREAM_EXCEPTION;
+	dir[i].location.rva = layout->exception_rva;
+	dir[i++].location.size = sizeof(struct mdmp_exception);
+
+	dir[i].type = MDMP_STREAM_LINUX_AUXV;
+	dir[i].location.rva = layout->auxv_rva;
+	dir[i++].location.size = layout->auxv_size;
+
+	dir[i].type = MDMP_STREAM_LINUX_CMD_LINE;
+	dir[i].location.rva = layout->cmdline_rva;
+	dir[i++].location.size = layout->cmdline_size;
+
+	fwrite(dir, sizeof(dir), 1, output);
+}
+
+/** \brief write a breakpad compatible minidump
+ *
+ * Threads come from each NT_PRSTATUS, memory from the windows loaded
+ * with the core, modules from NT_FILE and system info from auxv.
+ */
+/* the structures are written in host byte order */
+static int cortex_mdmp_host_le(void)
+{
+	const uint16_t one = 1;
+
+	return *(const uint8_t *)&one == 1;
+}
+
+void cortex_mdmp_write(struct cortex_proc_info *info, FILE * output)
+{
+	int i = 0;
+	int nr_modules = 0;
+	uint32_t count = 0;
+	uint32_t cursor = 0;
+	char csd[512];
+	unsigned char *context = NULL;
+	struct mdmp_header hdr;
+	struct mdmp_system_info sysinfo;
+	struct mdmp_exception exception;
+	struct cortex_mdmp_layout layout;
+	struct cortex_mdmp_module *modules = NULL;
+
+	if (!cortex_mdmp_host_le()) {
+		fprintf(stderr, "minidump is not supported on big endian hosts\n");
+		return;
+	}
+
+	if (!info->arch->fill_mdmp_context) {
+		fprintf(stderr, "minidump is not supported on %s\n",
+			info->arch->name);
+		return;
+	}
+
+	memset(&layout, 0, sizeof(layout));
+	layout.context_size = info->arch->fill_mdmp_context(NULL, NULL);
+	layout.region_rva = cortex_mem_calloc(info->nr_regions + 1, sizeof(uint32_t));
+	context = cortex_mem_calloc(1, layout.context_size);
+	if (!layout.region_rva || !context) {
+		fprintf(stderr, "%s: cannot allocate minidump\n", __FILE__);
+		goto out;
+	}
+
+	nr_modules = cortex_mdmp_modules(info, &modules);
+	cortex_mdmp_system_info(info, &sysinfo, csd, sizeof(csd));
+	cortex_mdmp_layout(info, &layout, modules, nr_modules, csd);
+
+	/* header and stream directory */
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.signature = MDMP_SIGNATURE;
+	hdr.version = MDMP_VERSION;
+	hdr.nr_streams = MDMP_NR_STREAMS;
+	hdr.stream_rva = sizeof(hdr);
+	hdr.time_date_stamp = time(NULL);
+	fwrite(&hdr, sizeof(hdr), 1, output);
+	cortex_mdmp_write_streams(info, output, &layout, nr_modules);
+	cursor = layout.sysinfo_rva;
+
+	/* system info */
+	sysinfo.csd_version_rva = layout.csd_rva;
+	fwrite(&sysinfo, sizeof(sysinfo), 1, output);
+	cursor += sizeof(sysinfo);
+	cortex_mdmp_write_string(output, &cursor, csd);
+
+	/* thread list */
+	count = info->nr_threads;
+	fwrite(&count, sizeof(count), 1, output);
+	cursor += sizeof(count);
+	for (i = 0; i < info->nr_threads; i++) {
+		struct cortex_cpu_regs cpu_regs[CORTEX_CPU_REGS_MAX];
+		struct mdmp_thread thread;
+		struct cortex_elf_region *stack = NULL;
+
+		info->arch->fill_regs(cpu_regs, info->threads[i].pr_reg);
+		stack = cortex_mdmp_stack(info, i, info->arch->get_sp(cpu_regs));
+
+		memset(&thread, 0, sizeof(thread));
+		thread.thread_id = info->threads[i].pr_pid;
+		thread.context.rva = layout.context_rva +
+		    i * layout.context_size;
+		thread.context.size = layout.context_size;
+		if (stack) {
+			thread.stack.start = stack->vaddr;
+			thread.stack.memory.size = stack->size;
+			thread.stack.memory.rva =
+			    layout.region_rva[stack - info->regions];
+		} else {
+			thread.stack.start = info->arch->get_sp(cpu_regs);
+		}
+
+		fwrite(&thread, sizeof(thread), 1, output);
+		cursor += sizeof(thread);
+	}
+
+	/* memory list */
+	count = info->nr_regions;
+	fwrite(&count, sizeof(count), 1, output);
+	cursor += sizeof(count);
+	for (i = 0; i < info->nr_regions; i++) {
+		struct mdmp_memory memory;
+
+		memory.start = info->regions[i].vaddr;
+		memory.memory.size = info->regions[i].size;
+		memory.memory.rva = layout.region_rva[i];
+		fwrite(&memory, sizeof(memory), 1, output);
+		cursor += sizeof(memory);
+	}
+
+	/* module list */
+	count = nr_modules;
+	fwrite(&count, sizeof(count), 1, output);
+	cursor += sizeof(count);
+	for (i = 0; i < nr_modules; i++) {
+		struct mdmp_module module;
+
+		memset(&module, 0, sizeof(module));
+		module.base = modules[i].base;
+		module.size = modules[i].end - modules[i].base;
+		module.name_rva = modules[i].name_rva;
+		if (modules[i].build_id_len) {
+			module.cv_record.rva = modules[i].cv_rva;
+			module.cv_record.size = sizeof(uint32_t) +
+			    modules[i].build_id_len;
+		}
+		fwrite(&module, sizeof(module), 1, output);
+		cursor += sizeof(module);
+	}
+
+	/* exception: the signal received by the active thread */
+	memset(&exception, 0, sizeof(exception));
+	exception.thread_id = info->threads[0].pr_pid;
+	exception.code = info->threads[0].pr_cursig;
+	exception.address = info->pc;
+	/* as breakpad does: si_code in the flags, the faulting address */
+	if (info->siginfo) {
+		exception.flags = info->siginfo->code;
+		if (info->siginfo->fault && info->siginfo->code > 0)
+			exception.address = info->siginfo->addr;
+	}
+	exception.context.rva = layout.context_rva;
+	exception.context.size = layout.context_size;
+	fwrite(&exception, sizeof(exception), 1, output);
+	cursor += sizeof(exception);
+
+	/* linux specific streams, auxv as found in the core */
+	if (layout.auxv_size)
+		fwrite(info->auxv_raw, 1, layout.auxv_size, output);
+	cursor += layout.auxv_size;
+	fwrite(info->info->pr_psargs, 1, layout.cmdline_size - 1, output);
+	fputc('\0', output);
+	cursor += layout.cmdline_size;
+
+	/* thread contexts */
+	cortex_mdmp_pad(output, &cursor, layout.context_rva);
+	for (i = 0; i < info->nr_threads; i++) {
+		memset(context, 0, layout.context_size);
+		info->arch->fill_mdmp_context(info->threads[i].pr_reg, context);
+		fwrite(context, 1, layout.context_size, output);
+		cursor += layout.context_size;
+	}
+
+	/* module names and build ids */
+	for (i = 0; i < nr_modules; i++) {
+		cortex_mdmp_write_string(output, &cursor, modules[i].name);
+		if (modules[i].build_id_len) {
+			uint32_t signature = MDMP_CV_ELF_SIGNATURE;
+
+			fwrite(&signature, sizeof(signature), 1, output);
+			fwrite(modules[i].build_id, 1,
+			       modules[i].build_id_len, output);
+			cursor += sizeof(signature) + modules[i].build_id_len;
+		}
+	}
+
+	/* and finally the memory */
+	for (i = 0; i < info->nr_regions; i++) {
+		cortex_mdmp_pad(output, &cursor, layout.region_rva[i]);
+		fwrite(info->regions[i].d_buf, 1, info->regions[i].size,
+		       output);
+		cursor += info->regions[i].size;
+	}
+
+	if (cursor != layout.end)
+		fprintf(stderr, "%s: layout mismatch\n", __FILE__);
+
+out:
+	cortex_mem_free(modules);
+	cortex_mem_free(context);
+	cortex_mem_free(layout.region_rva);
+}
@@ -0,0 +1,202 @@
+
+#ifndef _CORTEX_MDMP_H_
+#define _CORTEX_MDMP_H_
+
+/** \file cortex_mdmp.h
+ * \brief cortex minidump format definition
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cortex.h"
+
+/** \brief minidump layout, as read by breakpad
+ *
+ * All structures are little endian and packed. Offsets (rva) are
+ * relative to the beginning of the file. They are written as they lie
+ * in memory: minidumps are only written on little endian hosts.
+ */
+#define MDMP_SIGNATURE			0x504d444d	/* "MDMP" */
+#define MDMP_VERSION			0x0000a793
+
+#define MDMP_STREAM_THREAD_LIST		3
+#define MDMP_STREAM_MODULE_LIST		4
+#define MDMP_STREAM_MEMORY_LIST		5
+#define MDMP_STREAM_EXCEPTION		6
+#define MDMP_STREAM_SYSTEM_INFO		7
+#define MDMP_STREAM_LINUX_CMD_LINE	0x47670006
+#define MDMP_STREAM_LINUX_AUXV		0x47670008
+
+#define MDMP_CPU_X86			0
+#define MDMP_CPU_MIPS			1
+#define MDMP_CPU_PPC			3
+#define MDMP_CPU_ARM			5
+#define MDMP_CPU_AMD64			9
+#define MDMP_CPU_UNKNOWN		0xffff
+
+#define MDMP_OS_LINUX			0x8201
+
+#define MDMP_CV_ELF_SIGNATURE		0x4270454c	/* "BpEL" */
+
+#define MDMP_CONTEXT_X86		0x00010000
+#define MDMP_CONTEXT_AMD64		0x00100000
+#define MDMP_CONTEXT_ARM		0x40000000
+#define MDMP_CONTEXT_PPC		0x20000000
+#define MDMP_CONTEXT_CONTROL		0x00000001
+#define MDMP_CONTEXT_INTEGER		0x00000002
+#define MDMP_CONTEXT_SEGMENTS		0x00000004
+
+struct mdmp_location {
+	uint32_t size;
+	uint32_t rva;
+} __attribute__ ((packed));
+
+struct mdmp_memory {
+	uint64_t start;
+	struct mdmp_location memory;
+} __attribute__ ((packed));
+
+struct mdmp_header {
+	uint32_t signature;
+	uint32_t version;
+	uint32_t nr_streams;
+	uint32_t stream_rva;
+	uint32_t checksum;
+	uint32_t time_date_stamp;
+	uint64_t flags;
+} __attribute__ ((packed));
+
+struct mdmp_directory {
+	uint32_t type;
+	struct mdmp_location location;
+} __attribute__ ((packed));
+
+struct mdmp_thread {
+	uint32_t thread_id;
+	uint32_t suspend_count;
+	uint32_t priority_class;
+	uint32_t priority;
+	uint64_t teb;
+	struct mdmp_memory stack;
+	struct mdmp_location context;
+} __attribute__ ((packed));
+
+struct mdmp_module {
+	uint64_t base;
+	uint32_t size;
+	uint32_t checksum;
+	uint32_t time_date_stamp;
+	uint32_t name_rva;
+	uint32_t version_info[13];
+	struct mdmp_location cv_record;
+	struct mdmp_location misc_record;
+	uint64_t reserved0;
+	uint64_t reserved1;
+} __attribute__ ((packed));
+
+struct mdmp_exception {
+	uint32_t thread_id;
+	uint32_t alignment;
+	uint32_t code;
+	uint32_t flags;
+	uint64_t record;
+	uint64_t address;
+	uint32_t nr_parameters;
+	uint32_t unused_alignment;
+	uint64_t information[15];
+	struct mdmp_location context;
+} __attribute__ ((packed));
+
+struct mdmp_system_info {
+	uint16_t processor_architecture;
+	uint16_t processor_level;
+	uint16_t processor_revision;
+	uint8_t nr_processors;
+	uint8_t product_type;
+	uint32_t major_version;
+	uint32_t minor_version;
+	uint32_t build_number;
+	uint32_t platform_id;
+	uint32_t csd_version_rva;
+	uint16_t suite_mask;
+	uint16_t reserved2;
+	uint64_t processor_features[3];
+} __attribute__ ((packed));
+
+/** \brief thread contexts, filled by the arch backends */
+struct mdmp_context_x86 {
+	uint32_t context_flags;
+	uint32_t dr[6];
+	uint8_t float_save[112];
+	uint32_t gs, fs, es, ds;
+	uint32_t edi, esi, ebx, edx, ecx, eax;
+	uint32_t ebp, eip, cs, eflags, esp, ss;
+	uint8_t extended_registers[512];
+} __attribute__ ((packed));
+
+struct mdmp_context_amd64 {
+	uint64_t home[6];
+	uint32_t context_flags;
+	uint32_t mx_csr;
+	uint16_t cs, ds, es, fs, gs, ss;
+	uint32_t eflags;
+	uint64_t dr[6];
+	uint64_t rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi;
+	uint64_t r8, r9, r10, r11, r12, r13, r14, r15;
+	uint64_t rip;
+	uint8_t flt_save[512];
+	uint8_t vector_register[26 * 16];
+	uint64_t vector_control;
+	uint64_t debug_control;
+	uint64_t last_branch_to_rip;
+	uint64_t last_branch_from_rip;
+	uint64_t last_exception_to_rip;
+	uint64_t last_exception_from_rip;
+} __attribute__ ((packed));
+
+struct mdmp_context_arm {
+	uint32_t context_flags;
+	uint32_t iregs[16];
+	uint32_t cpsr;
+	uint64_t fpscr;
+	uint64_t fpregs[32];
+	uint32_t fpextra[8];
+} __attribute__ ((packed));
+
+struct mdmp_context_ppc {
+	uint32_t context_flags;
+	uint32_t srr0;
+	uint32_t srr1;
+	uint32_t gpr[32];
+	uint32_t cr;
+	uint32_t xer;
+	uint32_t lr;
+	uint32_t ctr;
+	uint32_t mq;
+	uint32_t vrsave;
+	uint64_t fpregs[32];
+	uint32_t fpscr_pad;
+	uint32_t fpscr;
+	uint8_t vector_save[32 * 16 + 16 + 4 * 4 + 4 + 7 * 4];
+} __attribute__ ((packed));
+
+void cortex_mdmp_write(struct cortex_proc_info *info, FILE * output);
+
+#endif /* _CORTEX_MDMP_H_ */
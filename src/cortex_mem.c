@@ -0,0 +1,420 @@
+/** \file cortex_mem.c
+ * \brief cortex memory arena
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "cortex_mem.h"
+
+/*
+ * cortex runs when a process crashed, often because the system is out
+ * of memory. All the memory it needs is reserved once at startup: the
+ * analysis then either fits in the arena or degrades, it never fails
+ * halfway on a refused malloc.
+ *
+ * The arena is a bump allocator. Every block is preceded by its size,
+ * so that the last block can be released or grown in place: this is
+ * enough for the load, parse, write, free sequence of cortex.
+ *
+ * Each analysis (struct cortex_ctx) has its own arena, bound to the
+ * thread working on it with cortex_mem_use(). A thread with no arena
+ * bound uses the process one, reserved by cortex_mem_init().
+ */
+
+struct cortex_mem_block {
+	size_t size;
+	size_t pad;
+};
+
+struct cortex_mem_arena {
+	pthread_mutex_t lock;
+	unsigned char *base;
+	size_t size;
+	size_t used;
+	size_t peak;		/*!< above it the arena was never touched */
+	long allocs;
+	long failed;
+	int locked;
+	int pins;		/*!< threads that may still write to it */
+	int released;		/*!< released while pinned: the last unpin
+				   releases it */
+};
+
+static struct cortex_mem_arena cortex_mem_process = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static __thread struct cortex_mem_arena *cortex_mem_current;
+
+#define min(a, b)		(((a)<(b))?(a):(b))
+
+#define CORTEX_MEM_ROUND(s) \
+	(((s) + CORTEX_MEM_ALIGN - 1) & ~((size_t)CORTEX_MEM_ALIGN - 1))
+
+/** \brief reserve the arena
+ * \param budget size of the arena in bytes
+ * \return 0 on success, -1 if the memory cannot be reserved
+ *
+ * The pages are faulted in, and locked if the limits allow it, so that
+ * the analysis does not depend on the state of the system anymore.
+ */
+static int cortex_mem_reserve(struct cortex_mem_arena *arena, size_t budget)
+{
+	void *base;
+
+	budget = CORTEX_MEM_ROUND(budget);
+
+	base = mmap(NULL, budget, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (base == MAP_FAILED) {
+		perror("cannot reserve memory arena");
+		return -1;
+	}
+
+	arena->locked = mlock(base, budget) == 0;
+	arena->base = base;
+	arena->size = budget;
+
+	return 0;
+}
+
+int cortex_mem_init(size_t budget)
+{
+	if (cortex_mem_process.base)
+		return 0;
+
+	return cortex_mem_reserve(&cortex_mem_process, budget);
+}
+
+/** \brief reserve an arena of its own for one analysis
+ * \param budget size of the arena in bytes
+ * \return the arena, or NULL if the memory cannot be reserved
+ */
+struct cortex_mem_arena *cortex_mem_arena_new(size_t budget)
+{
+	struct cortex_mem_arena *arena = calloc(1, sizeof(*arena));
+
+	if (arena == NULL)
+		return NULL;
+
+	if (cortex_mem_reserve(arena, budget) < 0) {
+		free(arena);
+		return NULL;
+	}
+	pthread_mutex_init(&arena->lock, NULL);
+
+	return arena;
+}
+
+/** \brief give back everything allocated from an arena, keep the memory */
+void cortex_mem_arena_reset(struct cortex_mem_arena *arena)
+{
+	pthread_mutex_lock(&arena->lock);
+	arena->used = 0;
+	pthread_mutex_unlock(&arena->lock);
+}
+
+static void __cortex_mem_arena_release(struct cortex_mem_arena *arena)
+{
+	munmap(arena->base, arena->size);
+	pthread_mutex_destroy(&arena->lock);
+	free(arena);
+}
+
+/** \brief unmap an arena, or leave it to the last thread pinning it */
+void cortex_mem_arena_release(struct cortex_mem_arena *arena)
+{
+	int pins;
+
+	if (arena == NULL)
+		return;
+
+	pthread_mutex_lock(&arena->lock);
+	pins = arena->pins;
+	arena->released = 1;
+	pthread_mutex_unlock(&arena->lock);
+
+	if (pins == 0)
+		__cortex_mem_arena_release(arena);
+}
+
+/** \brief keep an arena mapped for a thread that outlives its owner
+ *
+ * A pinned arena must not be reset: its blocks are still in use.
+ * Nothing is done for the process arena, it is never released.
+ */
+void cortex_mem_arena_pin(struct cortex_mem_arena *arena)
+{
+	if (arena == NULL)
+		return;
+
+	pthread_mutex_lock(&arena->lock);
+	arena->pins++;
+	pthread_mutex_unlock(&arena->lock);
+}
+
+/** \brief drop a pin. The last one releases the arena if its owner
+ * already did */
+void cortex_mem_arena_unpin(struct cortex_mem_arena *arena)
+{
+	int release;
+
+	if (arena == NULL)
+		return;
+
+	pthread_mutex_lock(&arena->lock);
+	release = --arena->pins == 0 && arena->released;
+	pthread_mutex_unlock(&arena->lock);
+
+	if (release)
+		__cortex_mem_arena_release(arena);
+}
+
+/** \brief the number of pins held on an arena */
+int cortex_mem_arena_pinned(struct cortex_mem_arena *arena)
+{
+	int pins;
+
+	if (arena == NULL)
+		return 0;
+
+	pthread_mutex_lock(&arena->lock);
+	pins = arena->pins;
+	pthread_mutex_unlock(&arena->lock);
+
+	return pins;
+}
+
+/** \brief bind an arena to the calling thread
+ * \param arena the arena, NULL for the process one
+ * \return the arena previously bound
+ */
+struct cortex_mem_arena *cortex_mem_use(struct cortex_mem_arena *arena)
+{
+	struct cortex_mem_arena *prev = cortex_mem_current;
+
+	cortex_mem_current = arena;
+
+	return prev;
+}
+
+/** \brief the arena bound to the calling thread, NULL for the process one */
+struct cortex_mem_arena *cortex_mem_bound(void)
+{
+	return cortex_mem_current;
+}
+
+static struct cortex_mem_arena *cortex_mem_arena(void)
+{
+	return cortex_mem_current ? cortex_mem_current : &cortex_mem_process;
+}
+
+/** \brief parse a size with an optional k, M or G suffix
+ * \return the size in bytes, or -1 if it is invalid
+ */
+long cortex_mem_parse_size(const char *str)
+{
+	char *end = NULL;
+	long size = strtol(str, &end, 0);
+
+	if (end == str || size <= 0)
+		goto out_err;
+
+	switch (*end) {
+	case 'g':
+	case 'G':
+		size <<= 10;
+		/* fall through */
+	case 'm':
+	case 'M':
+		size <<= 10;
+		/* fall through */
+	case 'k':
+	case 'K':
+		size <<= 10;
+		end++;
+		break;
+	default:
+		break;
+	}
+
+	if (*end == '\0')
+		return size;
+
+out_err:
+	fprintf(stderr, "invalid size %s\n", str);
+	return -1;
+}
+
+/* must be called with the lock held */
+static void *__cortex_mem_alloc(struct cortex_mem_arena *arena, size_t size)
+{
+	struct cortex_mem_block *block;
+	size_t offset = arena->used;
+	size_t total;
+
+	if (!arena->base && cortex_mem_reserve(arena, CORTEX_MEM_BUDGET) < 0)
+		return NULL;
+
+	total = sizeof(*block) + CORTEX_MEM_ROUND(size);
+	if (size > arena->size || total > arena->size - offset) {
+		arena->failed++;
+		return NULL;
+	}
+
+	block = (struct cortex_mem_block *)(arena->base + offset);
+	block->size = CORTEX_MEM_ROUND(size);
+
+	/* memory above the peak is still zero from mmap */
+	if (offset + total > arena->peak) {
+		if (arena->peak > offset)
+			memset(block + 1, 0, arena->peak - offset -
+			       sizeof(*block));
+		arena->peak = offset + total;
+	} else {
+		memset(block + 1, 0, block->size);
+	}
+
+	arena->used = offset + total;
+	arena->allocs++;
+
+	return block + 1;
+}
+
+static struct cortex_mem_block *cortex_mem_block(void *ptr)
+{
+	return (struct cortex_mem_block *)ptr - 1;
+}
+
+static int cortex_mem_is_last(struct cortex_mem_arena *arena, void *ptr)
+{
+	struct cortex_mem_block *block = cortex_mem_block(ptr);
+
+	return (unsigned char *)ptr + block->size ==
+	    arena->base + arena->used;
+}
+
+/** \brief allocate zeroed memory from the arena
+ * \return the memory, or NULL if it does not fit in the budget
+ */
+void *cortex_mem_alloc(size_t size)
+{
+	struct cortex_mem_arena *arena = cortex_mem_arena();
+	void *ptr;
+
+	pthread_mutex_lock(&arena->lock);
+	ptr = __cortex_mem_alloc(arena, size);
+	pthread_mutex_unlock(&arena->lock);
+
+	return ptr;
+}
+
+void *cortex_mem_calloc(size_t nmemb, size_t size)
+{
+	if (size && nmemb > SIZE_MAX / size)
+		return NULL;
+
+	return cortex_mem_alloc(nmemb * size);
+}
+
+/** \brief resize a block. The last block grows in place. */
+void *cortex_mem_realloc(void *ptr, size_t size)
+{
+	struct cortex_mem_arena *arena = cortex_mem_arena();
+	struct cortex_mem_block *block;
+	size_t offset;
+	void *new = NULL;
+
+	if (ptr == NULL)
+		return cortex_mem_alloc(size);
+
+	pthread_mutex_lock(&arena->lock);
+
+	block = cortex_mem_block(ptr);
+	if (size <= block->size) {
+		new = ptr;
+		goto out;
+	}
+
+	if (cortex_mem_is_last(arena, ptr)) {
+		size_t end;
+
+		/* grow in place: only the new part needs clearing,
+		   memory above the peak is still zero from mmap */
+		offset = (unsigned char *)ptr - arena->base;
+		if (size > arena->size - offset) {
+			arena->failed++;
+			goto out;
+		}
+
+		end = offset + CORTEX_MEM_ROUND(size);
+		if (arena->peak > arena->used)
+			memset(arena->base + arena->used, 0,
+			       min(end, arena->peak) - arena->used);
+
+		block->size = end - offset;
+		arena->used = end;
+		if (end > arena->peak)
+			arena->peak = end;
+		new = ptr;
+		goto out;
+	}
+
+	new = __cortex_mem_alloc(arena, size);
+	if (new)
+		memcpy(new, ptr, block->size);
+
+out:
+	pthread_mutex_unlock(&arena->lock);
+	return new;
+}
+
+/** \brief release a block. Only the last one really gives memory back */
+void cortex_mem_free(void *ptr)
+{
+	struct cortex_mem_arena *arena = cortex_mem_arena();
+
+	if (ptr == NULL)
+		return;
+
+	pthread_mutex_lock(&arena->lock);
+	if (cortex_mem_is_last(arena, ptr))
+		arena->used = (unsigned char *)cortex_mem_block(ptr) -
+		    arena->base;
+	pthread_mutex_unlock(&arena->lock);
+}
+
+void cortex_mem_get_stats(struct cortex_mem_stats *stats)
+{
+	struct cortex_mem_arena *arena = cortex_mem_arena();
+
+	pthread_mutex_lock(&arena->lock);
+	stats->budget = arena->size;
+	stats->used = arena->used;
+	stats->peak = arena->peak;
+	stats->allocs = arena->allocs;
+	stats->failed = arena->failed;
+	stats->locked = arena->locked;
+	pthread_mutex_unlock(&arena->lock);
+}
@@ -0,0 +1,64 @@
+#ifndef _CORTEX_MEM_H_
+#define _CORTEX_MEM_H_
+
+/** \file cortex_mem.h
+ * \brief cortex memory arena
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stddef.h>
+
+/** \brief default size of the arena */
+#define CORTEX_MEM_BUDGET	(8*1024*1024)
+/** \brief alignment of every allocation */
+#define CORTEX_MEM_ALIGN	16
+
+/** \struct cortex_mem_stats
+ ** \brief arena usage, reported at the end of the analysis
+ */
+struct cortex_mem_stats {
+	size_t budget;		/*!< size of the arena */
+	size_t used;		/*!< bytes allocated now */
+	size_t peak;		/*!< highest usage */
+	long allocs;		/*!< allocations served */
+	long failed;		/*!< allocations refused for lack of room */
+	int locked;		/*!< the arena is locked in RAM */
+};
+
+struct cortex_mem_arena;
+
+int cortex_mem_init(size_t budget);
+long cortex_mem_parse_size(const char *str);
+
+struct cortex_mem_arena *cortex_mem_arena_new(size_t budget);
+void cortex_mem_arena_reset(struct cortex_mem_arena *arena);
+void cortex_mem_arena_release(struct cortex_mem_arena *arena);
+void cortex_mem_arena_pin(struct cortex_mem_arena *arena);
+void cortex_mem_arena_unpin(struct cortex_mem_arena *arena);
+int cortex_mem_arena_pinned(struct cortex_mem_arena *arena);
+struct cortex_mem_arena *cortex_mem_use(struct cortex_mem_arena *arena);
+struct cortex_mem_arena *cortex_mem_bound(void);
+
+void *cortex_mem_alloc(size_t size);
+void *cortex_mem_calloc(size_t nmemb, size_t size);
+void *cortex_mem_realloc(void *ptr, size_t size);
+void cortex_mem_free(void *ptr);
+
+void cortex_mem_get_stats(struct cortex_mem_stats *stats);
+
+#endif /* _CORTEX_MEM_H_ */
@@ -0,0 +1,317 @@
+/** \file cortex_metrics.c
+ * \brief cortex cross-run metrics
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cortex_metrics.h"
+
+/*
+ * The metrics file is a fixed size struct cortex_metrics mapped shared
+ * by every run. Runs only add to it with relaxed atomics, so that
+ * overlapping crashes never wait for each other. The first run creates
+ * the file: it is zero filled by ftruncate and the magic is set once.
+ */
+
+static struct timespec cortex_metrics_begin;
+
+static const char *cortex_metrics_signames[32] = {
+	[1] = "SIGHUP",[2] = "SIGINT",[3] = "SIGQUIT",[4] = "SIGILL",
+	[5] = "SIGTRAP",[6] = "SIGABRT",[7] = "SIGBUS",[8] = "SIGFPE",
+	[9] = "SIGKILL",[10] = "SIGUSR1",[11] = "SIGSEGV",[12] = "SIGUSR2",
+	[13] = "SIGPIPE",[14] = "SIGALRM",[15] = "SIGTERM",[16] = "SIGSTKFLT",
+	[17] = "SIGCHLD",[18] = "SIGCONT",[19] = "SIGSTOP",[20] = "SIGTSTP",
+	[21] = "SIGTTIN",[22] = "SIGTTOU",[23] = "SIGURG",[24] = "SIGXCPU",
+	[25] = "SIGXFSZ",[26] = "SIGVTALRM",[27] = "SIGPROF",[28] = "SIGWINCH",
+	[29] = "SIGIO",[30] = "SIGPWR",[31] = "SIGSYS",
+};
+
+#define cortex_metrics_add(ptr, val) \
+	__atomic_fetch_add((ptr), (val), __ATOMIC_RELAXED)
+
+/** \brief the run starts now: its latency is measured from here */
+void cortex_metrics_start(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &cortex_metrics_begin);
+}
+
+/* bucket of a value: values below CORTEX_METRICS_SUB have their own
+ * bucket, then each power of two is split in CORTEX_METRICS_SUB */
+static int cortex_metrics_bucket(uint64_t val)
+{
+	int exp;
+
+	if (val < CORTEX_METRICS_SUB)
+		return val;
+
+	exp = 63 - __builtin_clzll(val);
+	return (exp - 2) * CORTEX_METRICS_SUB +
+	    ((val >> (exp - 3)) & (CORTEX_METRICS_SUB - 1));
+}
+
+/* first value above a bucket */
+static uint64_t cortex_metrics_bucket_end(int bucket)
+{
+	int exp = bucket / CORTEX_METRICS_SUB + 2;
+	int sub = bucket % CORTEX_METRICS_SUB;
+
+	if (bucket < CORTEX_METRICS_SUB)
+		return bucket + 1;
+
+	return (uint64_t) (CORTEX_METRICS_SUB + sub + 1) << (exp - 3);
+}
+
+static void cortex_metrics_histo_add(struct cortex_metrics_histo *histo,
+				     uint64_t val)
+{
+	cortex_metrics_add(&histo->buckets[cortex_metrics_bucket(val)], 1);
+	cortex_metrics_add(&histo->sum, val);
+	cortex_metrics_add(&histo->count, 1);
+}
+
+static struct cortex_metrics *cortex_metrics_map(const char *path, int write)
+{
+	struct cortex_metrics *metrics;
+	struct stat st;
+	uint32_t magic = 0;
+	int fd;
+
+	fd = open(path, write ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0)
+		goto out_err;
+
+	/* a concurrent creator truncates to the same size: harmless */
+	if (write && st.st_size < (off_t) sizeof(*metrics) &&
+	    ftruncate(fd, sizeof(*metrics)) < 0)
+		goto out_err;
+	else if (!write && st.st_size < (off_t) sizeof(*metrics))
+		goto out_err;
+
+	metrics = mmap(NULL, sizeof(*metrics),
+		       write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+		       fd, 0);
+	if (metrics == MAP_FAILED)
+		goto out_err;
+	close(fd);
+
+	if (write) {
+		__atomic_compare_exchange_n(&metrics->magic, &magic,
+					    CORTEX_METRICS_MAGIC, 0,
+					    __ATOMIC_SEQ_CST,
+					    __ATOMIC_SEQ_CST);
+		if (metrics->version == 0)
+			metrics->version = CORTEX_METRICS_VERSION;
+	}
+
+	if (metrics->magic != CORTEX_METRICS_MAGIC ||
+	    metrics->version != CORTEX_METRICS_VERSION) {
+		fprintf(stderr, "%s: not a cortex metrics file\n", path);
+		munmap(metrics, sizeof(*metrics));
+		return NULL;
+	}
+
+	return metrics;
+
+out_err:
+	close(fd);
+	return NULL;
+}
+
+/** \brief add one run to the metrics file
+ * \param path the metrics file, created if needed
+ * \param run what to record
+ * \return 0 on success, -1 if the file cannot be used
+ */
+int cortex_metrics_record(const char *path, struct cortex_metrics_run *run)
+{
+	struct cortex_metrics *metrics;
+	struct timespec now;
+	uint64_t latency;
+
+	metrics = cortex_metrics_map(path, 1);
+	if (metrics == NULL)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	latency = (now.tv_sec - cortex_metrics_begin.tv_sec) * 1000000ULL +
+	    (now.tv_nsec - cortex_metrics_begin.tv_nsec) / 1000;
+
+	cortex_metrics_add(&metrics->runs, 1);
+	if (run->failed)
+		cortex_metrics_add(&metrics->failed, 1);
+	if (run->truncated)
+		cortex_metrics_add(&metrics->truncated, 1);
+	if (run->dedup_hit)
+		cortex_metrics_add(&metrics->dedup_hits, 1);
+	if (run->signum > 0 && run->signum < CORTEX_METRICS_SIGNALS)
+		cortex_metrics_add(&metrics->signals[run->signum], 1);
+	cortex_metrics_add(&metrics->bytes, run->bytes);
+	__atomic_store_n(&metrics->last_run, (uint64_t) time(NULL),
+			 __ATOMIC_RELAXED);
+
+	cortex_metrics_histo_add(&metrics->latency, latency);
+	if (!run->failed)
+		cortex_metrics_histo_add(&metrics->core_size, run->bytes);
+
+	munmap(metrics, sizeof(*metrics));
+
+	return 0;
+}
+
+static void cortex_metrics_print_counter(FILE * output, const char *name,
+					 const char *help, uint64_t val)
+{
+	fprintf(output, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+		name, help, name, name, (unsigned long long)val);
+}
+
+/* upper bound of the bucket holding the q quantile */
+static uint64_t cortex_metrics_quantile(struct cortex_metrics_histo *histo,
+					double q)
+{
+	uint64_t rank = histo->count * q;
+	uint64_t seen = 0;
+	int i;
+
+	for (i = 0; i < CORTEX_METRICS_BUCKETS; i++) {
+		seen += histo->buckets[i];
+		if (seen > rank)
+			return cortex_metrics_bucket_end(i);
+	}
+
+	return 0;
+}
+
+/* Prometheus histogram, with a bucket per power of two between 2^first
+ * and 2^last: they fall on our bucket boundaries, no count is split */
+static void cortex_metrics_print_histo(FILE * output, const char *name,
+				       const char *help,
+				       struct cortex_metrics_histo *histo,
+				       int first, int last, double scale)
+{
+	static const double quantiles[] = { 0.5, 0.9, 0.99 };
+	uint64_t cumul = 0;
+	int bucket = 0;
+	unsigned int q;
+	int exp;
+
+	fprintf(output, "# HELP %s %s.\n# TYPE %s histogram\n", name, help,
+		name);
+
+	for (exp = first; exp <= last; exp++) {
+		while (bucket < CORTEX_METRICS_BUCKETS &&
+		       cortex_metrics_bucket_end(bucket) <= (1ULL << exp))
+			cumul += histo->buckets[bucket++];
+		fprintf(output, "%s_bucket{le=\"%.10g\"} %llu\n", name,
+			(double)(1ULL << exp) * scale,
+			(unsigned long long)cumul);
+	}
+
+	fprintf(output, "%s_bucket{le=\"+Inf\"} %llu\n", name,
+		(unsigned long long)histo->count);
+	fprintf(output, "%s_sum %.10g\n", name, histo->sum * scale);
+	fprintf(output, "%s_count %llu\n", name,
+		(unsigned long long)histo->count);
+
+	/* the fine buckets give better quantiles than the exported ones */
+	fprintf(output, "# HELP %s_quantile %s, quantiles within 12.5%%.\n"
+		"# TYPE %s_quantile gauge\n", name, help, name);
+	for (q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+		fprintf(output, "%s_quantile{quantile=\"%g\"} %.10g\n", name,
+			quantiles[q],
+			cortex_metrics_quantile(histo, quantiles[q]) * scale);
+}
+
+/** \brief render a metrics file in the Prometheus text format
+ * \param path the metrics file
+ * \param output where to write, for instance a node exporter textfile
+ * \return 0 on success, -1 if the file cannot be read
+ */
+int cortex_metrics_print(const char *path, FILE * output)
+{
+	struct cortex_metrics *metrics;
+	struct cortex_metrics snap;
+	int i;
+
+	metrics = cortex_metrics_map(path, 0);
+	if (metrics == NULL) {
+		fprintf(stderr, "cannot read metrics file %s\n", path);
+		return -1;
+	}
+
+	/* runs may still be adding: render a copy */
+	memcpy(&snap, metrics, sizeof(snap));
+	munmap(metrics, sizeof(*metrics));
+
+	cortex_metrics_print_counter(output, "cortex_runs_total",
+				     "Core dumps handled by cortex.",
+				     snap.runs);
+	cortex_metrics_print_counter(output, "cortex_runs_failed_total",
+				     "Core dumps that produced no report.",
+				     snap.failed);
+	cortex_metrics_print_counter(output, "cortex_reports_truncated_total",
+				     "Reports cut by the deadline.",
+				     snap.truncated);
+	cortex_metrics_print_counter(output, "cortex_core_bytes_total",
+				     "Core dump bytes consumed.", snap.bytes);
+	cortex_metrics_print_counter(output, "cortex_dedup_hits_total",
+				     "Crashes matching an already seen one.",
+				     snap.dedup_hits);
+
+	fprintf(output, "# HELP cortex_crashes_total Crashes by signal.\n"
+		"# TYPE cortex_crashes_total counter\n");
+	for (i = 1; i < CORTEX_METRICS_SIGNALS; i++) {
+		if (!snap.signals[i])
+			continue;
+		if (i < 32 && cortex_metrics_signames[i])
+			fprintf(output, "cortex_crashes_total{signal=\"%s\"} "
+				"%llu\n", cortex_metrics_signames[i],
+				(unsigned long long)snap.signals[i]);
+		else
+			fprintf(output, "cortex_crashes_total{signal=\"%d\"} "
+				"%llu\n", i,
+				(unsigned long long)snap.signals[i]);
+	}
+
+	fprintf(output, "# HELP cortex_last_run_timestamp_seconds "
+		"Time of the last run.\n"
+		"# TYPE cortex_last_run_timestamp_seconds gauge\n"
+		"cortex_last_run_timestamp_seconds %llu\n",
+		(unsigned long long)snap.last_run);
+
+	/* 1ms to 64s, in us */
+	cortex_metrics_print_histo(output, "cortex_handler_latency_seconds",
+				   "Time to handle a core dump",
+				   &snap.latency, 10, 26, 1e-6);
+	/* 64KB to 64GB */
+	cortex_metrics_print_histo(output, "cortex_core_size_bytes",
+				   "Core dump bytes consumed per run",
+				   &snap.core_size, 16, 36, 1);
+
+	return ferror(output) ? -1 : 0;
+}
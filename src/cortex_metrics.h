@@ -0,0 +1,84 @@
+#ifndef _CORTEX_METRICS_H_
+#define _CORTEX_METRICS_H_
+
+/** \file cortex_metrics.h
+ * \brief cortex cross-run metrics
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+/** \brief default metrics file, shared by all the runs */
+#define CORTEX_METRICS_FILE	"/var/lib/cortex/metrics"
+
+#define CORTEX_METRICS_MAGIC	0x58544d43	/* "CMTX" */
+#define CORTEX_METRICS_VERSION	1
+
+/** \brief sub buckets per power of two: values are kept within 12.5% */
+#define CORTEX_METRICS_SUB	8
+#define CORTEX_METRICS_BUCKETS	(64 * CORTEX_METRICS_SUB)
+
+#define CORTEX_METRICS_SIGNALS	65
+
+/** \struct cortex_metrics_histo
+ ** \brief log-linear histogram: the powers of two are split in
+ ** CORTEX_METRICS_SUB linear buckets
+ */
+struct cortex_metrics_histo {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t buckets[CORTEX_METRICS_BUCKETS];
+};
+
+/** \struct cortex_metrics
+ ** \brief layout of the metrics file
+ *
+ * Every run maps the file and adds to it with atomic operations: runs
+ * can overlap, nothing is locked and no daemon owns the file.
+ */
+struct cortex_metrics {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t runs;		/*!< cortex runs */
+	uint64_t failed;	/*!< runs that produced no report */
+	uint64_t truncated;	/*!< reports cut by the deadline */
+	uint64_t bytes;		/*!< core bytes consumed */
+	uint64_t dedup_hits;	/*!< crashes already seen */
+	uint64_t last_run;	/*!< time of the last run, in s since epoch */
+	uint64_t signals[CORTEX_METRICS_SIGNALS];	/*!< crashes by signal */
+	struct cortex_metrics_histo latency;	/*!< run time, in us */
+	struct cortex_metrics_histo core_size;	/*!< core bytes per run */
+};
+
+/** \struct cortex_metrics_run
+ ** \brief what one run adds to the metrics
+ */
+struct cortex_metrics_run {
+	int signum;		/*!< signal of the crash, 0 if unknown */
+	int failed;		/*!< no report was written */
+	int truncated;		/*!< the deadline cut the report */
+	int dedup_hit;		/*!< the crash was already seen */
+	uint64_t bytes;		/*!< core bytes consumed */
+};
+
+void cortex_metrics_start(void);
+int cortex_metrics_record(const char *path, struct cortex_metrics_run *run);
+int cortex_metrics_print(const char *path, FILE * output);
+
+#endif /* _CORTEX_METRICS_H_ */
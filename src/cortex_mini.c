@@ -0,0 +1,463 @@
+/** \file cortex_mini.c
+ * \brief cortex sparse minicore format
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cortex.h"
+#include "cortex_elf.h"
+#include "cortex_mem.h"
+#include "cortex_mini.h"
+#include "cortex_vec.h"
+#include "arch/cortex_arch.h"
+
+static int cortex_mini_wanted(int type, long fmt)
+{
+	switch (type) {
+	case CORTEX_REGION_STACK:
+		return fmt & (CORTEX_OUTPUT_FMT_CAL | CORTEX_OUTPUT_FMT_STA);
+	case CORTEX_REGION_CODE:
+		return fmt & CORTEX_OUTPUT_FMT_COD;
+	case CORTEX_REGION_DATA:
+		return fmt & CORTEX_OUTPUT_FMT_REG;
+	case CORTEX_REGION_MODULE:
+		return fmt & CORTEX_OUTPUT_FMT_GEN;
+	default:
+		return 1;
+	}
+}
+
+/* write the non zero parts of a region as a list of chunks */
+static void cortex_mini_write_region(FILE * output, unsigned char *buf,
+				     size_t size,
+				     struct cortex_mini_region *entry,
+				     uint64_t * cursor)
+{
+	size_t pos = 0;
+
+	entry->offset = *cursor;
+	entry->nr_chunks = 0;
+
+	while (pos < size) {
+		struct cortex_mini_chunk chunk;
+		size_t start = pos + cortex_vec_zero_span(buf + pos, size - pos);
+		size_t end = start;
+
+		if (start >= size)
+			break;
+
+		/* extend the chunk over short zero runs */
+		while (end < size) {
+			size_t zero = 0;
+
+			end += cortex_vec_data_span(buf + end, size - end);
+			zero = cortex_vec_zero_span(buf + end, size - end);
+			if (zero >= CORTEX_MINI_ZERO_RUN || end + zero >= size)
+				break;
+			end += zero;
+		}
+
+		chunk.offset = start;
+		chunk.size = end - start;
+		fwrite(&chunk, sizeof(chunk), 1, output);
+		fwrite(buf + start, 1, chunk.size, output);
+
+		*cursor += sizeof(chunk) + chunk.size;
+		entry->nr_chunks++;
+		pos = end;
+	}
+}
+
+void cortex_mini_write(struct cortex_proc_info *info, FILE * output, long fmt)
+{
+	int i = 0;
+	int nr = 0;
+	uint64_t cursor = 0;
+	struct cortex_mini_header hdr;
+	struct cortex_mini_footer footer;
+	struct cortex_mini_region *index = NULL;
+
+	index = cortex_mem_calloc(info->nr_regions + 1 +
+				  info->elf->ehdr->e_phnum, sizeof(*index));
+	if (!index) {
+		fprintf(stderr, "%s: cannot allocate index\n", __FILE__);
+		return;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CORTEX_MINI_MAGIC, CORTEX_MINI_MAGIC_LEN);
+	hdr.version = CORTEX_MINI_VERSION;
+	hdr.word_size = info->word_size;
+	memcpy(&hdr.ehdr, info->elf->ehdr, sizeof(ElfN_Ehdr));
+
+	fwrite(&hdr, sizeof(hdr), 1, output);
+	cursor = sizeof(hdr);
+
+	/* the note segment is needed by any report */
+	index[nr].type = CORTEX_REGION_NOTE;
+	index[nr].size = info->note->d_size;
+	cortex_mini_write_region(output, info->note->d_buf,
+				 info->note->d_size, &index[nr], &cursor);
+	nr++;
+
+	for (i = 0; i < info->nr_regions; i++) {
+		struct cortex_elf_region *region = &info->regions[i];
+
+		if (!cortex_mini_wanted(region->type, fmt))
+			continue;
+
+		index[nr].vaddr = region->vaddr;
+		index[nr].size = region->size;
+		index[nr].type = region->type;
+		index[nr].thread = region->thread;
+		index[nr].flags = region->flags;
+		cortex_mini_write_region(output, region->d_buf, region->size,
+					 &index[nr], &cursor);
+		nr++;
+	}
+
+	/* the executable segments, for the stack scanner */
+	for (i = 0; i < info->elf->ehdr->e_phnum; i++) {
+		ElfN_Phdr *phdr = &info->elf->phdr[i];
+
+		if (phdr->p_type != PT_LOAD || !(phdr->p_flags & PF_X) ||
+		    phdr->p_memsz == 0)
+			continue;
+
+		index[nr].vaddr = phdr->p_vaddr;
+		index[nr].size = phdr->p_memsz;
+		index[nr].offset = cursor;
+		index[nr].type = CORTEX_MINI_REGION_EXEC;
+		index[nr].flags = phdr->p_flags;
+		index[nr].file = phdr->p_filesz == 0;
+		nr++;
+	}
+
+	/* then the index, located by the footer */
+	fwrite(index, sizeof(*index), nr, output);
+
+	memset(&footer, 0, sizeof(footer));
+	footer.index_offset = cursor;
+	footer.nr_regions = nr;
+	footer.version = CORTEX_MINI_VERSION;
+	memcpy(footer.magic, CORTEX_MINI_MAGIC, CORTEX_MINI_MAGIC_LEN);
+	fwrite(&footer, sizeof(footer), 1, output);
+
+	cortex_mem_free(index);
+}
+
+/** \brief find the region that contains an address
+ *
+ * The index is sorted by address, the note region first.
+ * \return the region or NULL
+ */
+struct cortex_mini_region *cortex_mini_find(struct cortex_mini_region *index,
+					    int nr, uint64_t vaddr)
+{
+	int lo = 1;
+	int hi = nr - 1;
+
+	while (lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (vaddr < index[mid].vaddr) {
+			hi = mid - 1;
+		} else if (vaddr >= index[mid].vaddr + index[mid].size) {
+			lo = mid + 1;
+		} else {
+			return index + mid;
+		}
+	}
+
+	return NULL;
+}
+
+/* The minicore is small and its index is at the end:
+   keep it all in memory */
+static unsigned char *cortex_mini_slurp(struct cortex_elf *core, size_t *size)
+{
+	size_t len = core->offset;
+	size_t alloc = 4096;
+	unsigned char *buf = cortex_mem_alloc(alloc);
+
+	if (!buf)
+		return NULL;
+
+	/* e_ident was read while guessing the format */
+	memcpy(buf, core->e_ident, len);
+
+	do {
+		long count = 0;
+
+		if (len == alloc) {
+			unsigned char *tmp = NULL;
+
+			if (alloc >= CORTEX_MINI_SIZE_MAX) {
+				fprintf(stderr, "%s: file too big\n", __FILE__);
+				goto out_err;
+			}
+			alloc *= 2;
+			tmp = cortex_mem_realloc(buf, alloc);
+			if (!tmp)
+				goto out_err;
+			buf = tmp;
+		}
+
+		count = read(core->fd, buf + len, alloc - len);
+		if (count < 0)
+			goto out_err;
+		if (count == 0)
+			break;
+		len += count;
+		core->offset += count;
+	} while (1);
+
+	*size = len;
+	return buf;
+out_err:
+	cortex_mem_free(buf);
+	return NULL;
+}
+
+static unsigned char *cortex_mini_unpack(unsigned char *buf, size_t size,
+					 struct cortex_mini_region *entry)
+{
+	uint32_t i = 0;
+	uint64_t pos = entry->offset;
+	unsigned char *data = cortex_mem_calloc(1, entry->size ? entry->size : 1);
+
+	if (!data)
+		return NULL;
+
+	for (i = 0; i < entry->nr_chunks; i++) {
+		struct cortex_mini_chunk chunk;
+
+		if (pos + sizeof(chunk) > size)
+			goto out_err;
+		memcpy(&chunk, buf + pos, sizeof(chunk));
+		pos += sizeof(chunk);
+
+		if (pos + chunk.size > size ||
+		    (uint64_t) chunk.offset + chunk.size > entry->size)
+			goto out_err;
+		memcpy(data + chunk.offset, buf + pos, chunk.size);
+		pos += chunk.size;
+	}
+
+	return data;
+out_err:
+	fprintf(stderr, "%s: corrupted region\n", __FILE__);
+	cortex_mem_free(data);
+	return NULL;
+}
+
+static struct cortex_elf_data *cortex_mini_copy_data(struct cortex_proc_info
+						     *info, ElfN_Phdr * segm)
+{
+	struct cortex_elf_data *data = NULL;
+	int i = 0;
+
+	if (!segm)
+		return NULL;
+
+	/* phdr i + 1 describes region i */
+	i = segm - info->elf->phdr - 1;
+	if (i < 0 || i >= info->nr_regions)
+		return NULL;
+
+	data = cortex_mem_calloc(1, sizeof(*data));
+	if (!data)
+		return NULL;
+	data->d_buf = cortex_mem_alloc(info->regions[i].size);
+	if (!data->d_buf) {
+		cortex_mem_free(data);
+		return NULL;
+	}
+	memcpy(data->d_buf, info->regions[i].d_buf, info->regions[i].size);
+	data->d_size = info->regions[i].size;
+	data->d_align = 1;
+
+	return data;
+}
+
+/** \brief load a minicore
+ *
+ * Rebuild the ELF header, one program header per region, the note
+ * and the memory windows, so that all outputs work as with a core.
+ */
+struct cortex_proc_info *cortex_mini_parse(struct cortex_elf *core)
+{
+	int i = 0;
+	size_t size = 0;
+	unsigned char *buf = NULL;
+	struct cortex_mini_header hdr;
+	struct cortex_mini_footer footer;
+	struct cortex_mini_region *index = NULL;
+	struct cortex_mini_region *found = NULL;
+	struct cortex_mini_region *exec = NULL;
+	struct cortex_elf_data *note = NULL;
+	int nr_data = 0;
+	struct cortex_proc_info *info = NULL;
+
+	buf = cortex_mini_slurp(core, &size);
+	if (!buf) {
+		fprintf(stderr, "%s: cannot read file\n", __FILE__);
+		return NULL;
+	}
+
+	if (size < sizeof(hdr) + sizeof(footer))
+		goto out_trunc;
+
+	memcpy(&hdr, buf, sizeof(hdr));
+	memcpy(&footer, buf + size - sizeof(footer), sizeof(footer));
+
+	if (hdr.version < 1 || hdr.version > CORTEX_MINI_VERSION ||
+	    memcmp(footer.magic, CORTEX_MINI_MAGIC, CORTEX_MINI_MAGIC_LEN)) {
+		fprintf(stderr, "%s: unsupported minicore\n", __FILE__);
+		goto out_err;
+	}
+
+	/* the note is kept in the byte order of the core */
+	if (cortex_elf_select(core, hdr.ehdr.e_ident, hdr.ehdr.e_machine) < 0)
+		goto out_err;
+
+	if (footer.nr_regions == 0 ||
+	    footer.index_offset > size - sizeof(footer) ||
+	    footer.nr_regions > (size - sizeof(footer) -
+				 footer.index_offset) / sizeof(*index))
+		goto out_trunc;
+
+	index = cortex_mem_calloc(footer.nr_regions, sizeof(*index));
+	if (!index)
+		goto out_err;
+	memcpy(index, buf + footer.index_offset,
+	       footer.nr_regions * sizeof(*index));
+
+	if (index[0].type != CORTEX_REGION_NOTE)
+		goto out_trunc;
+
+	/* the regions with data come before the executable segments */
+	while (nr_data < (int)footer.nr_regions &&
+	       index[nr_data].type != CORTEX_MINI_REGION_EXEC)
+		nr_data++;
+	for (i = nr_data; i < (int)footer.nr_regions; i++)
+		if (index[i].type != CORTEX_MINI_REGION_EXEC ||
+		    index[i].nr_chunks)
+			goto out_trunc;
+
+	/* program headers for the note and each region */
+	core->ehdr = cortex_mem_alloc(sizeof(ElfN_Ehdr));
+	if (!core->ehdr)
+		goto out_err;
+	memcpy(core->ehdr, &hdr.ehdr, sizeof(ElfN_Ehdr));
+	core->ehdr->e_phnum = footer.nr_regions;
+	core->phdr = cortex_mem_calloc(footer.nr_regions, sizeof(ElfN_Phdr));
+	if (!core->phdr)
+		goto out_err;
+
+	for (i = 0; i < (int)footer.nr_regions; i++) {
+		ElfN_Phdr *phdr = &core->phdr[i];
+
+		phdr->p_type = i ? PT_LOAD : PT_NOTE;
+		phdr->p_vaddr = index[i].vaddr;
+		phdr->p_filesz = index[i].size;
+		phdr->p_memsz = i ? index[i].size : 0;
+		phdr->p_flags = index[i].flags;
+		phdr->p_align = i ? 1 : 4;
+
+		/* as in the core: no data when the code is in a file */
+		if (i >= nr_data && index[i].file)
+			phdr->p_filesz = 0;
+	}
+
+	note = cortex_mem_calloc(1, sizeof(*note));
+	if (!note)
+		goto out_err;
+	note->d_buf = cortex_mini_unpack(buf, size, &index[0]);
+	note->d_size = index[0].size;
+	note->d_align = 4;
+	if (!note->d_buf)
+		goto out_err;
+
+	info = cortex_elf_parse_process(core, core->phdr, note);
+	if (!info)
+		goto out_err;
+	note = NULL;
+
+	info->regions = cortex_mem_calloc(footer.nr_regions,
+			       sizeof(struct cortex_elf_region));
+	if (!info->regions)
+		goto out_info;
+
+	for (i = 1; i < nr_data; i++) {
+		struct cortex_elf_region *region =
+		    &info->regions[info->nr_regions];
+
+		region->vaddr = index[i].vaddr;
+		region->size = index[i].size;
+		region->type = index[i].type;
+		region->thread = index[i].thread;
+		region->flags = index[i].flags;
+		region->d_buf = cortex_mini_unpack(buf, size, &index[i]);
+		if (!region->d_buf)
+			goto out_info;
+		info->nr_regions++;
+	}
+
+	/* the index gives the code and stack windows directly */
+	found = cortex_mini_find(index, nr_data, info->pc);
+	info->pc_segm = found ? core->phdr + (found - index) : NULL;
+	found = cortex_mini_find(index, nr_data, info->sp);
+	info->sp_segm = found ? core->phdr + (found - index) : NULL;
+
+	info->code = cortex_mini_copy_data(info, info->pc_segm);
+	info->stack = cortex_mini_copy_data(info, info->sp_segm);
+
+	/* code read from a file was a window of its segment in the core */
+	for (i = nr_data; i < (int)footer.nr_regions; i++)
+		if (info->pc >= index[i].vaddr &&
+		    info->pc - index[i].vaddr < index[i].size)
+			exec = &index[i];
+	if (info->code && exec && exec->file) {
+		info->pc_window = *info->pc_segm;
+		info->pc_window.p_flags = exec->flags;
+		info->pc_segm = &info->pc_window;
+	}
+
+	cortex_mem_free(index);
+	cortex_mem_free(buf);
+	return info;
+
+out_trunc:
+	fprintf(stderr, "%s: truncated file\n", __FILE__);
+	goto out_err;
+out_info:
+	cortex_elf_cleanup_process_info(info);
+	info = NULL;
+out_err:
+	if (note)
+		cortex_mem_free(note->d_buf);
+	cortex_mem_free(note);
+	cortex_mem_free(index);
+	cortex_mem_free(buf);
+	return NULL;
+}
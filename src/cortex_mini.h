@@ -0,0 +1,95 @@
+
+#ifndef _CORTEX_MINI_H_
+#define _CORTEX_MINI_H_
+
+/** \file cortex_mini.h
+ * \brief cortex sparse minicore format
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cortex.h"
+
+/** \brief layout of a minicore file
+ *
+ * - a cortex_mini_header, that embeds the original ELF header
+ * - the content of each region: a list of chunks, each made of a
+ *   cortex_mini_chunk followed by its data. Zero runs are not stored.
+ * - the index: one cortex_mini_region per region, sorted by address.
+ *   The note region always comes first. Since version 2, the index ends
+ *   with the executable segments of the core, sorted by address and
+ *   without any data: the stack scanner looks for return addresses in
+ *   them, their code is read from the mapped files.
+ * - a cortex_mini_footer, that locates the index
+ *
+ * Everything is written sequentially so that the file can go to a pipe.
+ */
+#define CORTEX_MINI_MAGIC	"CORTEXMC"
+#define CORTEX_MINI_MAGIC_LEN	8
+#define CORTEX_MINI_VERSION	2
+
+/** \brief type of the index entries of the executable segments */
+#define CORTEX_MINI_REGION_EXEC	0x100
+
+/** \brief shortest zero run worth dropping from a region */
+#define CORTEX_MINI_ZERO_RUN	64
+
+/** \brief minicores are small: refuse to load anything bigger */
+#define CORTEX_MINI_SIZE_MAX	(64 * 1024 * 1024)
+
+struct cortex_mini_header {
+	char magic[CORTEX_MINI_MAGIC_LEN];
+	uint32_t version;
+	uint32_t word_size;
+	ElfN_Ehdr ehdr;		/*!< widened, e_ident as in the core */
+};
+
+struct cortex_mini_chunk {
+	uint32_t offset;	/*!< offset of the data in the region */
+	uint32_t size;		/*!< size of the data that follows */
+};
+
+struct cortex_mini_region {
+	uint64_t vaddr;		/*!< address of the region */
+	uint64_t size;		/*!< size in memory, zero runs included */
+	uint64_t offset;	/*!< file offset of the first chunk */
+	uint32_t nr_chunks;	/*!< number of chunks stored */
+	uint16_t type;		/*!< note, stack, code or data */
+	uint16_t thread;	/*!< owner thread index */
+	uint32_t flags;		/*!< p_flags of the original segment */
+	uint32_t file;		/*!< executable segment left out of the core:
+				   its code is in a mapped file */
+};
+
+struct cortex_mini_footer {
+	uint64_t index_offset;
+	uint32_t nr_regions;
+	uint32_t version;
+	char magic[CORTEX_MINI_MAGIC_LEN];
+};
+
+void cortex_mini_write(struct cortex_proc_info *info, FILE * output, long fmt);
+
+struct cortex_mini_region *cortex_mini_find(struct cortex_mini_region *index,
+					    int nr, uint64_t vaddr);
+
+struct cortex_proc_info *cortex_mini_parse(struct cortex_elf *core);
+
+#endif /* _CORTEX_MINI_H_ */
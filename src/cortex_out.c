@@ -19,16 +19,30 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
 
 #include "cortex.h"
 #include "cortex_elf.h"
+#include "cortex_deadline.h"
+#include "cortex_hex.h"
+#include "cortex_stream.h"
+#include "cortex_stats.h"
+#include "cortex_probe.h"
+#include "cortex_mem.h"
 #include "cortex_dis.h"
+#include "cortex_mini.h"
+#include "cortex_mdmp.h"
+#include "cortex_out.h"
+#include "cortex_sys.h"
+#include "cortex_zip.h"
 #include "arch/cortex_arch.h"
 
-static long cortex_output_fmt = 0;
-
-static char *auxv_names[] = {
+static const char *const auxv_names[] = {
 	"AT_NULL", "AT_IGNORE", "AT_EXECFD", "AT_PHDR", "AT_PHENT",
 	"AT_PHNUM", "AT_PAGESZ", "AT_BASE", "AT_FLAGS", "AT_ENTRY",
 	"AT_NOTELF", "AT_UID", "AT_EUID", "AT_GID", "AT_EGID",
@@ -40,17 +54,116 @@ static char *auxv_names[] = {
 	"AT_L1D_CACHESHAPE", "AT_L2_CACHESHAPE", "AT_L3_CACHESHAPE",
 };
 
+#define CORTEX_OUTPUT_NAMES(names)	(sizeof(names) / sizeof(names[0]))
+
+/* si_code of the faults, from 1 */
+static const char *const sigill_codes[] = {
+	"", "ILL_ILLOPC", "ILL_ILLOPN", "ILL_ILLADR", "ILL_ILLTRP",
+	"ILL_PRVOPC", "ILL_PRVREG", "ILL_COPROC", "ILL_BADSTK",
+};
+
+static const char *const sigtrap_codes[] = {
+	"", "TRAP_BRKPT", "TRAP_TRACE", "TRAP_BRANCH", "TRAP_HWBKPT",
+};
+
+static const char *const sigfpe_codes[] = {
+	"", "FPE_INTDIV", "FPE_INTOVF", "FPE_FLTDIV", "FPE_FLTOVF",
+	"FPE_FLTUND", "FPE_FLTRES", "FPE_FLTINV", "FPE_FLTSUB",
+};
+
+static const char *const sigsegv_codes[] = {
+	"", "SEGV_MAPERR", "SEGV_ACCERR", "SEGV_BNDERR", "SEGV_PKUERR",
+};
+
+static const char *const sigbus_codes[] = {
+	"", "BUS_ADRALN", "BUS_ADRERR", "BUS_OBJERR", "BUS_MCEERR_AR",
+	"BUS_MCEERR_AO",
+};
+
+/* name of si_code, "" if unknown */
+static const char *cortex_output_si_code(const struct cortex_siginfo *si)
+{
+	const char *const *names = NULL;
+	size_t nr = 0;
+
+	switch (si->code) {
+	case 0:
+		return "SI_USER";
+	case 0x80:
+		return "SI_KERNEL";
+	case -1:
+		return "SI_QUEUE";
+	case -6:
+		return "SI_TKILL";
+	default:
+		break;
+	}
+
+	switch (si->fault) {
+	case SIGILL:
+		names = sigill_codes;
+		nr = CORTEX_OUTPUT_NAMES(sigill_codes);
+		break;
+	case SIGTRAP:
+		names = sigtrap_codes;
+		nr = CORTEX_OUTPUT_NAMES(sigtrap_codes);
+		break;
+	case SIGFPE:
+		names = sigfpe_codes;
+		nr = CORTEX_OUTPUT_NAMES(sigfpe_codes);
+		break;
+	case SIGSEGV:
+		names = sigsegv_codes;
+		nr = CORTEX_OUTPUT_NAMES(sigsegv_codes);
+		break;
+	case SIGBUS:
+		names = sigbus_codes;
+		nr = CORTEX_OUTPUT_NAMES(sigbus_codes);
+		break;
+	default:
+		break;
+	}
+
+	if (si->code > 0 && (size_t)si->code < nr)
+		return names[si->code];
+
+	return "";
+}
+
+/* name of an auxv entry, "" if unknown */
+static const char *cortex_output_auxv_name(ElfN_Addr type)
+{
+	if (type >= CORTEX_OUTPUT_NAMES(auxv_names))
+		return "";
+
+	return auxv_names[type];
+}
+
 static void cortex_output_write_generic(struct cortex_proc_info *info,
-					FILE * output)
+					FILE * output, int ctx)
 {
+	struct cortex_mem_stats mem;
+
 	fprintf(output, "BUG: process %s<%d> ", info->info->pr_fname,
 		info->info->pr_pid);
 
-	if (info->threads[0]->pr_cursig) {
+	if (info->threads[0].pr_cursig) {
 		fprintf(output, "received signum %d in thread %d\n",
-			info->threads[0]->pr_cursig, info->threads[0]->pr_pid);
+			info->threads[0].pr_cursig, info->threads[0].pr_pid);
 	} else {
-		fprintf(output, "crashed\n");
+		/* no signal: a snapshot of a running process */
+		fprintf(output, "snapshot\n");
+	}
+
+	if (info->siginfo) {
+		fprintf(output, "  si_code: %s (%d)",
+			cortex_output_si_code(info->siginfo),
+			info->siginfo->code);
+		if (info->siginfo->fault && info->siginfo->code > 0)
+			fprintf(output, ", fault address: 0x%0*lx",
+				info->word_size * 2,
+				(unsigned long)info->siginfo->addr);
+		fprintf(output, "\n");
 	}
 
 	fprintf(output, "  cmdline was %s\n", info->info->pr_psargs);
@@ -58,24 +171,37 @@ static void cortex_output_write_generic(struct cortex_proc_info *info,
 	fprintf(output, "  uid/gid: %d/%d\n", info->info->pr_uid,
 		info->info->pr_gid);
 
-	fprintf(output, "  utime/stime: %u.%u/%u.%u\n",
-		info->threads[0]->pr_utime.tv_sec,
-		info->threads[0]->pr_utime.tv_usec,
-		info->threads[0]->pr_stime.tv_sec,
-		info->threads[0]->pr_stime.tv_usec);
+	fprintf(output, "  utime/stime: %ld.%ld/%ld.%ld\n",
+		info->threads[0].pr_utime.tv_sec,
+		info->threads[0].pr_utime.tv_usec,
+		info->threads[0].pr_stime.tv_sec,
+		info->threads[0].pr_stime.tv_usec);
 
-	fprintf(output, "  cutime/cstime: %u.%u/%u.%u\n",
-		info->threads[0]->pr_cutime.tv_sec,
-		info->threads[0]->pr_cutime.tv_usec,
-		info->threads[0]->pr_cstime.tv_sec,
-		info->threads[0]->pr_cstime.tv_usec);
+	fprintf(output, "  cutime/cstime: %ld.%ld/%ld.%ld\n",
+		info->threads[0].pr_cutime.tv_sec,
+		info->threads[0].pr_cutime.tv_usec,
+		info->threads[0].pr_cstime.tv_sec,
+		info->threads[0].pr_cstime.tv_usec);
 
 	fprintf(output, "  state: %c\n", "RSDTZW"[info->info->pr_state]);
 	fprintf(output, "  nr threads: %d\n", info->nr_threads);
+
+	cortex_mem_get_stats(&mem);
+	fprintf(output, "  cortex memory: peak %lu KB of %lu KB%s",
+		(unsigned long)(mem.peak >> 10),
+		(unsigned long)(mem.budget >> 10),
+		mem.locked ? " locked" : "");
+	if (mem.failed)
+		fprintf(output, ", %ld allocations refused", mem.failed);
+	if (info->pc_segm == &info->pc_window)
+		fprintf(output, ", code window only");
+	if (info->sp_segm == &info->sp_window)
+		fprintf(output, ", stack window only");
+	fprintf(output, "\n");
 }
 
 static void cortex_output_write_registers(struct cortex_proc_info *info,
-					  FILE * output)
+					  FILE * output, int ctx)
 {
 	int i = 0;
 
@@ -84,11 +210,11 @@ static void cortex_output_write_registers(struct cortex_proc_info *info,
 			fprintf(output, "  ");
 
 		if (info->cpu_regs[i].size == 4) {
-			fprintf(output, "%s:0x%08X  ", info->cpu_regs[i].name,
-				info->cpu_regs[i].value);
+			fprintf(output, "%s:0x%08llX  ", info->cpu_regs[i].name,
+				(unsigned long long)info->cpu_regs[i].value);
 		} else if (info->cpu_regs[i].size == 8) {
-			fprintf(output, "%s:0x%016X  ", info->cpu_regs[i].name,
-				info->cpu_regs[i].value);
+			fprintf(output, "%s:0x%016llX  ", info->cpu_regs[i].name,
+				(unsigned long long)info->cpu_regs[i].value);
 		}
 
 		if ((i % 4) == 3)
@@ -99,12 +225,79 @@ static void cortex_output_write_registers(struct cortex_proc_info *info,
 		fprintf(output, "\n");
 }
 
+/* the scalar registers four by line, the vectors one by line */
+static void cortex_output_write_vregs(FILE * output,
+				      const struct cortex_vreg *vregs, int nr)
+{
+	int col = 0;
+	int i = 0;
+	size_t j = 0;
+
+	for (i = 0; i < nr; i++) {
+		int wide = vregs[i].size > sizeof(long);
+
+		if (wide && col) {
+			fprintf(output, "\n");
+			col = 0;
+		}
+		if (col == 0)
+			fprintf(output, "  ");
+
+		fprintf(output, wide ? "%s: 0x" : "%s:0x", vregs[i].name);
+		for (j = vregs[i].size; j > 0; j--)
+			fprintf(output, "%02X", vregs[i].value[j - 1]);
+
+		if (wide || ++col == 4) {
+			fprintf(output, "\n");
+			col = 0;
+		} else {
+			fprintf(output, "  ");
+		}
+	}
+
+	if (col)
+		fprintf(output, "\n");
+}
+
+static void cortex_output_write_fp_registers(struct cortex_proc_info *info,
+					     FILE * output, int ctx)
+{
+	struct cortex_vreg vregs[CORTEX_VREGS_MAX];
+	int nr = 0;
+
+	if (info->arch->fill_fp_regs)
+		nr = info->arch->fill_fp_regs(info, 0, vregs);
+
+	if (nr == 0) {
+		fprintf(output, "FP registers: unavailable\n");
+		return;
+	}
+
+	fprintf(output, "FP registers:\n");
+	cortex_output_write_vregs(output, vregs, nr);
+}
+
+static void cortex_output_write_vec_registers(struct cortex_proc_info *info,
+					      FILE * output, int ctx)
+{
+	struct cortex_vreg vregs[CORTEX_VREGS_MAX];
+	int nr = 0;
+
+	if (info->arch->fill_vec_regs)
+		nr = info->arch->fill_vec_regs(info, 0, vregs);
+
+	if (nr == 0) {
+		fprintf(output, "Vector registers: unavailable\n");
+		return;
+	}
+
+	fprintf(output, "Vector registers:\n");
+	cortex_output_write_vregs(output, vregs, nr);
+}
+
 static void cortex_output_write_stack_frame(struct cortex_proc_info *info,
-					    FILE * output)
+					    FILE * output, int ctx)
 {
-	ElfN_Addr i;
-	void *priv_data = NULL;
-	unsigned char *stackframe = NULL;
 	struct cortex_stack_frame frame = CORTEX_EMPTY_FRAME;
 
 	if (info->stack) {
@@ -114,35 +307,59 @@ static void cortex_output_write_stack_frame(struct cortex_proc_info *info,
 		return;
 	}
 
-	stackframe = info->stack->d_buf;
-
-	if (cortex_arch_ops.unwind_init)
-		priv_data = cortex_arch_ops.unwind_init(info, &frame);
+	if (info->unwind && info->unwind[0].nr_frames)
+		frame = info->unwind[0].frames[0];
 
-	if (frame.bp == 0)
+	/* from the stack pointer up to the saved frame pointer */
+	if (frame.bp == 0 || frame.bp < frame.sp)
 		fprintf(output, "  <empty>\n");
-	for (i = frame.bp; i >= frame.sp; i -= info->word_size) {
-		ElfN_Addr *stack_val =
-		    (ElfN_Addr *) (stackframe + i - info->sp_segm->p_vaddr);
-		if (info->word_size == 4) {
-			fprintf(output, "  0x%08x: %08x\n", i, *stack_val);
-		} else if (info->word_size == 8) {
-			fprintf(output, "  0x%016x: %016x\n", i, *stack_val);
-		}
-	}
-
-	if (cortex_arch_ops.unwind_exit)
-		cortex_arch_ops.unwind_exit(info, priv_data);
+	else
+		cortex_hex_dump(info, output, frame.sp,
+				frame.bp - frame.sp + info->word_size);
+}
 
-	return;
+/* the frames of a call trace, and why it ends */
+static void cortex_output_write_frames(struct cortex_proc_info *info,
+				       FILE * output,
+				       struct cortex_unwind *unwind, int thread)
+{
+	int width = info->word_size * 2;
+	int frame_id;
+
+	for (frame_id = 0; frame_id < unwind->nr_frames; frame_id++)
+		fprintf(output, "  #%d at 0x%0*lx%s%s", frame_id, width,
+			(unsigned long)unwind->frames[frame_id].pc,
+			frame_id >= unwind->nr_walked ? " (scanned)" : "",
+			frame_id + 1 < unwind->nr_frames ? "\n" : "");
+
+	switch (unwind->stop) {
+	case CORTEX_UNWIND_END:
+		if (info->threads[thread].pr_pid !=
+		    info->threads[thread].pr_pgrp)
+			fprintf(output, " in <clone>\n");
+		else
+			fprintf(output, " in <main>\n");
+		break;
+	case CORTEX_UNWIND_MAX:
+		fprintf(output, "\n  [%d frames, truncated]\n",
+			unwind->nr_frames);
+		break;
+	case CORTEX_UNWIND_LOOP:
+		fprintf(output, "\n  [frame loop]\n");
+		break;
+	case CORTEX_UNWIND_DEADLINE:
+		fprintf(output, "\n  [deadline expired]\n");
+		break;
+	case CORTEX_UNWIND_SCANNED:
+		fprintf(output, "\n  [stack scanned from #%d]\n",
+			unwind->nr_walked);
+		break;
+	}
 }
 
 static void cortex_output_write_call_trace(struct cortex_proc_info *info,
-					   FILE * output)
+					   FILE * output, int ctx)
 {
-	void *priv_data = NULL;
-	struct cortex_stack_frame frame = CORTEX_EMPTY_FRAME;
-
 	if (info->stack) {
 		fprintf(output, "Call trace:\n");
 	} else {
@@ -150,47 +367,55 @@ static void cortex_output_write_call_trace(struct cortex_proc_info *info,
 		return;
 	}
 
-	if (cortex_arch_ops.unwind_init) {
-		priv_data = cortex_arch_ops.unwind_init(info, &frame);
-	} else {
+	if (info->unwind == NULL) {
 		fprintf(output, "Unsupported\n");
 		return;
 	}
 
-	if (cortex_arch_ops.unwind_next) {
-		do {
-			int next;
-			int frame_id = 0;
+	cortex_output_write_frames(info, output, info->unwind, 0);
+}
 
-			if (info->word_size == 4) {
-				fprintf(output, "  #%d at 0x%08x", frame_id,
-					frame.pc);
-			} else if (info->word_size == 8) {
-				fprintf(output, "  #%d at 0x%016x", frame_id,
-					frame.pc);
-			}
+/* sorted tids as runs: 12-15,18 */
+static void cortex_output_write_tids(FILE * output,
+				     struct cortex_unwind_group *group)
+{
+	int i, run;
 
-			next =
-			    cortex_arch_ops.unwind_next(info, &frame,
-							 priv_data);
+	for (i = 0; i < group->nr_threads; i = run + 1) {
+		for (run = i; run + 1 < group->nr_threads &&
+		     group->tids[run + 1] == group->tids[run] + 1; run++) ;
 
-			if (!next) {
-				if (info->threads[0]->pr_pid !=
-				    info->threads[0]->pr_pgrp)
-					fprintf(output, " in <clone>\n");
-				else
-					fprintf(output, " in <main>\n");
-				break;
-			}
-			fprintf(output, "\n");
-			frame_id++;
-		} while (1);
+		fprintf(output, "%s%d", i ? "," : "", group->tids[i]);
+		if (run > i)
+			fprintf(output, "-%d", group->tids[run]);
 	}
+}
 
-	if (cortex_arch_ops.unwind_exit)
-		cortex_arch_ops.unwind_exit(info, priv_data);
+static void cortex_output_write_threads(struct cortex_proc_info *info,
+					FILE * output, int ctx)
+{
+	int g;
 
-	return;
+	if (info->groups == NULL) {
+		fprintf(output, "Threads: unavailable\n");
+		return;
+	}
+
+	fprintf(output, "Threads: %d thread%s, %d distinct call trace%s\n",
+		info->nr_threads, info->nr_threads > 1 ? "s" : "",
+		info->nr_groups, info->nr_groups > 1 ? "s" : "");
+
+	for (g = 0; g < info->nr_groups; g++) {
+		struct cortex_unwind_group *group = &info->groups[g];
+
+		fprintf(output, "%d thread%s: ", group->nr_threads,
+			group->nr_threads > 1 ? "s" : "");
+		cortex_output_write_tids(output, group);
+		fprintf(output, "\n");
+		cortex_output_write_frames(info, output,
+					   &info->unwind[group->thread],
+					   group->thread);
+	}
 }
 
 static void cortex_output_write_source_code(struct cortex_proc_info *info,
@@ -198,7 +423,7 @@ static void cortex_output_write_source_code(struct cortex_proc_info *info,
 {
 	if (info->code) {
 		fprintf(output, "Code:\n");
-		cortex_dis_process_buffer(output, info->code->d_buf,
+		cortex_dis_process_buffer(output, info->elf, info->code->d_buf,
 					  info->code->d_size, ctx,
 					  info->pc_segm->p_vaddr, info->pc);
 	} else {
@@ -207,59 +432,225 @@ static void cortex_output_write_source_code(struct cortex_proc_info *info,
 }
 
 static void cortex_output_write_auxv(struct cortex_proc_info *info,
-				     FILE * output)
+				     FILE * output, int ctx)
 {
 	ElfN_auxv_t *auxv = info->auxv;
 	fprintf(output, "Auxiliary vector:\n");
 
-	while (auxv->a_type != AT_NULL) {
-		fprintf(output, "  %s = 0x%x (%d)\n", auxv_names[auxv->a_type],
-			auxv->a_un.a_val, auxv->a_un.a_val);
+	while (auxv && auxv->a_type != AT_NULL) {
+		const char *name = cortex_output_auxv_name(auxv->a_type);
+
+		if (name[0])
+			fprintf(output, "  %s = 0x%lx (%lu)\n", name,
+				(unsigned long)auxv->a_un.a_val,
+				(unsigned long)auxv->a_un.a_val);
+		else
+			fprintf(output, "  AT_%lu = 0x%lx (%lu)\n",
+				(unsigned long)auxv->a_type,
+				(unsigned long)auxv->a_un.a_val,
+				(unsigned long)auxv->a_un.a_val);
 		auxv++;
 	}
 }
 
+/* write the probes of one scope: system wide or /proc/<pid> */
+static void cortex_output_write_probes(struct cortex_proc_info *info,
+				       FILE * output, int proc)
+{
+	struct cortex_sys_probe *probe;
+	size_t start, end;
+	int i;
+
+	for (i = 0; info->sys && i < info->sys->nr_probes; i++) {
+		probe = &info->sys->probes[i];
+
+		if (cortex_sys_probe_is_proc(probe) != proc)
+			continue;
+
+		fprintf(output, "  %s:\n", cortex_sys_probe_label(probe));
+
+		for (start = 0; start < probe->len; start = end + 1) {
+			end = start;
+			while (end < probe->len && probe->buf[end] != '\n')
+				end++;
+			fprintf(output, "    %.*s\n", (int)(end - start),
+				probe->buf + start);
+		}
+
+		if (probe->truncated)
+			fprintf(output, "    [truncated]\n");
+
+		if (probe->state == CORTEX_SYS_FAILED)
+			fprintf(output, "    [failed]\n");
+		else if (probe->state == CORTEX_SYS_TIMEOUT)
+			fprintf(output, "    [timed out after %d ms%s%s]\n",
+				info->sys->budget, probe->current[0] ?
+				" on " : "", probe->current);
+	}
+}
+
+static void cortex_output_write_system(struct cortex_proc_info *info,
+				       FILE * output, int ctx)
+{
+	fprintf(output, "System context:\n");
+	cortex_output_write_probes(info, output, 0);
+}
+
+static void cortex_output_write_proc(struct cortex_proc_info *info,
+				     FILE * output, int ctx)
+{
+	if (info->sys == NULL || info->sys->pid <= 0) {
+		fprintf(output, "Process state: no pid given\n");
+		return;
+	}
+
+	fprintf(output, "Process state (/proc/%d):\n", info->sys->pid);
+	cortex_output_write_probes(info, output, 1);
+}
+
+/* bytes of the core in anonymous and file backed segments */
+static void cortex_output_mem_totals(struct cortex_proc_info *info,
+				     unsigned long *anon, int *nr_anon,
+				     unsigned long *file, int *nr_file)
+{
+	ElfN_Phdr *phdr = info->elf->phdr;
+	int i;
+
+	*anon = *file = 0;
+	*nr_anon = *nr_file = 0;
+
+	for (i = 0; i < info->stream->nr_segments; i++) {
+		if (phdr[i].p_type != PT_LOAD || !phdr[i].p_filesz)
+			continue;
+
+		if (cortex_elf_find_file(info, phdr[i].p_vaddr)) {
+			*file += phdr[i].p_filesz;
+			(*nr_file)++;
+		} else {
+			*anon += phdr[i].p_filesz;
+			(*nr_anon)++;
+		}
+	}
+}
+
+static void cortex_output_write_memory(struct cortex_proc_info *info,
+				       FILE * output, int ctx)
+{
+	struct cortex_stream *stream = info->stream;
+	int width = info->word_size * 2;
+	ElfN_Phdr *phdr = info->elf->phdr;
+	unsigned long anon, file;
+	int nr_anon, nr_file;
+	int i;
+
+	if (stream == NULL || !(stream->analyzers & CORTEX_STREAM_PAGES)) {
+		fprintf(output, "Core memory: unavailable\n");
+		return;
+	}
+
+	fprintf(output, "Core memory:\n");
+	if (!stream->complete)
+		fprintf(output, "  incomplete, %lu bytes read\n", stream->bytes);
+
+	cortex_output_mem_totals(info, &anon, &nr_anon, &file, &nr_file);
+	fprintf(output, "  anonymous: %lu bytes in %d segments, "
+		"file backed: %lu bytes in %d segments\n", anon, nr_anon,
+		file, nr_file);
+
+	for (i = 0; i < stream->nr_segments; i++) {
+		struct cortex_stream_segment *segment = &stream->segments[i];
+		struct cortex_elf_file *mapping;
+
+		if (phdr[i].p_type != PT_LOAD || !phdr[i].p_filesz)
+			continue;
+
+		mapping = cortex_elf_find_file(info, phdr[i].p_vaddr);
+		fprintf(output, "  0x%0*lx-0x%0*lx %c%c%c %lu/%lu zero pages%s%s\n",
+			width, (unsigned long)phdr[i].p_vaddr, width,
+			(unsigned long)(phdr[i].p_vaddr + phdr[i].p_memsz),
+			phdr[i].p_flags & PF_R ? 'r' : '-',
+			phdr[i].p_flags & PF_W ? 'w' : '-',
+			phdr[i].p_flags & PF_X ? 'x' : '-',
+			segment->zero_pages, segment->pages,
+			mapping ? " " : "", mapping ? mapping->name : "");
+	}
+}
+
+static void cortex_output_write_digest(struct cortex_proc_info *info,
+				       FILE * output, int ctx)
+{
+	struct cortex_stream *stream = info->stream;
+
+	if (stream == NULL || !(stream->analyzers & CORTEX_STREAM_DIGEST))
+		fprintf(output, "Core digest: unavailable\n");
+	else if (stream->complete)
+		fprintf(output, "Core digest: xxh64:%016llx, %lu bytes\n",
+			(unsigned long long)stream->digest, stream->bytes);
+	else
+		fprintf(output, "Core digest: incomplete, %lu bytes read\n",
+			stream->bytes);
+}
+
+/* segments are aligned on p_align, up to a page for PT_LOAD */
+static void cortex_output_pad(FILE * output, long size)
+{
+	static const char zero[64];
+
+	while (size > 0) {
+		long len = size;
+
+		if (len > (long)sizeof(zero))
+			len = sizeof(zero);
+		fwrite(zero, 1, len, output);
+		size -= len;
+	}
+}
+
 static void cortex_output_write_elf_core(struct cortex_proc_info *info,
-					 FILE * output)
+					 FILE * output, long fmt)
 {
 	long cursor = 0;
-	char padding[16];
 	long align_phdr[3] = { 0, 0, 0 };
 	long align = info->word_size;
 
 	long stack_offset = 0;
 
+	/* written in the class and byte order of the core */
+	const struct cortex_elf_class *elf_class = info->elf->elf_class;
+	int swap = info->elf->swap;
+	unsigned char raw[sizeof(Elf64_Ehdr)];
 	ElfN_Ehdr ehdr;
 	ElfN_Phdr phdr[3];
 
-	memset(padding, 0, 16);
+	/* only export the segments we could load */
+	if (!info->code)
+		fmt &= ~CORTEX_OUTPUT_FMT_COD;
+	if (!info->stack)
+		fmt &= ~CORTEX_OUTPUT_FMT_STA;
 
 	/* prepare elf core header */
 	memcpy(&ehdr, info->elf->ehdr, sizeof(ElfN_Ehdr));
 
-	ehdr.e_phoff = sizeof(ElfN_Ehdr);
-	ehdr.e_phentsize = sizeof(ElfN_Phdr);
+	ehdr.e_phoff = elf_class->ehdr_size;
+	ehdr.e_phentsize = elf_class->phdr_size;
 	ehdr.e_phnum = 0;
 	ehdr.e_shnum = 0;
 
-	if (cortex_output_fmt &
-	    (CORTEX_OUTPUT_FMT_GEN | CORTEX_OUTPUT_FMT_REG |
-	     CORTEX_OUTPUT_FMT_AUX))
+	if (fmt & CORTEX_OUTPUT_FMT_NOTE)
 		ehdr.e_phnum++;
-	if (cortex_output_fmt & CORTEX_OUTPUT_FMT_COD)
+	if (fmt & CORTEX_OUTPUT_FMT_COD)
 		ehdr.e_phnum++;
-	if (cortex_output_fmt & CORTEX_OUTPUT_FMT_STA)
+	if (fmt & CORTEX_OUTPUT_FMT_STA)
 		ehdr.e_phnum++;
 
 	/* write the ELF core header */
-	fwrite(&ehdr, sizeof(ElfN_Ehdr), 1, output);
+	elf_class->write_ehdr(raw, &ehdr, swap);
+	fwrite(raw, elf_class->ehdr_size, 1, output);
 
-	cursor = sizeof(ElfN_Ehdr) + ehdr.e_phnum * sizeof(ElfN_Phdr);
+	cursor = elf_class->ehdr_size + ehdr.e_phnum * elf_class->phdr_size;
 
 	/* prepare elf core note segment */
-	if (cortex_output_fmt &
-	    (CORTEX_OUTPUT_FMT_GEN | CORTEX_OUTPUT_FMT_REG |
-	     CORTEX_OUTPUT_FMT_AUX)) {
+	if (fmt & CORTEX_OUTPUT_FMT_NOTE) {
 		memcpy(&phdr[0], info->note_segm, sizeof(ElfN_Phdr));
 
 		if (phdr[0].p_align > 1) {
@@ -274,9 +665,9 @@ static void cortex_output_write_elf_core(struct cortex_proc_info *info,
 		cursor += align_phdr[0] + phdr[0].p_filesz;
 	}
 	/* prepare elf core code segment */
-	if (cortex_output_fmt & CORTEX_OUTPUT_FMT_COD) {
+	if (fmt & CORTEX_OUTPUT_FMT_COD) {
 		memcpy(&phdr[1], info->pc_segm, sizeof(ElfN_Phdr));
-		phdr[1].p_filesz = phdr[1].p_memsz;
+		phdr[1].p_filesz = info->code->d_size;
 
 		if (phdr[1].p_align > 1) {
 			align_phdr[1] =
@@ -290,11 +681,17 @@ static void cortex_output_write_elf_core(struct cortex_proc_info *info,
 		cursor += align_phdr[1] + phdr[1].p_filesz;
 	}
 	/* prepare elf core stack segment */
-	if (cortex_output_fmt & CORTEX_OUTPUT_FMT_STA) {
+	if (fmt & CORTEX_OUTPUT_FMT_STA) {
 		unsigned long stack_align = 0;
-		unsigned long long stack_reduced_size =
-		    info->word_size + info->sp_segm->p_vaddr +
-		    info->sp_segm->p_filesz - info->sp;
+		unsigned long long stack_reduced_size = 0;
+
+		/* from the word below sp to the end of what was loaded:
+		   info->stack may only hold a window of the segment */
+		if (info->sp - info->sp_segm->p_vaddr >
+		    (ElfN_Addr)info->word_size)
+			stack_offset = info->sp - info->word_size -
+			    info->sp_segm->p_vaddr;
+		stack_reduced_size = info->stack->d_size - stack_offset;
 
 		memcpy(&phdr[2], info->sp_segm, sizeof(ElfN_Phdr));
 		if (phdr[2].p_align > 1) {
@@ -311,93 +708,530 @@ static void cortex_output_write_elf_core(struct cortex_proc_info *info,
 			    (align - stack_reduced_size % align) % align;
 		}
 
+		/* the alignment cannot reach below the loaded data */
+		if (stack_align > (unsigned long)stack_offset)
+			stack_align = stack_offset;
+		stack_offset -= stack_align;
 		stack_reduced_size += stack_align;
-		stack_offset = phdr[2].p_memsz - stack_reduced_size;
 
 		phdr[2].p_filesz = phdr[2].p_memsz = stack_reduced_size;
-		phdr[2].p_vaddr = info->sp - info->word_size - stack_align;
+		phdr[2].p_vaddr = info->sp_segm->p_vaddr + stack_offset;
 		phdr[2].p_offset = cursor + align_phdr[2];
 
 		cursor += align_phdr[2] + phdr[2].p_filesz;
 	}
 
-	if (cortex_output_fmt &
-	    (CORTEX_OUTPUT_FMT_GEN | CORTEX_OUTPUT_FMT_REG |
-	     CORTEX_OUTPUT_FMT_AUX))
-		fwrite(phdr + 0, sizeof(ElfN_Phdr), 1, output);
-	if (cortex_output_fmt & CORTEX_OUTPUT_FMT_COD)
-		fwrite(phdr + 1, sizeof(ElfN_Phdr), 1, output);
-	if (cortex_output_fmt & CORTEX_OUTPUT_FMT_STA)
-		fwrite(phdr + 2, sizeof(ElfN_Phdr), 1, output);
+	if (fmt & CORTEX_OUTPUT_FMT_NOTE) {
+		elf_class->write_phdr(raw, phdr + 0, swap);
+		fwrite(raw, elf_class->phdr_size, 1, output);
+	}
+	if (fmt & CORTEX_OUTPUT_FMT_COD) {
+		elf_class->write_phdr(raw, phdr + 1, swap);
+		fwrite(raw, elf_class->phdr_size, 1, output);
+	}
+	if (fmt & CORTEX_OUTPUT_FMT_STA) {
+		elf_class->write_phdr(raw, phdr + 2, swap);
+		fwrite(raw, elf_class->phdr_size, 1, output);
+	}
 
 	/* write elf core note segment */
-	if (cortex_output_fmt &
-	    (CORTEX_OUTPUT_FMT_GEN | CORTEX_OUTPUT_FMT_REG |
-	     CORTEX_OUTPUT_FMT_AUX)) {
-		if (align_phdr[0])
-			fwrite(padding, align_phdr[0], 1, output);
+	if (fmt & CORTEX_OUTPUT_FMT_NOTE) {
+		cortex_output_pad(output, align_phdr[0]);
 		fwrite(info->note->d_buf, 1, info->note->d_size, output);
 	}
 	/* write elf core code segment */
-	if (cortex_output_fmt & CORTEX_OUTPUT_FMT_COD) {
-		if (align_phdr[1])
-			fwrite(padding, align_phdr[1], 1, output);
+	if (fmt & CORTEX_OUTPUT_FMT_COD) {
+		cortex_output_pad(output, align_phdr[1]);
 		fwrite(info->code->d_buf, 1, info->code->d_size, output);
 	}
 	/* write elf core stack segment */
-	if (cortex_output_fmt & CORTEX_OUTPUT_FMT_STA) {
-		if (align_phdr[2])
-			fwrite(padding, align_phdr[2], 1, output);
+	if (fmt & CORTEX_OUTPUT_FMT_STA) {
+		cortex_output_pad(output, align_phdr[2]);
 		fwrite(info->stack->d_buf + stack_offset, 1,
 		       info->stack->d_size - stack_offset, output);
 	}
 }
 
-int cortex_output_set_format(char *fmt)
+static void cortex_output_json_string(FILE * output, const char *str,
+				      size_t max)
+{
+	size_t i = 0;
+
+	fputc('"', output);
+	for (i = 0; i < max && str[i]; i++) {
+		unsigned char c = str[i];
+
+		if (c == '"' || c == '\\') {
+			fprintf(output, "\\%c", c);
+		} else if (c < 0x20) {
+			fprintf(output, "\\u%04x", c);
+		} else {
+			fputc(c, output);
+		}
+	}
+	fputc('"', output);
+}
+
+static void cortex_output_json_generic(struct cortex_proc_info *info,
+				       FILE * output, int ctx)
+{
+	struct cortex_mem_stats mem;
+
+	fprintf(output, "\"process\":{\"name\":");
+	cortex_output_json_string(output, info->info->pr_fname,
+				  sizeof(info->info->pr_fname));
+	fprintf(output, ",\"pid\":%d,\"signum\":%d,\"thread\":%d,\"cmdline\":",
+		info->info->pr_pid, info->threads[0].pr_cursig,
+		info->threads[0].pr_pid);
+	cortex_output_json_string(output, info->info->pr_psargs,
+				  sizeof(info->info->pr_psargs));
+	if (info->siginfo) {
+		fprintf(output, ",\"siginfo\":{\"signo\":%d,\"errno\":%d,"
+			"\"code\":%d,\"code_name\":\"%s\"",
+			info->siginfo->signo, info->siginfo->errnum,
+			info->siginfo->code,
+			cortex_output_si_code(info->siginfo));
+		if (info->siginfo->fault && info->siginfo->code > 0)
+			fprintf(output, ",\"addr\":\"0x%lx\"",
+				(unsigned long)info->siginfo->addr);
+		fprintf(output, "}");
+	}
+	fprintf(output, ",\"uid\":%d,\"gid\":%d,\"state\":\"%c\","
+		"\"nr_threads\":%d}", info->info->pr_uid, info->info->pr_gid,
+		"RSDTZW"[info->info->pr_state], info->nr_threads);
+
+	cortex_mem_get_stats(&mem);
+	fprintf(output, ",\"memory\":{\"peak\":%lu,\"budget\":%lu,"
+		"\"locked\":%s,\"refused\":%ld,\"code_window\":%s,"
+		"\"stack_window\":%s}", (unsigned long)mem.peak,
+		(unsigned long)mem.budget, mem.locked ? "true" : "false",
+		mem.failed, info->pc_segm == &info->pc_window ? "true" : "false",
+		info->sp_segm == &info->sp_window ? "true" : "false");
+}
+
+static void cortex_output_json_registers(struct cortex_proc_info *info,
+					 FILE * output, int ctx)
+{
+	int i = 0;
+
+	fprintf(output, "\"registers\":{");
+	for (i = 0; i < info->cpu_regs_nr; i++) {
+		fprintf(output, "%s\"%s\":\"0x%0*llx\"", i ? "," : "",
+			info->cpu_regs[i].name, (int)info->cpu_regs[i].size * 2,
+			(unsigned long long)info->cpu_regs[i].value);
+	}
+	fprintf(output, "}");
+}
+
+static void cortex_output_json_vregs(FILE * output, const char *key,
+				     const struct cortex_vreg *vregs, int nr)
+{
+	int i = 0;
+	size_t j = 0;
+
+	if (nr == 0) {
+		fprintf(output, "\"%s\":null", key);
+		return;
+	}
+
+	fprintf(output, "\"%s\":{", key);
+	for (i = 0; i < nr; i++) {
+		fprintf(output, "%s\"%s\":\"0x", i ? "," : "", vregs[i].name);
+		for (j = vregs[i].size; j > 0; j--)
+			fprintf(output, "%02x", vregs[i].value[j - 1]);
+		fprintf(output, "\"");
+	}
+	fprintf(output, "}");
+}
+
+static void cortex_output_json_fp_registers(struct cortex_proc_info *info,
+					    FILE * output, int ctx)
+{
+	struct cortex_vreg vregs[CORTEX_VREGS_MAX];
+	int nr = 0;
+
+	if (info->arch->fill_fp_regs)
+		nr = info->arch->fill_fp_regs(info, 0, vregs);
+
+	cortex_output_json_vregs(output, "fp_registers", vregs, nr);
+}
+
+static void cortex_output_json_vec_registers(struct cortex_proc_info *info,
+					     FILE * output, int ctx)
+{
+	struct cortex_vreg vregs[CORTEX_VREGS_MAX];
+	int nr = 0;
+
+	if (info->arch->fill_vec_regs)
+		nr = info->arch->fill_vec_regs(info, 0, vregs);
+
+	cortex_output_json_vregs(output, "vector_registers", vregs, nr);
+}
+
+static void cortex_output_json_source_code(struct cortex_proc_info *info,
+					   FILE * output, int ctx)
+{
+	ElfN_Addr start = 0;
+	ElfN_Addr end = 0;
+	ElfN_Addr i = 0;
+
+	if (!info->code) {
+		fprintf(output, "\"code\":null");
+		return;
+	}
+
+	/* only export the window around the instruction pointer */
+	start = info->pc - info->pc_segm->p_vaddr;
+	end = start + ctx + 1;
+	start = (start > (ElfN_Addr) ctx) ? start - ctx : 0;
+	if (end > info->code->d_size)
+		end = info->code->d_size;
+
+	fprintf(output, "\"code\":{\"pc\":\"0x%lx\",\"base\":\"0x%lx\","
+		"\"bytes\":\"", (unsigned long)info->pc,
+		(unsigned long)(info->pc_segm->p_vaddr + start));
+	for (i = start; i < end; i++)
+		fprintf(output, "%02x", info->code->d_buf[i]);
+	fprintf(output, "\"}");
+}
+
+static void cortex_output_json_frames(FILE * output,
+				      struct cortex_unwind *unwind)
+{
+	int frame_id;
+
+	fprintf(output, "\"call_trace\":[");
+
+	for (frame_id = 0; unwind && frame_id < unwind->nr_frames; frame_id++)
+		fprintf(output, "%s\"0x%lx\"", frame_id ? "," : "",
+			(unsigned long)unwind->frames[frame_id].pc);
+
+	fprintf(output, "]");
+
+	/* the frames from this one on are guesses */
+	if (unwind && unwind->nr_walked < unwind->nr_frames)
+		fprintf(output, ",\"call_trace_scanned\":%d",
+			unwind->nr_walked);
+}
+
+static void cortex_output_json_call_trace(struct cortex_proc_info *info,
+					  FILE * output, int ctx)
+{
+	cortex_output_json_frames(output, info->unwind);
+}
+
+static void cortex_output_json_threads(struct cortex_proc_info *info,
+				       FILE * output, int ctx)
+{
+	int g, i, run;
+
+	if (info->groups == NULL) {
+		fprintf(output, "\"threads\":null");
+		return;
+	}
+
+	fprintf(output, "\"threads\":[");
+
+	for (g = 0; g < info->nr_groups; g++) {
+		struct cortex_unwind_group *group = &info->groups[g];
+
+		/* the tids as [first,last] runs */
+		fprintf(output, "%s{\"count\":%d,\"tids\":[", g ? "," : "",
+			group->nr_threads);
+		for (i = 0; i < group->nr_threads; i = run + 1) {
+			for (run = i; run + 1 < group->nr_threads &&
+			     group->tids[run + 1] == group->tids[run] + 1;
+			     run++) ;
+			fprintf(output, "%s[%d,%d]", i ? "," : "",
+				group->tids[i], group->tids[run]);
+		}
+		fprintf(output, "],");
+		cortex_output_json_frames(output, &info->unwind[group->thread]);
+		fprintf(output, "}");
+	}
+
+	fprintf(output, "]");
+}
+
+static void cortex_output_json_auxv(struct cortex_proc_info *info,
+				    FILE * output, int ctx)
+{
+	ElfN_auxv_t *auxv = info->auxv;
+	int first = 1;
+
+	fprintf(output, "\"auxv\":{");
+	while (auxv && auxv->a_type != AT_NULL) {
+		const char *name = cortex_output_auxv_name(auxv->a_type);
+
+		if (name[0]) {
+			fprintf(output, "%s\"%s\":\"0x%lx\"", first ? "" : ",",
+				name,
+				(unsigned long)auxv->a_un.a_val);
+			first = 0;
+		}
+		auxv++;
+	}
+	fprintf(output, "}");
+}
+
+static void cortex_output_json_stack_frame(struct cortex_proc_info *info,
+					   FILE * output, int ctx)
+{
+	struct cortex_stack_frame frame = CORTEX_EMPTY_FRAME;
+	ElfN_Addr i;
+
+	if (!info->stack || !info->unwind) {
+		fprintf(output, "\"stack\":null");
+		return;
+	}
+
+	if (info->unwind[0].nr_frames)
+		frame = info->unwind[0].frames[0];
+
+	fprintf(output, "\"stack\":{\"sp\":\"0x%lx\",\"words\":[",
+		(unsigned long)frame.sp);
+	for (i = frame.bp; frame.bp && i >= frame.sp; i -= info->word_size) {
+		ElfN_Addr val;
+
+		if (cortex_elf_read_word(info, i, &val) < 0)
+			break;
+		fprintf(output, "%s\"0x%lx\"", (i == frame.bp) ? "" : ",",
+			(unsigned long)val);
+	}
+	fprintf(output, "]}");
+}
+
+static void cortex_output_json_probes(struct cortex_proc_info *info,
+				      FILE * output, int proc)
+{
+	static const char *states[] = { "pending", "done", "failed", "timeout" };
+	struct cortex_sys_probe *probe;
+	int sep = 0;
+	int i;
+
+	for (i = 0; info->sys && i < info->sys->nr_probes; i++) {
+		probe = &info->sys->probes[i];
+
+		if (cortex_sys_probe_is_proc(probe) != proc)
+			continue;
+
+		fprintf(output, "%s\"%s\":{\"state\":\"%s\",\"truncated\":%s,"
+			"\"text\":", sep ? "," : "", cortex_sys_probe_name(probe),
+			states[probe->state], probe->truncated ? "true" : "false");
+		cortex_output_json_string(output, probe->buf, probe->len);
+		if (probe->state == CORTEX_SYS_TIMEOUT && probe->current[0]) {
+			fprintf(output, ",\"blocked_on\":");
+			cortex_output_json_string(output, probe->current,
+						  sizeof(probe->current));
+		}
+		fprintf(output, "}");
+		sep = 1;
+	}
+}
+
+static void cortex_output_json_system(struct cortex_proc_info *info,
+				      FILE * output, int ctx)
+{
+	fprintf(output, "\"system\":{");
+	cortex_output_json_probes(info, output, 0);
+	fprintf(output, "}");
+}
+
+static void cortex_output_json_proc(struct cortex_proc_info *info,
+				    FILE * output, int ctx)
+{
+	fprintf(output, "\"proc\":{\"pid\":%d",
+		info->sys ? info->sys->pid : 0);
+	if (info->sys && info->sys->pid > 0) {
+		fprintf(output, ",");
+		cortex_output_json_probes(info, output, 1);
+	}
+	fprintf(output, "}");
+}
+
+static void cortex_output_json_memory(struct cortex_proc_info *info,
+				      FILE * output, int ctx)
+{
+	struct cortex_stream *stream = info->stream;
+	ElfN_Phdr *phdr = info->elf->phdr;
+	unsigned long anon, file;
+	int nr_anon, nr_file;
+	int sep = 0;
+	int i;
+
+	if (stream == NULL || !(stream->analyzers & CORTEX_STREAM_PAGES)) {
+		fprintf(output, "\"core_memory\":null");
+		return;
+	}
+
+	cortex_output_mem_totals(info, &anon, &nr_anon, &file, &nr_file);
+
+	fprintf(output, "\"core_memory\":{\"complete\":%s,\"bytes\":%lu,",
+		stream->complete ? "true" : "false", stream->bytes);
+	fprintf(output, "\"anon_bytes\":%lu,\"file_bytes\":%lu,"
+		"\"segments\":[", anon, file);
+
+	for (i = 0; i < stream->nr_segments; i++) {
+		struct cortex_stream_segment *segment = &stream->segments[i];
+		struct cortex_elf_file *mapping;
+
+		if (phdr[i].p_type != PT_LOAD || !phdr[i].p_filesz)
+			continue;
+
+		mapping = cortex_elf_find_file(info, phdr[i].p_vaddr);
+		fprintf(output, "%s{\"vaddr\":\"0x%lx\",\"size\":%lu,"
+			"\"flags\":%u,\"pages\":%lu,\"zero_pages\":%lu,"
+			"\"file\":", sep ? "," : "",
+			(unsigned long)phdr[i].p_vaddr,
+			(unsigned long)phdr[i].p_filesz,
+			(unsigned int)phdr[i].p_flags, segment->pages,
+			segment->zero_pages);
+		if (mapping)
+			cortex_output_json_string(output, mapping->name,
+						  PATH_MAX);
+		else
+			fprintf(output, "null");
+		fprintf(output, "}");
+		sep = 1;
+	}
+	fprintf(output, "]}");
+}
+
+static void cortex_output_json_digest(struct cortex_proc_info *info,
+				      FILE * output, int ctx)
+{
+	struct cortex_stream *stream = info->stream;
+
+	if (stream == NULL || !(stream->analyzers & CORTEX_STREAM_DIGEST)) {
+		fprintf(output, "\"core_digest\":null");
+		return;
+	}
+
+	fprintf(output, "\"core_digest\":{\"complete\":%s,\"bytes\":%lu",
+		stream->complete ? "true" : "false", stream->bytes);
+	if (stream->complete)
+		fprintf(output, ",\"xxh64\":\"%016llx\"",
+			(unsigned long long)stream->digest);
+	fprintf(output, "}");
+}
+
+/** \struct cortex_output_section
+ ** \brief one report section and its writers
+ */
+struct cortex_output_section {
+	long fmt;
+	int always;		/*!< written even once the deadline expired */
+	void (*text) (struct cortex_proc_info *, FILE *, int);
+	void (*json) (struct cortex_proc_info *, FILE *, int);
+};
+
+/* sections in the order they are written: the most useful first, so
+ * that a report cut by the deadline still holds what matters most.
+ * The generic info and registers come from the notes, read first and
+ * formatted in no time: they are always written */
+static const struct cortex_output_section cortex_output_sections[] = {
+	{CORTEX_OUTPUT_FMT_GEN, 1, cortex_output_write_generic,
+	 cortex_output_json_generic},
+	{CORTEX_OUTPUT_FMT_REG, 1, cortex_output_write_registers,
+	 cortex_output_json_registers},
+	{CORTEX_OUTPUT_FMT_CAL, 0, cortex_output_write_call_trace,
+	 cortex_output_json_call_trace},
+	{CORTEX_OUTPUT_FMT_COD, 0, cortex_output_write_source_code,
+	 cortex_output_json_source_code},
+	{CORTEX_OUTPUT_FMT_FPR, 0, cortex_output_write_fp_registers,
+	 cortex_output_json_fp_registers},
+	{CORTEX_OUTPUT_FMT_VEC, 0, cortex_output_write_vec_registers,
+	 cortex_output_json_vec_registers},
+	{CORTEX_OUTPUT_FMT_AUX, 0, cortex_output_write_auxv,
+	 cortex_output_json_auxv},
+	{CORTEX_OUTPUT_FMT_STA, 0, cortex_output_write_stack_frame,
+	 cortex_output_json_stack_frame},
+	{CORTEX_OUTPUT_FMT_THR, 0, cortex_output_write_threads,
+	 cortex_output_json_threads},
+	{CORTEX_OUTPUT_FMT_SYS, 0, cortex_output_write_system,
+	 cortex_output_json_system},
+	{CORTEX_OUTPUT_FMT_PRC, 0, cortex_output_write_proc,
+	 cortex_output_json_proc},
+	{CORTEX_OUTPUT_FMT_MEM, 0, cortex_output_write_memory,
+	 cortex_output_json_memory},
+	{CORTEX_OUTPUT_FMT_DIG, 0, cortex_output_write_digest,
+	 cortex_output_json_digest},
+};
+
+#define CORTEX_OUTPUT_NR_SECTIONS \
+	(sizeof(cortex_output_sections) / sizeof(cortex_output_sections[0]))
+
+long cortex_output_parse_format(char *fmt)
 {
 	long fmt_len = 0;
+	long output_fmt = 0;
 
 	if (fmt == NULL) {
-		cortex_output_fmt = CORTEX_OUTPUT_FMT_DEF;
-		return 0;
+		return CORTEX_OUTPUT_FMT_DEF;
 	}
 
 	fmt_len = strlen(fmt);
 
 	while (*fmt) {
+		long len = 3;
+
 		if (fmt_len < 3) {
-			cortex_output_fmt = 0;
 			fprintf(stderr, "truncated format string %s\n", fmt);
 			return -1;
 		}
 
-		if (strncmp(fmt, "gen", 3) == 0) {
-			cortex_output_fmt |= CORTEX_OUTPUT_FMT_GEN;
+		if (strncmp(fmt, "mdmp", 4) == 0) {
+			output_fmt &= ~CORTEX_OUTPUT_FMT_KIND;
+			output_fmt |= CORTEX_OUTPUT_FMT_MDP;
+			len = 4;
+		} else if (strncmp(fmt, "gen", 3) == 0) {
+			output_fmt |= CORTEX_OUTPUT_FMT_GEN;
 		} else if (strncmp(fmt, "reg", 3) == 0) {
-			cortex_output_fmt |= CORTEX_OUTPUT_FMT_REG;
+			output_fmt |= CORTEX_OUTPUT_FMT_REG;
 		} else if (strncmp(fmt, "cod", 3) == 0) {
-			cortex_output_fmt |= CORTEX_OUTPUT_FMT_COD;
+			output_fmt |= CORTEX_OUTPUT_FMT_COD;
 		} else if (strncmp(fmt, "cal", 3) == 0) {
-			cortex_output_fmt |= CORTEX_OUTPUT_FMT_CAL;
+			output_fmt |= CORTEX_OUTPUT_FMT_CAL;
 		} else if (strncmp(fmt, "aux", 3) == 0) {
-			cortex_output_fmt |= CORTEX_OUTPUT_FMT_AUX;
+			output_fmt |= CORTEX_OUTPUT_FMT_AUX;
 		} else if (strncmp(fmt, "sta", 3) == 0) {
-			cortex_output_fmt |= CORTEX_OUTPUT_FMT_STA;
+			output_fmt |= CORTEX_OUTPUT_FMT_STA;
+		} else if (strncmp(fmt, "fpr", 3) == 0) {
+			output_fmt |= CORTEX_OUTPUT_FMT_FPR;
+		} else if (strncmp(fmt, "vec", 3) == 0) {
+			output_fmt |= CORTEX_OUTPUT_FMT_VEC;
+		} else if (strncmp(fmt, "sys", 3) == 0) {
+			output_fmt |= CORTEX_OUTPUT_FMT_SYS;
+		} else if (strncmp(fmt, "prc", 3) == 0) {
+			output_fmt |= CORTEX_OUTPUT_FMT_PRC;
+		} else if (strncmp(fmt, "mem", 3) == 0) {
+			output_fmt |= CORTEX_OUTPUT_FMT_MEM;
+		} else if (strncmp(fmt, "dig", 3) == 0) {
+			output_fmt |= CORTEX_OUTPUT_FMT_DIG;
+		} else if (strncmp(fmt, "thr", 3) == 0) {
+			output_fmt |= CORTEX_OUTPUT_FMT_THR;
 		} else if (strncmp(fmt, "def", 3) == 0) {
-			cortex_output_fmt |= CORTEX_OUTPUT_FMT_DEF;
+			output_fmt |= CORTEX_OUTPUT_FMT_DEF;
 		} else if (strncmp(fmt, "all", 3) == 0) {
-			cortex_output_fmt |= CORTEX_OUTPUT_FMT_ALL;
+			output_fmt |= CORTEX_OUTPUT_FMT_ALL;
 		} else if (strncmp(fmt, "bin", 3) == 0) {
-			cortex_output_fmt |= CORTEX_OUTPUT_FMT_BIN;
-		} else if (strncmp(fmt, "bin", 3) == 0) {
-			cortex_output_fmt &= ~CORTEX_OUTPUT_FMT_BIN;
+			output_fmt &= ~CORTEX_OUTPUT_FMT_KIND;
+			output_fmt |= CORTEX_OUTPUT_FMT_BIN;
+		} else if (strncmp(fmt, "jsn", 3) == 0) {
+			output_fmt &= ~CORTEX_OUTPUT_FMT_KIND;
+			output_fmt |= CORTEX_OUTPUT_FMT_JSN;
+		} else if (strncmp(fmt, "min", 3) == 0) {
+			output_fmt &= ~CORTEX_OUTPUT_FMT_KIND;
+			output_fmt |= CORTEX_OUTPUT_FMT_MIN;
+		} else if (strncmp(fmt, "txt", 3) == 0) {
+			output_fmt &= ~CORTEX_OUTPUT_FMT_KIND;
 		} else {
 			fprintf(stderr, "unknown fmt %s\n", fmt);
 			return -1;
 		}
 
-		fmt += 3;
-		fmt_len -= 3;
+		fmt += len;
+		fmt_len -= len;
 
 		if (fmt_len && *fmt == ',') {
 			fmt++;
@@ -405,36 +1239,315 @@ int cortex_output_set_format(char *fmt)
 		}
 	}
 
+	return output_fmt;
+}
+
+int cortex_output_parse_sink(struct cortex_output_sink *sink, char *spec)
+{
+	char *dest = strchr(spec, ':');
+
+	if (dest == NULL) {
+		fprintf(stderr, "sink %s: expected <format>:<output>\n", spec);
+		return -1;
+	}
+
+	/* the format is everything before the first colon */
+	*dest++ = '\0';
+	sink->fmt = cortex_output_parse_format(spec);
+	if (sink->fmt < 0)
+		return -1;
+
+	sink->stream = NULL;
+	sink->raw = NULL;
+	sink->cookie = NULL;
+	sink->zip = CORTEX_ZIP_NONE;
+	sink->level = -1;
+	sink->dest = dest;
+
+	if (strcmp(dest, "-") == 0) {
+		sink->type = CORTEX_OUTPUT_SINK_STDOUT;
+	} else if (dest[0] == '|') {
+		sink->type = CORTEX_OUTPUT_SINK_CMD;
+		sink->dest = dest + 1;
+	} else if (dest[0] == '&') {
+		sink->type = CORTEX_OUTPUT_SINK_FD;
+		sink->dest = dest + 1;
+	} else {
+		sink->type = CORTEX_OUTPUT_SINK_FILE;
+	}
+
 	return 0;
 }
 
-void cortex_output_write_process(struct cortex_proc_info *info, FILE * output,
-				 int ctx)
+/* open a temporary file next to dest, so that a report is either
+ * complete or absent: it is renamed to dest once fully written.
+ * Devices and fifos are opened directly. */
+static FILE *cortex_output_open_tmp(struct cortex_output_sink *sink)
+{
+	struct stat st;
+	mode_t mask;
+	FILE *stream;
+	int fd;
+
+	if (stat(sink->dest, &st) == 0 && !S_ISREG(st.st_mode))
+		return fopen(sink->dest, "w");
+
+	sink->tmp = cortex_mem_alloc(strlen(sink->dest) + sizeof(".XXXXXX"));
+	if (sink->tmp == NULL)
+		return NULL;
+
+	sprintf(sink->tmp, "%s.XXXXXX", sink->dest);
+	fd = mkstemp(sink->tmp);
+	if (fd < 0)
+		goto out_err;
+
+	/* mkstemp creates the file 0600: give it the fopen permissions */
+	mask = umask(0);
+	umask(mask);
+	fchmod(fd, 0666 & ~mask);
+
+	stream = fdopen(fd, "w");
+	if (stream == NULL) {
+		close(fd);
+		unlink(sink->tmp);
+		goto out_err;
+	}
+
+	return stream;
+
+out_err:
+	cortex_mem_free(sink->tmp);
+	sink->tmp = NULL;
+	return NULL;
+}
+
+static int cortex_output_close_raw(struct cortex_output_sink *sink)
 {
-	if ((cortex_output_fmt & CORTEX_OUTPUT_FMT_BIN) == 0) {
-		fprintf(output,
-			"\n8<--------------------------------------------------------------------------\n");
+	switch (sink->type) {
+	case CORTEX_OUTPUT_SINK_CMD:
+		return pclose(sink->raw) == -1 ? -1 : 0;
+	case CORTEX_OUTPUT_SINK_FILE:
+	case CORTEX_OUTPUT_SINK_FD:
+		return fclose(sink->raw) != 0 ? -1 : 0;
+	case CORTEX_OUTPUT_SINK_STDOUT:
+	default:
+		return fflush(sink->raw) != 0 ? -1 : 0;
+	}
+}
 
-		if (cortex_output_fmt & CORTEX_OUTPUT_FMT_GEN)
-			cortex_output_write_generic(info, output);
+int cortex_output_open_sink(struct cortex_output_sink *sink)
+{
+	FILE *raw;
+	int fd;
+
+	sink->tmp = NULL;
+
+	switch (sink->type) {
+	case CORTEX_OUTPUT_SINK_FILE:
+		raw = cortex_output_open_tmp(sink);
+		break;
+	case CORTEX_OUTPUT_SINK_CMD:
+		raw = popen(sink->dest, "w");
+		break;
+	case CORTEX_OUTPUT_SINK_FD:
+		/* the descriptor belongs to the caller: close a copy of it */
+		raw = NULL;
+		fd = dup(atoi(sink->dest));
+		if (fd >= 0) {
+			raw = fdopen(fd, "w");
+			if (!raw)
+				close(fd);
+		}
+		break;
+	case CORTEX_OUTPUT_SINK_STDOUT:
+	default:
+		raw = stdout;
+		break;
+	}
 
-		if (cortex_output_fmt & CORTEX_OUTPUT_FMT_REG)
-			cortex_output_write_registers(info, output);
+	if (!raw) {
+		perror(sink->dest);
+		return -1;
+	}
 
-		if (cortex_output_fmt & CORTEX_OUTPUT_FMT_COD)
-			cortex_output_write_source_code(info, output, ctx);
+	sink->raw = raw;
+	sink->stream = raw;
+	sink->cookie = NULL;
+
+	if (sink->zip != CORTEX_ZIP_NONE) {
+		sink->stream = cortex_zip_open(raw, sink->zip, sink->level,
+					       &sink->cookie);
+		if (!sink->stream) {
+			cortex_output_close_raw(sink);
+			if (sink->tmp) {
+				unlink(sink->tmp);
+				cortex_mem_free(sink->tmp);
+				sink->tmp = NULL;
+			}
+			return -1;
+		}
+	}
+
+	return 0;
+}
 
-		if (cortex_output_fmt & CORTEX_OUTPUT_FMT_CAL)
-			cortex_output_write_call_trace(info, output);
+int cortex_output_close_sink(struct cortex_output_sink *sink)
+{
+	int ret = 0;
 
-		if (cortex_output_fmt & CORTEX_OUTPUT_FMT_AUX)
-			cortex_output_write_auxv(info, output);
+	if (!sink->stream)
+		return 0;
 
-		if (cortex_output_fmt & CORTEX_OUTPUT_FMT_STA)
-			cortex_output_write_stack_frame(info, output);
+	/* terminate the compressed stream first, it writes to raw */
+	if (sink->stream != sink->raw && fclose(sink->stream) != 0)
+		ret = -1;
 
-		fprintf(output, "\n");
-	} else {
-		cortex_output_write_elf_core(info, output);
+	if (ferror(sink->raw))
+		ret = -1;
+
+	if (cortex_output_close_raw(sink) < 0)
+		ret = -1;
+
+	if (sink->tmp) {
+		if (ret == 0 && rename(sink->tmp, sink->dest) < 0) {
+			perror(sink->dest);
+			ret = -1;
+		}
+		if (ret < 0)
+			unlink(sink->tmp);
+		cortex_mem_free(sink->tmp);
+		sink->tmp = NULL;
+	}
+
+	if (ret < 0)
+		fprintf(stderr, "%s: report is incomplete\n", sink->dest);
+
+	sink->stream = NULL;
+	sink->raw = NULL;
+	sink->cookie = NULL;
+
+	return ret;
+}
+
+/* push a completed section down to the output, through the
+ * compressor if any, so that it survives whatever happens next */
+static void cortex_output_flush_sink(struct cortex_output_sink *sink)
+{
+	uint64_t begin = cortex_stats_begin();
+
+	CORTEX_PROBE1(flush_start, sink->fmt);
+	fflush(sink->stream);
+	if (sink->cookie)
+		cortex_zip_sync(sink->cookie);
+	CORTEX_PROBE1(flush_end, sink->fmt);
+
+	cortex_stats_end(CORTEX_STATS_FLUSH, begin);
+}
+
+static int cortex_output_is_text(struct cortex_output_sink *sink)
+{
+	return sink->fmt >= 0 && !(sink->fmt & (CORTEX_OUTPUT_FMT_BIN |
+						CORTEX_OUTPUT_FMT_MDP |
+						CORTEX_OUTPUT_FMT_MIN));
+}
+
+/** \brief write the reports of all the sinks
+ * \param info the parsed core
+ * \param sinks the opened sinks, those with a negative format are unused
+ * \param nr_sinks number of entries in sinks
+ * \param ctx disassembly context size
+ *
+ * Text and json reports are written section by section in priority
+ * order, each section being flushed to every sink before the next one
+ * starts. Once the deadline expires no new section is started and the
+ * reports are terminated with a truncation marker. Binary outputs make
+ * no sense partially written: they are skipped after the deadline.
+ */
+void cortex_output_write_reports(struct cortex_proc_info *info,
+				 struct cortex_output_sink *sinks,
+				 int nr_sinks, int ctx)
+{
+	const struct cortex_output_section *section;
+	int sep[CORTEX_OUTPUT_SINK_MAX];
+	int truncated = 0;
+	unsigned int s;
+	int i;
+
+	for (i = 0; i < nr_sinks; i++) {
+		if (!cortex_output_is_text(&sinks[i]))
+			continue;
+
+		if (sinks[i].fmt & CORTEX_OUTPUT_FMT_JSN)
+			fprintf(sinks[i].stream, "{");
+		else
+			fprintf(sinks[i].stream,
+				"\n8<--------------------------------------------------------------------------\n");
+		sep[i] = 0;
+	}
+
+	for (s = 0; s < CORTEX_OUTPUT_NR_SECTIONS; s++) {
+		section = &cortex_output_sections[s];
+
+		for (i = 0; i < nr_sinks; i++) {
+			if (!cortex_output_is_text(&sinks[i]) ||
+			    !(sinks[i].fmt & section->fmt))
+				continue;
+
+			if (cortex_deadline_expired() && !section->always) {
+				truncated = 1;
+				break;
+			}
+
+			if (sinks[i].fmt & CORTEX_OUTPUT_FMT_JSN) {
+				fprintf(sinks[i].stream, sep[i] ? "," : "");
+				section->json(info, sinks[i].stream, ctx);
+				sep[i] = 1;
+			} else {
+				section->text(info, sinks[i].stream, ctx);
+			}
+
+			cortex_output_flush_sink(&sinks[i]);
+		}
+
+		if (truncated)
+			break;
+	}
+
+	for (i = 0; i < nr_sinks; i++) {
+		if (!cortex_output_is_text(&sinks[i]))
+			continue;
+
+		if (sinks[i].fmt & CORTEX_OUTPUT_FMT_JSN) {
+			if (truncated)
+				fprintf(sinks[i].stream, "%s\"truncated\":true",
+					sep[i] ? "," : "");
+			fprintf(sinks[i].stream, "}\n");
+		} else {
+			if (truncated)
+				fprintf(sinks[i].stream,
+					"[report truncated: deadline of %d ms expired]\n",
+					cortex_deadline_total());
+			fprintf(sinks[i].stream, "\n");
+		}
+	}
+
+	for (i = 0; i < nr_sinks; i++) {
+		long fmt = sinks[i].fmt;
+
+		if (fmt < 0 || cortex_output_is_text(&sinks[i]))
+			continue;
+
+		if (cortex_deadline_expired()) {
+			fprintf(stderr, "%s: deadline expired, not written\n",
+				sinks[i].dest);
+			continue;
+		}
+
+		if (fmt & CORTEX_OUTPUT_FMT_BIN)
+			cortex_output_write_elf_core(info, sinks[i].stream, fmt);
+		else if (fmt & CORTEX_OUTPUT_FMT_MDP)
+			cortex_mdmp_write(info, sinks[i].stream);
+		else
+			cortex_mini_write(info, sinks[i].stream, fmt);
 	}
 }
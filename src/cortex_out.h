@@ -22,9 +22,41 @@
  * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
 
-int cortex_output_set_format(char *fmt);
+#define CORTEX_OUTPUT_SINK_MAX	8
 
-void cortex_output_write_process(struct cortex_proc_info *info, FILE * output,
-				 int ctx);
+enum cortex_output_sink_type {
+	CORTEX_OUTPUT_SINK_STDOUT = 0,
+	CORTEX_OUTPUT_SINK_FILE,
+	CORTEX_OUTPUT_SINK_CMD,
+	CORTEX_OUTPUT_SINK_FD,
+};
+
+/** \struct cortex_output_sink
+ ** \brief one output destination
+ *
+ * Each sink has its own format and stream, so that a single parse
+ * of the core can feed several reports (text, stripped core, json).
+ */
+struct cortex_output_sink {
+	long fmt;		/*!< sections and kind of output */
+	int type;		/*!< stdout, file, command or file descriptor */
+	char *dest;		/*!< file path, command or fd number */
+	FILE *stream;		/*!< opened output stream */
+	int zip;		/*!< compression method, see cortex_zip.h */
+	int level;		/*!< compression level, -1 for default */
+	FILE *raw;		/*!< underlying stream when compressing */
+	char *tmp;		/*!< temporary file renamed to dest on close */
+	struct cortex_zip *cookie;	/*!< compressor behind stream, or NULL */
+};
+
+long cortex_output_parse_format(char *fmt);
+
+int cortex_output_parse_sink(struct cortex_output_sink *sink, char *spec);
+int cortex_output_open_sink(struct cortex_output_sink *sink);
+int cortex_output_close_sink(struct cortex_output_sink *sink);
+
+void cortex_output_write_reports(struct cortex_proc_info *info,
+				 struct cortex_output_sink *sinks,
+				 int nr_sinks, int ctx);
 
 #endif /* _CORTEX_OUT_H_ */
@@ -0,0 +1,129 @@
+#ifndef _CORTEX_PROBE_H_
+#define _CORTEX_PROBE_H_
+
+/** \file cortex_probe.h
+ * \brief cortex static tracepoints
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * USDT probes of the "cortex" provider, for perf, bpftrace or systemtap:
+ *
+ *   bpftrace -e 'usdt:/usr/bin/cortex:fetch_end { @[arg1] = count(); }'
+ *
+ * A probe is a nop in the code and a .note.stapsdt entry describing where
+ * its arguments live. Nothing runs unless a tracer replaces the nop with
+ * a breakpoint. <sys/sdt.h> is used when available, otherwise the same
+ * notes are emitted here on x86. Build with -DCORTEX_NO_PROBES to drop
+ * them altogether.
+ *
+ * Arguments are passed as unsigned longs.
+ */
+
+#include "config.h"
+
+#if defined(CORTEX_NO_PROBES)
+
+#define CORTEX_PROBE(name)			do { } while (0)
+#define CORTEX_PROBE1(name, a)			do { } while (0)
+#define CORTEX_PROBE2(name, a, b)		do { } while (0)
+#define CORTEX_PROBE3(name, a, b, c)		do { } while (0)
+
+#elif defined(HAVE_SYS_SDT_H)
+
+#include <sys/sdt.h>
+
+#define CORTEX_PROBE(name) \
+	DTRACE_PROBE(cortex, name)
+#define CORTEX_PROBE1(name, a) \
+	DTRACE_PROBE1(cortex, name, (unsigned long)(a))
+#define CORTEX_PROBE2(name, a, b) \
+	DTRACE_PROBE2(cortex, name, (unsigned long)(a), (unsigned long)(b))
+#define CORTEX_PROBE3(name, a, b, c) \
+	DTRACE_PROBE3(cortex, name, (unsigned long)(a), (unsigned long)(b), \
+		      (unsigned long)(c))
+
+#elif defined(__x86_64__) || defined(__i386__)
+
+#if defined(__x86_64__)
+#define __CORTEX_PROBE_ADDR	".8byte"
+#define __CORTEX_PROBE_ARG(n)	"8@%" #n
+#else
+#define __CORTEX_PROBE_ADDR	".4byte"
+#define __CORTEX_PROBE_ARG(n)	"4@%" #n
+#endif
+
+/* the stapsdt note: probe address, link time base to detect prelink,
+ * no semaphore, provider, name and argument locations. The base symbol
+ * is emitted once per object and merged by the linker */
+#define __CORTEX_PROBE_ASM(name, args)					\
+	"990:	nop\n"							\
+	"	.pushsection .note.stapsdt,\"?\",\"note\"\n"		\
+	"	.balign 4\n"						\
+	"	.4byte 992f-991f, 994f-993f, 3\n"			\
+	"991:	.asciz \"stapsdt\"\n"					\
+	"992:	.balign 4\n"						\
+	"993:	" __CORTEX_PROBE_ADDR " 990b\n"				\
+	"	" __CORTEX_PROBE_ADDR " _.stapsdt.base\n"		\
+	"	" __CORTEX_PROBE_ADDR " 0\n"				\
+	"	.asciz \"cortex\"\n"					\
+	"	.asciz \"" #name "\"\n"					\
+	"	.asciz \"" args "\"\n"					\
+	"994:	.balign 4\n"						\
+	"	.popsection\n"						\
+	"	.ifndef _.stapsdt.base\n"				\
+	"	.pushsection .stapsdt.base,\"aG\",\"progbits\","	\
+	".stapsdt.base,comdat\n"					\
+	"	.weak _.stapsdt.base\n"					\
+	"	.hidden _.stapsdt.base\n"				\
+	"_.stapsdt.base:\n"						\
+	"	.space 1\n"						\
+	"	.size _.stapsdt.base, 1\n"				\
+	"	.popsection\n"						\
+	"	.endif\n"
+
+#define CORTEX_PROBE(name)						\
+	__asm__ __volatile__(__CORTEX_PROBE_ASM(name, ""))
+
+#define CORTEX_PROBE1(name, a)						\
+	__asm__ __volatile__(__CORTEX_PROBE_ASM(name,			\
+		__CORTEX_PROBE_ARG(0))					\
+		:: "nor" ((unsigned long)(a)))
+
+#define CORTEX_PROBE2(name, a, b)					\
+	__asm__ __volatile__(__CORTEX_PROBE_ASM(name,			\
+		__CORTEX_PROBE_ARG(0) " " __CORTEX_PROBE_ARG(1))	\
+		:: "nor" ((unsigned long)(a)), "nor" ((unsigned long)(b)))
+
+#define CORTEX_PROBE3(name, a, b, c)					\
+	__asm__ __volatile__(__CORTEX_PROBE_ASM(name,			\
+		__CORTEX_PROBE_ARG(0) " " __CORTEX_PROBE_ARG(1) " "	\
+		__CORTEX_PROBE_ARG(2))					\
+		:: "nor" ((unsigned long)(a)), "nor" ((unsigned long)(b)), \
+		   "nor" ((unsigned long)(c)))
+
+#else
+
+#define CORTEX_PROBE(name)			do { } while (0)
+#define CORTEX_PROBE1(name, a)			do { } while (0)
+#define CORTEX_PROBE2(name, a, b)		do { } while (0)
+#define CORTEX_PROBE3(name, a, b, c)		do { } while (0)
+
+#endif
+
+#endif /* _CORTEX_PROBE_H_ */
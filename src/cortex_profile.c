@@ -0,0 +1,811 @@
+/** \file cortex_profile.c
+ * \brief cortex sampling profiler
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ptrace.h>
+#include <sys/procfs.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include "cortex.h"
+#include "cortex_elf.h"
+#include "cortex_mem.h"
+#include "cortex_stats.h"
+#include "cortex_unwind.h"
+#include "cortex_attach.h"
+#include "cortex_profile.h"
+#include "arch/cortex_arch.h"
+
+/*
+ * A sampling profiler for the targets perf does not run on. The
+ * threads of the process are seized once, new ones included through
+ * PTRACE_O_TRACECLONE. At each tick they are all interrupted, have their
+ * registers and the top of their stack read, and are let go together.
+ * Their frame pointers are then followed in the copies of their stacks
+ * by the unwinder of the backend, while they run again. Seizing and
+ * detaching at each tick, as a snapshot does, would cost ten times
+ * more to the process.
+ *
+ * The other stops of the threads (signals, new threads, group stops)
+ * are handled between the ticks as soon as they are reported, through
+ * SIGCHLD: the process is not held until the next tick.
+ *
+ * The call traces are counted in an open addressing table sized from
+ * the memory budget, and the threads are kept in a table sized from
+ * their number when the profile starts: nothing is allocated once
+ * sampling has started. The threads that do not fit are let go and
+ * counted as lost. The stack copies of a tick share one buffer, also
+ * sized when the profile starts: when there are more threads than it
+ * has room for at CORTEX_PROFILE_STACK, less of each stack is read.
+ * They are written in the folded format of the flame graph tools, one
+ * line per call trace, the frames named after the file they are mapped
+ * from and their offset in it.
+ */
+
+/* the stack read at each sample, from the stack pointer up */
+#define CORTEX_PROFILE_STACK	CORTEX_WINDOW_STACK
+#define CORTEX_PROFILE_PAGES	(CORTEX_PROFILE_STACK / 4096 + 2)
+/* room for the threads started during the profile */
+#define CORTEX_PROFILE_THREADS	64
+
+/** \struct cortex_profile_trace
+ ** \brief a distinct call trace and how often it was seen
+ */
+struct cortex_profile_trace {
+	uint64_t hash;
+	unsigned long count;	/*!< samples, 0 for a free slot */
+	int nr_frames;
+	size_t pcs;		/*!< its frames in the pc pool, innermost first */
+};
+
+/** \struct cortex_profile_thread
+ ** \brief a thread of the process, seized
+ */
+struct cortex_profile_thread {
+	int tid;
+	int signal;		/*!< to deliver when it is resumed */
+	int listen;		/*!< in a group stop: resumed with PTRACE_LISTEN */
+	int gone;		/*!< exited */
+
+	/* read at the last tick, unwound once every thread runs again */
+	int stopped;		/*!< interrupted, not resumed yet */
+	int sampled;
+	ElfN_Addr sp;
+	size_t stack_len;	/*!< bytes of its slice of the stack buffer */
+	ElfN_Addr pr_reg[CORTEX_GREGS_MAX];
+};
+
+/** \struct cortex_profile
+ ** \brief one profile
+ */
+struct cortex_profile {
+	int pid;
+	size_t page_size;
+
+	int nr_threads;
+	int max_threads;	/*!< room in threads */
+	struct cortex_profile_thread *threads;
+
+	/* the process as the unwinders see it: the sampled thread and
+	   the copy of its stack */
+	struct cortex_proc_info info;
+	struct cortex_elf elf;
+	struct cortex_prstatus prstatus;
+	struct cortex_elf_data stack;
+	ElfN_Phdr stack_segm;
+	struct cortex_stack_frame *frames;
+	struct iovec remote[CORTEX_PROFILE_PAGES];
+
+	unsigned char *stacks;	/*!< the stack copies of a tick */
+	size_t stacks_size;
+
+	size_t nr_slots;	/*!< a power of two */
+	size_t nr_traces;
+	struct cortex_profile_trace *traces;
+
+	size_t nr_pcs;
+	size_t max_pcs;
+	ElfN_Addr *pcs;
+
+	unsigned long samples;	/*!< ticks the process was sampled at */
+	unsigned long hits;	/*!< call traces counted */
+	unsigned long lost;	/*!< call traces the tables had no room for */
+	unsigned long lost_threads;	/*!< threads the table had no room for */
+	uint64_t stopped_ns;	/*!< time from the interrupts to the resumes */
+};
+
+static volatile sig_atomic_t cortex_profile_interrupted;
+
+static void cortex_profile_interrupt(int signum)
+{
+	cortex_profile_interrupted = 1;
+}
+
+static int cortex_profile_find(struct cortex_profile *profile, int tid)
+{
+	int i;
+
+	for (i = 0; i < profile->nr_threads; i++)
+		if (profile->threads[i].tid == tid)
+			return i;
+
+	return -1;
+}
+
+/* return the index of the new thread, -1 if the table is full */
+static int cortex_profile_add(struct cortex_profile *profile, int tid)
+{
+	struct cortex_profile_thread *thread;
+
+	if (profile->nr_threads == profile->max_threads)
+		return -1;
+
+	thread = &profile->threads[profile->nr_threads];
+	memset(thread, 0, sizeof(*thread));
+	thread->tid = tid;
+
+	return profile->nr_threads++;
+}
+
+static void cortex_profile_drop_gone(struct cortex_profile *profile)
+{
+	int i, nr = 0;
+
+	for (i = 0; i < profile->nr_threads; i++)
+		if (!profile->threads[i].gone)
+			profile->threads[nr++] = profile->threads[i];
+	profile->nr_threads = nr;
+}
+
+/* seize every thread, those started meanwhile included */
+static int cortex_profile_seize(struct cortex_profile *profile)
+{
+	struct dirent *entry;
+	char path[64];
+	int found = 1;
+	DIR *tasks;
+	int tid;
+
+	snprintf(path, sizeof(path), "/proc/%d/task", profile->pid);
+
+	while (found) {
+		found = 0;
+		/* each pass sees all of those left out */
+		profile->lost_threads = 0;
+
+		tasks = opendir(path);
+		if (tasks == NULL) {
+			perror(path);
+			return -1;
+		}
+
+		while ((entry = readdir(tasks))) {
+			tid = atoi(entry->d_name);
+			if (tid <= 0 || cortex_profile_find(profile, tid) >= 0)
+				continue;
+
+			if (profile->nr_threads == profile->max_threads) {
+				profile->lost_threads++;
+				continue;
+			}
+
+			if (ptrace(PTRACE_SEIZE, tid, 0,
+				   PTRACE_O_TRACECLONE) < 0) {
+				/* gone already */
+				if (errno == ESRCH)
+					continue;
+				fprintf(stderr, "%d: cannot attach: %s\n", tid,
+					strerror(errno));
+				closedir(tasks);
+				return -1;
+			}
+
+			cortex_profile_add(profile, tid);
+			found = 1;
+		}
+
+		closedir(tasks);
+	}
+
+	return profile->nr_threads ? 0 : -1;
+}
+
+static void cortex_profile_resume(struct cortex_profile_thread *thread)
+{
+	if (thread->listen)
+		ptrace(PTRACE_LISTEN, thread->tid, 0, 0);
+	else
+		ptrace(PTRACE_CONT, thread->tid, 0, thread->signal);
+	thread->signal = 0;
+}
+
+/* a stop or an exit reported for a thread: return 1 if it stopped for
+   a sample and is to be read, 0 if it was resumed or exited */
+static int cortex_profile_event(struct cortex_profile *profile, int tid,
+				int status, int sampling)
+{
+	struct cortex_profile_thread *thread;
+	unsigned long msg;
+	int i = cortex_profile_find(profile, tid);
+
+	/* the first stop of a new thread may come before the event of
+	   its creation. Without room for it, it is let go */
+	if (i < 0 && WIFSTOPPED(status)) {
+		i = cortex_profile_add(profile, tid);
+		if (i < 0) {
+			ptrace(PTRACE_DETACH, tid, 0, 0);
+			profile->lost_threads++;
+		}
+	}
+	if (i < 0)
+		return 0;
+	thread = &profile->threads[i];
+
+	if (!WIFSTOPPED(status)) {
+		thread->gone = 1;
+		return 0;
+	}
+
+	switch (status >> 16) {
+	case PTRACE_EVENT_CLONE:
+		if (ptrace(PTRACE_GETEVENTMSG, tid, 0, &msg) == 0 &&
+		    cortex_profile_find(profile, msg) < 0)
+			cortex_profile_add(profile, msg);
+		thread->listen = 0;
+		break;
+	case PTRACE_EVENT_STOP:
+		/* a group stop, or the interrupt of a sample */
+		switch (WSTOPSIG(status)) {
+		case SIGSTOP:
+		case SIGTSTP:
+		case SIGTTIN:
+		case SIGTTOU:
+			thread->listen = 1;
+			cortex_profile_resume(thread);
+			return 0;
+		}
+		thread->listen = 0;
+		break;
+	default:
+		/* a signal: delivered when the thread is resumed */
+		thread->signal = WSTOPSIG(status);
+		thread->listen = 0;
+		break;
+	}
+
+	if (sampling)
+		return 1;
+
+	cortex_profile_resume(thread);
+	return 0;
+}
+
+/* until the next tick, handle the stops reported meanwhile */
+static void cortex_profile_wait(struct cortex_profile *profile,
+				uint64_t until, const sigset_t * sigchld)
+{
+	struct timespec timeout;
+	uint64_t now;
+	int status;
+	int tid;
+
+	while (!cortex_profile_interrupted) {
+		while ((tid = waitpid(-1, &status, __WALL | WNOHANG)) > 0)
+			cortex_profile_event(profile, tid, status, 0);
+		cortex_profile_drop_gone(profile);
+
+		now = cortex_stats_now();
+		if (now >= until || profile->nr_threads == 0)
+			break;
+
+		timeout.tv_sec = (until - now) / 1000000000ULL;
+		timeout.tv_nsec = (until - now) % 1000000000ULL;
+		if (sigtimedwait(sigchld, NULL, &timeout) < 0 &&
+		    errno == EAGAIN)
+			break;
+	}
+}
+
+/* let the process go for good, with the signals it was sent */
+static void cortex_profile_release(struct cortex_profile *profile)
+{
+	struct cortex_profile_thread *thread;
+	int status;
+	int i;
+
+	for (i = 0; i < profile->nr_threads; i++)
+		ptrace(PTRACE_INTERRUPT, profile->threads[i].tid, 0, 0);
+
+	for (i = 0; i < profile->nr_threads; i++) {
+		thread = &profile->threads[i];
+		if (waitpid(thread->tid, &status, __WALL) < 0 ||
+		    !WIFSTOPPED(status))
+			continue;
+		if (status >> 16 == 0)
+			thread->signal = WSTOPSIG(status);
+		ptrace(PTRACE_DETACH, thread->tid, 0, thread->signal);
+	}
+}
+
+static uint64_t cortex_profile_hash(const struct cortex_stack_frame *frames,
+				    int nr)
+{
+	uint64_t hash = nr;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		hash = (hash ^ frames[i].pc) * 0x9E3779B97F4A7C15ULL;
+		hash ^= hash >> 32;
+	}
+
+	return hash;
+}
+
+/* count one call trace */
+static void cortex_profile_count(struct cortex_profile *profile, int nr)
+{
+	uint64_t hash = cortex_profile_hash(profile->frames, nr);
+	size_t pos = hash & (profile->nr_slots - 1);
+	struct cortex_profile_trace *trace;
+	int i;
+
+	for (;; pos = (pos + 1) & (profile->nr_slots - 1)) {
+		trace = &profile->traces[pos];
+		if (trace->count == 0)
+			break;
+		if (trace->hash != hash || trace->nr_frames != nr)
+			continue;
+		for (i = 0; i < nr; i++)
+			if (profile->pcs[trace->pcs + i] != profile->frames[i].pc)
+				break;
+		if (i == nr) {
+			trace->count++;
+			profile->hits++;
+			return;
+		}
+	}
+
+	/* the table is kept at most 3/4 full */
+	if (4 * (profile->nr_traces + 1) > 3 * profile->nr_slots ||
+	    profile->nr_pcs + nr > profile->max_pcs) {
+		profile->lost++;
+		return;
+	}
+
+	trace->hash = hash;
+	trace->count = 1;
+	trace->nr_frames = nr;
+	trace->pcs = profile->nr_pcs;
+	for (i = 0; i < nr; i++)
+		profile->pcs[profile->nr_pcs++] = profile->frames[i].pc;
+	profile->nr_traces++;
+	profile->hits++;
+}
+
+/* the registers and the top of the stack of a stopped thread, up to
+   size bytes of it in buf */
+static int cortex_profile_read(struct cortex_profile *profile,
+			       struct cortex_profile_thread *thread,
+			       unsigned char *buf, size_t size)
+{
+	struct cortex_cpu_regs cpu_regs[CORTEX_CPU_REGS_MAX];
+	const struct cortex_arch_ops *arch = profile->info.arch;
+	elf_gregset_t gregs;
+	struct iovec local;
+	ElfN_Addr sp, addr;
+	ssize_t len;
+	int nr = 0;
+	int i;
+
+	local.iov_base = &gregs;
+	local.iov_len = sizeof(gregs);
+	if (ptrace(PTRACE_GETREGSET, thread->tid, NT_PRSTATUS, &local) < 0)
+		return -1;
+
+	for (i = 0; i < arch->nr_gregs; i++)
+		thread->pr_reg[i] = ((unsigned long *)&gregs)[i];
+	arch->fill_regs(cpu_regs, thread->pr_reg);
+	sp = arch->get_sp(cpu_regs);
+
+	/* one remote vector per page: the read stops at the first page
+	   that is not mapped, the end of the stack */
+	for (addr = sp; addr < sp + size; nr++) {
+		ElfN_Addr end = (addr | (profile->page_size - 1)) + 1;
+
+		if (end > sp + size)
+			end = sp + size;
+		profile->remote[nr].iov_base = (void *)addr;
+		profile->remote[nr].iov_len = end - addr;
+		addr = end;
+	}
+
+	local.iov_base = buf;
+	local.iov_len = size;
+	len = process_vm_readv(profile->pid, &local, 1, profile->remote, nr, 0);
+
+	thread->sp = sp;
+	thread->stack_len = len > 0 ? len : 0;
+
+	return 0;
+}
+
+/* the call trace of a thread read at this tick, from its copy */
+static void cortex_profile_unwind(struct cortex_profile *profile,
+				  struct cortex_profile_thread *thread,
+				  unsigned char *buf)
+{
+	int stop, nr;
+
+	memcpy(profile->prstatus.pr_reg, thread->pr_reg,
+	       sizeof(thread->pr_reg));
+	profile->stack.d_buf = buf;
+	profile->stack.d_size = thread->stack_len;
+	profile->stack_segm.p_vaddr = thread->sp;
+
+	nr = cortex_unwind_walk(&profile->info, 0, profile->frames, &stop);
+	cortex_profile_count(profile, nr);
+}
+
+/* one tick: sample every thread */
+static int cortex_profile_sample(struct cortex_profile *profile)
+{
+	struct cortex_profile_thread *thread;
+	uint64_t begin, stop;
+	int nr_threads = profile->nr_threads;
+	size_t slice;
+	int status;
+	int i;
+
+	/* each thread gets an equal part of the stack buffer */
+	slice = profile->stacks_size / nr_threads;
+	if (slice > CORTEX_PROFILE_STACK)
+		slice = CORTEX_PROFILE_STACK;
+	slice &= ~(size_t)(sizeof(ElfN_Addr) - 1);
+
+	begin = cortex_stats_now();
+	stop = cortex_stats_begin();
+
+	for (i = 0; i < nr_threads; i++)
+		ptrace(PTRACE_INTERRUPT, profile->threads[i].tid, 0, 0);
+
+	/* the threads created meanwhile are sampled at the next tick */
+	for (i = 0; i < nr_threads; i++) {
+		thread = &profile->threads[i];
+		thread->stopped = 0;
+		thread->sampled = 0;
+
+		if (waitpid(thread->tid, &status, __WALL) < 0) {
+			thread->gone = 1;
+			continue;
+		}
+		thread->stopped = cortex_profile_event(profile, thread->tid,
+						       status, 1);
+		if (!thread->stopped)
+			continue;
+
+		thread->sampled = cortex_profile_read(profile, thread,
+						      profile->stacks +
+						      i * slice, slice) == 0;
+	}
+
+	/* all of them are read before any runs again */
+	for (i = 0; i < nr_threads; i++) {
+		thread = &profile->threads[i];
+		if (thread->stopped)
+			cortex_profile_resume(thread);
+		thread->stopped = 0;
+	}
+
+	cortex_stats_end(CORTEX_STATS_ATTACH, stop);
+	profile->stopped_ns += cortex_stats_now() - begin;
+	profile->samples++;
+
+	/* the process runs again, the copies are unwound */
+	for (i = 0; i < nr_threads; i++) {
+		thread = &profile->threads[i];
+		if (thread->sampled)
+			cortex_profile_unwind(profile, thread,
+					      profile->stacks + i * slice);
+	}
+
+	cortex_profile_drop_gone(profile);
+
+	return profile->nr_threads ? 0 : -1;
+}
+
+/* a frame, as its file and its offset in it */
+static void cortex_profile_write_frame(struct cortex_profile *profile,
+				       struct cortex_attach_maps *maps,
+				       ElfN_Addr pc, FILE * output)
+{
+	int i = cortex_attach_find_vma(maps, pc);
+	const char *name;
+
+	if (i < 0 || maps->vmas[i].name == NULL) {
+		fprintf(output, "0x%lx", (unsigned long)pc);
+		return;
+	}
+
+	name = strrchr(maps->vmas[i].name, '/');
+	name = name ? name + 1 : maps->vmas[i].name;
+	fprintf(output, "%s+0x%lx", name, (unsigned long)(pc -
+		maps->vmas[i].start + maps->vmas[i].pgoff * profile->page_size));
+}
+
+/* the folded stacks: the process name, the frames outermost first and
+   the count */
+static void cortex_profile_write(struct cortex_profile *profile,
+				 struct cortex_attach_maps *maps,
+				 const char *comm, FILE * output)
+{
+	struct cortex_profile_trace *trace;
+	size_t i;
+	int f;
+
+	for (i = 0; i < profile->nr_slots; i++) {
+		trace = &profile->traces[i];
+		if (trace->count == 0)
+			continue;
+
+		fputs(comm, output);
+		for (f = trace->nr_frames - 1; f >= 0; f--) {
+			fputc(';', output);
+			cortex_profile_write_frame(profile, maps,
+						   profile->pcs[trace->pcs + f],
+						   output);
+		}
+		fprintf(output, " %lu\n", trace->count);
+	}
+
+	if (profile->lost)
+		fprintf(output, "%s;[lost] %lu\n", comm, profile->lost);
+}
+
+/* the threads of the process, 0 if they cannot be read: seizing them
+   will tell why */
+static int cortex_profile_count_tasks(int pid)
+{
+	struct dirent *entry;
+	char path[64];
+	DIR *tasks;
+	int nr = 0;
+
+	snprintf(path, sizeof(path), "/proc/%d/task", pid);
+	tasks = opendir(path);
+	if (tasks == NULL)
+		return 0;
+
+	while ((entry = readdir(tasks)))
+		if (atoi(entry->d_name) > 0)
+			nr++;
+	closedir(tasks);
+
+	return nr;
+}
+
+/* the tables take what the memory budget leaves */
+static int cortex_profile_alloc(struct cortex_profile *profile)
+{
+	struct cortex_mem_stats stats;
+	size_t room;
+
+	int nr_tasks = cortex_profile_count_tasks(profile->pid);
+
+	profile->max_threads = 2 * nr_tasks + CORTEX_PROFILE_THREADS;
+
+	profile->threads = cortex_mem_alloc(profile->max_threads *
+					    sizeof(*profile->threads));
+	profile->frames = cortex_mem_alloc(STACK_FRAME_MAX *
+					   sizeof(*profile->frames));
+	if (!profile->threads || !profile->frames)
+		return -1;
+
+	/* some room is left to the unwinders of the backends */
+	cortex_mem_get_stats(&stats);
+	if (stats.budget < stats.used + 64 * 1024)
+		return -1;
+	room = stats.budget - stats.used - 64 * 1024;
+
+	/* a whole stack window per thread of the start, if a quarter of
+	   the room allows it */
+	profile->stacks_size = (nr_tasks ? nr_tasks : 1) * CORTEX_PROFILE_STACK;
+	if (profile->stacks_size > room / 4)
+		profile->stacks_size = room / 4 > CORTEX_PROFILE_STACK ?
+		    room / 4 : CORTEX_PROFILE_STACK;
+	if (profile->stacks_size + 4096 > room)
+		return -1;
+	profile->stacks = cortex_mem_alloc(profile->stacks_size);
+	if (profile->stacks == NULL)
+		return -1;
+	room -= profile->stacks_size + 4096;
+
+	profile->nr_slots = 1024;
+	while (profile->nr_slots * 2 * sizeof(*profile->traces) <= room / 4)
+		profile->nr_slots *= 2;
+
+	profile->traces = cortex_mem_calloc(profile->nr_slots,
+					    sizeof(*profile->traces));
+	if (profile->traces == NULL)
+		return -1;
+	room -= profile->nr_slots * sizeof(*profile->traces) + 4096;
+
+	/* and half of the rest to the mappings read at the end */
+	profile->max_pcs = room / 2 / sizeof(ElfN_Addr);
+	profile->pcs = cortex_mem_alloc(profile->max_pcs * sizeof(ElfN_Addr));
+
+	return profile->pcs ? 0 : -1;
+}
+
+/** \brief cpu time used by cortex so far, in ns */
+static uint64_t cortex_profile_cpu(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ULL +
+	    (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ULL;
+}
+
+/** \brief sample the call traces of a running process
+ * \param hz samples per second
+ * \param duration in s. SIGINT or SIGTERM end the profile earlier.
+ * \param output where to write the folded stacks
+ * \return 0 on success, -1 if the process cannot be profiled
+ *
+ * The tables are allocated in the memory arena of the caller, before
+ * the first sample. The time the process is stopped and the cpu used
+ * by cortex are summed up on stderr: on a loaded cpu, the threads wait
+ * for it once interrupted, and the stopped time exceeds what the
+ * samples cost.
+ */
+int cortex_profile(int pid, int hz, int duration, FILE * output)
+{
+	struct cortex_profile profile;
+	struct cortex_attach_maps maps = { 0, NULL };
+	struct sigaction action, old_int, old_term;
+	sigset_t sigchld, old_mask;
+	uint64_t period, begin = 0, end = 0, now, cpu = 0;
+	char path[64];
+	char comm[32] = "";
+	FILE *file;
+	int ret = -1;
+
+	memset(&profile, 0, sizeof(profile));
+	profile.pid = pid;
+	profile.page_size = sysconf(_SC_PAGESIZE);
+
+	profile.info.arch = cortex_attach_arch(pid);
+	if (profile.info.arch == NULL)
+		return -1;
+	profile.info.pid = pid;
+	profile.info.word_size = profile.info.arch->word_size;
+	profile.info.nr_threads = 1;
+	profile.info.threads = &profile.prstatus;
+	profile.info.elf = &profile.elf;
+	profile.info.stack = &profile.stack;
+	profile.info.sp_segm = &profile.stack_segm;
+
+	if (!profile.info.arch->unwind_init ||
+	    !profile.info.arch->unwind_next) {
+		fprintf(stderr, "%s: cannot unwind\n",
+			profile.info.arch->name);
+		return -1;
+	}
+
+	if (hz <= 0 || duration <= 0) {
+		fprintf(stderr, "invalid sampling frequency or duration\n");
+		return -1;
+	}
+
+	if (cortex_profile_alloc(&profile) < 0) {
+		fprintf(stderr, "%s: out of memory\n", __FILE__);
+		goto out;
+	}
+
+	snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+	file = fopen(path, "r");
+	if (file) {
+		if (fgets(comm, sizeof(comm), file))
+			comm[strcspn(comm, "\n")] = '\0';
+		fclose(file);
+	}
+	/* ';' and ' ' separate the fields of the folded format */
+	for (ret = 0; comm[ret]; ret++)
+		if (comm[ret] == ';' || comm[ret] == ' ')
+			comm[ret] = '_';
+	ret = -1;
+
+	/* the stops of the threads are reported by SIGCHLD, waited for
+	   between the ticks */
+	sigemptyset(&sigchld);
+	sigaddset(&sigchld, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &sigchld, &old_mask);
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = cortex_profile_interrupt;
+	sigaction(SIGINT, &action, &old_int);
+	sigaction(SIGTERM, &action, &old_term);
+
+	if (cortex_profile_seize(&profile) == 0) {
+		period = 1000000000ULL / hz;
+		begin = cortex_stats_now();
+		cpu = cortex_profile_cpu();
+		end = begin + duration * 1000000000ULL;
+
+		for (now = begin; now < end && !cortex_profile_interrupted;
+		     now += period) {
+			if (cortex_profile_sample(&profile) < 0)
+				break;
+			cortex_profile_wait(&profile, now + period, &sigchld);
+		}
+		end = cortex_stats_now();
+		cpu = cortex_profile_cpu() - cpu;
+	}
+	cortex_profile_release(&profile);
+
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+	sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+	if (profile.samples == 0) {
+		fprintf(stderr, "%d: cannot be profiled\n", pid);
+		goto out;
+	}
+
+	/* name the frames after the mappings of the end of the profile,
+	   the process may have exited */
+	if (cortex_attach_read_maps(pid, &maps) < 0)
+		maps.nr_vmas = 0;
+	cortex_profile_write(&profile, &maps, comm, output);
+	cortex_attach_free_maps(&maps);
+
+	fprintf(stderr, "profile: %lu samples of %s<%d> in %.3f s, %lu "
+		"call traces, %lu distinct, %lu lost\n", profile.samples,
+		comm, pid, (end - begin) / 1e9, profile.hits,
+		(unsigned long)profile.nr_traces, profile.lost);
+	if (profile.lost_threads)
+		fprintf(stderr, "profile: %lu threads lost, the thread table "
+			"was full\n", profile.lost_threads);
+	fprintf(stderr, "profile: process stopped %.3f ms per sample, "
+		"%.3f%% of the time, cortex used %.3f%% of a cpu\n",
+		profile.stopped_ns / 1e6 / profile.samples,
+		100.0 * profile.stopped_ns / (end - begin),
+		100.0 * cpu / (end - begin));
+
+	ret = ferror(output) ? -1 : 0;
+
+out:
+	cortex_mem_free(profile.pcs);
+	cortex_mem_free(profile.traces);
+	cortex_mem_free(profile.stacks);
+	cortex_mem_free(profile.frames);
+	cortex_mem_free(profile.threads);
+
+	return ret;
+}
@@ -0,0 +1,33 @@
+#ifndef _CORTEX_PROFILE_H_
+#define _CORTEX_PROFILE_H_
+
+/** \file cortex_profile.h
+ * \brief cortex sampling profiler
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+
+/** \brief default sampling frequency, in Hz */
+#define CORTEX_PROFILE_HZ		99
+/** \brief default profile duration, in s */
+#define CORTEX_PROFILE_DURATION		10
+
+int cortex_profile(int pid, int hz, int duration, FILE * output);
+
+#endif /* _CORTEX_PROFILE_H_ */
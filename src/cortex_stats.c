@@ -0,0 +1,125 @@
+/** \file cortex_stats.c
+ * \brief cortex phase timing and resource statistics
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "cortex_mem.h"
+#include "cortex_stats.h"
+
+/* each thread measures the analysis it runs */
+__thread int cortex_stats_on;
+__thread struct cortex_stats cortex_stats;
+
+static const char *cortex_stats_names[CORTEX_STATS_NR] = {
+	[CORTEX_STATS_INPUT] = "input",
+	[CORTEX_STATS_PARSE] = "parse",
+	[CORTEX_STATS_PROBES] = "probes",
+	[CORTEX_STATS_OPEN] = "open",
+	[CORTEX_STATS_REPORT] = "report",
+	[CORTEX_STATS_CLOSE] = "close",
+	[CORTEX_STATS_HEADERS] = "headers",
+	[CORTEX_STATS_NOTES] = "notes",
+	[CORTEX_STATS_MEMORY] = "memory",
+	[CORTEX_STATS_READ] = "read",
+	[CORTEX_STATS_SKIP] = "skip",
+	[CORTEX_STATS_UNWIND] = "unwind",
+	[CORTEX_STATS_DISASM] = "disassemble",
+	[CORTEX_STATS_FLUSH] = "flush",
+	[CORTEX_STATS_ANALYZE] = "analyze",
+	[CORTEX_STATS_ATTACH] = "attach",
+	[CORTEX_STATS_FETCH] = "fetch",
+};
+
+/** \brief monotonic time in ns */
+uint64_t cortex_stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** \brief turn the statistics on for the calling thread, the run starts now */
+void cortex_stats_start(void)
+{
+	memset(&cortex_stats, 0, sizeof(cortex_stats));
+	cortex_stats_on = 1;
+	cortex_stats.start = cortex_stats_now();
+}
+
+static double cortex_stats_ms(uint64_t ns)
+{
+	return ns / 1000000.0;
+}
+
+/** \brief write the statistics as a single json line
+ * \param dest file to write, or "-" for stderr
+ * \return 0 on success, -1 on error
+ */
+int cortex_stats_write(const char *dest)
+{
+	struct cortex_mem_stats mem;
+	struct rusage usage;
+	FILE *output = stderr;
+	int ret = 0;
+	int i;
+
+	if (!cortex_stats_on)
+		return 0;
+
+	if (strcmp(dest, "-") != 0) {
+		output = fopen(dest, "w");
+		if (output == NULL) {
+			perror(dest);
+			return -1;
+		}
+	}
+
+	cortex_mem_get_stats(&mem);
+	getrusage(RUSAGE_SELF, &usage);
+
+	fprintf(output, "{\"total_ms\":%.3f,\"timers\":{",
+		cortex_stats_ms(cortex_stats_now() - cortex_stats.start));
+	for (i = 0; i < CORTEX_STATS_NR; i++)
+		fprintf(output, "%s\"%s\":{\"ms\":%.3f,\"count\":%ld}",
+			i ? "," : "", cortex_stats_names[i],
+			cortex_stats_ms(cortex_stats.ns[i]),
+			cortex_stats.count[i]);
+	fprintf(output, "},\"bytes_read\":%llu,\"bytes_skipped\":%llu,"
+		"\"read_calls\":%ld,\"allocations\":%ld,\"alloc_refused\":%ld,"
+		"\"alloc_peak\":%zu,\"maxrss_kb\":%ld,\"utime_ms\":%.3f,"
+		"\"stime_ms\":%.3f}\n",
+		(unsigned long long)cortex_stats.bytes_read,
+		(unsigned long long)cortex_stats.bytes_skipped,
+		cortex_stats.read_calls, mem.allocs, mem.failed, mem.peak,
+		usage.ru_maxrss,
+		usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0,
+		usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0);
+
+	if (ferror(output))
+		ret = -1;
+	if (output != stderr && fclose(output) != 0)
+		ret = -1;
+
+	return ret;
+}
@@ -0,0 +1,99 @@
+#ifndef _CORTEX_STATS_H_
+#define _CORTEX_STATS_H_
+
+/** \file cortex_stats.h
+ * \brief cortex phase timing and resource statistics
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdint.h>
+
+/** \brief timers. The first ones are the phases of main, run one after
+ * the other, the others add up the time spent in a given operation */
+enum cortex_stats_timer {
+	CORTEX_STATS_INPUT = 0,	/*!< waiting for the first byte of the core */
+	CORTEX_STATS_PARSE,	/*!< headers, notes and memory of the core */
+	CORTEX_STATS_PROBES,	/*!< waiting for the system context probes */
+	CORTEX_STATS_OPEN,	/*!< opening the outputs */
+	CORTEX_STATS_REPORT,	/*!< writing the reports */
+	CORTEX_STATS_CLOSE,	/*!< closing the outputs */
+	CORTEX_STATS_HEADERS,	/*!< reading the elf and program headers */
+	CORTEX_STATS_NOTES,	/*!< reading and parsing the notes */
+	CORTEX_STATS_MEMORY,	/*!< reading the code, stack and windows */
+	CORTEX_STATS_READ,	/*!< in read() for the data we keep */
+	CORTEX_STATS_SKIP,	/*!< skipping data we do not need */
+	CORTEX_STATS_UNWIND,	/*!< unwinding the stack */
+	CORTEX_STATS_DISASM,	/*!< disassembling the code */
+	CORTEX_STATS_FLUSH,	/*!< pushing the reports to the outputs */
+	CORTEX_STATS_ANALYZE,	/*!< running the stream analyzers */
+	CORTEX_STATS_ATTACH,	/*!< process stopped for a snapshot */
+	CORTEX_STATS_FETCH,	/*!< reading the code from the mapped files */
+	CORTEX_STATS_NR,
+};
+
+/** \struct cortex_stats
+ ** \brief everything measured during one run
+ */
+struct cortex_stats {
+	uint64_t start;		/*!< when cortex started, in ns */
+	uint64_t ns[CORTEX_STATS_NR];	/*!< time spent in each timer */
+	long count[CORTEX_STATS_NR];	/*!< times each timer ran */
+	uint64_t bytes_read;	/*!< core bytes read and kept */
+	uint64_t bytes_skipped;	/*!< core bytes read and dropped */
+	long read_calls;	/*!< read() syscalls on the core */
+};
+
+extern __thread int cortex_stats_on;
+extern __thread struct cortex_stats cortex_stats;
+
+uint64_t cortex_stats_now(void);
+
+void cortex_stats_start(void);
+int cortex_stats_write(const char *dest);
+
+/* Everything below costs a test of cortex_stats_on when the stats are
+ * off: no clock is read and nothing is counted */
+
+/** \brief start a timer, returns what to give to cortex_stats_end */
+static inline uint64_t cortex_stats_begin(void)
+{
+	return cortex_stats_on ? cortex_stats_now() : 0;
+}
+
+/** \brief stop a timer started with cortex_stats_begin */
+static inline void cortex_stats_end(int timer, uint64_t begin)
+{
+	if (cortex_stats_on) {
+		cortex_stats.ns[timer] += cortex_stats_now() - begin;
+		cortex_stats.count[timer]++;
+	}
+}
+
+/** \brief account for a read() of the core */
+static inline void cortex_stats_read(long bytes, int skipped)
+{
+	if (cortex_stats_on) {
+		cortex_stats.read_calls++;
+		if (bytes > 0 && skipped)
+			cortex_stats.bytes_skipped += bytes;
+		else if (bytes > 0)
+			cortex_stats.bytes_read += bytes;
+	}
+}
+
+#endif /* _CORTEX_STATS_H_ */
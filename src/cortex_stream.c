@@ -0,0 +1,321 @@
+/** \file cortex_stream.c
+ * \brief cortex core stream analyzers
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <string.h>
+#include <endian.h>
+
+#include "cortex.h"
+#include "cortex_elf.h"
+#include "cortex_mem.h"
+#include "cortex_stats.h"
+#include "cortex_vec.h"
+#include "cortex_stream.h"
+
+/*
+ * The core is read once, front to back, and most of it is skipped.
+ * The analyzers below see every block read or skipped, in the buffer
+ * it was read into, and gather a few facts on the whole core: its
+ * digest and the zero pages of each segment. Only those asked for are
+ * run: the digest costs several times the zero page test.
+ *
+ * To add one, give it a CORTEX_STREAM_* bit, its state in struct
+ * cortex_stream and a row in cortex_stream_analyzers.
+ */
+
+/** \struct cortex_stream_analyzer
+ ** \brief one consumer of the core bytes
+ */
+struct cortex_stream_analyzer {
+	const char *name;
+	int mask;		/*!< CORTEX_STREAM_* */
+	void (*block) (struct cortex_stream * stream,
+		       const unsigned char *buf, size_t len);
+	void (*end) (struct cortex_stream * stream);
+};
+
+#define XXH_PRIME64_1	0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2	0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3	0x165667B19E3779F9ULL
+#define XXH_PRIME64_4	0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5	0x27D4EB2F165667C5ULL
+
+static inline uint64_t cortex_xxh64_rotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t cortex_xxh64_read64(const unsigned char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return le64toh(v);
+}
+
+static inline uint64_t cortex_xxh64_read32(const unsigned char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return le32toh(v);
+}
+
+static inline uint64_t cortex_xxh64_round(uint64_t acc, uint64_t input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = cortex_xxh64_rotl(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t cortex_xxh64_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= cortex_xxh64_round(0, val);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static inline void cortex_xxh64_stripe(uint64_t *v, const unsigned char *p)
+{
+	v[0] = cortex_xxh64_round(v[0], cortex_xxh64_read64(p));
+	v[1] = cortex_xxh64_round(v[1], cortex_xxh64_read64(p + 8));
+	v[2] = cortex_xxh64_round(v[2], cortex_xxh64_read64(p + 16));
+	v[3] = cortex_xxh64_round(v[3], cortex_xxh64_read64(p + 24));
+}
+
+static void cortex_xxh64_init(struct cortex_stream_xxh64 *xxh)
+{
+	memset(xxh, 0, sizeof(*xxh));
+	xxh->v[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+	xxh->v[1] = XXH_PRIME64_2;
+	xxh->v[2] = 0;
+	xxh->v[3] = -XXH_PRIME64_1;
+}
+
+static void cortex_stream_digest_block(struct cortex_stream *stream,
+				       const unsigned char *buf, size_t len)
+{
+	struct cortex_stream_xxh64 *xxh = &stream->xxh64;
+	const unsigned char *end = buf + len;
+
+	xxh->total += len;
+
+	if (xxh->memsize + len < sizeof(xxh->mem)) {
+		memcpy(xxh->mem + xxh->memsize, buf, len);
+		xxh->memsize += len;
+		return;
+	}
+
+	if (xxh->memsize) {
+		size_t fill = sizeof(xxh->mem) - xxh->memsize;
+
+		memcpy(xxh->mem + xxh->memsize, buf, fill);
+		cortex_xxh64_stripe(xxh->v, xxh->mem);
+		buf += fill;
+		xxh->memsize = 0;
+	}
+
+	for (; buf + sizeof(xxh->mem) <= end; buf += sizeof(xxh->mem))
+		cortex_xxh64_stripe(xxh->v, buf);
+
+	memcpy(xxh->mem, buf, end - buf);
+	xxh->memsize = end - buf;
+}
+
+static void cortex_stream_digest_end(struct cortex_stream *stream)
+{
+	struct cortex_stream_xxh64 *xxh = &stream->xxh64;
+	const unsigned char *p = xxh->mem;
+	const unsigned char *end = xxh->mem + xxh->memsize;
+	uint64_t h;
+
+	if (xxh->total >= sizeof(xxh->mem)) {
+		h = cortex_xxh64_rotl(xxh->v[0], 1) +
+		    cortex_xxh64_rotl(xxh->v[1], 7) +
+		    cortex_xxh64_rotl(xxh->v[2], 12) +
+		    cortex_xxh64_rotl(xxh->v[3], 18);
+		h = cortex_xxh64_merge(h, xxh->v[0]);
+		h = cortex_xxh64_merge(h, xxh->v[1]);
+		h = cortex_xxh64_merge(h, xxh->v[2]);
+		h = cortex_xxh64_merge(h, xxh->v[3]);
+	} else {
+		h = XXH_PRIME64_5;
+	}
+
+	h += xxh->total;
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= cortex_xxh64_round(0, cortex_xxh64_read64(p));
+		h = cortex_xxh64_rotl(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	if (p + 4 <= end) {
+		h ^= cortex_xxh64_read32(p) * XXH_PRIME64_1;
+		h = cortex_xxh64_rotl(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * XXH_PRIME64_5;
+		h = cortex_xxh64_rotl(h, 11) * XXH_PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+
+	stream->digest = h;
+}
+
+/* account for the page that was just read to its segment */
+static void cortex_stream_page_done(struct cortex_stream *stream)
+{
+	struct cortex_elf *core = stream->core;
+	ElfN_Off offset = (ElfN_Off)stream->page * CORTEX_STREAM_PAGE;
+	int i;
+
+	if (stream->segments == NULL)
+		return;
+
+	/* segments come in file order: start from the last one */
+	for (i = 0; i < stream->nr_segments; i++) {
+		int n = (stream->cursor + i) % stream->nr_segments;
+		ElfN_Phdr *phdr = &core->phdr[n];
+
+		if (phdr->p_type == PT_LOAD && offset >= phdr->p_offset &&
+		    offset < phdr->p_offset + phdr->p_filesz) {
+			stream->segments[n].pages++;
+			if (!stream->page_data)
+				stream->segments[n].zero_pages++;
+			stream->cursor = n;
+			break;
+		}
+	}
+}
+
+static void cortex_stream_pages_block(struct cortex_stream *stream,
+				      const unsigned char *buf, size_t len)
+{
+	struct cortex_elf *core = stream->core;
+	unsigned long offset = stream->bytes;
+
+	/* the program headers come before any segment data */
+	if (stream->segments == NULL && core->phdr && core->ehdr) {
+		stream->segments =
+		    cortex_mem_calloc(core->ehdr->e_phnum,
+				      sizeof(struct cortex_stream_segment));
+		if (stream->segments)
+			stream->nr_segments = core->ehdr->e_phnum;
+	}
+
+	while (len) {
+		size_t in_page = CORTEX_STREAM_PAGE - offset % CORTEX_STREAM_PAGE;
+		size_t piece = len < in_page ? len : in_page;
+
+		if (!stream->page_data &&
+		    cortex_vec_zero_span(buf, piece) != piece)
+			stream->page_data = 1;
+
+		offset += piece;
+		buf += piece;
+		len -= piece;
+
+		if (offset % CORTEX_STREAM_PAGE == 0) {
+			cortex_stream_page_done(stream);
+			stream->page++;
+			stream->page_data = 0;
+		}
+	}
+}
+
+static void cortex_stream_pages_end(struct cortex_stream *stream)
+{
+	/* a last partial page */
+	if (stream->bytes % CORTEX_STREAM_PAGE)
+		cortex_stream_page_done(stream);
+}
+
+static const struct cortex_stream_analyzer cortex_stream_analyzers[] = {
+	{"digest", CORTEX_STREAM_DIGEST, cortex_stream_digest_block,
+	 cortex_stream_digest_end},
+	{"pages", CORTEX_STREAM_PAGES, cortex_stream_pages_block,
+	 cortex_stream_pages_end},
+};
+
+#define CORTEX_STREAM_NR_ANALYZERS \
+	(sizeof(cortex_stream_analyzers) / sizeof(cortex_stream_analyzers[0]))
+
+/** \brief start analysing a core
+ * \param analyzers mask of CORTEX_STREAM_* to run
+ *
+ * To be called before the first byte of the core is read.
+ */
+struct cortex_stream *cortex_stream_new(struct cortex_elf *core, int analyzers)
+{
+	struct cortex_stream *stream;
+
+	stream = cortex_mem_calloc(1, sizeof(struct cortex_stream));
+	if (stream == NULL)
+		return NULL;
+
+	stream->core = core;
+	stream->analyzers = analyzers;
+	cortex_xxh64_init(&stream->xxh64);
+
+	return stream;
+}
+
+/** \brief hand a block of the core over to the analyzers
+ *
+ * Blocks must come in order, without any gap.
+ */
+void cortex_stream_feed(struct cortex_stream *stream,
+			const unsigned char *buf, size_t len)
+{
+	uint64_t begin = cortex_stats_begin();
+	size_t i;
+
+	for (i = 0; i < CORTEX_STREAM_NR_ANALYZERS; i++)
+		if (stream->analyzers & cortex_stream_analyzers[i].mask)
+			cortex_stream_analyzers[i].block(stream, buf, len);
+	stream->bytes += len;
+
+	cortex_stats_end(CORTEX_STATS_ANALYZE, begin);
+}
+
+/** \brief the core was read
+ * \param complete its end was reached, the results cover all of it
+ */
+void cortex_stream_end(struct cortex_stream *stream, int complete)
+{
+	size_t i;
+
+	for (i = 0; i < CORTEX_STREAM_NR_ANALYZERS; i++)
+		if (stream->analyzers & cortex_stream_analyzers[i].mask)
+			cortex_stream_analyzers[i].end(stream);
+	stream->complete = complete;
+}
+
+void cortex_stream_free(struct cortex_stream *stream)
+{
+	if (stream == NULL)
+		return;
+
+	cortex_mem_free(stream->segments);
+	cortex_mem_free(stream);
+}
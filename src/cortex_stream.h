@@ -0,0 +1,79 @@
+#ifndef _CORTEX_STREAM_H_
+#define _CORTEX_STREAM_H_
+
+/** \file cortex_stream.h
+ * \brief cortex core stream analyzers
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** \brief granularity of the zero page count */
+#define CORTEX_STREAM_PAGE	4096
+
+/* the analyzers, run on demand */
+#define CORTEX_STREAM_DIGEST	0x1	/*!< xxh64 of the whole core */
+#define CORTEX_STREAM_PAGES	0x2	/*!< zero pages of each segment */
+
+struct cortex_elf;
+
+/** \struct cortex_stream_xxh64
+ ** \brief running XXH64 digest
+ */
+struct cortex_stream_xxh64 {
+	uint64_t v[4];		/*!< accumulators */
+	uint64_t total;		/*!< bytes hashed */
+	unsigned char mem[32];	/*!< stripe being filled */
+	size_t memsize;		/*!< bytes in mem */
+};
+
+/** \struct cortex_stream_segment
+ ** \brief what was seen of the data of a segment
+ */
+struct cortex_stream_segment {
+	unsigned long pages;	/*!< pages of the core in the segment */
+	unsigned long zero_pages;	/*!< those that were all zero */
+};
+
+/** \struct cortex_stream
+ ** \brief the analyzers run on every byte of the core as it is read
+ */
+struct cortex_stream {
+	struct cortex_elf *core;	/*!< core being read, for its headers */
+	int analyzers;		/*!< CORTEX_STREAM_* run on the core */
+	unsigned long bytes;	/*!< bytes seen so far */
+	int complete;		/*!< the end of the core was reached */
+
+	struct cortex_stream_xxh64 xxh64;	/*!< digest of the whole core */
+	uint64_t digest;	/*!< its value, once complete */
+
+	unsigned long page;	/*!< core page being looked at */
+	int page_data;		/*!< it holds a non zero byte */
+	int nr_segments;	/*!< entries in segments, one per phdr */
+	int cursor;		/*!< segment of the last page */
+	struct cortex_stream_segment *segments;	/*!< per program header */
+};
+
+struct cortex_stream *cortex_stream_new(struct cortex_elf *core, int analyzers);
+void cortex_stream_feed(struct cortex_stream *stream,
+			const unsigned char *buf, size_t len);
+void cortex_stream_end(struct cortex_stream *stream, int complete);
+void cortex_stream_free(struct cortex_stream *stream);
+
+#endif /* _CORTEX_STREAM_H_ */
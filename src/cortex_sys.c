@@ -0,0 +1,682 @@
+/** \file cortex_sys.c
+ * \brief cortex system context collector
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <dirent.h>
+#include <mntent.h>
+#include <sys/statfs.h>
+
+#include "cortex_mem.h"
+#include "cortex_sys.h"
+
+/** \brief stack given to each probe thread */
+#define CORTEX_SYS_STACK	(64*1024)
+
+struct cortex_sys_desc {
+	const char *name;
+	const char *label;
+	size_t size;		/*!< room given to the probe output */
+	int (*run)(struct cortex_sys_probe *probe);
+};
+
+/* file systems without storage behind them, skipped by statfs */
+static const char *cortex_sys_pseudo_fs[] = {
+	"proc", "sysfs", "devpts", "cgroup", "cgroup2", "securityfs",
+	"debugfs", "tracefs", "pstore", "bpf", "configfs", "fusectl",
+	"mqueue", "hugetlbfs", "binfmt_misc", "autofs", "rpc_pipefs",
+	"selinuxfs", "efivarfs", "nsfs", NULL,
+};
+
+/* append text to the probe output. Once the budget is spent the
+ * report may already be written: late output is dropped. */
+static void cortex_sys_append(struct cortex_sys_probe *probe,
+			      const char *data, size_t len)
+{
+	struct cortex_sys *sys = probe->sys;
+
+	pthread_mutex_lock(&sys->lock);
+
+	if (sys->expired)
+		goto out;
+
+	if (probe->len + len > probe->size) {
+		len = probe->size - probe->len;
+		probe->truncated = 1;
+	}
+
+	memcpy(probe->buf + probe->len, data, len);
+	probe->len += len;
+
+out:
+	pthread_mutex_unlock(&sys->lock);
+}
+
+static void cortex_sys_printf(struct cortex_sys_probe *probe,
+			      const char *fmt, ...)
+{
+	char line[256];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+
+	if (len >= (int)sizeof(line))
+		len = sizeof(line) - 1;
+
+	if (len > 0)
+		cortex_sys_append(probe, line, len);
+}
+
+/* remember what the probe is blocked on, in case it never returns */
+static void cortex_sys_current(struct cortex_sys_probe *probe,
+			       const char *item)
+{
+	struct cortex_sys *sys = probe->sys;
+
+	pthread_mutex_lock(&sys->lock);
+	if (!sys->expired)
+		snprintf(probe->current, sizeof(probe->current), "%s",
+			 item ? item : "");
+	pthread_mutex_unlock(&sys->lock);
+}
+
+static int cortex_sys_cat(struct cortex_sys_probe *probe, int dirfd,
+			  const char *path)
+{
+	char buf[1024];
+	ssize_t len;
+	int fd;
+
+	fd = openat(dirfd, path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0)
+		cortex_sys_append(probe, buf, len);
+
+	close(fd);
+
+	return len < 0 ? -1 : 0;
+}
+
+static int cortex_sys_meminfo(struct cortex_sys_probe *probe)
+{
+	return cortex_sys_cat(probe, AT_FDCWD, "/proc/meminfo");
+}
+
+static int cortex_sys_loadavg(struct cortex_sys_probe *probe)
+{
+	if (cortex_sys_cat(probe, AT_FDCWD, "/proc/loadavg") < 0)
+		return -1;
+
+	return cortex_sys_cat(probe, AT_FDCWD, "/proc/uptime");
+}
+
+static int cortex_sys_netdev(struct cortex_sys_probe *probe)
+{
+	char line[512];
+	char state[32];
+	char path[PATH_MAX];
+	FILE *netdev;
+	int lineno = 0;
+
+	netdev = fopen("/proc/net/dev", "r");
+	if (netdev == NULL)
+		return -1;
+
+	cortex_sys_printf(probe, "%-12s %-8s %14s %10s %8s %14s %10s %8s\n",
+			  "interface", "state", "rx bytes", "rx packets",
+			  "rx errs", "tx bytes", "tx packets", "tx errs");
+
+	while (fgets(line, sizeof(line), netdev)) {
+		unsigned long long rx_bytes, rx_packets, rx_errs;
+		unsigned long long tx_bytes, tx_packets, tx_errs;
+		char *name = line;
+		char *stats;
+		int fd, len;
+
+		/* two header lines */
+		if (lineno++ < 2)
+			continue;
+
+		stats = strchr(line, ':');
+		if (stats == NULL)
+			continue;
+		*stats++ = '\0';
+
+		while (*name == ' ')
+			name++;
+
+		if (sscanf(stats, "%llu %llu %llu %*u %*u %*u %*u %*u "
+			   "%llu %llu %llu", &rx_bytes, &rx_packets, &rx_errs,
+			   &tx_bytes, &tx_packets, &tx_errs) != 6)
+			continue;
+
+		strcpy(state, "unknown");
+		snprintf(path, sizeof(path), "/sys/class/net/%s/operstate", name);
+		fd = open(path, O_RDONLY);
+		if (fd >= 0) {
+			len = read(fd, state, sizeof(state) - 1);
+			if (len > 0) {
+				state[len] = '\0';
+				state[strcspn(state, "\n")] = '\0';
+			}
+			close(fd);
+		}
+
+		cortex_sys_printf(probe, "%-12s %-8s %14llu %10llu %8llu "
+				  "%14llu %10llu %8llu\n", name, state,
+				  rx_bytes, rx_packets, rx_errs, tx_bytes,
+				  tx_packets, tx_errs);
+	}
+
+	fclose(netdev);
+
+	return 0;
+}
+
+static int cortex_sys_mounts(struct cortex_sys_probe *probe)
+{
+	return cortex_sys_cat(probe, AT_FDCWD, "/proc/self/mounts");
+}
+
+static int cortex_sys_is_pseudo(const char *type)
+{
+	int i;
+
+	for (i = 0; cortex_sys_pseudo_fs[i]; i++) {
+		if (strcmp(type, cortex_sys_pseudo_fs[i]) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static int cortex_sys_statfs(struct cortex_sys_probe *probe)
+{
+	struct mntent mnt;
+	struct statfs st;
+	char line[1024];
+	FILE *mounts;
+
+	mounts = setmntent("/proc/self/mounts", "r");
+	if (mounts == NULL)
+		return -1;
+
+	cortex_sys_printf(probe, "%-24s %10s %10s %10s %4s %s\n", "filesystem",
+			  "size (MB)", "used", "avail", "use%", "mounted on");
+
+	while (getmntent_r(mounts, &mnt, line, sizeof(line))) {
+		unsigned long long size, avail, used;
+
+		if (cortex_sys_is_pseudo(mnt.mnt_type))
+			continue;
+
+		/* statfs may block forever on a dead network mount */
+		cortex_sys_current(probe, mnt.mnt_dir);
+		if (statfs(mnt.mnt_dir, &st) < 0 || st.f_blocks == 0)
+			continue;
+
+		size = (unsigned long long)st.f_blocks * st.f_bsize;
+		avail = (unsigned long long)st.f_bavail * st.f_bsize;
+		used = size - (unsigned long long)st.f_bfree * st.f_bsize;
+
+		cortex_sys_printf(probe, "%-24s %10llu %10llu %10llu %3llu%% %s\n",
+				  mnt.mnt_fsname, size >> 20, used >> 20,
+				  avail >> 20, (used + avail) ?
+				  used * 100 / (used + avail) : 0,
+				  mnt.mnt_dir);
+	}
+	cortex_sys_current(probe, NULL);
+
+	endmntent(mounts);
+
+	return 0;
+}
+
+static int cortex_sys_maps(struct cortex_sys_probe *probe)
+{
+	return cortex_sys_cat(probe, probe->sys->pid_fd, "maps");
+}
+
+static int cortex_sys_status(struct cortex_sys_probe *probe)
+{
+	return cortex_sys_cat(probe, probe->sys->pid_fd, "status");
+}
+
+static int cortex_sys_smaps(struct cortex_sys_probe *probe)
+{
+	return cortex_sys_cat(probe, probe->sys->pid_fd, "smaps_rollup");
+}
+
+static int cortex_sys_cgroup(struct cortex_sys_probe *probe)
+{
+	return cortex_sys_cat(probe, probe->sys->pid_fd, "cgroup");
+}
+
+/* read a small file relative to dirfd into buf, without the
+ * trailing new line */
+static int cortex_sys_read_at(int dirfd, const char *path, char *buf,
+			      size_t size)
+{
+	ssize_t len;
+	int fd;
+
+	buf[0] = '\0';
+
+	fd = openat(dirfd, path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	len = read(fd, buf, size - 1);
+	close(fd);
+
+	if (len < 0)
+		return -1;
+
+	buf[len] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+
+	return len;
+}
+
+/* list the threads of the process with their state and where they
+ * sleep in the kernel */
+static int cortex_sys_tasks(struct cortex_sys_probe *probe)
+{
+	unsigned long utime, stime;
+	char path[PATH_MAX];
+	char stat[512];
+	char wchan[64];
+	char state;
+	int cpu;
+	struct dirent *entry;
+	char *comm, *end;
+	DIR *tasks;
+	int fd;
+
+	fd = openat(probe->sys->pid_fd, "task", O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return -1;
+
+	tasks = fdopendir(fd);
+	if (tasks == NULL) {
+		close(fd);
+		return -1;
+	}
+
+	cortex_sys_printf(probe, "%-8s %-16s %-5s %10s %10s %4s %s\n", "tid",
+			  "comm", "state", "utime", "stime", "cpu", "wchan");
+
+	while ((entry = readdir(tasks))) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		snprintf(path, sizeof(path), "%s/stat", entry->d_name);
+		if (cortex_sys_read_at(fd, path, stat, sizeof(stat)) < 0)
+			continue;
+
+		/* the command may hold spaces and parenthesis: it ends at
+		 * the last closing one */
+		comm = strchr(stat, '(');
+		end = strrchr(stat, ')');
+		if (comm == NULL || end == NULL || end < comm)
+			continue;
+		*end = '\0';
+
+		utime = stime = 0;
+		cpu = -1;
+		state = '?';
+		sscanf(end + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+		       "%lu %lu %*d %*d %*d %*d %*d %*d %*u %*u %*d %*u %*u "
+		       "%*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %d",
+		       &state, &utime, &stime, &cpu);
+
+		snprintf(path, sizeof(path), "%s/wchan", entry->d_name);
+		if (cortex_sys_read_at(fd, path, wchan, sizeof(wchan)) <= 0)
+			strcpy(wchan, "-");
+
+		cortex_sys_printf(probe, "%-8s %-16s %-5c %10lu %10lu %4d %s\n",
+				  entry->d_name, comm + 1, state, utime, stime,
+				  cpu, wchan);
+	}
+
+	closedir(tasks);
+
+	return 0;
+}
+
+static int cortex_sys_fds(struct cortex_sys_probe *probe)
+{
+	char target[512];
+	struct dirent *entry;
+	ssize_t len;
+	DIR *fds;
+	int fd;
+
+	fd = openat(probe->sys->pid_fd, "fd", O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return -1;
+
+	fds = fdopendir(fd);
+	if (fds == NULL) {
+		close(fd);
+		return -1;
+	}
+
+	while ((entry = readdir(fds))) {
+		if (entry->d_name[0] == '.')
+			continue;
+
+		len = readlinkat(fd, entry->d_name, target, sizeof(target) - 1);
+		if (len < 0)
+			continue;
+		target[len] = '\0';
+
+		cortex_sys_printf(probe, "%-5s -> %s\n", entry->d_name, target);
+	}
+
+	closedir(fds);
+
+	return 0;
+}
+
+static const struct cortex_sys_desc cortex_sys_descs[CORTEX_SYS_PROBE_MAX] = {
+	[CORTEX_SYS_MEMINFO] = {"meminfo", "Memory", CORTEX_SYS_PROBE_SIZE,
+				cortex_sys_meminfo},
+	[CORTEX_SYS_LOADAVG] = {"loadavg", "Load", CORTEX_SYS_PROBE_SIZE,
+				cortex_sys_loadavg},
+	[CORTEX_SYS_NETDEV] = {"netdev", "Network", CORTEX_SYS_PROBE_SIZE,
+			       cortex_sys_netdev},
+	[CORTEX_SYS_MOUNTS] = {"mounts", "Mount", CORTEX_SYS_PROBE_SIZE,
+			       cortex_sys_mounts},
+	[CORTEX_SYS_STATFS] = {"statfs", "Disks", CORTEX_SYS_PROBE_SIZE,
+			       cortex_sys_statfs},
+	[CORTEX_SYS_MAPS] = {"maps", "Mappings", CORTEX_SYS_MAPS_SIZE,
+			     cortex_sys_maps},
+	[CORTEX_SYS_STATUS] = {"status", "Status", CORTEX_SYS_PROBE_SIZE,
+			       cortex_sys_status},
+	[CORTEX_SYS_SMAPS] = {"smaps", "Memory usage", CORTEX_SYS_PROBE_SIZE,
+			      cortex_sys_smaps},
+	[CORTEX_SYS_TASKS] = {"tasks", "Tasks", CORTEX_SYS_PROBE_SIZE,
+			      cortex_sys_tasks},
+	[CORTEX_SYS_FDS] = {"fds", "File descriptors", CORTEX_SYS_PROBE_SIZE,
+			    cortex_sys_fds},
+	[CORTEX_SYS_CGROUP] = {"cgroup", "Cgroup", CORTEX_SYS_PROBE_SIZE,
+			       cortex_sys_cgroup},
+};
+
+const char *cortex_sys_probe_name(struct cortex_sys_probe *probe)
+{
+	return cortex_sys_descs[probe->id].name;
+}
+
+const char *cortex_sys_probe_label(struct cortex_sys_probe *probe)
+{
+	return cortex_sys_descs[probe->id].label;
+}
+
+int cortex_sys_probe_is_proc(struct cortex_sys_probe *probe)
+{
+	return (CORTEX_SYS_PROBES_PROC >> probe->id) & 1;
+}
+
+/** \brief parse a comma separated list of probe names
+ * \param list probe names, 'all' or 'none'
+ * \return a mask of (1 << probe id), or -1 on error
+ */
+long cortex_sys_parse_probes(char *list)
+{
+	long probes = 0;
+	size_t len;
+	int i;
+
+	while (*list) {
+		len = strcspn(list, ",");
+
+		if (len == 3 && strncmp(list, "all", 3) == 0) {
+			probes = CORTEX_SYS_PROBES_ALL;
+		} else if (len == 4 && strncmp(list, "none", 4) == 0) {
+			probes = 0;
+		} else {
+			for (i = 0; i < CORTEX_SYS_PROBE_MAX; i++) {
+				if (strlen(cortex_sys_descs[i].name) == len &&
+				    strncmp(list, cortex_sys_descs[i].name,
+					    len) == 0)
+					break;
+			}
+
+			if (i == CORTEX_SYS_PROBE_MAX) {
+				fprintf(stderr, "unknown probe %.*s\n",
+					(int)len, list);
+				return -1;
+			}
+
+			probes |= 1L << i;
+		}
+
+		list += len;
+		if (*list == ',')
+			list++;
+	}
+
+	return probes;
+}
+
+/* drop one reference. The last one, main thread or late probe,
+ * frees the collector and unpins its arena. Returns the references
+ * left */
+static int cortex_sys_put(struct cortex_sys *sys)
+{
+	struct cortex_mem_arena *arena = sys->arena;
+	int refs, i;
+
+	pthread_mutex_lock(&sys->lock);
+	refs = --sys->refs;
+	pthread_mutex_unlock(&sys->lock);
+
+	if (refs)
+		return refs;
+
+	for (i = 0; i < sys->nr_probes; i++)
+		cortex_mem_free(sys->probes[i].buf);
+
+	if (sys->pid_fd >= 0)
+		close(sys->pid_fd);
+
+	pthread_cond_destroy(&sys->cond);
+	pthread_mutex_destroy(&sys->lock);
+	cortex_mem_free(sys);
+
+	cortex_mem_arena_unpin(arena);
+
+	return 0;
+}
+
+static void *cortex_sys_run(void *arg)
+{
+	struct cortex_sys_probe *probe = arg;
+	struct cortex_sys *sys = probe->sys;
+	int ret;
+
+	/* the buffers go back to the arena of the analysis */
+	cortex_mem_use(sys->arena);
+
+	ret = cortex_sys_descs[probe->id].run(probe);
+
+	pthread_mutex_lock(&sys->lock);
+	if (!sys->expired) {
+		probe->state = ret < 0 ? CORTEX_SYS_FAILED : CORTEX_SYS_DONE;
+		if (--sys->nr_running == 0)
+			pthread_cond_signal(&sys->cond);
+	}
+	pthread_mutex_unlock(&sys->lock);
+
+	cortex_sys_put(sys);
+
+	return NULL;
+}
+
+/** \brief start the selected probes in the background
+ * \param probes mask of probes to run
+ * \param budget time given to the probes, in ms
+ * \param pid crashing process for the /proc/<pid> probes, 0 for none
+ * \return the collector, or NULL if nothing could be started
+ */
+struct cortex_sys *cortex_sys_start(long probes, int budget, int pid)
+{
+	char path[32];
+	struct cortex_sys *sys = NULL;
+	struct cortex_sys_probe *probe;
+	pthread_condattr_t cond_attr;
+	pthread_attr_t attr;
+	pthread_t thread;
+	sigset_t mask, saved;
+	int i;
+
+	sys = cortex_mem_calloc(1, sizeof(struct cortex_sys));
+	if (sys == NULL)
+		return NULL;
+
+	pthread_mutex_init(&sys->lock, NULL);
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sys->cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+
+	sys->refs = 1;
+	sys->arena = cortex_mem_bound();
+	cortex_mem_arena_pin(sys->arena);
+	sys->budget = budget;
+	sys->pid = pid;
+	sys->pid_fd = -1;
+
+	/* the process only exists until its core is consumed: hold its
+	 * /proc directory right away, every probe reads relative to it */
+	if (pid > 0 && (probes & CORTEX_SYS_PROBES_PROC)) {
+		snprintf(path, sizeof(path), "/proc/%d", pid);
+		sys->pid_fd = open(path, O_RDONLY | O_DIRECTORY);
+		if (sys->pid_fd < 0)
+			perror(path);
+	} else {
+		probes &= ~CORTEX_SYS_PROBES_PROC;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &sys->deadline);
+	sys->deadline.tv_sec += budget / 1000;
+	sys->deadline.tv_nsec += (budget % 1000) * 1000000L;
+	if (sys->deadline.tv_nsec >= 1000000000L) {
+		sys->deadline.tv_sec++;
+		sys->deadline.tv_nsec -= 1000000000L;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_attr_setstacksize(&attr, CORTEX_SYS_STACK);
+
+	/* the deadline alarm must interrupt the core reads of the main
+	 * thread: the probes inherit a mask that keeps it away from them */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGALRM);
+	pthread_sigmask(SIG_BLOCK, &mask, &saved);
+
+	for (i = 0; i < CORTEX_SYS_PROBE_MAX; i++) {
+		if (!(probes & (1L << i)))
+			continue;
+
+		probe = &sys->probes[sys->nr_probes];
+		probe->id = i;
+		probe->sys = sys;
+		probe->size = cortex_sys_descs[i].size;
+		probe->buf = cortex_mem_alloc(probe->size);
+		if (probe->buf == NULL)
+			continue;
+		sys->nr_probes++;
+
+		if (cortex_sys_probe_is_proc(probe) && sys->pid_fd < 0) {
+			probe->state = CORTEX_SYS_FAILED;
+			continue;
+		}
+
+		pthread_mutex_lock(&sys->lock);
+		sys->refs++;
+		sys->nr_running++;
+		pthread_mutex_unlock(&sys->lock);
+
+		if (pthread_create(&thread, &attr, cortex_sys_run, probe) != 0) {
+			pthread_mutex_lock(&sys->lock);
+			probe->state = CORTEX_SYS_FAILED;
+			sys->refs--;
+			sys->nr_running--;
+			pthread_mutex_unlock(&sys->lock);
+		}
+	}
+
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	pthread_attr_destroy(&attr);
+
+	return sys;
+}
+
+/** \brief wait for the probes until they are done or the budget is spent
+ *
+ * After this call the probe outputs do not change anymore.
+ */
+void cortex_sys_wait(struct cortex_sys *sys)
+{
+	int i;
+
+	pthread_mutex_lock(&sys->lock);
+
+	while (sys->nr_running) {
+		if (pthread_cond_timedwait(&sys->cond, &sys->lock,
+					   &sys->deadline) != 0)
+			break;
+	}
+
+	sys->expired = 1;
+	for (i = 0; i < sys->nr_probes; i++) {
+		if (sys->probes[i].state == CORTEX_SYS_PENDING)
+			sys->probes[i].state = CORTEX_SYS_TIMEOUT;
+	}
+
+	pthread_mutex_unlock(&sys->lock);
+}
+
+/** \brief release the collector. Probes still blocked keep it alive,
+ * and its arena pinned
+ * \return the number of such probes: their memory must not be reused
+ */
+int cortex_sys_release(struct cortex_sys *sys)
+{
+	if (sys == NULL)
+		return 0;
+
+	return cortex_sys_put(sys);
+}
@@ -0,0 +1,111 @@
+#ifndef _CORTEX_SYS_H_
+#define _CORTEX_SYS_H_
+
+/** \file cortex_sys.h
+ * \brief cortex system context collector
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+/** \brief default time budget given to all the probes, in ms */
+#define CORTEX_SYS_BUDGET	500
+/** \brief maximum amount of text kept for one probe */
+#define CORTEX_SYS_PROBE_SIZE	(32*1024)
+/** \brief maximum amount of text kept for the mappings of the process */
+#define CORTEX_SYS_MAPS_SIZE	(256*1024)
+
+enum cortex_sys_probe_id {
+	CORTEX_SYS_MEMINFO = 0,
+	CORTEX_SYS_LOADAVG,
+	CORTEX_SYS_NETDEV,
+	CORTEX_SYS_MOUNTS,
+	CORTEX_SYS_STATFS,
+	/* the following ones read /proc/<pid> of the crashing process */
+	CORTEX_SYS_MAPS,
+	CORTEX_SYS_STATUS,
+	CORTEX_SYS_SMAPS,
+	CORTEX_SYS_TASKS,
+	CORTEX_SYS_FDS,
+	CORTEX_SYS_CGROUP,
+	CORTEX_SYS_PROBE_MAX,
+};
+
+#define CORTEX_SYS_PROBES_ALL		((1L << CORTEX_SYS_PROBE_MAX) - 1)
+#define CORTEX_SYS_PROBES_SYSTEM	((1L << CORTEX_SYS_MAPS) - 1)
+#define CORTEX_SYS_PROBES_PROC		(CORTEX_SYS_PROBES_ALL & \
+					 ~CORTEX_SYS_PROBES_SYSTEM)
+
+enum cortex_sys_state {
+	CORTEX_SYS_PENDING = 0,
+	CORTEX_SYS_DONE,
+	CORTEX_SYS_FAILED,
+	CORTEX_SYS_TIMEOUT,
+};
+
+struct cortex_sys;
+
+/** \struct cortex_sys_probe
+ ** \brief one source of system context, run in its own thread
+ */
+struct cortex_sys_probe {
+	int id;			/*!< probe identifier */
+	int state;		/*!< pending, done, failed or timed out */
+	char current[128];	/*!< item being read, reported on timeout */
+	char *buf;		/*!< text collected so far */
+	size_t len;		/*!< length of the text */
+	size_t size;		/*!< room allocated for the text */
+	int truncated;		/*!< set if the text did not fit */
+	struct cortex_sys *sys;	/*!< collector this probe belongs to */
+};
+
+/** \struct cortex_sys
+ ** \brief system context collector
+ *
+ * The probes run in parallel with the parsing of the core. Once the
+ * budget is spent the collector stops listening: probes still blocked
+ * (on a hung mount for instance) are reported as timed out and their
+ * late output is dropped.
+ */
+struct cortex_sys {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int refs;		/*!< main thread plus running probes */
+	int nr_running;		/*!< probes not finished yet */
+	int expired;		/*!< the budget is spent */
+	int budget;		/*!< time budget in ms */
+	int pid;		/*!< crashing process, 0 if unknown */
+	int pid_fd;		/*!< /proc/<pid> directory, -1 if not open */
+	struct cortex_mem_arena *arena;	/*!< arena the collector lives in,
+					   pinned until it is freed */
+	struct timespec deadline;	/*!< end of the budget (monotonic) */
+	int nr_probes;
+	struct cortex_sys_probe probes[CORTEX_SYS_PROBE_MAX];
+};
+
+long cortex_sys_parse_probes(char *list);
+const char *cortex_sys_probe_name(struct cortex_sys_probe *probe);
+const char *cortex_sys_probe_label(struct cortex_sys_probe *probe);
+int cortex_sys_probe_is_proc(struct cortex_sys_probe *probe);
+
+struct cortex_sys *cortex_sys_start(long probes, int budget, int pid);
+void cortex_sys_wait(struct cortex_sys *sys);
+int cortex_sys_release(struct cortex_sys *sys);
+
+#endif /* _CORTEX_SYS_H_ */
@@ -0,0 +1,424 @@
+/** \file cortex_tune.c
+ * \brief cortex coredump_filter tuning
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "cortex.h"
+#include "cortex_tune.h"
+
+/*
+ * cortex keeps a small part of the core, but the kernel writes all of it
+ * to the pipe before the process can go away. /proc/<pid>/coredump_filter
+ * tells the kernel which mappings to write: the filter set here only
+ * keeps those the requested sections read, the notes are always written.
+ *
+ * The filter is inherited on fork and kept across execve, so the
+ * processes started afterwards by a tuned one are tuned as well.
+ *
+ * The expected size is worked out from /proc/<pid>/smaps with the rules
+ * of vma_dump_size() in fs/coredump.c.
+ */
+
+#define CORTEX_TUNE_LINE	4096
+
+/** \struct cortex_tune
+ ** \brief one tuning run over a set of processes
+ */
+struct cortex_tune {
+	long filter;		/*!< filter to set */
+	int dry_run;		/*!< only report what would change */
+	FILE *output;		/*!< report */
+	int nr_procs;		/*!< processes found */
+	int failed;		/*!< processes that could not be tuned */
+	int unsized;		/*!< processes whose smaps was not readable */
+	unsigned long before;	/*!< dumped bytes with the current filters */
+	unsigned long after;	/*!< dumped bytes with the new filter */
+};
+
+/** \struct cortex_tune_vma
+ ** \brief what decides whether a mapping is dumped
+ */
+struct cortex_tune_vma {
+	unsigned long size;
+	unsigned long offset;
+	int readable;
+	int file;		/*!< backed by a file */
+	int unlinked;		/*!< the file has no name: shmem, deleted */
+	int anon;		/*!< holds anonymous pages */
+	int always;		/*!< vdso and such, always dumped */
+	int shared;
+	int hugetlb;
+	int io;
+	int dontdump;
+};
+
+/** \brief coredump_filter needed by the sections of a format
+ * \param fmt the sections and kinds of all the reports
+ *
+ * The notes (registers, auxv, siginfo, file mappings) are always dumped:
+ * a report made of them only needs an empty filter.
+ */
+long cortex_tune_filter(long fmt)
+{
+	long filter = 0;
+
+	/* the mem section reports on the whole core */
+	if (fmt & CORTEX_OUTPUT_FMT_MEM)
+		return CORTEX_TUNE_DEFAULT;
+
+	/* stacks and whatever the registers point to */
+	if (fmt & (CORTEX_OUTPUT_FMT_CAL | CORTEX_OUTPUT_FMT_STA |
+		   CORTEX_OUTPUT_FMT_THR | CORTEX_OUTPUT_FMT_MIN |
+		   CORTEX_OUTPUT_FMT_MDP))
+		filter |= CORTEX_TUNE_ANON_PRIVATE;
+
+	/* the code around the instruction pointers is read from the mapped
+	   files, once their headers tell they were not replaced */
+	if (fmt & (CORTEX_OUTPUT_FMT_COD | CORTEX_OUTPUT_FMT_MIN |
+		   CORTEX_OUTPUT_FMT_MDP))
+		filter |= CORTEX_TUNE_ELF_HEADERS;
+
+	return filter;
+}
+
+/* bytes of a mapping written to the core, see vma_dump_size() */
+static unsigned long cortex_tune_vma_size(struct cortex_tune_vma *vma,
+					  long filter)
+{
+	if (vma->always)
+		return vma->size;
+	if (vma->dontdump)
+		return 0;
+	if (vma->hugetlb)
+		return filter & (vma->shared ? CORTEX_TUNE_HUGETLB_SHARED :
+				 CORTEX_TUNE_HUGETLB_PRIVATE) ? vma->size : 0;
+	if (vma->io)
+		return 0;
+	if (vma->shared)
+		return filter & (vma->unlinked ? CORTEX_TUNE_ANON_SHARED :
+				 CORTEX_TUNE_MAPPED_SHARED) ? vma->size : 0;
+	if (vma->anon && (filter & CORTEX_TUNE_ANON_PRIVATE))
+		return vma->size;
+	if (!vma->file)
+		return 0;
+	if (filter & CORTEX_TUNE_MAPPED_PRIVATE)
+		return vma->size;
+
+	/* only the first page of an ELF file */
+	if ((filter & CORTEX_TUNE_ELF_HEADERS) && vma->offset == 0 &&
+	    vma->readable)
+		return sysconf(_SC_PAGESIZE);
+
+	return 0;
+}
+
+static void cortex_tune_vma_flags(struct cortex_tune_vma *vma, char *flags)
+{
+	char *flag;
+
+	for (flag = strtok(flags, " \n"); flag; flag = strtok(NULL, " \n")) {
+		if (strcmp(flag, "dd") == 0)
+			vma->dontdump = 1;
+		else if (strcmp(flag, "io") == 0)
+			vma->io = 1;
+		else if (strcmp(flag, "ht") == 0)
+			vma->hugetlb = 1;
+		else if (strcmp(flag, "sh") == 0)
+			vma->shared = 1;
+	}
+}
+
+/* start a mapping from its smaps header line */
+static int cortex_tune_vma_header(struct cortex_tune_vma *vma, char *line)
+{
+	unsigned long start, end, inode;
+	char perms[5];
+	char *path;
+	int len = 0;
+
+	if (sscanf(line, "%lx-%lx %4s %lx %*s %lu %n", &start, &end, perms,
+		   &vma->offset, &inode, &len) != 5)
+		return -1;
+
+	path = line + len;
+	path[strcspn(path, "\n")] = '\0';
+
+	vma->size = end - start;
+	vma->readable = perms[0] == 'r';
+	vma->shared = perms[3] == 's';
+	vma->file = inode != 0;
+	vma->unlinked = strstr(path, " (deleted)") != NULL;
+	vma->always = path[0] == '[' && strcmp(path, "[heap]") != 0 &&
+	    strncmp(path, "[stack", 6) != 0 && strncmp(path, "[anon", 5) != 0;
+
+	return 0;
+}
+
+/* dumped bytes of a process, with its current filter and the new one */
+static int cortex_tune_size(struct cortex_tune *tune, int pid, long current,
+			    unsigned long *before, unsigned long *after)
+{
+	struct cortex_tune_vma vma;
+	char line[CORTEX_TUNE_LINE];
+	char path[64];
+	unsigned long anon;
+	int pending = 0;
+	FILE *smaps;
+
+	snprintf(path, sizeof(path), "/proc/%d/smaps", pid);
+	smaps = fopen(path, "r");
+	if (smaps == NULL)
+		return -1;
+
+	*before = *after = 0;
+
+	while (fgets(line, sizeof(line), smaps)) {
+		/* "Anonymous:" starts with a hex digit as well */
+		if (line[strspn(line, "0123456789abcdef")] == '-') {
+			if (pending) {
+				*before += cortex_tune_vma_size(&vma, current);
+				*after += cortex_tune_vma_size(&vma,
+							       tune->filter);
+			}
+			memset(&vma, 0, sizeof(vma));
+			pending = cortex_tune_vma_header(&vma, line) == 0;
+		} else if (sscanf(line, "Anonymous: %lu kB", &anon) == 1) {
+			vma.anon = anon > 0;
+		} else if (strncmp(line, "VmFlags:", 8) == 0) {
+			cortex_tune_vma_flags(&vma, line + 8);
+		}
+	}
+
+	if (pending) {
+		*before += cortex_tune_vma_size(&vma, current);
+		*after += cortex_tune_vma_size(&vma, tune->filter);
+	}
+
+	fclose(smaps);
+
+	return 0;
+}
+
+static int cortex_tune_read_filter(int pid, long *filter)
+{
+	char path[64];
+	FILE *file;
+	int ret;
+
+	snprintf(path, sizeof(path), "/proc/%d/coredump_filter", pid);
+	file = fopen(path, "r");
+	if (file == NULL)
+		return -1;
+
+	ret = fscanf(file, "%lx", filter) == 1 ? 0 : -1;
+	fclose(file);
+
+	return ret;
+}
+
+static int cortex_tune_write_filter(int pid, long filter)
+{
+	char path[64];
+	FILE *file;
+	int ret;
+
+	snprintf(path, sizeof(path), "/proc/%d/coredump_filter", pid);
+	file = fopen(path, "w");
+	if (file == NULL)
+		return -1;
+
+	fprintf(file, "0x%lx\n", filter);
+	ret = fclose(file);
+
+	return ret;
+}
+
+static void cortex_tune_comm(int pid, char *comm, size_t size)
+{
+	char path[64];
+	FILE *file;
+
+	snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+	file = fopen(path, "r");
+	if (file == NULL || fgets(comm, size, file) == NULL)
+		snprintf(comm, size, "?");
+	comm[strcspn(comm, "\n")] = '\0';
+	if (file)
+		fclose(file);
+}
+
+static void cortex_tune_pid(struct cortex_tune *tune, int pid)
+{
+	unsigned long before, after;
+	long current;
+	char comm[32];
+
+	/* gone, or a kernel thread */
+	if (cortex_tune_read_filter(pid, &current) < 0)
+		return;
+
+	cortex_tune_comm(pid, comm, sizeof(comm));
+	tune->nr_procs++;
+
+	if (!tune->dry_run && current != tune->filter &&
+	    cortex_tune_write_filter(pid, tune->filter) < 0) {
+		fprintf(stderr, "%d (%s): cannot set coredump_filter: %s\n",
+			pid, comm, strerror(errno));
+		tune->failed++;
+		return;
+	}
+
+	fprintf(tune->output, "%d (%s): coredump_filter 0x%02lx -> 0x%02lx",
+		pid, comm, current, tune->filter);
+
+	if (cortex_tune_size(tune, pid, current, &before, &after) < 0) {
+		fprintf(tune->output, ", dumped memory unknown\n");
+		tune->unsized++;
+		return;
+	}
+
+	fprintf(tune->output, ", dumped memory %lu kB -> %lu kB\n",
+		before >> 10, after >> 10);
+	tune->before += before;
+	tune->after += after;
+}
+
+static int cortex_tune_cgroup(struct cortex_tune *tune, const char *cgroup)
+{
+	char path[PATH_MAX];
+	FILE *procs;
+	int pid;
+
+	snprintf(path, sizeof(path), "%s/cgroup.procs", cgroup);
+	procs = fopen(path, "r");
+	if (procs == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	while (fscanf(procs, "%d", &pid) == 1)
+		cortex_tune_pid(tune, pid);
+
+	fclose(procs);
+
+	return 0;
+}
+
+/* the processes running an executable, by path or by name */
+static int cortex_tune_exe(struct cortex_tune *tune, const char *exe)
+{
+	char path[64];
+	char link[PATH_MAX];
+	char comm[32];
+	struct dirent *entry;
+	DIR *proc;
+	ssize_t len;
+	int pid;
+
+	proc = opendir("/proc");
+	if (proc == NULL) {
+		perror("/proc");
+		return -1;
+	}
+
+	while ((entry = readdir(proc))) {
+		pid = atoi(entry->d_name);
+		if (pid <= 0 || pid == getpid())
+			continue;
+
+		if (exe[0] == '/') {
+			snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+			len = readlink(path, link, sizeof(link) - 1);
+			if (len < 0)
+				continue;
+			link[len] = '\0';
+			if (strcmp(link, exe) != 0)
+				continue;
+		} else {
+			cortex_tune_comm(pid, comm, sizeof(comm));
+			/* comm is truncated to 15 chars */
+			if (strncmp(comm, exe, 15) != 0)
+				continue;
+		}
+
+		cortex_tune_pid(tune, pid);
+	}
+
+	closedir(proc);
+
+	return 0;
+}
+
+/** \brief set the coredump_filter of processes
+ * \param target a pid, a cgroup directory, or an executable given by
+ * its path or its name
+ * \param filter the filter, see cortex_tune_filter()
+ * \param dry_run only report the filters and sizes
+ * \param output where to write the report
+ * \return 0 on success, -1 if no process was found or one could not be
+ * tuned
+ */
+int cortex_tune_apply(const char *target, long filter, int dry_run,
+		      FILE * output)
+{
+	struct cortex_tune tune = {
+		.filter = filter,
+		.dry_run = dry_run,
+		.output = output,
+	};
+	struct stat st;
+	int ret;
+
+	if (target[0] && strspn(target, "0123456789") == strlen(target)) {
+		cortex_tune_pid(&tune, atoi(target));
+		ret = 0;
+	} else if (target[0] == '/' && stat(target, &st) == 0 &&
+		   S_ISDIR(st.st_mode)) {
+		ret = cortex_tune_cgroup(&tune, target);
+	} else {
+		ret = cortex_tune_exe(&tune, target);
+	}
+
+	if (ret < 0)
+		return -1;
+
+	if (tune.nr_procs == 0) {
+		fprintf(stderr, "%s: no process found\n", target);
+		return -1;
+	}
+
+	fprintf(output, "%d processes", tune.nr_procs);
+	if (tune.nr_procs > tune.unsized)
+		fprintf(output, ", dumped memory %lu kB -> %lu kB",
+			tune.before >> 10, tune.after >> 10);
+	if (tune.before)
+		fprintf(output, " (%+.1f%%)", 100.0 * tune.after /
+			tune.before - 100.0);
+	fprintf(output, "%s\n", dry_run ? ", dry run: nothing changed" : "");
+
+	return tune.failed ? -1 : 0;
+}
@@ -0,0 +1,42 @@
+#ifndef _CORTEX_TUNE_H_
+#define _CORTEX_TUNE_H_
+
+/** \file cortex_tune.h
+ * \brief cortex coredump_filter tuning
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+
+/* /proc/<pid>/coredump_filter bits, see core(5) */
+#define CORTEX_TUNE_ANON_PRIVATE	0x01
+#define CORTEX_TUNE_ANON_SHARED		0x02
+#define CORTEX_TUNE_MAPPED_PRIVATE	0x04
+#define CORTEX_TUNE_MAPPED_SHARED	0x08
+#define CORTEX_TUNE_ELF_HEADERS		0x10
+#define CORTEX_TUNE_HUGETLB_PRIVATE	0x20
+#define CORTEX_TUNE_HUGETLB_SHARED	0x40
+
+/** \brief kernel default filter */
+#define CORTEX_TUNE_DEFAULT		0x33
+
+long cortex_tune_filter(long fmt);
+int cortex_tune_apply(const char *target, long filter, int dry_run,
+		      FILE * output);
+
+#endif /* _CORTEX_TUNE_H_ */
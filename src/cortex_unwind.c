@@ -0,0 +1,430 @@
+/** \file cortex_unwind.c
+ * \brief cortex call trace unwinding
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cortex.h"
+#include "cortex_elf.h"
+#include "cortex_mem.h"
+#include "cortex_vec.h"
+#include "cortex_stats.h"
+#include "cortex_probe.h"
+#include "cortex_deadline.h"
+#include "cortex_unwind.h"
+#include "arch/cortex_arch.h"
+
+/*
+ * Each thread is unwound once, when the core is parsed, into a vector
+ * of frames that every output reads: the unwinders are not run again
+ * for each section and each sink.
+ *
+ * When the frame pointers lead nowhere, the code was most likely built
+ * without them: the stack window is then scanned for words pointing to
+ * executable memory. Those frames are guesses, and reported as such.
+ *
+ * The threads are then grouped by call trace: a server blocks most of
+ * its threads in the same few places.
+ */
+
+/** \struct cortex_unwind_scanner
+ ** \brief what the stack scanner looks for
+ */
+struct cortex_unwind_scanner {
+	int mode;		/*!< enum cortex_unwind_scan */
+	int nr_ranges;		/*!< entries in ranges */
+	struct cortex_vec_range *ranges;	/*!< executable memory, sorted */
+	struct cortex_vec_hulls hulls;	/*!< ranges for the block test */
+};
+
+static int cortex_unwind_range_cmp(const void *a, const void *b)
+{
+	const struct cortex_vec_range *ra = a;
+	const struct cortex_vec_range *rb = b;
+
+	if (ra->start < rb->start)
+		return -1;
+	return ra->start > rb->start;
+}
+
+/* the executable PT_LOAD segments, merged when they touch */
+static int cortex_unwind_exec_ranges(struct cortex_proc_info *info,
+				     struct cortex_unwind_scanner *scanner)
+{
+	ElfN_Phdr *phdr = info->elf->phdr;
+	int nr = 0;
+	int i;
+
+	scanner->ranges = cortex_mem_alloc(info->elf->ehdr->e_phnum *
+					   sizeof(struct cortex_vec_range));
+	if (scanner->ranges == NULL)
+		return -1;
+
+	for (i = 0; i < info->elf->ehdr->e_phnum; i++) {
+		if (phdr[i].p_type != PT_LOAD || !(phdr[i].p_flags & PF_X) ||
+		    phdr[i].p_memsz == 0)
+			continue;
+		scanner->ranges[nr].start = phdr[i].p_vaddr;
+		scanner->ranges[nr].end = phdr[i].p_vaddr + phdr[i].p_memsz;
+		nr++;
+	}
+
+	qsort(scanner->ranges, nr, sizeof(struct cortex_vec_range),
+	      cortex_unwind_range_cmp);
+
+	scanner->nr_ranges = 0;
+	for (i = 0; i < nr; i++) {
+		struct cortex_vec_range *last =
+		    &scanner->ranges[scanner->nr_ranges - 1];
+
+		if (scanner->nr_ranges && scanner->ranges[i].start <= last->end) {
+			if (scanner->ranges[i].end > last->end)
+				last->end = scanner->ranges[i].end;
+			continue;
+		}
+		scanner->ranges[scanner->nr_ranges++] = scanner->ranges[i];
+	}
+
+	cortex_vec_hulls_init(&scanner->hulls, scanner->ranges,
+			      scanner->nr_ranges);
+	return 0;
+}
+
+/* add the return address candidates found from the stack address from
+ * to the end of its window, return the new number of frames */
+static int cortex_unwind_scan(struct cortex_proc_info *info,
+			      struct cortex_unwind_scanner *scanner,
+			      ElfN_Addr from, struct cortex_stack_frame *frames,
+			      int nr, int *stop)
+{
+	const unsigned char *stack;
+	struct cortex_stack_frame frame;
+	size_t pos = 0;
+	size_t len;
+
+	from += (info->word_size - from % info->word_size) % info->word_size;
+	stack = cortex_elf_map(info, from, &len);
+	if (stack == NULL)
+		return nr;
+
+	while (nr < STACK_FRAME_MAX) {
+		pos += cortex_vec_range_span(stack + pos, len - pos,
+					     info->word_size, info->elf->swap,
+					     scanner->ranges,
+					     scanner->nr_ranges,
+					     &scanner->hulls);
+		if (pos + info->word_size > len)
+			return nr;
+
+		frame.pc = cortex_elf_get_word(info, stack + pos);
+		frame.sp = from + pos + info->word_size;
+		frame.bp = 0;
+		pos += info->word_size;
+
+		/* code that is neither in the core nor in the mapped files
+		   cannot be told from data, the vdso base for instance */
+		if (scanner->mode == CORTEX_UNWIND_SCAN_CALLS &&
+		    info->arch->is_call_site &&
+		    info->arch->is_call_site(info, frame.pc) != 1)
+			continue;
+
+		frames[nr++] = frame;
+		*stop = CORTEX_UNWIND_SCANNED;
+	}
+
+	*stop = CORTEX_UNWIND_MAX;
+	return nr;
+}
+
+/** \brief follow the frame pointers of a thread
+ * \param frames room for STACK_FRAME_MAX frames, innermost first
+ * \param stop set to an enum cortex_unwind_stop
+ * \return the number of frames walked
+ *
+ * Nothing is allocated here but by the backend: this is the unwinder
+ * of the profiler as well.
+ */
+int cortex_unwind_walk(struct cortex_proc_info *info, int thread,
+		       struct cortex_stack_frame *frames, int *stop)
+{
+	struct cortex_stack_frame frame = CORTEX_EMPTY_FRAME;
+	void *priv_data;
+	uint64_t begin;
+	int nr = 0;
+	int next;
+
+	priv_data = info->arch->unwind_init(info, thread, &frame);
+
+	*stop = CORTEX_UNWIND_END;
+	do {
+		frames[nr++] = frame;
+
+		if (nr >= STACK_FRAME_MAX) {
+			*stop = CORTEX_UNWIND_MAX;
+			break;
+		}
+		if (cortex_deadline_expired()) {
+			*stop = CORTEX_UNWIND_DEADLINE;
+			break;
+		}
+
+		begin = cortex_stats_begin();
+		next = info->arch->unwind_next(info, &frame, priv_data);
+		cortex_stats_end(CORTEX_STATS_UNWIND, begin);
+		CORTEX_PROBE3(unwind_step, nr - 1, frame.pc, next);
+
+		/* the stack grows down: a caller frame is above its callee */
+		if (next && frame.bp && frame.bp <= frames[nr - 1].bp) {
+			frames[nr++] = frame;
+			*stop = CORTEX_UNWIND_LOOP;
+			break;
+		}
+	} while (next);
+
+	if (info->arch->unwind_exit)
+		info->arch->unwind_exit(info, priv_data);
+
+	return nr;
+}
+
+static void cortex_unwind_thread(struct cortex_proc_info *info, int thread,
+				 struct cortex_unwind_scanner *scanner,
+				 struct cortex_unwind *unwind,
+				 struct cortex_stack_frame *frames)
+{
+	uint64_t begin;
+	ElfN_Addr from;
+	int nr;
+
+	nr = cortex_unwind_walk(info, thread, frames, &unwind->stop);
+
+	unwind->nr_walked = nr;
+
+	/* no frame pointer at all, or a broken chain: scan the stack
+	   above the last frame that was walked */
+	if (scanner->mode != CORTEX_UNWIND_SCAN_NONE &&
+	    (nr == 1 || unwind->stop == CORTEX_UNWIND_LOOP)) {
+		if (nr == 1)
+			from = frames[0].sp;
+		else
+			from = frames[nr - 2].bp + 2 * info->word_size;
+
+		begin = cortex_stats_begin();
+		nr = cortex_unwind_scan(info, scanner, from, frames, nr,
+					&unwind->stop);
+		cortex_stats_end(CORTEX_STATS_UNWIND, begin);
+	}
+
+	unwind->frames = cortex_mem_alloc(nr * sizeof(*frames));
+	if (unwind->frames == NULL)
+		return;
+
+	memcpy(unwind->frames, frames, nr * sizeof(*frames));
+	unwind->nr_frames = nr;
+}
+
+/* hash of a call trace: its frames and how the walk ended */
+static uint64_t cortex_unwind_hash(struct cortex_unwind *unwind)
+{
+	uint64_t hash = (uint64_t)unwind->nr_frames << 32 |
+	    unwind->nr_walked << 8 | unwind->stop;
+	int i;
+
+	for (i = 0; i < unwind->nr_frames; i++) {
+		hash = (hash ^ unwind->frames[i].pc) * 0x9E3779B97F4A7C15ULL;
+		hash ^= hash >> 32;
+	}
+
+	return hash;
+}
+
+static int cortex_unwind_equal(struct cortex_unwind *a, struct cortex_unwind *b)
+{
+	int i;
+
+	if (a->nr_frames != b->nr_frames || a->nr_walked != b->nr_walked ||
+	    a->stop != b->stop)
+		return 0;
+
+	for (i = 0; i < a->nr_frames; i++)
+		if (a->frames[i].pc != b->frames[i].pc)
+			return 0;
+
+	return 1;
+}
+
+static int cortex_unwind_tid_cmp(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/* largest group first, then in thread order: the crashing thread
+   leads among groups of the same size */
+static int cortex_unwind_group_cmp(const void *a, const void *b)
+{
+	const struct cortex_unwind_group *ga = a;
+	const struct cortex_unwind_group *gb = b;
+
+	if (ga->nr_threads != gb->nr_threads)
+		return gb->nr_threads - ga->nr_threads;
+	return ga->thread - gb->thread;
+}
+
+/* bucket the threads by call trace, in an open addressing table keyed
+ * by the hash of their frames. Each thread is hashed once; the report
+ * then only walks the distinct traces */
+static int cortex_unwind_group(struct cortex_proc_info *info)
+{
+	struct cortex_unwind_group *groups;
+	uint64_t *hashes;
+	int *slots, *group_of, *tids;
+	size_t size = 1;
+	int nr_groups = 0;
+	int ret = -1;
+	int i, g;
+
+	while (size < 2 * (size_t)info->nr_threads)
+		size <<= 1;
+
+	slots = cortex_mem_calloc(size, sizeof(int));
+	hashes = cortex_mem_alloc(info->nr_threads * sizeof(uint64_t));
+	group_of = cortex_mem_alloc(info->nr_threads * sizeof(int));
+	/* the tids follow the groups, in the same block */
+	groups = cortex_mem_calloc(info->nr_threads,
+				   sizeof(struct cortex_unwind_group) +
+				   sizeof(int));
+	if (!slots || !hashes || !group_of || !groups)
+		goto out;
+	tids = (int *)(groups + info->nr_threads);
+
+	for (i = 0; i < info->nr_threads; i++) {
+		uint64_t hash = cortex_unwind_hash(&info->unwind[i]);
+		size_t pos = hash & (size - 1);
+
+		/* slots hold a group index + 1, 0 when empty */
+		while ((g = slots[pos] - 1) >= 0) {
+			if (hashes[g] == hash &&
+			    cortex_unwind_equal(&info->unwind[i],
+						&info->unwind[groups[g].thread]))
+				break;
+			pos = (pos + 1) & (size - 1);
+		}
+
+		if (g < 0) {
+			g = nr_groups++;
+			slots[pos] = g + 1;
+			hashes[g] = hash;
+			groups[g].thread = i;
+		}
+
+		group_of[i] = g;
+		groups[g].nr_threads++;
+	}
+
+	/* give each group its run of tids */
+	for (g = 0; g < nr_groups; g++) {
+		groups[g].tids = tids;
+		tids += groups[g].nr_threads;
+		groups[g].nr_threads = 0;
+	}
+	for (i = 0; i < info->nr_threads; i++) {
+		struct cortex_unwind_group *group = &groups[group_of[i]];
+
+		group->tids[group->nr_threads++] = info->threads[i].pr_pid;
+	}
+	for (g = 0; g < nr_groups; g++)
+		qsort(groups[g].tids, groups[g].nr_threads, sizeof(int),
+		      cortex_unwind_tid_cmp);
+
+	qsort(groups, nr_groups, sizeof(struct cortex_unwind_group),
+	      cortex_unwind_group_cmp);
+
+	info->groups = groups;
+	info->nr_groups = nr_groups;
+	groups = NULL;
+	ret = 0;
+
+out:
+	if (ret < 0)
+		fprintf(stderr, "%s: out of memory\n", __FILE__);
+	cortex_mem_free(groups);
+	cortex_mem_free(group_of);
+	cortex_mem_free(hashes);
+	cortex_mem_free(slots);
+
+	return ret;
+}
+
+/** \brief unwind the call trace of every thread
+ * \param scan enum cortex_unwind_scan
+ * \return 0 on success, -1 if the memory budget is exhausted
+ *
+ * info->unwind is left NULL when the backend cannot unwind or the core
+ * holds no stack. A thread whose frames could not be stored has none.
+ */
+int cortex_unwind_process(struct cortex_proc_info *info, int scan)
+{
+	struct cortex_unwind_scanner scanner = {.mode = scan };
+	struct cortex_stack_frame *frames;
+	int i;
+
+	if (!info->stack || !info->arch->unwind_init ||
+	    !info->arch->unwind_next)
+		return 0;
+
+	frames = cortex_mem_alloc(STACK_FRAME_MAX * sizeof(*frames));
+	info->unwind = cortex_mem_calloc(info->nr_threads,
+					 sizeof(struct cortex_unwind));
+	if (frames == NULL || info->unwind == NULL ||
+	    (scan != CORTEX_UNWIND_SCAN_NONE &&
+	     cortex_unwind_exec_ranges(info, &scanner) < 0)) {
+		fprintf(stderr, "%s: out of memory\n", __FILE__);
+		cortex_mem_free(info->unwind);
+		cortex_mem_free(frames);
+		info->unwind = NULL;
+		return -1;
+	}
+
+	for (i = 0; i < info->nr_threads; i++)
+		cortex_unwind_thread(info, i, &scanner, &info->unwind[i],
+				     frames);
+
+	cortex_mem_free(scanner.ranges);
+	cortex_mem_free(frames);
+
+	return cortex_unwind_group(info);
+}
+
+/** \brief parse the --unwind-scan argument
+ * \return an enum cortex_unwind_scan, -1 if arg is not one
+ */
+int cortex_unwind_parse_scan(const char *arg)
+{
+	if (strcmp(arg, "none") == 0)
+		return CORTEX_UNWIND_SCAN_NONE;
+	if (strcmp(arg, "all") == 0)
+		return CORTEX_UNWIND_SCAN_ALL;
+	if (strcmp(arg, "calls") == 0)
+		return CORTEX_UNWIND_SCAN_CALLS;
+
+	fprintf(stderr, "unknown stack scan mode %s\n", arg);
+	return -1;
+}
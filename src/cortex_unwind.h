@@ -0,0 +1,31 @@
+#ifndef _CORTEX_UNWIND_H_
+#define _CORTEX_UNWIND_H_
+
+/** \file cortex_unwind.h
+ * \brief cortex call trace unwinding
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "cortex.h"
+
+int cortex_unwind_process(struct cortex_proc_info *info, int scan);
+int cortex_unwind_walk(struct cortex_proc_info *info, int thread,
+		       struct cortex_stack_frame *frames, int *stop);
+int cortex_unwind_parse_scan(const char *arg);
+
+#endif /* _CORTEX_UNWIND_H_ */
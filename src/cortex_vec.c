@@ -0,0 +1,439 @@
+/** \file cortex_vec.c
+ * \brief cortex vectorized memory helpers
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <byteswap.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "cortex_vec.h"
+
+/* return non zero if the CORTEX_VEC_BLOCK bytes at buf are all zero */
+static inline int cortex_vec_block_is_zero(const unsigned char *buf)
+{
+#if defined(__AVX2__) || defined(__SSE2__)
+	__m128i v = _mm_loadu_si128((const __m128i *)buf);
+	__m128i z = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+
+	return _mm_movemask_epi8(z) == 0xFFFF;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	uint8x16_t v = vld1q_u8(buf);
+	uint64x2_t w = vreinterpretq_u64_u8(v);
+
+	return (vgetq_lane_u64(w, 0) | vgetq_lane_u64(w, 1)) == 0;
+#else
+	uint64_t w[2];
+
+	memcpy(w, buf, sizeof(w));
+	return (w[0] | w[1]) == 0;
+#endif
+}
+
+/* same for 4 blocks: their bytes are or'ed first, a single test
+ * is left for the whole of them */
+static inline int cortex_vec_blocks_are_zero(const unsigned char *buf)
+{
+#if defined(__AVX2__) || defined(__SSE2__)
+	__m128i v = _mm_or_si128(
+	    _mm_or_si128(_mm_loadu_si128((const __m128i *)buf),
+			 _mm_loadu_si128((const __m128i *)(buf + 16))),
+	    _mm_or_si128(_mm_loadu_si128((const __m128i *)(buf + 32)),
+			 _mm_loadu_si128((const __m128i *)(buf + 48))));
+	__m128i z = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+
+	return _mm_movemask_epi8(z) == 0xFFFF;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	uint8x16_t v = vorrq_u8(vorrq_u8(vld1q_u8(buf), vld1q_u8(buf + 16)),
+				vorrq_u8(vld1q_u8(buf + 32),
+					 vld1q_u8(buf + 48)));
+	uint64x2_t w = vreinterpretq_u64_u8(v);
+
+	return (vgetq_lane_u64(w, 0) | vgetq_lane_u64(w, 1)) == 0;
+#else
+	uint64_t w[8];
+
+	memcpy(w, buf, sizeof(w));
+	return (w[0] | w[1] | w[2] | w[3] | w[4] | w[5] | w[6] | w[7]) == 0;
+#endif
+}
+
+/** \brief length of the zero run at the start of a buffer
+ *
+ * Whole blocks are compared at once, the tail byte per byte.
+ * \return the number of leading zero bytes
+ */
+size_t cortex_vec_zero_span(const unsigned char *buf, size_t len)
+{
+	size_t pos = 0;
+
+	while (pos + 4 * CORTEX_VEC_BLOCK <= len &&
+	       cortex_vec_blocks_are_zero(buf + pos))
+		pos += 4 * CORTEX_VEC_BLOCK;
+
+	while (pos + CORTEX_VEC_BLOCK <= len &&
+	       cortex_vec_block_is_zero(buf + pos))
+		pos += CORTEX_VEC_BLOCK;
+
+	if (pos + CORTEX_VEC_BLOCK <= len)
+		goto out;
+
+	while (pos < len && buf[pos] == 0)
+		pos++;
+out:
+	return pos;
+}
+
+/** \brief length of the data at the start of a buffer
+ *
+ * Stops at the first block that is entirely zero.
+ * \return the number of bytes before the next zero block
+ */
+size_t cortex_vec_data_span(const unsigned char *buf, size_t len)
+{
+	size_t pos = 0;
+
+	while (pos + CORTEX_VEC_BLOCK <= len &&
+	       !cortex_vec_block_is_zero(buf + pos))
+		pos += CORTEX_VEC_BLOCK;
+
+	if (pos + CORTEX_VEC_BLOCK <= len)
+		goto out;
+
+	/* tail is kept as data unless it is all zero */
+	if (cortex_vec_zero_span(buf + pos, len - pos) != len - pos)
+		pos = len;
+out:
+	return pos;
+}
+
+/** \brief find the range that holds a value
+ * \param ranges sorted and disjoint
+ * \return its index, -1 if none does
+ */
+int cortex_vec_range_find(const struct cortex_vec_range *ranges, int nr,
+			  uint64_t value)
+{
+	int lo = 0;
+	int hi = nr - 1;
+
+	while (lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (value < ranges[mid].start)
+			hi = mid - 1;
+		else if (value >= ranges[mid].end)
+			lo = mid + 1;
+		else
+			return mid;
+	}
+
+	return -1;
+}
+
+/** \brief fold sorted and disjoint ranges into a few intervals
+ *
+ * When a range does not fit, the smallest gap left is closed, so the
+ * intervals keep out the largest gaps between the ranges.
+ */
+void cortex_vec_hulls_init(struct cortex_vec_hulls *hulls,
+			   const struct cortex_vec_range *ranges, int nr)
+{
+	uint64_t gap, min;
+	int i, k, merge;
+
+	hulls->nr = 0;
+	for (i = 0; i < nr; i++) {
+		if (hulls->nr < CORTEX_VEC_HULLS)
+			goto append;
+
+		/* the gap before the new range first, then the others */
+		merge = hulls->nr;
+		min = ranges[i].start - hulls->hi[hulls->nr - 1];
+		for (k = 1; k < hulls->nr; k++) {
+			gap = hulls->lo[k] - hulls->hi[k - 1];
+			if (gap < min) {
+				min = gap;
+				merge = k;
+			}
+		}
+
+		if (merge == hulls->nr) {
+			hulls->hi[hulls->nr - 1] = ranges[i].end - 1;
+			continue;
+		}
+
+		hulls->hi[merge - 1] = hulls->hi[merge];
+		for (k = merge + 1; k < hulls->nr; k++) {
+			hulls->lo[k - 1] = hulls->lo[k];
+			hulls->hi[k - 1] = hulls->hi[k];
+		}
+		hulls->nr--;
+append:
+		hulls->lo[hulls->nr] = ranges[i].start;
+		hulls->hi[hulls->nr] = ranges[i].end - 1;
+		hulls->nr++;
+	}
+}
+
+/*
+ * Most stack words are small integers, stack addresses or zeros: a
+ * whole block is first compared with each interval of the hulls, and
+ * only the blocks where a word falls in one are searched word by word
+ * in the ranges themselves.
+ *
+ * A word is in [lo, hi] when word - lo, unsigned, is not above hi - lo:
+ * one compare per interval. Lanes are compared as unsigned values by
+ * flipping their sign bit. SSE2 has no 64 bit compare: it is built from
+ * the 32 bit compares of the two halves, the high half deciding unless
+ * it is equal. The ARMv7 NEON unit has none either and only compares
+ * the high half, which lets through a few more blocks than needed but
+ * never misses one.
+ */
+#if defined(__AVX2__)
+#define CORTEX_VEC_SCAN_BLOCK	32
+
+static inline int cortex_vec_block_in_hulls(const unsigned char *buf,
+					    int word_size,
+					    const struct cortex_vec_hulls *hulls)
+{
+	__m256i v = _mm256_loadu_si256((const __m256i *)buf);
+	__m256i out = _mm256_set1_epi8(-1);
+	__m256i x;
+	int k;
+
+	for (k = 0; k < hulls->nr; k++) {
+		uint64_t lo = hulls->lo[k];
+		uint64_t size = hulls->hi[k] - lo;
+
+		if (word_size == 8) {
+			x = _mm256_sub_epi64(v, _mm256_set1_epi64x(lo));
+			x = _mm256_xor_si256(x, _mm256_set1_epi64x(INT64_MIN));
+			out = _mm256_and_si256(out, _mm256_cmpgt_epi64(x,
+				_mm256_set1_epi64x(size ^ INT64_MIN)));
+		} else {
+			x = _mm256_sub_epi32(v, _mm256_set1_epi32(lo));
+			x = _mm256_xor_si256(x, _mm256_set1_epi32(INT32_MIN));
+			out = _mm256_and_si256(out, _mm256_cmpgt_epi32(x,
+				_mm256_set1_epi32((uint32_t)size ^ INT32_MIN)));
+		}
+	}
+
+	return (uint32_t)_mm256_movemask_epi8(out) != 0xFFFFFFFF;
+}
+#elif defined(__SSE2__)
+#define CORTEX_VEC_SCAN_BLOCK	CORTEX_VEC_BLOCK
+
+/* the 64 bit lanes of a greater than b, both sign flipped per 32 bit
+ * half: lanes 1 and 3 are the high halves */
+static inline __m128i cortex_vec_cmpgt64(__m128i a, __m128i b)
+{
+	__m128i gt = _mm_cmpgt_epi32(a, b);
+	__m128i eq = _mm_cmpeq_epi32(a, b);
+	__m128i hi_gt = _mm_shuffle_epi32(gt, _MM_SHUFFLE(3, 3, 1, 1));
+	__m128i hi_eq = _mm_shuffle_epi32(eq, _MM_SHUFFLE(3, 3, 1, 1));
+	__m128i lo_gt = _mm_shuffle_epi32(gt, _MM_SHUFFLE(2, 2, 0, 0));
+
+	return _mm_or_si128(hi_gt, _mm_and_si128(hi_eq, lo_gt));
+}
+
+static inline int cortex_vec_block_in_hulls(const unsigned char *buf,
+					    int word_size,
+					    const struct cortex_vec_hulls *hulls)
+{
+	const uint64_t sign64 = 0x8000000080000000ULL;
+	__m128i v = _mm_loadu_si128((const __m128i *)buf);
+	__m128i sign = _mm_set1_epi32(INT32_MIN);
+	__m128i out = _mm_set1_epi8(-1);
+	__m128i x;
+	int k;
+
+	for (k = 0; k < hulls->nr; k++) {
+		uint64_t lo = hulls->lo[k];
+		uint64_t size = hulls->hi[k] - lo;
+
+		if (word_size == 8) {
+			x = _mm_sub_epi64(v, _mm_set1_epi64x(lo));
+			out = _mm_and_si128(out, cortex_vec_cmpgt64(
+				_mm_xor_si128(x, sign),
+				_mm_set1_epi64x(size ^ sign64)));
+		} else {
+			x = _mm_sub_epi32(v, _mm_set1_epi32(lo));
+			out = _mm_and_si128(out, _mm_cmpgt_epi32(
+				_mm_xor_si128(x, sign),
+				_mm_set1_epi32((uint32_t)size ^ INT32_MIN)));
+		}
+	}
+
+	return _mm_movemask_epi8(out) != 0xFFFF;
+}
+#elif defined(__aarch64__) && !defined(__ARM_BIG_ENDIAN)
+#define CORTEX_VEC_SCAN_BLOCK	CORTEX_VEC_BLOCK
+
+static inline int cortex_vec_block_in_hulls(const unsigned char *buf,
+					    int word_size,
+					    const struct cortex_vec_hulls *hulls)
+{
+	uint64x2_t w = vdupq_n_u64(0);
+	uint64x2_t v64;
+	uint32x4_t v32;
+	int k;
+
+	if (word_size == 8) {
+		v64 = vld1q_u64((const uint64_t *)buf);
+		for (k = 0; k < hulls->nr; k++)
+			w = vorrq_u64(w, vandq_u64(
+				vcgeq_u64(v64, vdupq_n_u64(hulls->lo[k])),
+				vcleq_u64(v64, vdupq_n_u64(hulls->hi[k]))));
+	} else {
+		v32 = vld1q_u32((const uint32_t *)buf);
+		for (k = 0; k < hulls->nr; k++)
+			w = vorrq_u64(w, vreinterpretq_u64_u32(vandq_u32(
+				vcgeq_u32(v32, vdupq_n_u32(hulls->lo[k])),
+				vcleq_u32(v32, vdupq_n_u32(hulls->hi[k])))));
+	}
+
+	return (vgetq_lane_u64(w, 0) | vgetq_lane_u64(w, 1)) != 0;
+}
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && \
+	!defined(__ARM_BIG_ENDIAN)
+#define CORTEX_VEC_SCAN_BLOCK	CORTEX_VEC_BLOCK
+
+static inline int cortex_vec_block_in_hulls(const unsigned char *buf,
+					    int word_size,
+					    const struct cortex_vec_hulls *hulls)
+{
+	static const uint32_t high[4] = { 0, ~0U, 0, ~0U };
+	uint32x4_t v = vld1q_u32((const uint32_t *)buf);
+	uint32x4_t in = vdupq_n_u32(0);
+	int shift = word_size == 8 ? 32 : 0;
+	uint64x2_t w;
+	int k;
+
+	for (k = 0; k < hulls->nr; k++)
+		in = vorrq_u32(in, vandq_u32(
+			vcgeq_u32(v, vdupq_n_u32(hulls->lo[k] >> shift)),
+			vcleq_u32(v, vdupq_n_u32(hulls->hi[k] >> shift))));
+	if (word_size == 8)
+		in = vandq_u32(in, vld1q_u32(high));
+
+	w = vreinterpretq_u64_u32(in);
+	return (vgetq_lane_u64(w, 0) | vgetq_lane_u64(w, 1)) != 0;
+}
+#else
+#define CORTEX_VEC_SCAN_BLOCK	CORTEX_VEC_BLOCK
+
+static inline int cortex_vec_block_in_hulls(const unsigned char *buf,
+					    int word_size,
+					    const struct cortex_vec_hulls *hulls)
+{
+	uint64_t w[2];
+	uint32_t h[4];
+	int i, k;
+
+	if (word_size == 8)
+		memcpy(w, buf, sizeof(w));
+	else
+		memcpy(h, buf, sizeof(h));
+
+	for (k = 0; k < hulls->nr; k++) {
+		if (word_size == 8) {
+			for (i = 0; i < 2; i++)
+				if (w[i] >= hulls->lo[k] && w[i] <= hulls->hi[k])
+					return 1;
+			continue;
+		}
+		for (i = 0; i < 4; i++)
+			if (h[i] >= hulls->lo[k] && h[i] <= hulls->hi[k])
+				return 1;
+	}
+	return 0;
+}
+#endif
+
+static inline uint64_t cortex_vec_word(const unsigned char *buf,
+				       int word_size, int swap)
+{
+	uint64_t v64;
+	uint32_t v32;
+
+	if (word_size == 8) {
+		memcpy(&v64, buf, sizeof(v64));
+		return swap ? bswap_64(v64) : v64;
+	}
+
+	memcpy(&v32, buf, sizeof(v32));
+	return swap ? bswap_32(v32) : v32;
+}
+
+/** \brief length of the words at the start of a buffer that are not in
+ * any range
+ * \param word_size 4 or 8, buf is read word by word
+ * \param swap the words are not in the host byte order
+ * \param ranges sorted and disjoint
+ * \param hulls the ranges folded by cortex_vec_hulls_init()
+ * \return the offset of the first word in a range, or the length of
+ * the whole words of the buffer if none is
+ */
+size_t cortex_vec_range_span(const unsigned char *buf, size_t len,
+			     int word_size, int swap,
+			     const struct cortex_vec_range *ranges, int nr,
+			     const struct cortex_vec_hulls *hulls)
+{
+	uint64_t lo, hi;
+	size_t pos = 0;
+	size_t end;
+
+	len -= len % word_size;
+	if (nr == 0)
+		return len;
+
+	lo = ranges[0].start;
+	hi = ranges[nr - 1].end - 1;
+
+	while (pos < len) {
+		/* the blocks are in the host byte order */
+		if (!swap && pos + CORTEX_VEC_SCAN_BLOCK <= len &&
+		    !cortex_vec_block_in_hulls(buf + pos, word_size, hulls)) {
+			pos += CORTEX_VEC_SCAN_BLOCK;
+			continue;
+		}
+
+		end = swap ? len : pos + CORTEX_VEC_SCAN_BLOCK;
+		if (end > len)
+			end = len;
+		for (; pos < end; pos += word_size) {
+			uint64_t value = cortex_vec_word(buf + pos, word_size,
+							 swap);
+
+			if (value >= lo && value <= hi &&
+			    cortex_vec_range_find(ranges, nr, value) >= 0)
+				return pos;
+		}
+	}
+
+	return len;
+}
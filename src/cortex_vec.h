@@ -0,0 +1,66 @@
+
+#ifndef _CORTEX_VEC_H_
+#define _CORTEX_VEC_H_
+
+/** \file cortex_vec.h
+ * \brief cortex vectorized memory helpers
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** \brief size of the blocks compared at once by the scanners */
+#define CORTEX_VEC_BLOCK	16
+
+/** \struct cortex_vec_range
+ ** \brief a range of addresses, [start, end)
+ */
+struct cortex_vec_range {
+	uint64_t start;
+	uint64_t end;
+};
+
+/** \brief intervals the ranges are folded into for the block test */
+#define CORTEX_VEC_HULLS	8
+
+/** \struct cortex_vec_hulls
+ ** \brief ranges folded into a few intervals, compared at once
+ *
+ * The smallest gaps between the ranges are closed until at most
+ * CORTEX_VEC_HULLS intervals are left: with that many ranges or less,
+ * the intervals are the ranges themselves.
+ */
+struct cortex_vec_hulls {
+	int nr;
+	uint64_t lo[CORTEX_VEC_HULLS];	/*!< first value */
+	uint64_t hi[CORTEX_VEC_HULLS];	/*!< last value, included */
+};
+
+size_t cortex_vec_zero_span(const unsigned char *buf, size_t len);
+size_t cortex_vec_data_span(const unsigned char *buf, size_t len);
+int cortex_vec_range_find(const struct cortex_vec_range *ranges, int nr,
+			  uint64_t value);
+void cortex_vec_hulls_init(struct cortex_vec_hulls *hulls,
+			   const struct cortex_vec_range *ranges, int nr);
+size_t cortex_vec_range_span(const unsigned char *buf, size_t len,
+			     int word_size, int swap,
+			     const struct cortex_vec_range *ranges, int nr,
+			     const struct cortex_vec_hulls *hulls);
+
+#endif /* _CORTEX_VEC_H_ */
@@ -0,0 +1,355 @@
+/** \file cortex_zip.c
+ * \brief cortex streaming compression of the reports
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD_H
+#include <zstd.h>
+#endif
+
+#include "cortex_mem.h"
+#include "cortex_zip.h"
+
+/** \struct cortex_zip
+ ** \brief state of one compressed stream
+ *
+ * The report writers only know about FILE streams: the compressor is
+ * hidden behind a custom stream which deflates what is written into
+ * it and forwards the result to the real output.
+ */
+struct cortex_zip {
+	FILE *output;		/*!< where the compressed data goes */
+	int method;		/*!< gzip or zstd */
+	int error;		/*!< set once the output failed */
+#ifdef HAVE_ZLIB_H
+	z_stream gz;
+#endif
+#ifdef HAVE_ZSTD_H
+	ZSTD_CCtx *zstd;
+#endif
+	unsigned char buf[CORTEX_ZIP_BLOCK];
+};
+
+#if defined(HAVE_ZLIB_H) || defined(HAVE_ZSTD_H)
+static int cortex_zip_flush(struct cortex_zip *zip, size_t len)
+{
+	if (len && fwrite(zip->buf, 1, len, zip->output) != len)
+		zip->error = 1;
+
+	return zip->error ? -1 : 0;
+}
+#endif
+
+#ifdef HAVE_ZLIB_H
+/* the deflate state comes from the memory arena, as everything else */
+static voidpf cortex_zip_zalloc(voidpf opaque, uInt items, uInt size)
+{
+	return cortex_mem_calloc(items, size);
+}
+
+static void cortex_zip_zfree(voidpf opaque, voidpf address)
+{
+	cortex_mem_free(address);
+}
+
+static int cortex_zip_gzip_init(struct cortex_zip *zip, int level)
+{
+	if (level < 0)
+		level = Z_DEFAULT_COMPRESSION;
+
+	zip->gz.zalloc = cortex_zip_zalloc;
+	zip->gz.zfree = cortex_zip_zfree;
+
+	/* windowBits + 16 asks zlib for a gzip header and trailer */
+	if (deflateInit2(&zip->gz, level, Z_DEFLATED, MAX_WBITS + 16, 8,
+			 Z_DEFAULT_STRATEGY) != Z_OK) {
+		fprintf(stderr, "cannot initialize gzip stream\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int cortex_zip_gzip(struct cortex_zip *zip, const char *buf,
+			   size_t size, int flush)
+{
+	int ret;
+
+	zip->gz.next_in = (Bytef *) buf;
+	zip->gz.avail_in = size;
+
+	do {
+		zip->gz.next_out = zip->buf;
+		zip->gz.avail_out = sizeof(zip->buf);
+
+		ret = deflate(&zip->gz, flush);
+		if (ret == Z_STREAM_ERROR)
+			return -1;
+
+		if (cortex_zip_flush(zip, sizeof(zip->buf) - zip->gz.avail_out) < 0)
+			return -1;
+	} while (zip->gz.avail_out == 0);
+
+	return 0;
+}
+#endif /* HAVE_ZLIB_H */
+
+#ifdef HAVE_ZSTD_H
+static int cortex_zip_zstd_init(struct cortex_zip *zip, int level)
+{
+	zip->zstd = ZSTD_createCCtx();
+	if (zip->zstd == NULL) {
+		fprintf(stderr, "cannot initialize zstd stream\n");
+		return -1;
+	}
+
+	if (level >= 0)
+		ZSTD_CCtx_setParameter(zip->zstd, ZSTD_c_compressionLevel, level);
+
+	return 0;
+}
+
+static int cortex_zip_zstd(struct cortex_zip *zip, const char *buf,
+			   size_t size, ZSTD_EndDirective mode)
+{
+	ZSTD_inBuffer in = { buf, size, 0 };
+	ZSTD_outBuffer out;
+	size_t remaining;
+
+	do {
+		out.dst = zip->buf;
+		out.size = sizeof(zip->buf);
+		out.pos = 0;
+
+		remaining = ZSTD_compressStream2(zip->zstd, &out, &in, mode);
+		if (ZSTD_isError(remaining))
+			return -1;
+
+		if (cortex_zip_flush(zip, out.pos) < 0)
+			return -1;
+	} while (mode != ZSTD_e_continue ? remaining != 0 : in.pos < in.size);
+
+	return 0;
+}
+#endif /* HAVE_ZSTD_H */
+
+static ssize_t cortex_zip_write(void *cookie, const char *buf, size_t size)
+{
+	struct cortex_zip *zip = cookie;
+	int ret = -1;
+
+	switch (zip->method) {
+#ifdef HAVE_ZLIB_H
+	case CORTEX_ZIP_GZIP:
+		ret = cortex_zip_gzip(zip, buf, size, Z_NO_FLUSH);
+		break;
+#endif
+#ifdef HAVE_ZSTD_H
+	case CORTEX_ZIP_ZSTD:
+		ret = cortex_zip_zstd(zip, buf, size, ZSTD_e_continue);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	/* a short write makes stdio report the error to the writer */
+	return ret < 0 ? 0 : (ssize_t) size;
+}
+
+static int cortex_zip_close(void *cookie)
+{
+	struct cortex_zip *zip = cookie;
+	int ret = -1;
+
+	switch (zip->method) {
+#ifdef HAVE_ZLIB_H
+	case CORTEX_ZIP_GZIP:
+		ret = cortex_zip_gzip(zip, NULL, 0, Z_FINISH);
+		deflateEnd(&zip->gz);
+		break;
+#endif
+#ifdef HAVE_ZSTD_H
+	case CORTEX_ZIP_ZSTD:
+		ret = cortex_zip_zstd(zip, NULL, 0, ZSTD_e_end);
+		ZSTD_freeCCtx(zip->zstd);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	if (fflush(zip->output) != 0)
+		ret = -1;
+
+	cortex_mem_free(zip);
+
+	return ret < 0 ? EOF : 0;
+}
+
+/** \brief flush the data compressed so far to the output
+ * \param zip the compressor returned by cortex_zip_open
+ * \return 0 on success, -1 on error
+ *
+ * The stream itself must be flushed first. Everything written up to
+ * now can then be decompressed even if the stream is never closed.
+ */
+int cortex_zip_sync(struct cortex_zip *zip)
+{
+	int ret = -1;
+
+	switch (zip->method) {
+#ifdef HAVE_ZLIB_H
+	case CORTEX_ZIP_GZIP:
+		ret = cortex_zip_gzip(zip, NULL, 0, Z_SYNC_FLUSH);
+		break;
+#endif
+#ifdef HAVE_ZSTD_H
+	case CORTEX_ZIP_ZSTD:
+		ret = cortex_zip_zstd(zip, NULL, 0, ZSTD_e_flush);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	if (fflush(zip->output) != 0)
+		ret = -1;
+
+	return ret;
+}
+
+/** \brief parse a compression spec
+ * \param spec "gzip" or "zstd", optionally followed by ":<level>"
+ * \param level filled with the level, or -1 for the library default
+ * \return the compression method, or -1 if it is unknown or not built in
+ */
+int cortex_zip_parse(const char *spec, int *level)
+{
+	const char *colon = strchr(spec, ':');
+	size_t len = colon ? (size_t) (colon - spec) : strlen(spec);
+	int method = -1;
+
+	*level = colon ? atoi(colon + 1) : -1;
+
+	if (len == 4 && strncmp(spec, "none", 4) == 0) {
+		method = CORTEX_ZIP_NONE;
+	} else if (len == 4 && strncmp(spec, "gzip", 4) == 0) {
+#ifdef HAVE_ZLIB_H
+		method = CORTEX_ZIP_GZIP;
+#else
+		fprintf(stderr, "gzip support is not built in\n");
+		return -1;
+#endif
+	} else if (len == 4 && strncmp(spec, "zstd", 4) == 0) {
+#ifdef HAVE_ZSTD_H
+		method = CORTEX_ZIP_ZSTD;
+#else
+		fprintf(stderr, "zstd support is not built in\n");
+		return -1;
+#endif
+	} else {
+		fprintf(stderr, "unknown compression %s\n", spec);
+	}
+
+	return method;
+}
+
+/** \brief wrap an output stream into a compressed stream
+ * \param output the stream receiving the compressed data
+ * \param method CORTEX_ZIP_GZIP or CORTEX_ZIP_ZSTD
+ * \param level compression level, -1 for the default
+ * \param cookie filled with the compressor, for cortex_zip_sync
+ * \return a stream to write the report to. Closing it terminates the
+ *	   compressed stream and flushes output, which stays open.
+ */
+FILE *cortex_zip_open(FILE *output, int method, int level,
+		      struct cortex_zip **cookie)
+{
+	cookie_io_functions_t funcs = {
+		.read = NULL,
+		.write = cortex_zip_write,
+		.seek = NULL,
+		.close = cortex_zip_close,
+	};
+	struct cortex_zip *zip = NULL;
+	FILE *stream = NULL;
+	int ret = -1;
+
+	zip = cortex_mem_calloc(1, sizeof(struct cortex_zip));
+	if (zip == NULL) {
+		perror("cannot allocate compression stream");
+		return NULL;
+	}
+
+	zip->output = output;
+	zip->method = method;
+
+	switch (method) {
+#ifdef HAVE_ZLIB_H
+	case CORTEX_ZIP_GZIP:
+		ret = cortex_zip_gzip_init(zip, level);
+		break;
+#endif
+#ifdef HAVE_ZSTD_H
+	case CORTEX_ZIP_ZSTD:
+		ret = cortex_zip_zstd_init(zip, level);
+		break;
+#endif
+	default:
+		fprintf(stderr, "unsupported compression method %d\n", method);
+		break;
+	}
+
+	if (ret < 0)
+		goto out_err;
+
+	stream = fopencookie(zip, "w", funcs);
+	if (stream == NULL) {
+		perror("cannot open compression stream");
+		goto out_err;
+	}
+
+	/* the compressor works on blocks anyway: feed it large ones */
+	setvbuf(stream, NULL, _IOFBF, CORTEX_ZIP_BLOCK);
+
+	*cookie = zip;
+	return stream;
+
+out_err:
+#ifdef HAVE_ZLIB_H
+	if (ret == 0 && method == CORTEX_ZIP_GZIP)
+		deflateEnd(&zip->gz);
+#endif
+#ifdef HAVE_ZSTD_H
+	if (zip->zstd)
+		ZSTD_freeCCtx(zip->zstd);
+#endif
+	cortex_mem_free(zip);
+	return NULL;
+}
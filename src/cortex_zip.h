@@ -0,0 +1,42 @@
+#ifndef _CORTEX_ZIP_H_
+#define _CORTEX_ZIP_H_
+
+/** \file cortex_zip.h
+ * \brief cortex streaming compression of the reports
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+
+/** \brief size of the compressed output buffer */
+#define CORTEX_ZIP_BLOCK	(16*1024)
+
+enum cortex_zip_method {
+	CORTEX_ZIP_NONE = 0,
+	CORTEX_ZIP_GZIP,
+	CORTEX_ZIP_ZSTD,
+};
+
+struct cortex_zip;
+
+int cortex_zip_parse(const char *spec, int *level);
+FILE *cortex_zip_open(FILE *output, int method, int level,
+		      struct cortex_zip **cookie);
+int cortex_zip_sync(struct cortex_zip *zip);
+
+#endif /* _CORTEX_ZIP_H_ */
@@ -0,0 +1,416 @@
+/** \file libcortex.c
+ * \brief cortex library interface
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cortex.h"
+#include "cortex_elf.h"
+#include "cortex_out.h"
+#include "cortex_mini.h"
+#include "cortex_sys.h"
+#include "cortex_mem.h"
+#include "cortex_stats.h"
+#include "cortex_unwind.h"
+#include "cortex_stream.h"
+#include "cortex_attach.h"
+#include "cortex_profile.h"
+#include "libcortex.h"
+
+/** \struct cortex_ctx
+ ** \brief one analysis and everything it owns
+ */
+struct cortex_ctx {
+	struct cortex_mem_arena *arena;	/*!< all the memory of the analysis */
+	struct cortex_elf *core;	/*!< the core being read */
+	struct cortex_proc_info *info;	/*!< the parsed core */
+	struct cortex_sys *sys;	/*!< system context probes, if started */
+	unsigned long bytes;	/*!< core bytes consumed */
+	int scan;		/*!< enum cortex_unwind_scan */
+	int stream;		/*!< CORTEX_STREAM_* analyzers to run */
+};
+
+/* every call works in the arena of its context, whatever thread runs it */
+static struct cortex_mem_arena *cortex_ctx_enter(struct cortex_ctx *ctx)
+{
+	return cortex_mem_use(ctx->arena);
+}
+
+static void cortex_ctx_leave(struct cortex_mem_arena *prev)
+{
+	cortex_mem_use(prev);
+}
+
+/** \brief create an analysis context
+ * \param mem_budget size of its arena, 0 for CORTEX_MEM_BUDGET
+ * \return the context, or NULL if the memory cannot be reserved
+ *
+ * All the memory of the analysis is reserved here: nothing is
+ * allocated by the other calls.
+ */
+struct cortex_ctx *cortex_ctx_new(size_t mem_budget)
+{
+	struct cortex_ctx *ctx = calloc(1, sizeof(*ctx));
+
+	if (ctx == NULL)
+		return NULL;
+
+	ctx->arena = cortex_mem_arena_new(mem_budget ? mem_budget :
+					  CORTEX_MEM_BUDGET);
+	if (ctx->arena == NULL) {
+		free(ctx);
+		return NULL;
+	}
+
+	ctx->scan = CORTEX_UNWIND_SCAN_CALLS;
+
+	return ctx;
+}
+
+/* drop the analysis. Probes blocked on a hung mount keep the arena
+   pinned until they return */
+static void cortex_ctx_cleanup(struct cortex_ctx *ctx)
+{
+	struct cortex_mem_arena *prev = cortex_ctx_enter(ctx);
+
+	cortex_elf_cleanup_process_info(ctx->info);
+	cortex_sys_release(ctx->sys);
+	cortex_elf_release_core(ctx->core);
+
+	ctx->info = NULL;
+	ctx->sys = NULL;
+	ctx->core = NULL;
+	ctx->bytes = 0;
+
+	cortex_ctx_leave(prev);
+}
+
+/* all the blocks of the arena can be reused once the context holds
+   nothing and the late probes of the previous analyses are gone */
+static void cortex_ctx_reclaim(struct cortex_ctx *ctx)
+{
+	if (!ctx->core && !ctx->info && !ctx->sys &&
+	    !cortex_mem_arena_pinned(ctx->arena))
+		cortex_mem_arena_reset(ctx->arena);
+}
+
+/** \brief get the context ready for another core
+ *
+ * The arena is kept, there is no need to reserve it again. It is only
+ * reset when no probe of a previous analysis still uses its buffers:
+ * otherwise the next analysis allocates above them.
+ */
+void cortex_ctx_reset(struct cortex_ctx *ctx)
+{
+	cortex_ctx_cleanup(ctx);
+	cortex_ctx_reclaim(ctx);
+}
+
+void cortex_ctx_free(struct cortex_ctx *ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	cortex_ctx_cleanup(ctx);
+
+	/* left to the late probes rather than unmapped under them */
+	cortex_mem_arena_release(ctx->arena);
+	free(ctx);
+}
+
+/** \brief start collecting the system context of the crash
+ * \param probes mask of probes, see cortex_sys.h
+ * \param budget time given to the probes, in ms
+ * \param pid crashing process for the /proc/<pid> probes, 0 for none
+ * \return 0 on success, -1 if nothing could be started
+ *
+ * To be called before cortex_ctx_parse(): the probes run while the
+ * core is read, and the kernel releases the process once it is.
+ */
+int cortex_ctx_probe(struct cortex_ctx *ctx, long probes, int budget, int pid)
+{
+	struct cortex_mem_arena *prev = cortex_ctx_enter(ctx);
+
+	ctx->sys = cortex_sys_start(probes, budget, pid);
+
+	cortex_ctx_leave(prev);
+
+	return ctx->sys ? 0 : -1;
+}
+
+/** \brief choose how the stack is scanned when the frame pointers lead
+ * nowhere
+ * \param scan enum cortex_unwind_scan, CORTEX_UNWIND_SCAN_CALLS by default
+ *
+ * To be called before cortex_ctx_parse(): the threads are unwound there.
+ */
+void cortex_ctx_set_scan(struct cortex_ctx *ctx, int scan)
+{
+	ctx->scan = scan;
+}
+
+/** \brief run stream analyzers on the core
+ * \param analyzers mask of CORTEX_STREAM_*, added to those already set
+ *
+ * To be called before cortex_ctx_parse(). Every byte of the core is
+ * then read, up to its end, and seen by the analyzers of
+ * cortex_stream.h: their results are the mem and dig sections. A
+ * minicore is not analysed.
+ */
+void cortex_ctx_stream(struct cortex_ctx *ctx, int analyzers)
+{
+	ctx->stream |= analyzers;
+}
+
+/** \brief read and parse a core dump or a minicore
+ * \param fd the core, read sequentially: it may be a pipe. The context
+ * owns it from now on and closes it.
+ * \return 0 on success, -1 if the core cannot be used
+ */
+int cortex_ctx_parse(struct cortex_ctx *ctx, int fd)
+{
+	struct cortex_mem_arena *prev = cortex_ctx_enter(ctx);
+	ElfN_Ehdr *ehdr = NULL;
+	uint64_t begin;
+
+	begin = cortex_stats_begin();
+	ctx->core = cortex_elf_load_core(fd);
+	cortex_stats_end(CORTEX_STATS_INPUT, begin);
+
+	if (ctx->core == NULL)
+		goto out;
+
+	/* the identification bytes were read to tell the format */
+	if (ctx->stream && ctx->core->format != CORTEX_ELF_FORMAT_MINI) {
+		ctx->core->stream = cortex_stream_new(ctx->core, ctx->stream);
+		if (ctx->core->stream)
+			cortex_stream_feed(ctx->core->stream,
+					   ctx->core->e_ident,
+					   ctx->core->offset);
+	}
+
+	begin = cortex_stats_begin();
+	if (ctx->core->format == CORTEX_ELF_FORMAT_MINI) {
+		/* a minicore written by cortex: render it offline */
+		ctx->info = cortex_mini_parse(ctx->core);
+	} else {
+		ehdr = cortex_elf_load_ehdr(ctx->core);
+
+		/* elf core is valid: read it */
+		if (ehdr)
+			ctx->info = cortex_elf_parse(ctx->core, ehdr);
+	}
+
+	/* every output reads the same call traces */
+	if (ctx->info)
+		cortex_unwind_process(ctx->info, ctx->scan);
+	cortex_stats_end(CORTEX_STATS_PARSE, begin);
+
+	/* the analyzers see the whole core, not only what was parsed */
+	if (ctx->info && ctx->core->stream) {
+		cortex_stream_end(ctx->core->stream,
+				  cortex_elf_drain(ctx->core) == 0);
+		ctx->info->stream = ctx->core->stream;
+	}
+
+	ctx->bytes = ctx->core->offset;
+
+	if (ctx->info && ctx->sys) {
+		begin = cortex_stats_begin();
+		cortex_sys_wait(ctx->sys);
+		cortex_stats_end(CORTEX_STATS_PROBES, begin);
+		ctx->info->sys = ctx->sys;
+	}
+
+out:
+	cortex_ctx_leave(prev);
+
+	return ctx->info ? 0 : -1;
+}
+
+/** \brief take a snapshot of a running process
+ * \return a file holding its core, to be parsed as any other, or -1 on
+ * error
+ *
+ * The snapshot is taken in the arena of the context. It frees all it
+ * allocated, but the arena only takes back its last block: when the
+ * context holds nothing else, the arena is reset for the analysis.
+ */
+int cortex_ctx_attach(struct cortex_ctx *ctx, int pid)
+{
+	struct cortex_mem_arena *prev = cortex_ctx_enter(ctx);
+	int fd = cortex_attach(pid);
+
+	cortex_ctx_reclaim(ctx);
+
+	cortex_ctx_leave(prev);
+
+	return fd;
+}
+
+/** \brief sample the call traces of a running process
+ * \param hz samples per second
+ * \param duration in s
+ * \param output where to write the folded stacks
+ * \return 0 on success, -1 on error
+ *
+ * The profile takes the memory left in the arena of the context: the
+ * more there is, the more distinct call traces it can count.
+ */
+int cortex_ctx_profile(struct cortex_ctx *ctx, int pid, int hz, int duration,
+		       FILE * output)
+{
+	struct cortex_mem_arena *prev = cortex_ctx_enter(ctx);
+	int ret = cortex_profile(pid, hz, duration, output);
+
+	cortex_ctx_leave(prev);
+
+	return ret;
+}
+
+/** \brief the parsed core, NULL if there is none */
+const struct cortex_proc_info *cortex_ctx_info(struct cortex_ctx *ctx)
+{
+	return ctx->info;
+}
+
+int cortex_ctx_pid(struct cortex_ctx *ctx)
+{
+	return ctx->info ? ctx->info->pid : 0;
+}
+
+int cortex_ctx_signum(struct cortex_ctx *ctx)
+{
+	return ctx->info ? ctx->info->signum : 0;
+}
+
+int cortex_ctx_nr_threads(struct cortex_ctx *ctx)
+{
+	return ctx->info ? ctx->info->nr_threads : 0;
+}
+
+uint64_t cortex_ctx_pc(struct cortex_ctx *ctx)
+{
+	return ctx->info ? ctx->info->pc : 0;
+}
+
+uint64_t cortex_ctx_sp(struct cortex_ctx *ctx)
+{
+	return ctx->info ? ctx->info->sp : 0;
+}
+
+/** \brief core bytes consumed, even if the core could not be parsed */
+unsigned long cortex_ctx_bytes(struct cortex_ctx *ctx)
+{
+	return ctx->core ? ctx->core->offset : ctx->bytes;
+}
+
+/** \brief open the sinks, write the reports and close the sinks
+ * \param sinks the sinks, those with a negative format are unused
+ * \param nr_sinks number of entries in sinks
+ * \param disassemble_ctx disassembly context size
+ * \return 0 on success, -1 if a report could not be written
+ */
+int cortex_ctx_render(struct cortex_ctx *ctx, struct cortex_output_sink *sinks,
+		      int nr_sinks, int disassemble_ctx)
+{
+	struct cortex_mem_arena *prev;
+	uint64_t begin;
+	int ret = 0;
+	int i;
+
+	if (ctx->info == NULL)
+		return -1;
+
+	prev = cortex_ctx_enter(ctx);
+
+	begin = cortex_stats_begin();
+	for (i = 0; i < nr_sinks; i++) {
+		if (sinks[i].fmt < 0)
+			continue;
+		if (cortex_output_open_sink(&sinks[i]) < 0) {
+			fprintf(stderr, "cannot open output\n");
+			ret = -1;
+			break;
+		}
+	}
+	cortex_stats_end(CORTEX_STATS_OPEN, begin);
+
+	/* write to each output stream from the same data,
+	 * until the deadline */
+	if (ret == 0) {
+		begin = cortex_stats_begin();
+		cortex_output_write_reports(ctx->info, sinks, nr_sinks,
+					    disassemble_ctx);
+		cortex_stats_end(CORTEX_STATS_REPORT, begin);
+	}
+
+	/* on error, the reports opened so far are left incomplete */
+	begin = cortex_stats_begin();
+	for (i = 0; i < nr_sinks; i++) {
+		if (sinks[i].fmt >= 0 && cortex_output_close_sink(&sinks[i]) < 0)
+			ret = -1;
+	}
+	cortex_stats_end(CORTEX_STATS_CLOSE, begin);
+
+	cortex_ctx_leave(prev);
+
+	return ret;
+}
+
+/** \brief write one report to a stream opened by the caller
+ * \param fmt sections and kind of report, see cortex_output_parse_format()
+ * \param stream where to write, left open
+ * \return 0 on success, -1 on error
+ */
+int cortex_ctx_render_stream(struct cortex_ctx *ctx, long fmt, FILE * stream,
+			     int disassemble_ctx)
+{
+	struct cortex_output_sink sink = {
+		.fmt = fmt,
+		.type = CORTEX_OUTPUT_SINK_FD,
+		.dest = "stream",
+		.stream = stream,
+		.raw = stream,
+	};
+	struct cortex_mem_arena *prev;
+
+	if (ctx->info == NULL || fmt < 0)
+		return -1;
+
+	prev = cortex_ctx_enter(ctx);
+	cortex_output_write_reports(ctx->info, &sink, 1, disassemble_ctx);
+	cortex_ctx_leave(prev);
+
+	return ferror(stream) ? -1 : 0;
+}
+
+/** \brief write the statistics of the analysis run by the calling thread
+ * \param dest file to write, or "-" for stderr
+ */
+int cortex_ctx_write_stats(struct cortex_ctx *ctx, const char *dest)
+{
+	struct cortex_mem_arena *prev = cortex_ctx_enter(ctx);
+	int ret = cortex_stats_write(dest);
+
+	cortex_ctx_leave(prev);
+
+	return ret;
+}
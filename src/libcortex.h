@@ -0,0 +1,83 @@
+#ifndef _LIBCORTEX_H_
+#define _LIBCORTEX_H_
+
+/** \file libcortex.h
+ * \brief cortex library interface
+ * \author Tristan Lelong <tristan.lelong@blunderer.org>
+ * \date 2011 06 27
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * A struct cortex_ctx holds one analysis: its memory arena, the parsed
+ * core and the system context. Nothing is shared between contexts, so
+ * that any number of cores can be analysed at the same time, one
+ * context per thread.
+ *
+ * The calls that change a context (parse, probe, reset, free) must not
+ * run concurrently on it. Once parsed, a context can be queried and
+ * rendered from several threads at once.
+ *
+ * The deadline (cortex_deadline.h) is a process wide alarm left to the
+ * cortex command: a library user that does not start it is not
+ * affected by it. It is not part of any context: only one deadline can
+ * be armed at a time, and once armed it bounds every context of the
+ * process. Analysing cores concurrently under separate budgets is not
+ * supported.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "cortex.h"
+#include "cortex_out.h"
+#include "cortex_stream.h"
+
+struct cortex_ctx;
+
+struct cortex_ctx *cortex_ctx_new(size_t mem_budget);
+void cortex_ctx_free(struct cortex_ctx *ctx);
+void cortex_ctx_reset(struct cortex_ctx *ctx);
+
+/* parse */
+int cortex_ctx_probe(struct cortex_ctx *ctx, long probes, int budget,
+		     int pid);
+void cortex_ctx_set_scan(struct cortex_ctx *ctx, int scan);
+void cortex_ctx_stream(struct cortex_ctx *ctx, int analyzers);
+int cortex_ctx_parse(struct cortex_ctx *ctx, int fd);
+
+/* running processes */
+int cortex_ctx_attach(struct cortex_ctx *ctx, int pid);
+int cortex_ctx_profile(struct cortex_ctx *ctx, int pid, int hz, int duration,
+		       FILE * output);
+
+/* query */
+const struct cortex_proc_info *cortex_ctx_info(struct cortex_ctx *ctx);
+int cortex_ctx_pid(struct cortex_ctx *ctx);
+int cortex_ctx_signum(struct cortex_ctx *ctx);
+int cortex_ctx_nr_threads(struct cortex_ctx *ctx);
+uint64_t cortex_ctx_pc(struct cortex_ctx *ctx);
+uint64_t cortex_ctx_sp(struct cortex_ctx *ctx);
+unsigned long cortex_ctx_bytes(struct cortex_ctx *ctx);
+
+/* render */
+int cortex_ctx_render(struct cortex_ctx *ctx, struct cortex_output_sink *sinks,
+		      int nr_sinks, int disassemble_ctx);
+int cortex_ctx_render_stream(struct cortex_ctx *ctx, long fmt, FILE * stream,
+			     int disassemble_ctx);
+int cortex_ctx_write_stats(struct cortex_ctx *ctx, const char *dest);
+
+#endif /* _LIBCORTEX_H_ */